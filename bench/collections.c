@@ -0,0 +1,510 @@
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "collections/vec.h"
+#include "collections/string.h"
+#include "collections/list.h"
+#include "xmalloc.h"
+#include "macros.h"
+
+/*
+ * Microbenchmarks for the collections everything else is built on.
+ *
+ * Every case does n operations of some kind. n is picked so that one run takes
+ * about --time milliseconds, the run is repeated --repeat times and the fastest
+ * one is reported, since everything slower than that is noise from the system.
+ * Allocations are counted too (see __wrap_malloc), they don't depend on noise at
+ * all and show what a change to growth factors does directly.
+ *
+ * With --tsv results are printed as tab separated values, which can be saved
+ * and passed back with --baseline to compare against.
+ */
+
+#define KEEP(x) __asm__ volatile("" : : "g"(x) : "memory")
+
+static struct {
+    int64_t start, elapsed;
+    size_t allocs;
+} timer;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+}
+
+/* cases call these around the part that is measured, setup stays outside */
+static void timer_start(void) {
+    timer.allocs = 0;
+    timer.start = now_ns();
+}
+
+static void timer_stop(void) {
+    timer.elapsed = now_ns() - timer.start;
+}
+
+/* Linked with -Wl,--wrap=malloc,--wrap=realloc,--wrap=reallocarray */
+void *__real_malloc(size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_reallocarray(void *ptr, size_t nmemb, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    timer.allocs += 1;
+    return __real_malloc(size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    timer.allocs += 1;
+    return __real_realloc(ptr, size);
+}
+
+void *__wrap_reallocarray(void *ptr, size_t nmemb, size_t size) {
+    timer.allocs += 1;
+    return __real_reallocarray(ptr, nmemb, size);
+}
+
+struct bench_case {
+    const char *name;
+    void (*run)(const struct bench_case *c, size_t n);
+    size_t size; /* meaning depends on the case: vec length, ops per batch... */
+    ptrdiff_t pos; /* for insert/erase */
+    const char *str; /* for string cases */
+    size_t bytes; /* processed per op, for throughput */
+};
+
+/* appends to an empty vec until it has c->size elements, then starts over */
+static void run_vec_append(const struct bench_case *c, size_t n) {
+    VEC(int) v = VEC_INITALISER;
+
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        if (VEC_SIZE(&v) == c->size) {
+            VEC_FREE(&v);
+        }
+        int x = i;
+        VEC_APPEND(&v, &x);
+    }
+    KEEP(VEC_DATA(&v));
+    timer_stop();
+
+    VEC_FREE(&v);
+}
+
+/* same, but capacity is reserved upfront, difference with the above is the cost of growing */
+static void run_vec_append_reserved(const struct bench_case *c, size_t n) {
+    VEC(int) v = VEC_INITALISER;
+
+    timer_start();
+    VEC_RESERVE(&v, c->size);
+    for (size_t i = 0; i < n; i++) {
+        if (VEC_SIZE(&v) == c->size) {
+            VEC_CLEAR(&v);
+        }
+        int x = i;
+        VEC_APPEND(&v, &x);
+    }
+    KEEP(VEC_DATA(&v));
+    timer_stop();
+
+    VEC_FREE(&v);
+}
+
+struct row {
+    char *id, *name;
+    int64_t values[6];
+};
+
+/* like vecs of api types that are filled while parsing a response */
+static void run_vec_append_struct(const struct bench_case *c, size_t n) {
+    VEC(struct row) v = VEC_INITALISER;
+
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        if (VEC_SIZE(&v) == c->size) {
+            VEC_FREE(&v);
+        }
+        struct row *r = VEC_EMPLACE_BACK(&v);
+        r->id = r->name = NULL;
+        r->values[0] = i;
+    }
+    KEEP(VEC_DATA(&v));
+    timer_stop();
+
+    VEC_FREE(&v);
+}
+
+/* inserts and erases c->bytes / sizeof(int) elements at c->pos of a vec of c->size elements */
+static void run_vec_insert_erase(const struct bench_case *c, size_t n) {
+    VEC(int) v = VEC_INITALISER;
+    VEC_EMPLACE_BACK_N_ZEROED(&v, c->size);
+
+    const size_t count = c->bytes / sizeof(int);
+    int elems[64] = {0};
+
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        VEC_INSERT_N(&v, c->pos, elems, count);
+        VEC_ERASE_N(&v, c->pos, count);
+    }
+    KEEP(VEC_DATA(&v));
+    timer_stop();
+
+    VEC_FREE(&v);
+}
+
+/* walks a vec of c->size elements, to compare with list_iterate */
+static void run_vec_iterate(const struct bench_case *c, size_t n) {
+    VEC(struct row) v = VEC_INITALISER;
+    for (size_t i = 0; i < c->size; i++) {
+        struct row *r = VEC_EMPLACE_BACK_ZEROED(&v);
+        r->values[0] = i;
+    }
+
+    int64_t sum = 0;
+    size_t j = 0;
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        sum += VEC_AT(&v, j)->values[0];
+        if (++j == c->size) {
+            j = 0;
+        }
+    }
+    KEEP(sum);
+    timer_stop();
+
+    VEC_FREE(&v);
+}
+
+static void run_string_append(const struct bench_case *c, size_t n) {
+    struct string s = {0};
+
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        if (i % c->size == 0) {
+            string_clear(&s);
+        }
+        string_append(&s, c->str);
+    }
+    KEEP(s.str);
+    timer_stop();
+
+    string_free(&s);
+}
+
+/* what request url building does for every request */
+static void run_string_appendf_url(const struct bench_case *, size_t n) {
+    struct string s = {0};
+
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        string_clear(&s);
+        string_appendf(&s, "%s/rest/%s?u=%s&t=%s&s=%s&v=%s&c=%s&f=json&id=so-%zu",
+                       "https://music.example.org", "stream", "user",
+                       "26719a1196d2a940705a59634eb18eab", "c19b2d", "1.16.1", "campanula", i);
+    }
+    KEEP(s.str);
+    timer_stop();
+
+    string_free(&s);
+}
+
+static void run_string_appendf_int(const struct bench_case *c, size_t n) {
+    struct string s = {0};
+
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        if (i % c->size == 0) {
+            string_clear(&s);
+        }
+        string_appendf(&s, "&offset=%zu", i);
+    }
+    KEEP(s.str);
+    timer_stop();
+
+    string_free(&s);
+}
+
+static void run_string_append_urlencode(const struct bench_case *c, size_t n) {
+    struct string s = {0};
+
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        if (i % c->size == 0) {
+            string_clear(&s);
+        }
+        string_append_urlencode(&s, c->str);
+    }
+    KEEP(s.str);
+    timer_stop();
+
+    string_free(&s);
+}
+
+struct node {
+    LIST_ENTRY link;
+    int64_t value;
+};
+
+/* keeps c->size nodes in a list, every op appends one and removes the oldest */
+static void run_list_append_remove(const struct bench_case *c, size_t n) {
+    LIST_HEAD head;
+    LIST_INIT(&head);
+
+    struct node *nodes = xmalloc(c->size * sizeof(*nodes));
+    for (size_t i = 0; i < c->size; i++) {
+        LIST_APPEND(&head, &nodes[i].link);
+    }
+
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        struct node *last;
+        LIST_GET_LAST(last, &head, link);
+        LIST_REMOVE(&last->link);
+        LIST_APPEND(&head, &last->link);
+    }
+    KEEP(head.next);
+    timer_stop();
+
+    free(nodes);
+}
+
+/* nodes are allocated one by one, like player and menu do */
+static void run_list_iterate(const struct bench_case *c, size_t n) {
+    LIST_HEAD head;
+    LIST_INIT(&head);
+
+    struct node **nodes = xmalloc(c->size * sizeof(*nodes));
+    for (size_t i = 0; i < c->size; i++) {
+        nodes[i] = xmalloc(sizeof(**nodes));
+        nodes[i]->value = i;
+        LIST_APPEND(&head, &nodes[i]->link);
+    }
+
+    int64_t sum = 0;
+    struct list *elem = head.next;
+    timer_start();
+    for (size_t i = 0; i < n; i++) {
+        if (elem == &head) {
+            elem = elem->next;
+        }
+        struct node *node;
+        LIST_GET(node, elem, link);
+        sum += node->value;
+        elem = elem->next;
+    }
+    KEEP(sum);
+    timer_stop();
+
+    for (size_t i = 0; i < c->size; i++) {
+        free(nodes[i]);
+    }
+    free(nodes);
+}
+
+#define URL_ASCII "Pink Floyd - The Dark Side of the Moon (2011 Remaster) [FLAC]"
+#define URL_MIXED "東京事変 — 群青日和 / Ромашки & ☆ 100%"
+
+static const struct bench_case cases[] = {
+    { "vec_append/64", run_vec_append, .size = 64 },
+    { "vec_append/4096", run_vec_append, .size = 4096 },
+    { "vec_append/1048576", run_vec_append, .size = 1 << 20 },
+    { "vec_append_reserved/4096", run_vec_append_reserved, .size = 4096 },
+    { "vec_append_struct/4096", run_vec_append_struct, .size = 4096 },
+
+    { "vec_insert_erase/front/1", run_vec_insert_erase, .size = 4096, .pos = 0, .bytes = 4 },
+    { "vec_insert_erase/middle/1", run_vec_insert_erase, .size = 4096, .pos = 2048, .bytes = 4 },
+    { "vec_insert_erase/back/1", run_vec_insert_erase, .size = 4096, .pos = 4095, .bytes = 4 },
+    { "vec_insert_erase/front/64", run_vec_insert_erase, .size = 4096, .pos = 0, .bytes = 256 },
+    { "vec_insert_erase/middle/64", run_vec_insert_erase, .size = 4096, .pos = 2048, .bytes = 256 },
+    { "vec_insert_erase/back/64", run_vec_insert_erase, .size = 4096, .pos = 4095, .bytes = 256 },
+    { "vec_iterate/4096", run_vec_iterate, .size = 4096 },
+
+    { "string_append/short", run_string_append, .size = 1024, .str = "abcdefgh", .bytes = 8 },
+    { "string_appendf/int", run_string_appendf_int, .size = 64 },
+    { "string_appendf/url", run_string_appendf_url, .size = 1 },
+    { "string_append_urlencode/ascii", run_string_append_urlencode, .size = 64,
+      .str = URL_ASCII, .bytes = sizeof(URL_ASCII) - 1 },
+    { "string_append_urlencode/mixed", run_string_append_urlencode, .size = 64,
+      .str = URL_MIXED, .bytes = sizeof(URL_MIXED) - 1 },
+
+    { "list_append_remove/1024", run_list_append_remove, .size = 1024 },
+    { "list_iterate/4096", run_list_iterate, .size = 4096 },
+};
+
+struct result {
+    double ns_per_op, allocs_per_op;
+};
+
+static struct result measure(const struct bench_case *c, int64_t target_ns, int repeat) {
+    /* find n that takes about target_ns */
+    size_t n = 1;
+    for (;;) {
+        c->run(c, n);
+        if (timer.elapsed >= target_ns / 10 || n >= (size_t)1 << 40) {
+            break;
+        }
+        n *= 4;
+    }
+    n = MAX((size_t)((double)n * target_ns / MAX(timer.elapsed, (int64_t)1)), (size_t)1);
+
+    struct result best = { .ns_per_op = INFINITY };
+    for (int i = 0; i < repeat; i++) {
+        c->run(c, n);
+        const double ns_per_op = (double)timer.elapsed / n;
+        if (ns_per_op < best.ns_per_op) {
+            best.ns_per_op = ns_per_op;
+        }
+        best.allocs_per_op = (double)timer.allocs / n;
+    }
+
+    return best;
+}
+
+struct baseline_entry {
+    char name[128];
+    double ns_per_op;
+};
+
+static VEC(struct baseline_entry) baseline;
+
+static bool load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        struct baseline_entry e;
+        if (line[0] == '#' || sscanf(line, "%127[^\t]\t%lf", e.name, &e.ns_per_op) != 2) {
+            continue;
+        }
+        VEC_APPEND(&baseline, &e);
+    }
+
+    fclose(f);
+    return true;
+}
+
+static const struct baseline_entry *find_baseline(const char *name) {
+    VEC_FOREACH(&baseline, i) {
+        const struct baseline_entry *e = VEC_AT(&baseline, i);
+        if (STREQ(e->name, name)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static bool selected(const char *name, char **filters, int n_filters) {
+    if (n_filters == 0) {
+        return true;
+    }
+    for (int i = 0; i < n_filters; i++) {
+        if (strstr(name, filters[i]) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options] [FILTER]...\n"
+            "  only cases with one of FILTERs in their name are run, all if none given\n"
+            "  -t, --time MS             how long one run of a case takes (100)\n"
+            "  -r, --repeat N            runs per case, fastest one counts (5)\n"
+            "      --tsv                 print tab separated values for saving as baseline\n"
+            "  -b, --baseline FILE       compare with results saved with --tsv\n"
+            "      --threshold PERCENT   slower than baseline by this much is a regression (10)\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    enum {
+        OPT_TSV = 256, OPT_THRESHOLD,
+    };
+    static const struct option long_options[] = {
+        { "time", required_argument, NULL, 't' },
+        { "repeat", required_argument, NULL, 'r' },
+        { "tsv", no_argument, NULL, OPT_TSV },
+        { "baseline", required_argument, NULL, 'b' },
+        { "threshold", required_argument, NULL, OPT_THRESHOLD },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    int64_t target_ns = 100'000'000;
+    int repeat = 5;
+    bool tsv = false;
+    double threshold = 10;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "t:r:b:h", long_options, NULL)) != -1) {
+        switch (c) {
+        case 't': target_ns = strtoll(optarg, NULL, 10) * 1'000'000; break;
+        case 'r': repeat = MAX(atoi(optarg), 1); break;
+        case OPT_TSV: tsv = true; break;
+        case 'b': if (!load_baseline(optarg)) return 1; break;
+        case OPT_THRESHOLD: threshold = strtod(optarg, NULL); break;
+        case 'h': usage(argv[0]); return 0;
+        default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (tsv) {
+        printf("# name\tns_per_op\tallocs_per_op\tmb_per_s\n");
+    } else {
+        printf("%-32s %10s %10s %10s  %s\n", "case", "ns/op", "allocs/op", "MB/s", "baseline");
+    }
+
+    size_t regressions = 0;
+    for (size_t i = 0; i < SIZEOF_VEC(cases); i++) {
+        const struct bench_case *bc = &cases[i];
+        if (!selected(bc->name, argv + optind, argc - optind)) {
+            continue;
+        }
+
+        const struct result r = measure(bc, target_ns, repeat);
+        const double mb_per_s = bc->bytes > 0 ? bc->bytes / r.ns_per_op * 1e9 / 1e6 : 0;
+
+        char baseline_str[64] = "-";
+        const struct baseline_entry *b = find_baseline(bc->name);
+        if (b != NULL) {
+            const double change = (r.ns_per_op / b->ns_per_op - 1) * 100;
+            const bool regression = change > threshold;
+            snprintf(baseline_str, sizeof(baseline_str), "%+.1f%%%s",
+                     change, regression ? " REGRESSION" : "");
+            regressions += regression;
+        }
+
+        if (tsv) {
+            printf("%s\t%.3f\t%.4f\t%.1f\n", bc->name, r.ns_per_op, r.allocs_per_op, mb_per_s);
+            fflush(stdout);
+            continue;
+        }
+
+        char mb_str[32] = "-";
+        if (bc->bytes > 0) {
+            snprintf(mb_str, sizeof(mb_str), "%.1f", mb_per_s);
+        }
+        printf("%-32s %10.2f %10.4f %10s  %s\n",
+               bc->name, r.ns_per_op, r.allocs_per_op, mb_str, baseline_str);
+        fflush(stdout);
+    }
+
+    VEC_FREE(&baseline);
+
+    if (regressions > 0) {
+        fprintf(stderr, "%zu cases are more than %.0f%% slower than baseline\n",
+                regressions, threshold);
+        return 1;
+    }
+
+    return 0;
+}
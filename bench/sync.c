@@ -0,0 +1,442 @@
+#include <sys/resource.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "mock/library.h"
+#include "db/init.h"
+#include "db/internal.h"
+#include "db/populate.h"
+#include "db/query.h"
+#include "api/requests.h"
+#include "api/json.h"
+#include "api/types.h"
+#include "collections/vec.h"
+#include "collections/string.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "config.h"
+#include "log.h"
+
+/*
+ * Runs the real sync pipeline (db_populate and db_sync) against a synthetic library.
+ * The api functions used by sync are replaced with ones that queue the request,
+ * and the queue is drained by generating the response with test/mock/library,
+ * parsing it with api_parse_response and calling the callback, like network.c would.
+ * Time spent in sqlite is split by statement kind, see __wrap_sqlite3_step.
+ */
+
+struct config config = {
+    .server_id = -1,
+    .sync_max_requests = 4,
+};
+
+enum phase {
+    PHASE_GENERATE, /* mock library, not part of the client */
+    PHASE_PARSE,
+    PHASE_INSERT,
+    PHASE_MARK,
+    PHASE_DELETE,
+    PHASE_COMMIT,
+    PHASE_OTHER_SQL,
+    PHASE_REST, /* whatever is left: binding, bookkeeping, callbacks */
+    PHASE_COUNT,
+};
+
+static const char *const phase_names[] = {
+    [PHASE_GENERATE] = "generate",
+    [PHASE_PARSE] = "parse",
+    [PHASE_INSERT] = "insert",
+    [PHASE_MARK] = "mark",
+    [PHASE_DELETE] = "delete",
+    [PHASE_COMMIT] = "commit",
+    [PHASE_OTHER_SQL] = "other sql",
+    [PHASE_REST] = "rest",
+};
+static_assert(SIZEOF_VEC(phase_names) == PHASE_COUNT);
+
+static struct {
+    int64_t phases[PHASE_COUNT]; /* nanoseconds */
+    size_t requests, rows, bytes;
+} stats;
+
+enum pending_kind {
+    PENDING_SEARCH3,
+    PENDING_ALBUM_LIST_2,
+    PENDING_ALBUM,
+    PENDING_ARTISTS,
+    PENDING_INDEXES,
+};
+
+struct pending {
+    enum pending_kind kind;
+    size_t args[6];
+    api_response_callback_t callback;
+    void *callback_data;
+};
+
+static VEC(struct pending) queue;
+static size_t queue_head;
+
+static const struct mock_library *lib;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+}
+
+static void enqueue(struct pending p) {
+    VEC_APPEND(&queue, &p);
+}
+
+bool api_search3(const char *,
+                 int32_t artist_count, int32_t artist_offset,
+                 int32_t album_count, int32_t album_offset,
+                 int32_t song_count, int32_t song_offset,
+                 const char *,
+                 api_response_callback_t callback, void *callback_data) {
+    enqueue((struct pending){
+        .kind = PENDING_SEARCH3,
+        .args = { artist_count, artist_offset, album_count, album_offset, song_count, song_offset },
+        .callback = callback,
+        .callback_data = callback_data,
+    });
+    return true;
+}
+
+bool api_get_album_list_2(const char *, int32_t size, int32_t offset,
+                          int32_t, int32_t, const char *, const char *,
+                          api_response_callback_t callback, void *callback_data) {
+    enqueue((struct pending){
+        .kind = PENDING_ALBUM_LIST_2,
+        .args = { size, offset },
+        .callback = callback,
+        .callback_data = callback_data,
+    });
+    return true;
+}
+
+bool api_get_album(const char *id, api_response_callback_t callback, void *callback_data) {
+    size_t album;
+    if (!mock_library_parse_id(lib, id, MOCK_ALBUM, &album)) {
+        ERROR("bench: album %s does not exist", id);
+        return false;
+    }
+
+    enqueue((struct pending){
+        .kind = PENDING_ALBUM,
+        .args = { album },
+        .callback = callback,
+        .callback_data = callback_data,
+    });
+    return true;
+}
+
+bool api_get_artists(const char *, api_response_callback_t callback, void *callback_data) {
+    enqueue((struct pending){
+        .kind = PENDING_ARTISTS,
+        .callback = callback,
+        .callback_data = callback_data,
+    });
+    return true;
+}
+
+bool api_get_indexes(const char *, int64_t, api_response_callback_t callback, void *callback_data) {
+    enqueue((struct pending){
+        .kind = PENDING_INDEXES,
+        .callback = callback,
+        .callback_data = callback_data,
+    });
+    return true;
+}
+
+static size_t response_rows(const struct subsonic_response *resp) {
+    const union subsonic_response_inner_object *o = &resp->inner_object;
+
+    switch (resp->inner_object_type) {
+    case API_TYPE_SEARCH_RESULT_3:
+        return VEC_SIZE(&o->search_result_3.artist) + VEC_SIZE(&o->search_result_3.album)
+               + VEC_SIZE(&o->search_result_3.song);
+    case API_TYPE_ALBUM_LIST_2:
+        return VEC_SIZE(&o->album_list_2.album);
+    case API_TYPE_ALBUM_WITH_SONGS_ID3:
+        return 1 + VEC_SIZE(&o->album_with_songs_id3.song);
+    case API_TYPE_ARTISTS_ID3: {
+        size_t n = 0;
+        VEC_FOREACH(&o->artists_id3.index, i) {
+            n += VEC_SIZE(&VEC_AT(&o->artists_id3.index, i)->artist);
+        }
+        return n;
+    }
+    default:
+        return 0;
+    }
+}
+
+static void serve(const struct pending *p, struct string *body) {
+    enum api_request_type request = API_REQUEST_TYPE_COUNT;
+
+    string_clear(body);
+    int64_t t0 = now_ns();
+    switch (p->kind) {
+    case PENDING_SEARCH3:
+        request = API_REQUEST_SEARCH3;
+        mock_response_search3(lib, body, p->args[0], p->args[1], p->args[2],
+                              p->args[3], p->args[4], p->args[5]);
+        break;
+    case PENDING_ALBUM_LIST_2:
+        request = API_REQUEST_GET_ALBUM_LIST_2;
+        mock_response_album_list_2(lib, body, p->args[0], p->args[1]);
+        break;
+    case PENDING_ALBUM:
+        request = API_REQUEST_GET_ALBUM;
+        mock_response_album(lib, body, p->args[0]);
+        break;
+    case PENDING_ARTISTS:
+        request = API_REQUEST_GET_ARTISTS;
+        mock_response_artists(lib, body);
+        break;
+    case PENDING_INDEXES:
+        /* always newer than last sync, so db_sync goes on */
+        request = API_REQUEST_GET_INDEXES;
+        mock_response_indexes(lib, body, (time(NULL) + 1) * 1000ll);
+        break;
+    }
+    int64_t t1 = now_ns();
+    struct subsonic_response *resp = api_parse_response(request, body->str, body->len);
+    int64_t t2 = now_ns();
+
+    stats.phases[PHASE_GENERATE] += t1 - t0;
+    stats.phases[PHASE_PARSE] += t2 - t1;
+    stats.requests += 1;
+    stats.bytes += body->len;
+
+    if (resp == NULL) {
+        p->callback("failed to parse server response", NULL, p->callback_data);
+        return;
+    }
+    stats.rows += response_rows(resp);
+    p->callback(NULL, resp, p->callback_data);
+    subsonic_response_free(resp);
+}
+
+static void drain_queue(void) {
+    struct string body = {0};
+
+    /* callbacks append to the queue, so no pointers into it are kept */
+    while (queue_head < VEC_SIZE(&queue)) {
+        const struct pending p = *VEC_AT(&queue, queue_head);
+        queue_head += 1;
+        serve(&p, &body);
+    }
+    VEC_CLEAR(&queue);
+    queue_head = 0;
+
+    string_free(&body);
+}
+
+/*
+ * Linked with -Wl,--wrap=sqlite3_step. The profile hook of sqlite only has
+ * millisecond resolution, which is useless for statements that take microseconds.
+ */
+int __real_sqlite3_step(struct sqlite3_stmt *stmt);
+
+int __wrap_sqlite3_step(struct sqlite3_stmt *stmt) {
+    const int64_t start = now_ns();
+    const int ret = __real_sqlite3_step(stmt);
+    const int64_t ns = now_ns() - start;
+
+    const char *sql = sqlite3_sql(stmt);
+    while (isspace((unsigned char)*sql)) {
+        sql++;
+    }
+
+    enum phase phase = PHASE_OTHER_SQL;
+    if (strncasecmp(sql, "INSERT", 6) == 0) {
+        phase = PHASE_INSERT;
+    } else if (strncasecmp(sql, "UPDATE", 6) == 0) {
+        phase = PHASE_MARK;
+    } else if (strncasecmp(sql, "DELETE", 6) == 0) {
+        phase = PHASE_DELETE;
+    } else if (strncasecmp(sql, "COMMIT", 6) == 0) {
+        phase = PHASE_COMMIT;
+    }
+    stats.phases[phase] += ns;
+
+    return ret;
+}
+
+static long peak_rss_kib(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static bool run(const char *name, const struct mock_library *l, bool incremental) {
+    memset(&stats, 0, sizeof(stats));
+    lib = l;
+
+    const int64_t start = now_ns();
+    const bool ok = incremental ? db_sync(NULL, NULL) : db_populate(NULL, NULL);
+    if (ok) {
+        drain_queue();
+    }
+    const int64_t total = now_ns() - start;
+
+    if (!ok) {
+        fprintf(stderr, "%s: failed to start\n", name);
+        return false;
+    }
+
+    /* either kind of sync must leave exactly the library in db */
+    const size_t artists = db_count_artists(), albums = db_count_albums(), songs = db_count_songs();
+    if (artists != l->n_artists || albums != l->n_albums || songs != l->n_songs) {
+        fprintf(stderr, "%s: db has %zu artists, %zu albums, %zu songs; expected %zu, %zu, %zu\n",
+                name, artists, albums, songs, l->n_artists, l->n_albums, l->n_songs);
+        return false;
+    }
+
+    int64_t accounted = 0;
+    for (size_t i = 0; i < PHASE_REST; i++) {
+        accounted += stats.phases[i];
+    }
+    stats.phases[PHASE_REST] = total - accounted;
+
+    /* generating responses is the server's job, don't count it against the client */
+    const int64_t client = total - stats.phases[PHASE_GENERATE];
+
+    printf("%s: %zu rows in %zu requests (%.1f MiB of json), %.3f s, %.0f rows/s, peak rss %.1f MiB\n",
+           name, stats.rows, stats.requests, stats.bytes / 1048576.0,
+           client / 1e9, stats.rows / (client / 1e9), peak_rss_kib() / 1024.0);
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        printf("  %-10s %8.3f s %5.1f%%\n",
+               phase_names[i], stats.phases[i] / 1e9, 100.0 * stats.phases[i] / total);
+    }
+
+    return true;
+}
+
+static void remove_db(const char *dir) {
+    static const char *const suffixes[] = { "", "-wal", "-shm" };
+    for (size_t i = 0; i < SIZEOF_VEC(suffixes); i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/db.sqlite3%s", dir, suffixes[i]);
+        unlink(path);
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "      --seed N              library seed (1)\n"
+            "      --artists N           number of artists (5000)\n"
+            "      --albums N            number of albums (25000)\n"
+            "      --songs N             number of songs (300000)\n"
+            "  -r, --requests N          pages requested at once, like sync_max_requests (4)\n"
+            "  -d, --dir DIR             where to put the db (new directory in /tmp)\n"
+            "  -k, --keep                don't delete the db afterwards\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    enum {
+        OPT_SEED = 256, OPT_ARTISTS, OPT_ALBUMS, OPT_SONGS,
+    };
+    static const struct option long_options[] = {
+        { "seed", required_argument, NULL, OPT_SEED },
+        { "artists", required_argument, NULL, OPT_ARTISTS },
+        { "albums", required_argument, NULL, OPT_ALBUMS },
+        { "songs", required_argument, NULL, OPT_SONGS },
+        { "requests", required_argument, NULL, 'r' },
+        { "dir", required_argument, NULL, 'd' },
+        { "keep", no_argument, NULL, 'k' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    uint64_t seed = 1;
+    size_t n_artists = 5'000, n_albums = 25'000, n_songs = 300'000;
+    const char *dir = NULL;
+    bool keep = false;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "r:d:kh", long_options, NULL)) != -1) {
+        switch (c) {
+        case OPT_SEED: seed = strtoull(optarg, NULL, 10); break;
+        case OPT_ARTISTS: n_artists = strtoull(optarg, NULL, 10); break;
+        case OPT_ALBUMS: n_albums = strtoull(optarg, NULL, 10); break;
+        case OPT_SONGS: n_songs = strtoull(optarg, NULL, 10); break;
+        case 'r': config.sync_max_requests = atoi(optarg); break;
+        case 'd': dir = optarg; break;
+        case 'k': keep = true; break;
+        case 'h': usage(argv[0]); return 0;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (config.sync_max_requests < 1) {
+        config.sync_max_requests = 1;
+    }
+
+    log_init(stderr, LOG_WARN, false);
+
+    char tmp_dir[] = "/tmp/campanula-bench-XXXXXX";
+    if (dir == NULL) {
+        if (mkdtemp(tmp_dir) == NULL) {
+            perror("mkdtemp");
+            return 1;
+        }
+        dir = tmp_dir;
+    } else {
+        remove_db(dir);
+    }
+    config.data_dir = dir;
+
+    if (!db_init()) {
+        return 1;
+    }
+    config.server_id = db_add_server("http://bench.invalid");
+
+    /*
+     * grown is what the next incremental sync sees, shrunk makes full sync delete things.
+     * They are all cut from one library so ids stay the same, like with a real server.
+     */
+    struct mock_library grown, full, shrunk;
+    int64_t t = now_ns();
+    mock_library_init(&grown, seed, n_artists + n_artists / 100,
+                      n_albums + n_albums / 100, n_songs + n_songs / 100);
+    mock_library_init_truncated(&full, &grown, n_albums);
+    mock_library_init_truncated(&shrunk, &grown, n_albums - n_albums / 10);
+    printf("library: %zu artists, %zu albums, %zu songs, seed %" PRIu64 ", set up in %.3f s\n",
+           full.n_artists, full.n_albums, full.n_songs, seed, (now_ns() - t) / 1e9);
+
+    bool ok = run("populate (empty db)", &full, false)
+              && run("populate (unchanged)", &full, false)
+              && run("sync (1% new albums)", &grown, true)
+              && run("populate (10% removed)", &shrunk, false);
+
+    mock_library_free(&full);
+    mock_library_free(&grown);
+    mock_library_free(&shrunk);
+    VEC_FREE(&queue);
+
+    db_cleanup();
+    if (!keep) {
+        remove_db(dir);
+        if (dir == tmp_dir) {
+            rmdir(dir);
+        }
+    } else {
+        printf("db kept in %s\n", dir);
+    }
+    log_cleanup();
+
+    return ok ? 0 : 1;
+}
@@ -5,6 +5,7 @@
 
 #include "api/json.h"
 #include "api/types.h"
+#include "collections/arena.h"
 #include "xmalloc.h"
 #include "macros.h"
 #include "log.h"
@@ -72,25 +73,26 @@
         json_object_get_##type(tmp); \
     })
 
-static bool parse_child(struct api_type_child *child, const struct json_object *json) {
+static bool parse_child(struct arena *arena, struct api_type_child *child,
+                        const struct json_object *json) {
     /* required */
-    child->id = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "id"));
+    child->id = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "id"));
     child->is_dir = JSON_GET_VALUE_OR_FAIL(json, boolean, "isDir");
-    child->title = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "title"));
+    child->title = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "title"));
 
-    child->parent = xstrdup(JSON_GET_VALUE(json, string, "parent"));
-    child->album = xstrdup(JSON_GET_VALUE(json, string, "album"));
-    child->artist = xstrdup(JSON_GET_VALUE(json, string, "artist"));
+    child->parent = arena_strdup(arena, JSON_GET_VALUE(json, string, "parent"));
+    child->album = arena_strdup(arena, JSON_GET_VALUE(json, string, "album"));
+    child->artist = arena_strdup(arena, JSON_GET_VALUE(json, string, "artist"));
     child->track = JSON_GET_VALUE(json, int, "track");
     child->year = JSON_GET_VALUE(json, int, "year");
     child->size = JSON_GET_VALUE(json, int, "size");
     /* TODO: enum */
-    child->content_type = xstrdup(JSON_GET_VALUE(json, string, "contentType"));
-    child->suffix = xstrdup(JSON_GET_VALUE(json, string, "suffix"));
+    child->content_type = arena_strdup(arena, JSON_GET_VALUE(json, string, "contentType"));
+    child->suffix = arena_strdup(arena, JSON_GET_VALUE(json, string, "suffix"));
     child->duration = JSON_GET_VALUE(json, int, "duration");
     child->bit_rate = JSON_GET_VALUE(json, int, "bitRate");
-    child->album_id = xstrdup(JSON_GET_VALUE(json, string, "albumId"));
-    child->artist_id = xstrdup(JSON_GET_VALUE(json, string, "artistId"));
+    child->album_id = arena_strdup(arena, JSON_GET_VALUE(json, string, "albumId"));
+    child->artist_id = arena_strdup(arena, JSON_GET_VALUE(json, string, "artistId"));
 
     return true;
 
@@ -98,10 +100,11 @@ err:
     return false;
 }
 
-static bool parse_artist(struct api_type_artist *artist, const struct json_object *json) {
+static bool parse_artist(struct arena *arena, struct api_type_artist *artist,
+                         const struct json_object *json) {
     /* required */
-    artist->id = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "id"));
-    artist->name = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "name"));
+    artist->id = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "id"));
+    artist->name = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "name"));
 
     return true;
 
@@ -109,10 +112,11 @@ err:
     return false;
 }
 
-static bool parse_artist_id3(struct api_type_artist_id3 *artist, const struct json_object *json) {
+static bool parse_artist_id3(struct arena *arena, struct api_type_artist_id3 *artist,
+                             const struct json_object *json) {
     /* required */
-    artist->id = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "id"));
-    artist->name = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "name"));
+    artist->id = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "id"));
+    artist->name = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "name"));
     artist->album_count = JSON_GET_VALUE_OR_FAIL(json, int, "albumCount");
 
     return true;
@@ -121,16 +125,17 @@ err:
     return false;
 }
 
-static bool parse_album_id3(struct api_type_album_id3 *album, const struct json_object *json) {
+static bool parse_album_id3(struct arena *arena, struct api_type_album_id3 *album,
+                            const struct json_object *json) {
     /* required */
-    album->id = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "id"));
-    album->name = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "name"));
+    album->id = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "id"));
+    album->name = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "name"));
     album->song_count = JSON_GET_VALUE_OR_FAIL(json, int, "songCount");
     album->duration = JSON_GET_VALUE_OR_FAIL(json, int, "duration");
-    album->created = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "created"));
+    album->created = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "created"));
     /* optional */
-    album->artist = xstrdup(JSON_GET_VALUE(json, string, "artist"));
-    album->artist_id = xstrdup(JSON_GET_VALUE(json, string, "artistId"));
+    album->artist = arena_strdup(arena, JSON_GET_VALUE(json, string, "artist"));
+    album->artist_id = arena_strdup(arena, JSON_GET_VALUE(json, string, "artistId"));
     album->year = JSON_GET_VALUE(json, int, "year");
 
     return true;
@@ -139,7 +144,7 @@ err:
     return false;
 }
 
-static bool parse_type_songs(struct api_type_songs *songs,
+static bool parse_type_songs(struct arena *arena, struct api_type_songs *songs,
                              const struct json_object *json) {
     const struct json_object *song = JSON_GET_OR_FAIL(json, array, "song");
 
@@ -151,7 +156,7 @@ static bool parse_type_songs(struct api_type_songs *songs,
         JSON_CHECK_TYPE_OR_FAIL(elem, object);
 
         struct api_type_child *child = VEC_EMPLACE_BACK_ZEROED(&songs->song);
-        if (!parse_child(child, elem)) {
+        if (!parse_child(arena, child, elem)) {
             return false;
         }
     }
@@ -162,7 +167,7 @@ err:
     return false;
 }
 
-static bool parse_type_album_list(struct api_type_album_list *album_list,
+static bool parse_type_album_list(struct arena *arena, struct api_type_album_list *album_list,
                                   const struct json_object *json) {
     const struct json_object *album = JSON_GET_OR_FAIL(json, array, "album");
 
@@ -174,7 +179,7 @@ static bool parse_type_album_list(struct api_type_album_list *album_list,
         JSON_CHECK_TYPE_OR_FAIL(elem, object);
 
         struct api_type_child *child = VEC_EMPLACE_BACK_ZEROED(&album_list->album);
-        if (!parse_child(child, elem)) {
+        if (!parse_child(arena, child, elem)) {
             return false;
         }
     }
@@ -185,7 +190,7 @@ err:
     return false;
 }
 
-static bool parse_type_search_result_2(struct api_type_search_result_2 *sr2,
+static bool parse_type_search_result_2(struct arena *arena, struct api_type_search_result_2 *sr2,
                                        const struct json_object *json) {
     VEC_INIT(&sr2->artist);
     VEC_INIT(&sr2->album);
@@ -198,7 +203,7 @@ static bool parse_type_search_result_2(struct api_type_search_result_2 *sr2,
             JSON_CHECK_TYPE_OR_FAIL(elem, object);
 
             struct api_type_artist *artist = VEC_EMPLACE_BACK_ZEROED(&sr2->artist);
-            if (!parse_artist(artist, elem)) {
+            if (!parse_artist(arena, artist, elem)) {
                 goto err;
             }
         }
@@ -211,7 +216,7 @@ static bool parse_type_search_result_2(struct api_type_search_result_2 *sr2,
             JSON_CHECK_TYPE_OR_FAIL(elem, object);
 
             struct api_type_child *child = VEC_EMPLACE_BACK_ZEROED(&sr2->album);
-            if (!parse_child(child, elem)) {
+            if (!parse_child(arena, child, elem)) {
                 goto err;
             }
         }
@@ -224,7 +229,7 @@ static bool parse_type_search_result_2(struct api_type_search_result_2 *sr2,
             JSON_CHECK_TYPE_OR_FAIL(elem, object);
 
             struct api_type_child *child = VEC_EMPLACE_BACK_ZEROED(&sr2->song);
-            if (!parse_child(child, elem)) {
+            if (!parse_child(arena, child, elem)) {
                 goto err;
             }
         }
@@ -236,7 +241,7 @@ err:
     return false;
 }
 
-static bool parse_type_search_result_3(struct api_type_search_result_3 *sr3,
+static bool parse_type_search_result_3(struct arena *arena, struct api_type_search_result_3 *sr3,
                                        const struct json_object *json) {
     VEC_INIT(&sr3->artist);
     VEC_INIT(&sr3->album);
@@ -249,7 +254,7 @@ static bool parse_type_search_result_3(struct api_type_search_result_3 *sr3,
             JSON_CHECK_TYPE_OR_FAIL(elem, object);
 
             struct api_type_artist_id3 *artist = VEC_EMPLACE_BACK_ZEROED(&sr3->artist);
-            if (!parse_artist_id3(artist, elem)) {
+            if (!parse_artist_id3(arena, artist, elem)) {
                 goto err;
             }
         }
@@ -262,7 +267,7 @@ static bool parse_type_search_result_3(struct api_type_search_result_3 *sr3,
             JSON_CHECK_TYPE_OR_FAIL(elem, object);
 
             struct api_type_album_id3 *child = VEC_EMPLACE_BACK_ZEROED(&sr3->album);
-            if (!parse_album_id3(child, elem)) {
+            if (!parse_album_id3(arena, child, elem)) {
                 goto err;
             }
         }
@@ -275,7 +280,105 @@ static bool parse_type_search_result_3(struct api_type_search_result_3 *sr3,
             JSON_CHECK_TYPE_OR_FAIL(elem, object);
 
             struct api_type_child *child = VEC_EMPLACE_BACK_ZEROED(&sr3->song);
-            if (!parse_child(child, elem)) {
+            if (!parse_child(arena, child, elem)) {
+                goto err;
+            }
+        }
+    }
+
+    return true;
+
+err:
+    return false;
+}
+
+static bool parse_type_indexes(struct arena *arena, struct api_type_indexes *indexes,
+                               const struct json_object *json) {
+    /* JSON_GET_VALUE can't do int64 */
+    const struct json_object *last_modified = JSON_GET_OR_FAIL(json, int, "lastModified");
+    indexes->last_modified = json_object_get_int64(last_modified);
+
+    return true;
+
+err:
+    return false;
+}
+
+static bool parse_type_artists_id3(struct arena *arena, struct api_type_artists_id3 *artists,
+                                   const struct json_object *json) {
+    VEC_INIT(&artists->index);
+
+    const struct json_object *index = NULL;
+    if ((index = JSON_GET(json, array, "index"))) {
+        for (size_t i = 0; i < json_object_array_length(index); i++) {
+            const struct json_object *elem = json_object_array_get_idx(index, i);
+            JSON_CHECK_TYPE_OR_FAIL(elem, object);
+
+            struct api_type_index_id3 *idx = VEC_EMPLACE_BACK_ZEROED(&artists->index);
+            idx->name = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(elem, string, "name"));
+
+            const struct json_object *artist = NULL;
+            if ((artist = JSON_GET(elem, array, "artist"))) {
+                for (size_t j = 0; j < json_object_array_length(artist); j++) {
+                    const struct json_object *a = json_object_array_get_idx(artist, j);
+                    JSON_CHECK_TYPE_OR_FAIL(a, object);
+
+                    struct api_type_artist_id3 *artist_id3 = VEC_EMPLACE_BACK_ZEROED(&idx->artist);
+                    if (!parse_artist_id3(arena, artist_id3, a)) {
+                        goto err;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+
+err:
+    return false;
+}
+
+static bool parse_type_album_list_2(struct arena *arena, struct api_type_album_list_2 *album_list,
+                                    const struct json_object *json) {
+    VEC_INIT(&album_list->album);
+
+    /* missing if the list is empty */
+    const struct json_object *album = NULL;
+    if ((album = JSON_GET(json, array, "album"))) {
+        for (size_t i = 0; i < json_object_array_length(album); i++) {
+            const struct json_object *elem = json_object_array_get_idx(album, i);
+            JSON_CHECK_TYPE_OR_FAIL(elem, object);
+
+            struct api_type_album_id3 *album_id3 = VEC_EMPLACE_BACK_ZEROED(&album_list->album);
+            if (!parse_album_id3(arena, album_id3, elem)) {
+                goto err;
+            }
+        }
+    }
+
+    return true;
+
+err:
+    return false;
+}
+
+static bool parse_type_album_with_songs_id3(struct arena *arena,
+                                            struct api_type_album_with_songs_id3 *album,
+                                            const struct json_object *json) {
+    VEC_INIT(&album->song);
+
+    if (!parse_album_id3(arena, &album->album, json)) {
+        goto err;
+    }
+
+    const struct json_object *song = NULL;
+    if ((song = JSON_GET(json, array, "song"))) {
+        for (size_t i = 0; i < json_object_array_length(song); i++) {
+            const struct json_object *elem = json_object_array_get_idx(song, i);
+            JSON_CHECK_TYPE_OR_FAIL(elem, object);
+
+            struct api_type_child *child = VEC_EMPLACE_BACK_ZEROED(&album->song);
+            if (!parse_child(arena, child, elem)) {
                 goto err;
             }
         }
@@ -290,29 +393,55 @@ err:
 static bool parse_response_search2(struct subsonic_response *resp,
                                    const struct json_object *json) {
     resp->inner_object_type = API_TYPE_SEARCH_RESULT_2;
-    return parse_type_search_result_2(&resp->inner_object.search_result_2, json);
+    return parse_type_search_result_2(&resp->arena, &resp->inner_object.search_result_2, json);
 }
 
 static bool parse_response_search3(struct subsonic_response *resp,
                                    const struct json_object *json) {
     resp->inner_object_type = API_TYPE_SEARCH_RESULT_3;
-    return parse_type_search_result_3(&resp->inner_object.search_result_3, json);
+    return parse_type_search_result_3(&resp->arena, &resp->inner_object.search_result_3, json);
 }
 
 static bool parse_response_random_songs(struct subsonic_response *resp,
                                         const struct json_object *json) {
     resp->inner_object_type = API_TYPE_SONGS;
-    return parse_type_songs(&resp->inner_object.songs, json);
+    return parse_type_songs(&resp->arena, &resp->inner_object.songs, json);
 }
 
 static bool parse_response_album_list(struct subsonic_response *resp,
                                       const struct json_object *json) {
     resp->inner_object_type = API_TYPE_ALBUM_LIST;
-    return parse_type_album_list(&resp->inner_object.album_list, json);
+    return parse_type_album_list(&resp->arena, &resp->inner_object.album_list, json);
 }
 
-static bool parse_error(struct api_type_error *err, const struct json_object *json) {
-    err->message = xstrdup(JSON_GET_VALUE_OR_FAIL(json, string, "message"));
+static bool parse_response_indexes(struct subsonic_response *resp,
+                                   const struct json_object *json) {
+    resp->inner_object_type = API_TYPE_INDEXES;
+    return parse_type_indexes(&resp->arena, &resp->inner_object.indexes, json);
+}
+
+static bool parse_response_artists(struct subsonic_response *resp,
+                                   const struct json_object *json) {
+    resp->inner_object_type = API_TYPE_ARTISTS_ID3;
+    return parse_type_artists_id3(&resp->arena, &resp->inner_object.artists_id3, json);
+}
+
+static bool parse_response_album_list_2(struct subsonic_response *resp,
+                                        const struct json_object *json) {
+    resp->inner_object_type = API_TYPE_ALBUM_LIST_2;
+    return parse_type_album_list_2(&resp->arena, &resp->inner_object.album_list_2, json);
+}
+
+static bool parse_response_album(struct subsonic_response *resp,
+                                 const struct json_object *json) {
+    resp->inner_object_type = API_TYPE_ALBUM_WITH_SONGS_ID3;
+    return parse_type_album_with_songs_id3(&resp->arena,
+                                           &resp->inner_object.album_with_songs_id3, json);
+}
+
+static bool parse_error(struct arena *arena, struct api_type_error *err,
+                        const struct json_object *json) {
+    err->message = arena_strdup(arena, JSON_GET_VALUE_OR_FAIL(json, string, "message"));
     err->code = JSON_GET_VALUE_OR_FAIL(json, int, "code");
 
     return true;
@@ -331,6 +460,10 @@ static const inner_object_parser_t inner_object_parsers[] = {
     [API_REQUEST_SEARCH2] = parse_response_search2,
     [API_REQUEST_SEARCH3] = parse_response_search3,
     [API_REQUEST_SCROBBLE] = NULL, /* returns empty response */
+    [API_REQUEST_GET_INDEXES] = parse_response_indexes,
+    [API_REQUEST_GET_ARTISTS] = parse_response_artists,
+    [API_REQUEST_GET_ALBUM_LIST_2] = parse_response_album_list_2,
+    [API_REQUEST_GET_ALBUM] = parse_response_album,
 };
 static_assert(SIZEOF_VEC(inner_object_parsers) == API_REQUEST_TYPE_COUNT);
 
@@ -341,6 +474,10 @@ static const char *inner_object_names[] = {
     [API_REQUEST_SEARCH2] = "searchResult2",
     [API_REQUEST_SEARCH3] = "searchResult3",
     [API_REQUEST_SCROBBLE] = NULL, /* returns empty response */
+    [API_REQUEST_GET_INDEXES] = "indexes",
+    [API_REQUEST_GET_ARTISTS] = "artists",
+    [API_REQUEST_GET_ALBUM_LIST_2] = "albumList2",
+    [API_REQUEST_GET_ALBUM] = "album",
 };
 static_assert(SIZEOF_VEC(inner_object_names) == API_REQUEST_TYPE_COUNT);
 
@@ -356,7 +493,7 @@ struct subsonic_response *api_parse_response(enum api_request_type request,
 
     const struct json_object *root = JSON_GET_OR_FAIL(json, object, "subsonic-response");
 
-    resp->version = xstrdup(JSON_GET_VALUE_OR_FAIL(root, string, "version"));
+    resp->version = arena_strdup(&resp->arena, JSON_GET_VALUE_OR_FAIL(root, string, "version"));
 
     const char *status_str = JSON_GET_VALUE_OR_FAIL(root, string, "status");
     if (STREQ(status_str, "failed")) {
@@ -371,7 +508,8 @@ struct subsonic_response *api_parse_response(enum api_request_type request,
     case RESPONSE_STATUS_FAILED:
         const struct json_object *error = JSON_GET_OR_FAIL(root, object, "error");
 
-        JSON_ERROR_IF(!parse_error(&resp->inner_object.error, error), "failed to parse \"error\"");
+        JSON_ERROR_IF(!parse_error(&resp->arena, &resp->inner_object.error, error),
+                      "failed to parse \"error\"");
         break;
     case RESPONSE_STATUS_OK:
         const inner_object_parser_t inner_object_parser = inner_object_parsers[request];
@@ -400,3 +538,304 @@ err:
     return NULL;
 }
 
+
+/*
+ * Streaming parser. Elements of big arrays (see streamed_arrays) are cut out of
+ * the response as soon as they are complete, parsed one by one and appended to
+ * items. Everything else goes into skeleton, where those arrays end up empty.
+ * At the end skeleton is parsed as usual and streamed elements are moved into
+ * the result. This way the raw body and the json-c tree of the whole response
+ * never exist in memory, only the raw text and tree of one element at a time do.
+ * Parsed elements are kept until the end, they are a fraction of the size of
+ * either, and callers get the whole response on the main loop as before.
+ */
+
+/* elements of streamed arrays are only parsed as objects */
+typedef bool (*item_parser_t)(struct arena *arena, void *item, const struct json_object *json);
+
+static bool parse_child_item(struct arena *arena, void *item,
+                             const struct json_object *json) {
+    return parse_child(arena, item, json);
+}
+
+static bool parse_album_id3_item(struct arena *arena, void *item,
+                                 const struct json_object *json) {
+    return parse_album_id3(arena, item, json);
+}
+
+static bool parse_artist_id3_item(struct arena *arena, void *item,
+                                  const struct json_object *json) {
+    return parse_artist_id3(arena, item, json);
+}
+
+#define STREAMED_ARRAY(req, t, member, key, parser) \
+    { \
+        .request = (req), \
+        .type = (t), \
+        .name = (key), \
+        .offset = offsetof(struct subsonic_response, inner_object.member), \
+        .item_size = sizeof(*((struct subsonic_response *)0)->inner_object.member.data), \
+        .parse = (parser), \
+    }
+
+static const struct streamed_array {
+    enum api_request_type request;
+    enum subsonic_response_inner_object_type type;
+    const char *name;
+    size_t offset; /* of the VEC inside struct subsonic_response */
+    size_t item_size;
+    item_parser_t parse;
+} streamed_arrays[] = {
+    STREAMED_ARRAY(API_REQUEST_GET_RANDOM_SONGS, API_TYPE_SONGS,
+                   songs.song, "song", parse_child_item),
+    STREAMED_ARRAY(API_REQUEST_SEARCH3, API_TYPE_SEARCH_RESULT_3,
+                   search_result_3.artist, "artist", parse_artist_id3_item),
+    STREAMED_ARRAY(API_REQUEST_SEARCH3, API_TYPE_SEARCH_RESULT_3,
+                   search_result_3.album, "album", parse_album_id3_item),
+    STREAMED_ARRAY(API_REQUEST_SEARCH3, API_TYPE_SEARCH_RESULT_3,
+                   search_result_3.song, "song", parse_child_item),
+    STREAMED_ARRAY(API_REQUEST_GET_ALBUM_LIST_2, API_TYPE_ALBUM_LIST_2,
+                   album_list_2.album, "album", parse_album_id3_item),
+    STREAMED_ARRAY(API_REQUEST_GET_ALBUM, API_TYPE_ALBUM_WITH_SONGS_ID3,
+                   album_with_songs_id3.song, "song", parse_child_item),
+};
+
+/* depth of {"subsonic-response": {"innerObject": {"array": [{element}]}}} */
+#define STREAMED_ARRAY_DEPTH 4
+#define MAX_KEY_LENGTH 32
+
+struct api_response_parser {
+    enum api_request_type request;
+    bool failed;
+
+    VEC(char) skeleton;
+    VEC(char) element;
+    struct subsonic_response *items;
+    struct json_tokener *tokener;
+
+    /* array whose elements are currently being cut out, NULL if none */
+    const struct streamed_array *array;
+
+    int depth;
+    bool in_string, escape;
+    /* only short strings are kept, that's enough to match keys */
+    char string[MAX_KEY_LENGTH];
+    size_t string_len;
+    /* keys of enclosing objects up to the streamed array */
+    char keys[STREAMED_ARRAY_DEPTH - 1][MAX_KEY_LENGTH];
+};
+
+struct api_response_parser *api_response_parser_new(enum api_request_type request) {
+    struct api_response_parser *p = xcalloc(1, sizeof(*p));
+    p->request = request;
+    p->tokener = json_tokener_new();
+
+    p->items = xcalloc(1, sizeof(*p->items));
+    for (size_t i = 0; i < SIZEOF_VEC(streamed_arrays); i++) {
+        if (streamed_arrays[i].request == request) {
+            /* so that subsonic_response_free knows how to free items */
+            p->items->inner_object_type = streamed_arrays[i].type;
+            break;
+        }
+    }
+
+    return p;
+}
+
+void api_response_parser_free(struct api_response_parser *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    subsonic_response_free(p->items);
+    json_tokener_free(p->tokener);
+    VEC_FREE(&p->element);
+    VEC_FREE(&p->skeleton);
+    free(p);
+}
+
+static const struct streamed_array *find_streamed_array(const struct api_response_parser *p) {
+    const char *inner_object_name = inner_object_names[p->request];
+    if (inner_object_name == NULL
+        || !STREQ(p->keys[0], "subsonic-response")
+        || !STREQ(p->keys[1], inner_object_name)) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < SIZEOF_VEC(streamed_arrays); i++) {
+        const struct streamed_array *a = &streamed_arrays[i];
+        if (a->request == p->request && STREQ(a->name, p->keys[2])) {
+            return a;
+        }
+    }
+
+    return NULL;
+}
+
+static bool parse_element(struct api_response_parser *p) {
+    struct json_object *json = NULL;
+
+    json_tokener_reset(p->tokener);
+    json = json_tokener_parse_ex(p->tokener, VEC_DATA(&p->element), VEC_SIZE(&p->element));
+    const enum json_tokener_error err = json_tokener_get_error(p->tokener);
+    JSON_ERROR_IF(err != json_tokener_success, "%s", json_tokener_error_desc(err));
+    JSON_CHECK_TYPE_OR_FAIL(json, object);
+
+    struct vec_generic *vec = (struct vec_generic *)((char *)p->items + p->array->offset);
+    void *item = vec_append_generic(vec, NULL, p->array->item_size, 1, true);
+    JSON_ERROR_IF(!p->array->parse(&p->items->arena, item, json),
+                  "failed to parse element of \"%s\"", p->array->name);
+
+    json_object_put(json);
+    VEC_CLEAR(&p->element);
+    return true;
+
+err:
+    ERROR("raw json: %.*s", (int)VEC_SIZE(&p->element), VEC_DATA(&p->element));
+    json_object_put(json);
+    return false;
+}
+
+enum feed_sink {
+    FEED_SINK_NONE,
+    FEED_SINK_SKELETON,
+    FEED_SINK_ELEMENT,
+    FEED_SINK_ELEMENT_END, /* last byte of an element, which can be parsed now */
+};
+
+/* runs for every byte of the response, so keep it cheap */
+static enum feed_sink feed_char(struct api_response_parser *p, char c) {
+    const bool in_element = (p->array != NULL && p->depth > STREAMED_ARRAY_DEPTH);
+
+    if (p->in_string) {
+        if (p->escape) {
+            p->escape = false;
+        } else if (c == '\\') {
+            p->escape = true;
+        } else if (c == '"') {
+            p->in_string = false;
+            p->string[p->string_len] = '\0';
+        } else if (p->string_len < sizeof(p->string) - 1) {
+            p->string[p->string_len++] = c;
+        }
+    } else switch (c) {
+    case '"':
+        p->in_string = true;
+        p->string_len = 0;
+        break;
+    case ':':
+        if (p->depth >= 1 && p->depth < STREAMED_ARRAY_DEPTH) {
+            memcpy(p->keys[p->depth - 1], p->string, p->string_len + 1);
+        }
+        break;
+    case '{':
+    case '[':
+        p->depth += 1;
+        if (c == '[' && p->depth == STREAMED_ARRAY_DEPTH && p->array == NULL) {
+            p->array = find_streamed_array(p);
+        } else if (p->array != NULL && p->depth == STREAMED_ARRAY_DEPTH + 1) {
+            return FEED_SINK_ELEMENT;
+        }
+        break;
+    case '}':
+    case ']':
+        p->depth -= 1;
+        if (p->array != NULL && p->depth == STREAMED_ARRAY_DEPTH) {
+            return FEED_SINK_ELEMENT_END;
+        } else if (p->array != NULL && p->depth == STREAMED_ARRAY_DEPTH - 1) {
+            p->array = NULL;
+        }
+        break;
+    case ',':
+        if (p->array != NULL && p->depth == STREAMED_ARRAY_DEPTH) {
+            /* separates elements, which don't make it into skeleton */
+            return FEED_SINK_NONE;
+        }
+        break;
+    }
+
+    return in_element ? FEED_SINK_ELEMENT : FEED_SINK_SKELETON;
+}
+
+static void flush_run(struct api_response_parser *p, enum feed_sink sink,
+                      const char *run, size_t len) {
+    switch (sink) {
+    case FEED_SINK_SKELETON:
+        VEC_APPEND_N(&p->skeleton, run, len);
+        break;
+    case FEED_SINK_ELEMENT:
+    case FEED_SINK_ELEMENT_END:
+        VEC_APPEND_N(&p->element, run, len);
+        break;
+    case FEED_SINK_NONE:
+        break;
+    }
+}
+
+bool api_response_parser_feed(struct api_response_parser *p, const char *data, size_t size) {
+    /* bytes are copied in runs going to the same place, not one by one */
+    enum feed_sink run_sink = FEED_SINK_NONE;
+    size_t run_start = 0;
+
+    for (size_t i = 0; i < size && !p->failed; i++) {
+        const enum feed_sink sink = feed_char(p, data[i]);
+
+        if (sink == FEED_SINK_ELEMENT_END) {
+            if (run_sink != FEED_SINK_ELEMENT) {
+                flush_run(p, run_sink, &data[run_start], i - run_start);
+                run_start = i;
+            }
+            flush_run(p, sink, &data[run_start], i + 1 - run_start);
+            run_sink = FEED_SINK_NONE;
+            run_start = i + 1;
+            if (!parse_element(p)) {
+                p->failed = true;
+            }
+        } else if (sink != run_sink) {
+            flush_run(p, run_sink, &data[run_start], i - run_start);
+            run_sink = sink;
+            run_start = i;
+        }
+    }
+
+    if (!p->failed) {
+        flush_run(p, run_sink, &data[run_start], size - run_start);
+    }
+
+    return !p->failed;
+}
+
+struct subsonic_response *api_response_parser_finish(struct api_response_parser *p) {
+    struct subsonic_response *resp = NULL;
+
+    if (p->failed) {
+        goto out;
+    }
+
+    resp = api_parse_response(p->request, VEC_DATA(&p->skeleton), VEC_SIZE(&p->skeleton));
+    if (resp == NULL || resp->status != RESPONSE_STATUS_OK) {
+        goto out;
+    }
+
+    for (size_t i = 0; i < SIZEOF_VEC(streamed_arrays); i++) {
+        const struct streamed_array *a = &streamed_arrays[i];
+        if (a->request != p->request) {
+            continue;
+        }
+
+        struct vec_generic *dst = (struct vec_generic *)((char *)resp + a->offset);
+        struct vec_generic *src = (struct vec_generic *)((char *)p->items + a->offset);
+
+        /* empty in skeleton, or missing if there was nothing in the first place */
+        assert(dst->size == 0);
+        free(dst->data);
+        *dst = *src;
+        *src = (struct vec_generic){0};
+    }
+    /* strings of streamed elements */
+    arena_merge(&resp->arena, &p->items->arena);
+
+out:
+    api_response_parser_free(p);
+    return resp;
+}
@@ -6,5 +6,19 @@
 struct subsonic_response *api_parse_response(enum api_request_type request,
                                              const char *data, size_t data_size);
 
+/*
+ * Incremental version of the above, for feeding the response as it arrives.
+ * Raw text and json-c tree of the whole response are never kept, parsed result still is.
+ * Feed returns false if response turned out to be invalid, further data is ignored then.
+ * Finish returns NULL if parsing failed, parser is freed either way.
+ */
+struct api_response_parser;
+
+struct api_response_parser *api_response_parser_new(enum api_request_type request);
+bool api_response_parser_feed(struct api_response_parser *parser,
+                              const char *data, size_t size);
+struct subsonic_response *api_response_parser_finish(struct api_response_parser *parser);
+void api_response_parser_free(struct api_response_parser *parser);
+
 #endif /* #ifndef SRC_API_JSON_H */
 
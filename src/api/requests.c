@@ -18,6 +18,10 @@ static const char *api_endpoints[] = {
     [API_REQUEST_SEARCH2] = "search2",
     [API_REQUEST_SEARCH3] = "search3",
     [API_REQUEST_SCROBBLE] = "scrobble",
+    [API_REQUEST_GET_INDEXES] = "getIndexes",
+    [API_REQUEST_GET_ARTISTS] = "getArtists",
+    [API_REQUEST_GET_ALBUM_LIST_2] = "getAlbumList2",
+    [API_REQUEST_GET_ALBUM] = "getAlbum",
 };
 static_assert(SIZEOF_VEC(api_endpoints) == API_REQUEST_TYPE_COUNT);
 
@@ -74,6 +78,9 @@ static void url_append_key_value_int(struct string *str, const char *k, int64_t
 
 struct api_request_callback_data {
     enum api_request_type request_type;
+    /* fed on network thread as data arrives, finished on main loop */
+    struct api_response_parser *parser;
+    bool parse_failed; /* transfer is cancelled then */
     api_response_callback_t callback;
     void *callback_data;
 };
@@ -107,12 +114,23 @@ static const char *error_code_to_string(int32_t code) {
 static bool on_api_stream_data(const char *errmsg, const struct response_headers *headers,
                                const void *data, ssize_t size, void *userdata) {
     struct api_stream_callback_data *d = userdata;
-    const size_t expected_size = headers->content_length.present ? headers->content_length.size : 0;
     bool ret = true;
 
+    struct api_stream_info info = {
+        .expected_size = headers->content_length.present ? headers->content_length.size : 0,
+        .seekable = headers->accept_ranges.present && STREQ(headers->accept_ranges.str, "bytes"),
+    };
+    if (headers->content_range.present) {
+        info.offset = headers->content_range.range.start;
+        info.total_size = headers->content_range.range.total;
+        info.seekable = true;
+    } else {
+        info.total_size = info.expected_size;
+    }
+
     switch (size) {
     case -1: /* error */
-        d->callback(errmsg, expected_size, NULL, -1, d->callback_data);
+        d->callback(errmsg, &info, NULL, -1, d->callback_data);
 
         goto out_free;
     case 0: /* EOF */
@@ -123,7 +141,7 @@ static bool on_api_stream_data(const char *errmsg, const struct response_headers
 
             if (r == NULL || r->inner_object_type != API_TYPE_ERROR) {
                 d->callback("Failed to parse server response",
-                            expected_size, NULL, -1, d->callback_data);
+                            &info, NULL, -1, d->callback_data);
             } else {
                 const struct api_type_error *err = &r->inner_object.error;
                 const char *errmsg;
@@ -132,12 +150,12 @@ static bool on_api_stream_data(const char *errmsg, const struct response_headers
                 } else {
                     errmsg = error_code_to_string(err->code);
                 }
-                d->callback(errmsg, expected_size, NULL, -1, d->callback_data);
+                d->callback(errmsg, &info, NULL, -1, d->callback_data);
             }
 
             subsonic_response_free(r);
         } else {
-            d->callback(NULL, expected_size, NULL, 0, d->callback_data);
+            d->callback(NULL, &info, NULL, 0, d->callback_data);
         }
 
         goto out_free;
@@ -150,7 +168,7 @@ static bool on_api_stream_data(const char *errmsg, const struct response_headers
 
         if (d->error) {
             VEC_APPEND_N(&d->error_data, (char *)data, size);
-        } else if (!d->callback(NULL, expected_size, data, size, d->callback_data)) {
+        } else if (!d->callback(NULL, &info, data, size, d->callback_data)) {
             ret = false;
             goto out_free;
         }
@@ -166,17 +184,25 @@ out:
     return ret;
 }
 
-static bool on_api_request_done(const char *errmsg, const struct response_headers *headers,
+static bool on_api_request_data(const char *errmsg, const struct response_headers *headers,
                                 const void *data, ssize_t size, void *userdata) {
     struct api_request_callback_data *d = userdata;
 
     [[gnu::cleanup(string_free)]] struct string err = {0};
 
-    if (errmsg != NULL) {
-        string_appendf(&err, "network error: %s", errmsg);
-        d->callback(err.str, NULL, d->callback_data);
-    } else {
-        struct subsonic_response *response = api_parse_response(d->request_type, data, size);
+    switch (size) {
+    case -1: /* error, on main loop */
+        if (d->parse_failed) {
+            d->callback("failed to parse server response", NULL, d->callback_data);
+        } else {
+            string_appendf(&err, "network error: %s", errmsg);
+            d->callback(err.str, NULL, d->callback_data);
+        }
+
+        api_response_parser_free(d->parser);
+        break;
+    case 0: /* EOF, on main loop */
+        struct subsonic_response *response = api_response_parser_finish(d->parser);
 
         if (response == NULL) {
             d->callback("failed to parse server response", NULL, d->callback_data);
@@ -196,6 +222,14 @@ static bool on_api_request_done(const char *errmsg, const struct response_header
         }
 
         subsonic_response_free(response);
+        break;
+    default: /* data, on network thread */
+        if (!api_response_parser_feed(d->parser, data, size)) {
+            /* no point downloading the rest, error is reported by the final callback */
+            d->parse_failed = true;
+            return false;
+        }
+        return true;
     }
 
     free(d);
@@ -211,7 +245,7 @@ static void dummy_api_callback(const char *e, const struct subsonic_response *r,
 
 static bool api_make_request(enum api_request_type request,
                              const struct url_arg *args, int args_count,
-                             bool stream,
+                             const struct request_options *options,
                              void *callback, void *callback_userdata) {
     struct string url = {0};
 
@@ -244,20 +278,26 @@ static bool api_make_request(enum api_request_type request,
     url_append_key_value_str(&url, "s", auth->salt);
 
     bool res;
-    if (!stream) {
+    if (!options->stream) {
         struct api_request_callback_data *data = xcalloc(1, sizeof(*data));
         data->request_type = request;
+        data->parser = api_response_parser_new(request);
         data->callback = callback;
         data->callback_data = callback_userdata;
 
-        res = make_request(url.str, false, on_api_request_done, data);
+        /* streamed at network level so parsing overlaps with download */
+        struct request_options stream_options = *options;
+        stream_options.stream = true;
+        stream_options.report_cancel = true;
+
+        res = make_request(url.str, &stream_options, on_api_request_data, data);
     } else {
         struct api_stream_callback_data *data = xcalloc(1, sizeof(*data));
         data->request_type = request;
         data->callback = callback;
         data->callback_data = callback_userdata;
 
-        res = make_request(url.str, true, on_api_stream_data, data);
+        res = make_request(url.str, options, on_api_stream_data, data);
     }
 
     string_free(&url);
@@ -278,7 +318,7 @@ bool api_get_random_songs(int32_t size, const char *genre,
 
     return api_make_request(API_REQUEST_GET_RANDOM_SONGS,
                             args.args, args.count,
-                            false,
+                            &(struct request_options){ .stream = false },
                             callback, callback_data);
 
 }
@@ -299,7 +339,65 @@ bool api_get_album_list(const char *type,
 
     return api_make_request(API_REQUEST_GET_ALBUM_LIST,
                             args.args, args.count,
-                            false,
+                            &(struct request_options){ .stream = false },
+                            callback, callback_data);
+}
+
+bool api_get_album_list_2(const char *type,
+                          int32_t size, int32_t offset,
+                          int32_t from_year, int32_t to_year,
+                          const char *genre, const char *music_folder_id,
+                          api_response_callback_t callback, void *callback_data) {
+    ARG_BUILDER(7) args = {0};
+    if (type != NULL) ARG_BUILDER_ADD_STR(args, "type", type);
+    if (size >= 0) ARG_BUILDER_ADD_INT(args, "size", size);
+    if (offset >= 0) ARG_BUILDER_ADD_INT(args, "offset", offset);
+    if (from_year >= 0) ARG_BUILDER_ADD_INT(args, "fromYear", from_year);
+    if (to_year >= 0) ARG_BUILDER_ADD_INT(args, "toYear", to_year);
+    if (genre != NULL) ARG_BUILDER_ADD_STR(args, "genre", genre);
+    if (music_folder_id != NULL) ARG_BUILDER_ADD_STR(args, "musicFolderId", music_folder_id);
+
+    return api_make_request(API_REQUEST_GET_ALBUM_LIST_2,
+                            args.args, args.count,
+                            &(struct request_options){ .stream = false },
+                            callback, callback_data);
+}
+
+bool api_get_indexes(const char *music_folder_id, int64_t if_modified_since,
+                     api_response_callback_t callback, void *callback_data) {
+    ARG_BUILDER(2) args = {0};
+    if (music_folder_id != NULL) ARG_BUILDER_ADD_STR(args, "musicFolderId", music_folder_id);
+    if (if_modified_since >= 0) ARG_BUILDER_ADD_INT(args, "ifModifiedSince", if_modified_since);
+
+    return api_make_request(API_REQUEST_GET_INDEXES,
+                            args.args, args.count,
+                            &(struct request_options){ .stream = false },
+                            callback, callback_data);
+}
+
+bool api_get_artists(const char *music_folder_id,
+                     api_response_callback_t callback, void *callback_data) {
+    ARG_BUILDER(1) args = {0};
+    if (music_folder_id != NULL) ARG_BUILDER_ADD_STR(args, "musicFolderId", music_folder_id);
+
+    return api_make_request(API_REQUEST_GET_ARTISTS,
+                            args.args, args.count,
+                            &(struct request_options){ .stream = false },
+                            callback, callback_data);
+}
+
+bool api_get_album(const char *id, api_response_callback_t callback, void *callback_data) {
+    ARG_BUILDER(1) args = {0};
+
+    if (id == NULL || strlen(id) == 0) {
+        ERROR("did not pass required parameter \"id\" to getAlbum api method");
+        return false;
+    }
+    ARG_BUILDER_ADD_STR(args, "id", id);
+
+    return api_make_request(API_REQUEST_GET_ALBUM,
+                            args.args, args.count,
+                            &(struct request_options){ .stream = false },
                             callback, callback_data);
 }
 
@@ -327,7 +425,7 @@ bool api_search2(const char *query,
 
     return api_make_request(API_REQUEST_SEARCH2,
                             args.args, args.count,
-                            false,
+                            &(struct request_options){ .stream = false },
                             callback, callback_data);
 }
 
@@ -355,7 +453,7 @@ bool api_search3(const char *query,
 
     return api_make_request(API_REQUEST_SEARCH3,
                             args.args, args.count,
-                            false,
+                            &(struct request_options){ .stream = false },
                             callback, callback_data);
 }
 
@@ -372,11 +470,12 @@ bool api_scrobble(const char *id) {
 
     return api_make_request(API_REQUEST_SCROBBLE,
                             args.args, args.count,
-                            false,
+                            &(struct request_options){ .stream = false },
                             dummy_api_callback, (void *)(uintptr_t)API_REQUEST_SCROBBLE);
 }
 
 bool api_stream(const char *id, int32_t max_bit_rate, const char *format,
+                size_t range_start, size_t range_end, size_t max_recv_speed,
                 api_stream_callback_t callback, void *callback_data) {
     ARG_BUILDER(4) args = {0};
 
@@ -392,7 +491,12 @@ bool api_stream(const char *id, int32_t max_bit_rate, const char *format,
 
     return api_make_request(API_REQUEST_STREAM,
                             args.args, args.count,
-                            true,
+                            &(struct request_options){
+                                .stream = true,
+                                .range_start = range_start,
+                                .range_end = range_end,
+                                .max_recv_speed = max_recv_speed,
+                            },
                             callback, callback_data);
 }
 
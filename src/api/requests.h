@@ -15,6 +15,10 @@ enum api_request_type {
     API_REQUEST_SEARCH2,
     API_REQUEST_SEARCH3,
     API_REQUEST_SCROBBLE,
+    API_REQUEST_GET_INDEXES,
+    API_REQUEST_GET_ARTISTS,
+    API_REQUEST_GET_ALBUM_LIST_2,
+    API_REQUEST_GET_ALBUM,
 
     /* put new types before this one, TO THE END OR EVERYTHING WILL EXPLODE */
     API_REQUEST_TYPE_COUNT,
@@ -24,8 +28,15 @@ typedef void (*api_response_callback_t)(const char *errmsg,
                                         const struct subsonic_response *response,
                                         void *userdata);
 
+struct api_stream_info {
+    size_t expected_size; /* size of this response, 0 if unknown */
+    size_t offset; /* offset of the first byte of this response in the whole file */
+    size_t total_size; /* size of the whole file, 0 if unknown */
+    bool seekable; /* server accepts byte range requests */
+};
+
 /* return false to cancel transfer, no more callbacks will be called after that */
-typedef bool (*api_stream_callback_t)(const char *errmsg, size_t expected_size,
+typedef bool (*api_stream_callback_t)(const char *errmsg, const struct api_stream_info *info,
                                       const void *data, ssize_t data_size,
                                       void *userdata);
 
@@ -65,6 +76,48 @@ bool api_get_album_list(const char *type,
                         const char *genre, const char *music_folder_id,
                         api_response_callback_t callback, void *callback_data);
 
+/*
+ * Similar to getAlbumList, but organizes music according to ID3 tags.
+ * Parameters are the same as for getAlbumList.
+ */
+bool api_get_album_list_2(const char *type,
+                          int32_t size, int32_t offset,
+                          int32_t from_year, int32_t to_year,
+                          const char *genre, const char *music_folder_id,
+                          api_response_callback_t callback, void *callback_data);
+
+/*
+ * Returns an indexed structure of all artists.
+ * Only lastModified is parsed, it's used to check if anything changed.
+ *
+ * Parameter       Required Default Comment
+ * musicFolderId   No               If specified, only return artists in the music folder
+ *                                  with the given ID.
+ * ifModifiedSince No               If specified, only return a result if the artist collection
+ *                                  has changed since the given time (in milliseconds since
+ *                                  1 Jan 1970).
+ */
+bool api_get_indexes(const char *music_folder_id, int64_t if_modified_since,
+                     api_response_callback_t callback, void *callback_data);
+
+/*
+ * Similar to getIndexes, but organizes music according to ID3 tags.
+ *
+ * Parameter     Required Default Comment
+ * musicFolderId No               If specified, only return artists in the music folder
+ *                                with the given ID.
+ */
+bool api_get_artists(const char *music_folder_id,
+                     api_response_callback_t callback, void *callback_data);
+
+/*
+ * Returns details for an album, including a list of songs. Music is organized according to ID3 tags.
+ *
+ * Parameter Required Default Comment
+ * id        Yes              The album ID.
+ */
+bool api_get_album(const char *id, api_response_callback_t callback, void *callback_data);
+
 /*
  * Returns albums, artists and songs matching the given search criteria.
  * Supports paging through the result.
@@ -121,6 +174,10 @@ bool api_scrobble(const char *id /*, time_t time, bool submission */);
 
 /*
  * Streams a given media file.
+ * range_start and range_end select a part of the file, [range_start, range_end),
+ * pass 0 to both to get the whole file. range_end of 0 means until the end.
+ * Servers that do not support ranges will return the whole file, check info->offset.
+ * max_recv_speed limits download speed in bytes per second, 0 for no limit.
  *
  * Parameter             Required Default Comment
  * id                    Yes              A string which uniquely identifies the file to stream.
@@ -128,6 +185,7 @@ bool api_scrobble(const char *id /*, time_t time, bool submission */);
  * format                No               Preferred target format, "raw" for no transcoding.
  */
 bool api_stream(const char *id, int32_t max_bit_rate, const char *format,
+                size_t range_start, size_t range_end, size_t max_recv_speed,
                 api_stream_callback_t callback, void *callback_data);
 
 #endif /* #ifndef SRC_API_REQUESTS_H */
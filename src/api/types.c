@@ -3,20 +3,11 @@
 
 #include "api/types.h"
 
-static void free_child(struct api_type_child *c) {
-    free(c->id);
-    free(c->title);
-
-    free(c->parent);
-    free(c->album);
-    free(c->artist);
-    free(c->content_type);
-    free(c->suffix);
-    free(c->album_id);
-    free(c->artist_id);
-}
-
 void print_child(const struct api_type_child *c, enum log_level lvl, int indent) {
+    if (!log_level_enabled(lvl)) {
+        return;
+    }
+
     log_println(lvl, "%*sChild {", indent, "");
 
     log_println(lvl, "%*sid: %s", indent + 4, "", c->id);
@@ -42,12 +33,11 @@ void print_child(const struct api_type_child *c, enum log_level lvl, int indent)
     log_println(lvl, "%*s}", indent, "");
 }
 
-static void free_artist(struct api_type_artist *a) {
-    free(a->id);
-    free(a->name);
-}
-
 void print_artist(const struct api_type_artist *a, enum log_level lvl, int indent) {
+    if (!log_level_enabled(lvl)) {
+        return;
+    }
+
     log_println(lvl, "%*sArtist {", indent, "");
 
     log_println(lvl, "%*sid: %s", indent + 4, "", a->id);
@@ -56,12 +46,11 @@ void print_artist(const struct api_type_artist *a, enum log_level lvl, int inden
     log_println(lvl, "%*s}", indent, "");
 }
 
-static void free_artist_id3(struct api_type_artist_id3 *a) {
-    free(a->id);
-    free(a->name);
-}
-
 void print_artist_id3(const struct api_type_artist_id3 *a, enum log_level lvl, int indent) {
+    if (!log_level_enabled(lvl)) {
+        return;
+    }
+
     log_println(lvl, "%*sArtistID3 {", indent, "");
 
     log_println(lvl, "%*sid: %s", indent + 4, "", a->id);
@@ -71,15 +60,11 @@ void print_artist_id3(const struct api_type_artist_id3 *a, enum log_level lvl, i
     log_println(lvl, "%*s}", indent, "");
 }
 
-static void free_album_id3(struct api_type_album_id3 *a) {
-    free(a->id);
-    free(a->name);
-    free(a->created);
-    free(a->artist);
-    free(a->artist_id);
-}
-
 void print_album_id3(const struct api_type_album_id3 *a, enum log_level lvl, int indent) {
+    if (!log_level_enabled(lvl)) {
+        return;
+    }
+
     log_println(lvl, "%*sAlbumID3 {", indent, "");
 
     log_println(lvl, "%*sid: %s", indent + 4, "", a->id);
@@ -96,8 +81,7 @@ void print_album_id3(const struct api_type_album_id3 *a, enum log_level lvl, int
 }
 
 static void free_error(union subsonic_response_inner_object *o) {
-    struct api_type_error *e = &o->error;
-    free(e->message);
+    /* nothing to free */
 }
 
 static void print_error(const union subsonic_response_inner_object *o,
@@ -111,10 +95,6 @@ static void print_error(const union subsonic_response_inner_object *o,
 
 static void free_songs(union subsonic_response_inner_object *o) {
     struct api_type_songs *s = &o->songs;
-    VEC_FOREACH(&s->song, i) {
-        struct api_type_child *c = VEC_AT(&s->song, i);
-        free_child(c);
-    }
     VEC_FREE(&s->song);
 }
 
@@ -133,10 +113,6 @@ static void print_songs(const union subsonic_response_inner_object *o,
 
 static void free_album_list(union subsonic_response_inner_object *o) {
     struct api_type_album_list *l = &o->album_list;
-    VEC_FOREACH(&l->album, i) {
-        struct api_type_child *c = VEC_AT(&l->album, i);
-        free_child(c);
-    }
     VEC_FREE(&l->album);
 }
 
@@ -155,17 +131,8 @@ static void print_album_list(const union subsonic_response_inner_object *o,
 
 static void free_search_result_2(union subsonic_response_inner_object *o) {
     struct api_type_search_result_2 *r = &o->search_result_2;
-    VEC_FOREACH(&r->artist, i) {
-        free_artist(VEC_AT(&r->artist, i));
-    }
     VEC_FREE(&r->artist);
-    VEC_FOREACH(&r->album, i) {
-        free_child(VEC_AT(&r->album, i));
-    }
     VEC_FREE(&r->album);
-    VEC_FOREACH(&r->song, i) {
-        free_child(VEC_AT(&r->song, i));
-    }
     VEC_FREE(&r->song);
 }
 
@@ -197,17 +164,8 @@ static void print_search_result_2(const union subsonic_response_inner_object *o,
 
 static void free_search_result_3(union subsonic_response_inner_object *o) {
     struct api_type_search_result_3 *r = &o->search_result_3;
-    VEC_FOREACH(&r->artist, i) {
-        free_artist_id3(VEC_AT(&r->artist, i));
-    }
     VEC_FREE(&r->artist);
-    VEC_FOREACH(&r->album, i) {
-        free_album_id3(VEC_AT(&r->album, i));
-    }
     VEC_FREE(&r->album);
-    VEC_FOREACH(&r->song, i) {
-        free_child(VEC_AT(&r->song, i));
-    }
     VEC_FREE(&r->song);
 }
 
@@ -237,6 +195,82 @@ static void print_search_result_3(const union subsonic_response_inner_object *o,
     log_println(lvl, "%*s}", indent, "");
 }
 
+static void free_indexes(union subsonic_response_inner_object *o) {
+    /* nothing to free */
+}
+
+static void print_indexes(const union subsonic_response_inner_object *o,
+                          enum log_level lvl, int indent) {
+    const struct api_type_indexes *i = &o->indexes;
+    log_println(lvl, "%*sIndexes {", indent, "");
+    log_println(lvl, "%*slastModified: %li", indent + 4, "", i->last_modified);
+    log_println(lvl, "%*s}", indent, "");
+}
+
+static void free_artists_id3(union subsonic_response_inner_object *o) {
+    struct api_type_artists_id3 *a = &o->artists_id3;
+    VEC_FOREACH(&a->index, i) {
+        struct api_type_index_id3 *index = VEC_AT(&a->index, i);
+        VEC_FREE(&index->artist);
+    }
+    VEC_FREE(&a->index);
+}
+
+static void print_artists_id3(const union subsonic_response_inner_object *o,
+                              enum log_level lvl, int indent) {
+    const struct api_type_artists_id3 *a = &o->artists_id3;
+    log_println(lvl, "%*sArtistsID3 {", indent, "");
+    log_println(lvl, "%*sindex (%zu) [", indent + 4, "", VEC_SIZE(&a->index));
+    VEC_FOREACH(&a->index, i) {
+        const struct api_type_index_id3 *index = VEC_AT(&a->index, i);
+        log_println(lvl, "%*sIndexID3 {", indent + 8, "");
+        log_println(lvl, "%*sname: %s", indent + 12, "", index->name);
+        log_println(lvl, "%*sartist (%zu) [", indent + 12, "", VEC_SIZE(&index->artist));
+        VEC_FOREACH(&index->artist, j) {
+            print_artist_id3(VEC_AT(&index->artist, j), lvl, indent + 16);
+        }
+        log_println(lvl, "%*s]", indent + 12, "");
+        log_println(lvl, "%*s}", indent + 8, "");
+    }
+    log_println(lvl, "%*s]", indent + 4, "");
+    log_println(lvl, "%*s}", indent, "");
+}
+
+static void free_album_list_2(union subsonic_response_inner_object *o) {
+    struct api_type_album_list_2 *l = &o->album_list_2;
+    VEC_FREE(&l->album);
+}
+
+static void print_album_list_2(const union subsonic_response_inner_object *o,
+                               enum log_level lvl, int indent) {
+    const struct api_type_album_list_2 *l = &o->album_list_2;
+    log_println(lvl, "%*sAlbumList2 {", indent, "");
+    log_println(lvl, "%*salbum (%zu) [", indent + 4, "", VEC_SIZE(&l->album));
+    VEC_FOREACH(&l->album, i) {
+        print_album_id3(VEC_AT(&l->album, i), lvl, indent + 8);
+    }
+    log_println(lvl, "%*s]", indent + 4, "");
+    log_println(lvl, "%*s}", indent, "");
+}
+
+static void free_album_with_songs_id3(union subsonic_response_inner_object *o) {
+    struct api_type_album_with_songs_id3 *a = &o->album_with_songs_id3;
+    VEC_FREE(&a->song);
+}
+
+static void print_album_with_songs_id3(const union subsonic_response_inner_object *o,
+                                       enum log_level lvl, int indent) {
+    const struct api_type_album_with_songs_id3 *a = &o->album_with_songs_id3;
+    log_println(lvl, "%*sAlbumWithSongsID3 {", indent, "");
+    print_album_id3(&a->album, lvl, indent + 4);
+    log_println(lvl, "%*ssong (%zu) [", indent + 4, "", VEC_SIZE(&a->song));
+    VEC_FOREACH(&a->song, i) {
+        print_child(VEC_AT(&a->song, i), lvl, indent + 8);
+    }
+    log_println(lvl, "%*s]", indent + 4, "");
+    log_println(lvl, "%*s}", indent, "");
+}
+
 static const struct {
     void (*free)(union subsonic_response_inner_object *o);
     void (*print)(const union subsonic_response_inner_object *o, enum log_level lvl, int indent);
@@ -246,6 +280,10 @@ static const struct {
     [API_TYPE_ALBUM_LIST] = { free_album_list, print_album_list },
     [API_TYPE_SEARCH_RESULT_2] = { free_search_result_2, print_search_result_2 },
     [API_TYPE_SEARCH_RESULT_3] = { free_search_result_3, print_search_result_3 },
+    [API_TYPE_INDEXES] = { free_indexes, print_indexes },
+    [API_TYPE_ARTISTS_ID3] = { free_artists_id3, print_artists_id3 },
+    [API_TYPE_ALBUM_LIST_2] = { free_album_list_2, print_album_list_2 },
+    [API_TYPE_ALBUM_WITH_SONGS_ID3] = { free_album_with_songs_id3, print_album_with_songs_id3 },
 };
 static_assert(SIZEOF_VEC(inner_object_funcs) == SUBSONIC_RESPONSE_INNER_OBJECT_TYPE_COUNT);
 
@@ -256,11 +294,16 @@ void subsonic_response_free(struct subsonic_response *response) {
 
     inner_object_funcs[response->inner_object_type].free(&response->inner_object);
 
-    free(response->version);
+    /* all strings live here */
+    arena_free(&response->arena);
     free(response);
 }
 
 void subsonic_response_print(const struct subsonic_response *resp, enum log_level lvl) {
+    if (!log_level_enabled(lvl)) {
+        return;
+    }
+
     if (resp == NULL) {
         log_println(lvl, "subsonic-response (NULL)");
         return;
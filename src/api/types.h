@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 
+#include "collections/arena.h"
 #include "collections/vec.h"
 #include "log.h"
 
@@ -66,6 +67,27 @@ struct api_type_album_id3 {
     int32_t year;
 };
 
+struct api_type_album_with_songs_id3 {
+    struct api_type_album_id3 album;
+    VEC(struct api_type_child) song;
+};
+
+struct api_type_index_id3 {
+    /* required */
+    char *name;
+    VEC(struct api_type_artist_id3) artist;
+};
+
+struct api_type_artists_id3 {
+    VEC(struct api_type_index_id3) index;
+};
+
+struct api_type_indexes {
+    /* required */
+    int64_t last_modified; /* in milliseconds */
+    /* index, shortcut and child omitted, only used to check for changes */
+};
+
 struct api_type_songs {
     VEC(struct api_type_child) song;
 };
@@ -74,6 +96,10 @@ struct api_type_album_list {
     VEC(struct api_type_child) album;
 };
 
+struct api_type_album_list_2 {
+    VEC(struct api_type_album_id3) album;
+};
+
 struct api_type_search_result_2 {
     VEC(struct api_type_artist) artist;
     VEC(struct api_type_child) album;
@@ -97,6 +123,10 @@ enum subsonic_response_inner_object_type {
     API_TYPE_ALBUM_LIST,
     API_TYPE_SEARCH_RESULT_2,
     API_TYPE_SEARCH_RESULT_3,
+    API_TYPE_INDEXES,
+    API_TYPE_ARTISTS_ID3,
+    API_TYPE_ALBUM_LIST_2,
+    API_TYPE_ALBUM_WITH_SONGS_ID3,
 
     SUBSONIC_RESPONSE_INNER_OBJECT_TYPE_COUNT
 };
@@ -107,9 +137,19 @@ union subsonic_response_inner_object {
     struct api_type_album_list album_list;
     struct api_type_search_result_2 search_result_2;
     struct api_type_search_result_3 search_result_3;
+    struct api_type_indexes indexes;
+    struct api_type_artists_id3 artists_id3;
+    struct api_type_album_list_2 album_list_2;
+    struct api_type_album_with_songs_id3 album_with_songs_id3;
 };
 
+/*
+ * All strings in a response are allocated from its arena and are gone
+ * after subsonic_response_free, copy them if you need them for longer.
+ */
 struct subsonic_response {
+    struct arena arena;
+
     enum subsonic_response_status status;
     char *version;
 
@@ -8,6 +8,8 @@
 #include "db/init.h"
 #include "db/populate.h"
 #include "db/query.h"
+#include "db/worker.h"
+#include "stream/cache.h"
 #include "tui/init.h"
 #include "mpris/init.h"
 
@@ -41,6 +43,12 @@ int main(int argc, char **argv) {
     event_loop = pollen_loop_create();
     pollen_loop_add_signal(event_loop, SIGINT, sigint_handler, &event_loop);
 
+    if (!db_worker_init()) {
+        return 1;
+    }
+    if (!stream_cache_init()) {
+        return 1;
+    }
     if (!network_init()) {
         return 1;
     }
@@ -58,6 +66,8 @@ int main(int argc, char **argv) {
     tui_cleanup();
     player_cleanup();
     network_cleanup();
+    stream_cache_cleanup();
+    db_worker_cleanup();
     db_cleanup();
     pollen_loop_cleanup(event_loop);
 
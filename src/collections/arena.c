@@ -0,0 +1,92 @@
+#include <stdalign.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "collections/arena.h"
+#include "xmalloc.h"
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    alignas(max_align_t) char data[];
+};
+
+static size_t align_up(size_t size) {
+    return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+}
+
+void *arena_alloc(struct arena *arena, size_t size) {
+    /* zero-sized allocations still get a unique pointer, empty arena has no ptr to return */
+    size = align_up(size > 0 ? size : 1);
+
+    if (size <= (size_t)(arena->end - arena->ptr)) {
+        void *ret = arena->ptr;
+        arena->ptr += size;
+        return ret;
+    }
+
+    /* big ones get a chunk of their own so that the rest of current chunk isn't wasted */
+    if (size > ARENA_CHUNK_SIZE / 4) {
+        struct arena_chunk *chunk = xmalloc(sizeof(*chunk) + size);
+        if (arena->chunks != NULL) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        } else {
+            /* nothing to bump yet, ptr and end stay NULL */
+            chunk->next = NULL;
+            arena->chunks = chunk;
+        }
+        return chunk->data;
+    }
+
+    struct arena_chunk *chunk = xmalloc(sizeof(*chunk) + ARENA_CHUNK_SIZE);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->ptr = chunk->data + size;
+    arena->end = chunk->data + ARENA_CHUNK_SIZE;
+
+    return chunk->data;
+}
+
+char *arena_strdup(struct arena *arena, const char *s) {
+    if (s == NULL) {
+        return NULL;
+    }
+
+    const size_t len = strlen(s) + 1;
+    char *ret = arena_alloc(arena, len);
+    memcpy(ret, s, len);
+
+    return ret;
+}
+
+void arena_merge(struct arena *dst, struct arena *src) {
+    if (src->chunks == NULL) {
+        return;
+    }
+
+    if (dst->chunks == NULL) {
+        *dst = *src;
+    } else {
+        /* keep bumping dst's current chunk, src's chunks go after it */
+        struct arena_chunk *last = src->chunks;
+        while (last->next != NULL) {
+            last = last->next;
+        }
+        last->next = dst->chunks->next;
+        dst->chunks->next = src->chunks;
+    }
+
+    *src = (struct arena){0};
+}
+
+void arena_free(struct arena *arena) {
+    struct arena_chunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    *arena = (struct arena){0};
+}
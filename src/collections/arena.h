@@ -0,0 +1,32 @@
+#ifndef SRC_COLLECTIONS_ARENA_H
+#define SRC_COLLECTIONS_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator. Memory is carved from big chunks and can only be freed all at once.
+ * Zero-initialised struct arena is a valid empty arena.
+ * Nothing allocated from an arena outlives it, copy things out if you need to keep them.
+ */
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *chunks; /* first one is the one being bumped */
+    char *ptr, *end;
+};
+
+/* Never returns NULL, even for size 0. Memory is aligned to max_align_t and is NOT
+ * zero-initialised. */
+void *arena_alloc(struct arena *arena, size_t size);
+/* Returns NULL if s is NULL */
+char *arena_strdup(struct arena *arena, const char *s);
+
+/* Moves all memory of src into dst, src becomes empty. Pointers into src stay valid. */
+void arena_merge(struct arena *dst, struct arena *src);
+
+void arena_free(struct arena *arena);
+
+#endif /* #ifndef SRC_COLLECTIONS_ARENA_H */
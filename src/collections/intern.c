@@ -0,0 +1,158 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "collections/intern.h"
+#include "collections/list.h" /* CONTAINER_OF */
+#include "xmalloc.h"
+
+#define INTERN_MIN_CAPACITY 64
+
+struct intern_entry {
+    uint64_t hash;
+    size_t refs;
+    char str[];
+};
+
+/* open addressing with linear probing, capacity is always a power of two */
+static struct {
+    pthread_mutex_t lock;
+    struct intern_entry **slots;
+    size_t capacity, count;
+} table = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* FNV-1a */
+static uint64_t hash_str(const char *str, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static void grow(void) {
+    const size_t new_capacity = (table.capacity == 0) ? INTERN_MIN_CAPACITY : table.capacity * 2;
+    struct intern_entry **new_slots = xcalloc(new_capacity, sizeof(*new_slots));
+
+    for (size_t i = 0; i < table.capacity; i++) {
+        struct intern_entry *e = table.slots[i];
+        if (e == NULL) {
+            continue;
+        }
+
+        size_t j = e->hash & (new_capacity - 1);
+        while (new_slots[j] != NULL) {
+            j = (j + 1) & (new_capacity - 1);
+        }
+        new_slots[j] = e;
+    }
+
+    free(table.slots);
+    table.slots = new_slots;
+    table.capacity = new_capacity;
+}
+
+const char *intern(const char *str) {
+    if (str == NULL) {
+        return NULL;
+    }
+
+    const size_t len = strlen(str);
+    const uint64_t hash = hash_str(str, len);
+
+    pthread_mutex_lock(&table.lock);
+
+    /* keep load factor under 1/2 so probe sequences stay short */
+    if ((table.count + 1) * 2 > table.capacity) {
+        grow();
+    }
+
+    struct intern_entry *e = NULL;
+    size_t i = hash & (table.capacity - 1);
+    while ((e = table.slots[i]) != NULL) {
+        if (e->hash == hash && memcmp(e->str, str, len + 1) == 0) {
+            e->refs += 1;
+            goto out;
+        }
+        i = (i + 1) & (table.capacity - 1);
+    }
+
+    e = xmalloc(sizeof(*e) + len + 1);
+    e->hash = hash;
+    e->refs = 1;
+    memcpy(e->str, str, len + 1);
+
+    table.slots[i] = e;
+    table.count += 1;
+
+out:
+    pthread_mutex_unlock(&table.lock);
+    return e->str;
+}
+
+const char *intern_ref(const char *str) {
+    if (str == NULL) {
+        return NULL;
+    }
+
+    struct intern_entry *e = CONTAINER_OF(str, e, str);
+
+    pthread_mutex_lock(&table.lock);
+    assert(e->refs > 0);
+    e->refs += 1;
+    pthread_mutex_unlock(&table.lock);
+
+    return str;
+}
+
+void intern_unref(const char *str) {
+    if (str == NULL) {
+        return;
+    }
+
+    struct intern_entry *e = CONTAINER_OF(str, e, str);
+
+    pthread_mutex_lock(&table.lock);
+
+    assert(e->refs > 0);
+    if (--e->refs > 0) {
+        goto out;
+    }
+
+    const size_t mask = table.capacity - 1;
+    size_t i = e->hash & mask;
+    while (table.slots[i] != e) {
+        i = (i + 1) & mask;
+    }
+
+    /*
+     * No tombstones: shift back entries that follow in the same cluster
+     * if the hole is between their home slot and where they are now.
+     */
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; table.slots[j] != NULL; j = (j + 1) & mask) {
+        const size_t home = table.slots[j]->hash & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            table.slots[hole] = table.slots[j];
+            hole = j;
+        }
+    }
+    table.slots[hole] = NULL;
+    table.count -= 1;
+
+    free(e);
+
+out:
+    pthread_mutex_unlock(&table.lock);
+}
+
+size_t intern_count(void) {
+    pthread_mutex_lock(&table.lock);
+    const size_t count = table.count;
+    pthread_mutex_unlock(&table.lock);
+    return count;
+}
@@ -0,0 +1,23 @@
+#ifndef SRC_COLLECTIONS_INTERN_H
+#define SRC_COLLECTIONS_INTERN_H
+
+#include <stddef.h>
+
+/*
+ * Global table of refcounted immutable strings, safe to use from any thread.
+ * Equal strings interned at the same time share memory, so interned strings
+ * can be compared by pointer instead of strcmp.
+ * Every intern or intern_ref must be paired with an intern_unref.
+ */
+
+/* Returns NULL if str is NULL */
+const char *intern(const char *str);
+/* Takes another reference to an already interned str, which is returned. NULL is ok. */
+const char *intern_ref(const char *str);
+/* Drops a reference, string is freed when the last one is gone. NULL is ok. */
+void intern_unref(const char *str);
+
+/* Number of distinct strings currently in the table */
+size_t intern_count(void);
+
+#endif /* #ifndef SRC_COLLECTIONS_INTERN_H */
@@ -0,0 +1,52 @@
+#include "collections/mpsc.h"
+
+void mpsc_queue_init(struct mpsc_queue *queue) {
+    atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, &queue->stub, memory_order_relaxed);
+    queue->tail = &queue->stub;
+}
+
+void mpsc_queue_push(struct mpsc_queue *queue, struct mpsc_node *node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    struct mpsc_node *prev = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+    /* queue is "broken" between these two lines, consumer will see it as empty */
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+struct mpsc_node *mpsc_queue_pop(struct mpsc_queue *queue) {
+    struct mpsc_node *tail = queue->tail;
+    struct mpsc_node *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &queue->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        /* skip the stub */
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    struct mpsc_node *head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail != head) {
+        /* producer is in the middle of push */
+        return NULL;
+    }
+
+    /* tail is the last node. Put stub behind it so tail can be popped */
+    mpsc_queue_push(queue, &queue->stub);
+
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
@@ -0,0 +1,35 @@
+#ifndef SRC_COLLECTIONS_MPSC_H
+#define SRC_COLLECTIONS_MPSC_H
+
+#include <stdatomic.h>
+
+#include "collections/list.h" /* CONTAINER_OF */
+
+/*
+ * Intrusive lock-free multiple producer single consumer queue (Vyukov's algorithm).
+ * Any thread can push, only one thread at a time can pop.
+ * Embed struct mpsc_node into your struct and use CONTAINER_OF to get it back.
+ */
+
+struct mpsc_node {
+    _Atomic(struct mpsc_node *) next;
+};
+
+struct mpsc_queue {
+    _Atomic(struct mpsc_node *) head; /* producers push here */
+    struct mpsc_node *tail; /* consumer pops from here */
+    struct mpsc_node stub;
+};
+
+void mpsc_queue_init(struct mpsc_queue *queue);
+
+void mpsc_queue_push(struct mpsc_queue *queue, struct mpsc_node *node);
+
+/*
+ * Returns NULL if queue is empty. Might also return NULL if some producer is in
+ * the middle of pushing, so producers must wake consumer up after pushing is done.
+ */
+struct mpsc_node *mpsc_queue_pop(struct mpsc_queue *queue);
+
+#endif /* #ifndef SRC_COLLECTIONS_MPSC_H */
+
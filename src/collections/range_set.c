@@ -0,0 +1,90 @@
+#include <stdint.h>
+
+#include "collections/range_set.h"
+
+/* returns index of the first range whose end is >= pos (might be equal to size) */
+static size_t lower_bound(const struct range_set *set, size_t pos) {
+    size_t lo = 0, hi = VEC_SIZE(&set->ranges);
+
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (VEC_DATA(&set->ranges)[mid].end < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+void range_set_free(struct range_set *set) {
+    VEC_FREE(&set->ranges);
+}
+
+void range_set_clear(struct range_set *set) {
+    VEC_CLEAR(&set->ranges);
+}
+
+void range_set_add(struct range_set *set, size_t start, size_t end) {
+    if (start >= end) {
+        return;
+    }
+
+    const size_t first = lower_bound(set, start);
+
+    size_t last = first;
+    while (last < VEC_SIZE(&set->ranges) && VEC_DATA(&set->ranges)[last].start <= end) {
+        const struct range *r = &VEC_DATA(&set->ranges)[last];
+        start = MIN(start, r->start);
+        end = MAX(end, r->end);
+        last += 1;
+    }
+
+    if (last > first) {
+        VEC_ERASE_N(&set->ranges, first, last - first);
+    }
+
+    const struct range new = { .start = start, .end = end };
+    if (first < VEC_SIZE(&set->ranges)) {
+        VEC_INSERT(&set->ranges, first, &new);
+    } else {
+        VEC_APPEND(&set->ranges, &new);
+    }
+}
+
+const struct range *range_set_find(const struct range_set *set, size_t pos) {
+    /* end is exclusive, so look for the first range with end > pos */
+    const size_t i = lower_bound(set, pos + 1);
+    if (i < VEC_SIZE(&set->ranges) && VEC_DATA(&set->ranges)[i].start <= pos) {
+        return &VEC_DATA(&set->ranges)[i];
+    }
+
+    return NULL;
+}
+
+size_t range_set_next_start(const struct range_set *set, size_t pos) {
+    const size_t i = lower_bound(set, pos + 1);
+    if (i >= VEC_SIZE(&set->ranges)) {
+        return SIZE_MAX;
+    }
+
+    const struct range *r = &VEC_DATA(&set->ranges)[i];
+    if (r->start > pos) {
+        return r->start;
+    } else if (i + 1 < VEC_SIZE(&set->ranges)) {
+        return VEC_DATA(&set->ranges)[i + 1].start;
+    } else {
+        return SIZE_MAX;
+    }
+}
+
+bool range_set_covers(const struct range_set *set, size_t start, size_t end) {
+    if (start >= end) {
+        return true;
+    }
+
+    const struct range *r = range_set_find(set, start);
+    return r != NULL && r->end >= end;
+}
+
@@ -0,0 +1,34 @@
+#ifndef SRC_COLLECTIONS_RANGE_SET_H
+#define SRC_COLLECTIONS_RANGE_SET_H
+
+#include <stddef.h>
+
+#include "collections/vec.h"
+
+/* half-open interval [start, end) */
+struct range {
+    size_t start, end;
+};
+
+/* set of sorted, non-overlapping and non-adjacent ranges */
+struct range_set {
+    VEC(struct range) ranges;
+};
+
+void range_set_free(struct range_set *set);
+void range_set_clear(struct range_set *set);
+
+/* adds [start, end) to the set, merging it with overlapping or adjacent ranges */
+void range_set_add(struct range_set *set, size_t start, size_t end);
+
+/* returns pointer to range containing pos, or NULL if pos is not in the set */
+const struct range *range_set_find(const struct range_set *set, size_t pos);
+
+/* returns start of the first range that begins after pos, or SIZE_MAX if there is none */
+size_t range_set_next_start(const struct range_set *set, size_t pos);
+
+/* returns true if the whole [start, end) is in the set */
+bool range_set_covers(const struct range_set *set, size_t start, size_t end);
+
+#endif /* #ifndef SRC_COLLECTIONS_RANGE_SET_H */
+
@@ -18,6 +18,15 @@ struct config config = {
 
     .preferred_audio_format = "raw",
     .preferred_audio_bitrate = 128,
+
+    .prefetch_count = 2,
+    .prefetch_max_speed = 1024 * 1024,
+
+    .max_host_connections = 4,
+    .sync_max_requests = 4,
+
+    .music_cache_max_size = 4ULL * 1024 * 1024 * 1024,
+    .music_cache_fsync = true,
 };
 
 bool load_config(void) {
@@ -2,6 +2,7 @@
 #define SRC_CONFIG_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 struct config {
     /* server url (without /rest) */
@@ -20,12 +21,29 @@ struct config {
     char *preferred_audio_format;
     int preferred_audio_bitrate;
 
+    /* how many songs after the current one to download into cache in background */
+    int prefetch_count;
+    /* download speed limit for background downloads, bytes per second, 0 for no limit */
+    size_t prefetch_max_speed;
+
+    /* max simultaneous connections to the server, 0 for no limit.
+     * Requests are multiplexed over HTTP/2 connections when the server supports it */
+    int max_host_connections;
+
+    /* how many pages of library to request at once when syncing with the server, at least 1 */
+    int sync_max_requests;
+
     /* ~/.config/campanula/ */
     const char *config_dir;
     /* ~/.cache/campanula/ */
     const char *cache_dir;
     /* ~/.cache/campanula/music/ */
     char *music_cache_dir;
+    /* least recently played songs are removed from cache when it grows larger than this,
+     * in bytes, 0 for no limit */
+    size_t music_cache_max_size;
+    /* flush songs to disk before adding them to cache */
+    bool music_cache_fsync;
     /* ~/.local/share/campanula/ */
     const char *data_dir;
 };
@@ -1,10 +1,15 @@
 #include "db/cache.h"
 #include "db/internal.h"
+#include "collections/vec.h"
 #include "xmalloc.h"
 #include "config.h"
 #include "log.h"
 
 bool db_get_cached_song(struct cached_song *song, const char *id) {
+    if (!db_ensure_connection()) {
+        return false;
+    }
+
     [[gnu::cleanup(statement_resetp)]]
     struct sqlite3_stmt *const stmt = statements[STATEMENT_GET_CACHED_SONG].stmt;
 
@@ -18,6 +23,7 @@ bool db_get_cached_song(struct cached_song *song, const char *id) {
         return false;
     }
 
+    song->server_id = config.server_id;
     song->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
     song->filename = xstrdup((char *)sqlite3_column_text(stmt, 1));
     song->filetype = xstrdup((char *)sqlite3_column_text(stmt, 2));
@@ -27,17 +33,21 @@ bool db_get_cached_song(struct cached_song *song, const char *id) {
     return true;
 }
 
-bool db_delete_cached_song(const char *id) {
+bool db_delete_cached_song(const struct cached_song *song) {
+    if (!db_ensure_connection()) {
+        return false;
+    }
+
     [[gnu::cleanup(statement_resetp)]]
     struct sqlite3_stmt *const stmt = statements[STATEMENT_DELETE_CACHED_SONG].stmt;
 
-    STMT_BIND(stmt, int64, "$server_id", config.server_id);
+    STMT_BIND(stmt, int64, "$server_id", song->server_id);
 
-    STMT_BIND(stmt, text, "$id", id, -1, SQLITE_STATIC);
+    STMT_BIND(stmt, text, "$id", song->id, -1, SQLITE_STATIC);
 
     int ret = sqlite3_step(stmt);
     if (ret != SQLITE_DONE) {
-        WARN("failed to delete cached song for song id %s: %s", id, sqlite3_errmsg(db));
+        WARN("failed to delete cached song for song id %s: %s", song->id, sqlite3_errmsg(db));
         return false;
     }
 
@@ -45,6 +55,10 @@ bool db_delete_cached_song(const char *id) {
 }
 
 bool db_add_cached_song(const struct cached_song *song) {
+    if (!db_ensure_connection()) {
+        return false;
+    }
+
     [[gnu::cleanup(statement_resetp)]]
     struct sqlite3_stmt *const stmt = statements[STATEMENT_ADD_CACHED_SONG].stmt;
 
@@ -66,6 +80,10 @@ bool db_add_cached_song(const struct cached_song *song) {
 }
 
 bool db_touch_cached_song(const char *song_id) {
+    if (!db_ensure_connection()) {
+        return false;
+    }
+
     [[gnu::cleanup(statement_resetp)]]
     struct sqlite3_stmt *const stmt = statements[STATEMENT_TOUCH_CACHED_SONG].stmt;
 
@@ -82,3 +100,41 @@ bool db_touch_cached_song(const char *song_id) {
     return true;
 }
 
+size_t db_get_cached_songs_over_limit(struct cached_song **psongs, size_t max_size, size_t count) {
+    if (!db_ensure_connection()) {
+        *psongs = NULL;
+        return 0;
+    }
+
+    [[gnu::cleanup(statement_resetp)]]
+    struct sqlite3_stmt *const stmt = statements[STATEMENT_GET_CACHED_SONGS_OVER_LIMIT].stmt;
+
+    VEC(struct cached_song) songs = {0};
+
+    STMT_BIND(stmt, int64, "$max_size", max_size);
+    STMT_BIND(stmt, int64, "$select_count", count);
+
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        struct cached_song *s = VEC_EMPLACE_BACK(&songs);
+
+        s->server_id = sqlite3_column_int64(stmt, 0);
+        s->id = xstrdup((char *)sqlite3_column_text(stmt, 1));
+        s->filename = xstrdup((char *)sqlite3_column_text(stmt, 2));
+        s->filetype = xstrdup((char *)sqlite3_column_text(stmt, 3));
+        s->bitrate = sqlite3_column_int64(stmt, 4);
+        s->size = sqlite3_column_int64(stmt, 5);
+    }
+    if (ret != SQLITE_DONE) {
+        ERROR("failed to fetch cached songs from db: %s", sqlite3_errmsg(db));
+        VEC_FOREACH(&songs, i) {
+            cached_song_free_contents(VEC_AT(&songs, i));
+        }
+        VEC_FREE(&songs);
+        *psongs = NULL;
+        return 0;
+    }
+
+    *psongs = VEC_DATA(&songs);
+    return VEC_SIZE(&songs);
+}
@@ -1,12 +1,18 @@
 #ifndef SRC_DB_CACHE_H
 #define SRC_DB_CACHE_H
 
+#include <stddef.h>
+
 #include "types/cached_song.h"
 
 bool db_get_cached_song(struct cached_song *song, const char *song_id);
-bool db_delete_cached_song(const char *song_id);
+bool db_delete_cached_song(const struct cached_song *song);
 bool db_add_cached_song(const struct cached_song *song);
 bool db_touch_cached_song(const char *song_id);
 
+/* Returns up to count least recently accessed songs that need to be removed
+ * for the total size of the cache to fit into max_size */
+size_t db_get_cached_songs_over_limit(struct cached_song **songs, size_t max_size, size_t count);
+
 #endif /* #ifndef SRC_DB_CACHE_H */
 
@@ -2,6 +2,9 @@
 #define SRC_DB_INIT_H
 
 bool db_init(void);
+/* Opens a separate connection for the calling thread. db_init must be called first. */
+bool db_init_thread(void);
+/* Closes the connection of the calling thread */
 void db_cleanup(void);
 
 #endif /* #ifndef SRC_DB_INIT_H */
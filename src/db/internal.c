@@ -1,16 +1,25 @@
+#include <pthread.h>
 #include <assert.h>
 
 #include "db/internal.h"
+#include "db/init.h"
+#include "collections/string.h"
 #include "cleanup.h"
 #include "xmalloc.h"
 #include "macros.h"
 #include "config.h"
 #include "log.h"
 
-struct sqlite_statement statements[] = {
+thread_local struct sqlite_statement statements[] = {
     [STATEMENT_ENABLE_FOREIGN_KEYS] = { .src = "PRAGMA foreign_keys = ON" },
+    /* until the end of current transaction */
 
-    [STATEMENT_BEGIN] = { .src = "BEGIN" },
+    /* negative means KiB, see db_populate */
+    [STATEMENT_SYNC_CACHE_SIZE] = { .src = "PRAGMA cache_size = -65536" },
+    [STATEMENT_DEFAULT_CACHE_SIZE] = { .src = "PRAGMA cache_size = -2000" },
+
+    /* takes the write lock right away, so a read at the start can't make it fail later */
+    [STATEMENT_BEGIN] = { .src = "BEGIN IMMEDIATE" },
     [STATEMENT_COMMIT] = { .src = "COMMIT" },
     [STATEMENT_ROLLBACK] = { .src = "ROLLBACK" },
 
@@ -94,6 +103,9 @@ struct sqlite_statement statements[] = {
             "PRIMARY KEY ( id, server_id ) "
         ")"
     },
+    [STATEMENT_CREATE_INDEX_CACHED_SONGS_ACCESSED] = { .src =
+        "CREATE INDEX IF NOT EXISTS cached_songs_accessed ON cached_songs ( accessed )"
+    },
 
     [STATEMENT_INSERT_SERVER] = { .src =
         "INSERT INTO servers ( url ) VALUES ( $url ) RETURNING id"
@@ -118,6 +130,41 @@ struct sqlite_statement statements[] = {
     [STATEMENT_MARK_SONGS_AS_DELETED] = { .src =
         "UPDATE songs SET deleted = TRUE WHERE server_id = $server_id"
     },
+    /* marks left over by a sync that failed halfway */
+    [STATEMENT_UNMARK_SONGS_AS_DELETED] = { .src =
+        "UPDATE songs SET deleted = FALSE WHERE deleted = TRUE AND server_id = $server_id"
+    },
+    [STATEMENT_MARK_SONGS_OF_DELETED_ALBUMS_AS_DELETED] = { .src =
+        "UPDATE songs SET deleted = TRUE "
+        "WHERE server_id = $server_id AND album_id IN ( "
+            "SELECT id FROM albums WHERE deleted = TRUE AND server_id = $server_id "
+        ")"
+    },
+    /* getArtists might not return artists that only appear on songs */
+    [STATEMENT_UNMARK_REFERENCED_ARTISTS] = { .src =
+        "UPDATE artists SET deleted = FALSE "
+        "WHERE deleted = TRUE AND server_id = $server_id AND ( "
+            "id IN ( SELECT artist_id FROM albums "
+                    "WHERE deleted = FALSE AND server_id = $server_id ) "
+            "OR id IN ( SELECT artist_id FROM songs "
+                       "WHERE deleted = FALSE AND server_id = $server_id ) "
+        ")"
+    },
+    [STATEMENT_MARK_ALBUM_SONGS_AS_DELETED] = { .src =
+        "UPDATE songs SET deleted = TRUE WHERE album_id = $album_id AND server_id = $server_id"
+    },
+    /*
+     * album is either not in db yet, was added on the server after last sync, or
+     * differs from what's stored (tracks added or removed, retagged)
+     */
+    [STATEMENT_ALBUM_NEEDS_SYNC] = { .src =
+        "SELECT NOT EXISTS ( "
+            "SELECT 1 FROM albums "
+            "WHERE id = $id AND server_id = $server_id "
+                "AND name IS $name AND artist IS $artist "
+                "AND song_count = $song_count AND duration = $duration "
+        ") OR unixepoch($created) >= $last_sync"
+    },
     [STATEMENT_DELETE_DELETED_ARTISTS] = { .src =
         "DELETE FROM artists WHERE ( deleted = TRUE AND server_id = $server_id )"
     },
@@ -128,63 +175,63 @@ struct sqlite_statement statements[] = {
         "DELETE FROM songs WHERE ( deleted = TRUE AND server_id = $server_id )"
     },
 
-    /* The following will break if, let's say, a song "foo" with ID "123" is deleted
-     * on the remote server, and then another song "bar" is added with the same ID.
-     * The old song will remain in our database and new one will never be picked up. */
-    [STATEMENT_INSERT_ARTIST] = { .src =
-        "INSERT INTO artists ( "
-            "id, name, server_id "
-        ") VALUES ( "
-            "$id, $name, $server_id "
-        ") ON CONFLICT DO UPDATE SET deleted = FALSE"
+    [STATEMENT_COUNT_ARTISTS] = { .src =
+        "SELECT count(*) FROM artists WHERE server_id = $server_id"
     },
-    [STATEMENT_INSERT_ALBUM] = { .src =
-        "INSERT INTO albums ( "
-            "id, name, artist, song_count, duration, created, "
-            "artist_id, server_id "
-        ") VALUES ( "
-            "$id, $name, $artist, $song_count, $duration, unixepoch($created), "
-            "$artist_id, $server_id "
-        ") ON CONFLICT DO UPDATE SET deleted = FALSE"
+    [STATEMENT_COUNT_ALBUMS] = { .src =
+        "SELECT count(*) FROM albums WHERE server_id = $server_id"
     },
-    [STATEMENT_INSERT_SONG] = { .src =
-        "INSERT INTO songs ( "
-            "id, title, artist, album, "
-            "track, year, duration, bitrate, size, filetype, "
-            "artist_id, album_id, server_id "
-        ") VALUES ( "
-            "$id, $title, $artist, $album, "
-            "$track, $year, $duration, $bitrate, $size, $filetype, "
-            "$artist_id, $album_id, $server_id "
-        ") ON CONFLICT DO UPDATE SET deleted = FALSE"
+    [STATEMENT_COUNT_SONGS] = { .src =
+        "SELECT count(*) FROM songs WHERE server_id = $server_id"
     },
 
     [STATEMENT_GET_ARTISTS_WITH_PAGINATION] = { .src =
         "SELECT id, name "
         "FROM artists "
         "WHERE server_id = $server_id "
-        "ORDER BY name ASC "
+        "ORDER BY name ASC, id ASC "
         "LIMIT $select_count OFFSET $select_offset"
     },
-    [STATEMENT_SEARCH_ARTISTS_WITH_PAGINATION] = { .src =
+    /*
+     * keyset pagination, returns rows that come after the given one. Its sort key is
+     * passed in rather than looked up, so it works even if that row is gone by now
+     */
+    [STATEMENT_GET_ARTISTS_AFTER] = { .src =
         "SELECT id, name "
         "FROM artists "
-        "WHERE ( ( server_id = $server_id ) AND ( name LIKE '%' || $query || '%' ) )"
-        "ORDER BY name ASC "
+        "WHERE server_id = $server_id AND ( name, id ) > ( $after_name, $after_id ) "
+        "ORDER BY name ASC, id ASC "
+        "LIMIT $select_count"
+    },
+    /* $query is a fts5 query string, see fts_query() in query.c */
+    [STATEMENT_SEARCH_ARTISTS_WITH_PAGINATION] = { .src =
+        "SELECT artists.id, artists.name "
+        "FROM artists_fts JOIN artists ON artists.rowid = artists_fts.rowid "
+        "WHERE ( ( artists_fts MATCH $query ) AND ( artists.server_id = $server_id ) ) "
+        "ORDER BY artists_fts.rank "
         "LIMIT $select_count OFFSET $select_offset"
     },
     [STATEMENT_GET_ALBUMS_WITH_PAGINATION] = { .src =
-        "SELECT id, name, artist, artist_id, song_count, duration "
+        "SELECT id, name, artist, artist_id, song_count, duration, created "
         "FROM albums "
         "WHERE server_id = $server_id "
-        "ORDER BY created DESC "
+        "ORDER BY created DESC, id DESC "
         "LIMIT $select_count OFFSET $select_offset"
     },
-    [STATEMENT_SEARCH_ALBUMS_WITH_PAGINATION] = { .src =
-        "SELECT id, name, artist, artist_id, song_count, duration "
+    [STATEMENT_GET_ALBUMS_AFTER] = { .src =
+        "SELECT id, name, artist, artist_id, song_count, duration, created "
         "FROM albums "
-        "WHERE ( ( server_id = $server_id ) AND ( name LIKE '%' || $query || '%' ) ) "
-        "ORDER BY created DESC "
+        "WHERE server_id = $server_id AND ( created, id ) < ( $after_created, $after_id ) "
+        "ORDER BY created DESC, id DESC "
+        "LIMIT $select_count"
+    },
+    [STATEMENT_SEARCH_ALBUMS_WITH_PAGINATION] = { .src =
+        "SELECT "
+            "albums.id, albums.name, albums.artist, albums.artist_id, "
+            "albums.song_count, albums.duration, albums.created "
+        "FROM albums_fts JOIN albums ON albums.rowid = albums_fts.rowid "
+        "WHERE ( ( albums_fts MATCH $query ) AND ( albums.server_id = $server_id ) ) "
+        "ORDER BY albums_fts.rank "
         "LIMIT $select_count OFFSET $select_offset"
     },
     [STATEMENT_GET_SONGS_WITH_PAGINATION] = { .src =
@@ -194,7 +241,27 @@ struct sqlite_statement statements[] = {
             "artist_id, album_id  "
         "FROM songs "
         "WHERE server_id = $server_id "
-        "ORDER BY title ASC "
+        "ORDER BY title ASC, id ASC "
+        "LIMIT $select_count OFFSET $select_offset"
+    },
+    [STATEMENT_GET_SONGS_AFTER] = { .src =
+        "SELECT "
+            "id, title, artist, album, "
+            "track, year, duration, bitrate, size, filetype, "
+            "artist_id, album_id  "
+        "FROM songs "
+        "WHERE server_id = $server_id AND ( title, id ) > ( $after_title, $after_id ) "
+        "ORDER BY title ASC, id ASC "
+        "LIMIT $select_count"
+    },
+    [STATEMENT_SEARCH_SONGS_WITH_PAGINATION] = { .src =
+        "SELECT "
+            "songs.id, songs.title, songs.artist, songs.album, "
+            "songs.track, songs.year, songs.duration, songs.bitrate, songs.size, songs.filetype, "
+            "songs.artist_id, songs.album_id "
+        "FROM songs_fts JOIN songs ON songs.rowid = songs_fts.rowid "
+        "WHERE ( ( songs_fts MATCH $query ) AND ( songs.server_id = $server_id ) ) "
+        "ORDER BY songs_fts.rank "
         "LIMIT $select_count OFFSET $select_offset"
     },
 
@@ -209,7 +276,7 @@ struct sqlite_statement statements[] = {
     },
 
     [STATEMENT_GET_ALBUMS_FOR_ARTIST] = { .src =
-        "SELECT id, name, artist, artist_id, song_count, duration "
+        "SELECT id, name, artist, artist_id, song_count, duration, created "
         "FROM albums "
         "WHERE ( server_id = $server_id AND artist_id = $artist_id ) "
         "ORDER BY created DESC"
@@ -244,10 +311,71 @@ struct sqlite_statement statements[] = {
         "SET accessed = unixepoch('now') "
         "WHERE ( id = $id AND server_id = $server_id )"
     },
+    /* Walks cached songs from most to least recently accessed, summing up their sizes,
+     * and returns least recently accessed ones that don't fit into $max_size.
+     * Songs from all servers are counted since they share the same directory. */
+    [STATEMENT_GET_CACHED_SONGS_OVER_LIMIT] = { .src =
+        "SELECT server_id, id, filename, filetype, bitrate, size "
+        "FROM ( "
+            "SELECT *, SUM(size) OVER ( "
+                "ORDER BY accessed DESC ROWS UNBOUNDED PRECEDING "
+            ") AS total_size "
+            "FROM cached_songs "
+        ") "
+        "WHERE total_size > $max_size "
+        "ORDER BY accessed ASC "
+        "LIMIT $select_count"
+    },
 };
 static_assert(SIZEOF_VEC(statements) == SQLITE_STATEMENT_TYPE_COUNT);
 
-struct sqlite3 *db = NULL;
+/* The following will break if, let's say, a song "foo" with ID "123" is deleted
+ * on the remote server, and then another song "bar" is added with the same ID.
+ * The old row will be updated in place, and whatever is cached for "foo" will be
+ * played as "bar". */
+thread_local struct sqlite_batch_insert batch_inserts[] = {
+    [BATCH_INSERT_ARTISTS] = {
+        .head = "INSERT INTO artists ( id, name, server_id ) VALUES ",
+        .row = "( ?, ?, ? )",
+        .tail = " ON CONFLICT DO UPDATE SET name = excluded.name, deleted = FALSE",
+        .columns = 3,
+    },
+    [BATCH_INSERT_ALBUMS] = {
+        .head =
+            "INSERT INTO albums ( "
+                "id, name, artist, song_count, duration, created, "
+                "artist_id, server_id "
+            ") VALUES ",
+        .row = "( ?, ?, ?, ?, ?, unixepoch(?), ?, ? )",
+        .tail =
+            " ON CONFLICT DO UPDATE SET "
+                "name = excluded.name, artist = excluded.artist, "
+                "song_count = excluded.song_count, duration = excluded.duration, "
+                "created = excluded.created, artist_id = excluded.artist_id, "
+                "deleted = FALSE",
+        .columns = 8,
+    },
+    [BATCH_INSERT_SONGS] = {
+        .head =
+            "INSERT INTO songs ( "
+                "id, title, artist, album, "
+                "track, year, duration, bitrate, size, filetype, "
+                "artist_id, album_id, server_id "
+            ") VALUES ",
+        .row = "( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )",
+        .tail =
+            " ON CONFLICT DO UPDATE SET "
+                "title = excluded.title, artist = excluded.artist, album = excluded.album, "
+                "track = excluded.track, year = excluded.year, duration = excluded.duration, "
+                "bitrate = excluded.bitrate, size = excluded.size, filetype = excluded.filetype, "
+                "artist_id = excluded.artist_id, album_id = excluded.album_id, "
+                "deleted = FALSE",
+        .columns = 13,
+    },
+};
+static_assert(SIZEOF_VEC(batch_inserts) == SQLITE_BATCH_INSERT_TYPE_COUNT);
+
+thread_local struct sqlite3 *db = NULL;
 
 void statement_resetp(struct sqlite3_stmt *const *pstmt) {
     struct sqlite3_stmt *const stmt = *pstmt;
@@ -261,6 +389,9 @@ bool statement_execute(enum sqlite_statement_type index) {
     [[gnu::cleanup(statement_resetp)]]
     struct sqlite3_stmt *const stmt = statements[index].stmt;
 
+    /* does nothing if statement has no such parameter */
+    STMT_BIND(stmt, int64, "$server_id", config.server_id);
+
     int ret = sqlite3_step(stmt);
     if (ret != SQLITE_DONE) {
         return false;
@@ -269,7 +400,168 @@ bool statement_execute(enum sqlite_statement_type index) {
     return true;
 }
 
-bool db_init(void) {
+/*
+ * Schema changes on top of CREATE TABLE IF NOT EXISTS above. Index in this array + 1
+ * is stored in user_version after migration is applied. Only ever append to this.
+ */
+static const char *const migrations[] = {
+    /* full-text search. fts tables index the implicit rowid of the main tables,
+     * VACUUM can change those, so don't VACUUM without rebuilding fts tables */
+    "CREATE VIRTUAL TABLE artists_fts USING fts5 ( "
+        "name, "
+        "content = 'artists', "
+        "tokenize = 'unicode61 remove_diacritics 2', "
+        "prefix = '2 3' "
+    "); "
+    "CREATE TRIGGER artists_fts_insert AFTER INSERT ON artists BEGIN "
+        "INSERT INTO artists_fts ( rowid, name ) "
+        "VALUES ( new.rowid, new.name ); "
+    "END; "
+    "CREATE TRIGGER artists_fts_delete AFTER DELETE ON artists BEGIN "
+        "INSERT INTO artists_fts ( artists_fts, rowid, name ) "
+        "VALUES ( 'delete', old.rowid, old.name ); "
+    "END; "
+    "CREATE TRIGGER artists_fts_update AFTER UPDATE OF name ON artists BEGIN "
+        "INSERT INTO artists_fts ( artists_fts, rowid, name ) "
+        "VALUES ( 'delete', old.rowid, old.name ); "
+        "INSERT INTO artists_fts ( rowid, name ) "
+        "VALUES ( new.rowid, new.name ); "
+    "END; "
+    "INSERT INTO artists_fts ( artists_fts ) VALUES ( 'rebuild' ); "
+    "CREATE VIRTUAL TABLE albums_fts USING fts5 ( "
+        "name, artist, "
+        "content = 'albums', "
+        "tokenize = 'unicode61 remove_diacritics 2', "
+        "prefix = '2 3' "
+    "); "
+    "CREATE TRIGGER albums_fts_insert AFTER INSERT ON albums BEGIN "
+        "INSERT INTO albums_fts ( rowid, name, artist ) "
+        "VALUES ( new.rowid, new.name, new.artist ); "
+    "END; "
+    "CREATE TRIGGER albums_fts_delete AFTER DELETE ON albums BEGIN "
+        "INSERT INTO albums_fts ( albums_fts, rowid, name, artist ) "
+        "VALUES ( 'delete', old.rowid, old.name, old.artist ); "
+    "END; "
+    "CREATE TRIGGER albums_fts_update AFTER UPDATE OF name, artist ON albums BEGIN "
+        "INSERT INTO albums_fts ( albums_fts, rowid, name, artist ) "
+        "VALUES ( 'delete', old.rowid, old.name, old.artist ); "
+        "INSERT INTO albums_fts ( rowid, name, artist ) "
+        "VALUES ( new.rowid, new.name, new.artist ); "
+    "END; "
+    "INSERT INTO albums_fts ( albums_fts ) VALUES ( 'rebuild' ); "
+    "CREATE VIRTUAL TABLE songs_fts USING fts5 ( "
+        "title, artist, album, "
+        "content = 'songs', "
+        "tokenize = 'unicode61 remove_diacritics 2', "
+        "prefix = '2 3' "
+    "); "
+    "CREATE TRIGGER songs_fts_insert AFTER INSERT ON songs BEGIN "
+        "INSERT INTO songs_fts ( rowid, title, artist, album ) "
+        "VALUES ( new.rowid, new.title, new.artist, new.album ); "
+    "END; "
+    "CREATE TRIGGER songs_fts_delete AFTER DELETE ON songs BEGIN "
+        "INSERT INTO songs_fts ( songs_fts, rowid, title, artist, album ) "
+        "VALUES ( 'delete', old.rowid, old.title, old.artist, old.album ); "
+    "END; "
+    "CREATE TRIGGER songs_fts_update AFTER UPDATE OF title, artist, album ON songs BEGIN "
+        "INSERT INTO songs_fts ( songs_fts, rowid, title, artist, album ) "
+        "VALUES ( 'delete', old.rowid, old.title, old.artist, old.album ); "
+        "INSERT INTO songs_fts ( rowid, title, artist, album ) "
+        "VALUES ( new.rowid, new.title, new.artist, new.album ); "
+    "END; "
+    "INSERT INTO songs_fts ( songs_fts ) VALUES ( 'rebuild' ); ",
+
+    /* indexes for browsing, they match ORDER BY of the queries above */
+    "CREATE INDEX songs_album ON songs ( server_id, album_id, track ); "
+    "CREATE INDEX songs_artist ON songs ( server_id, artist_id ); "
+    "CREATE INDEX songs_title ON songs ( server_id, title, id ); "
+    "CREATE INDEX albums_created ON albums ( server_id, created, id ); "
+    "CREATE INDEX albums_artist ON albums ( server_id, artist_id, created ); "
+    "CREATE INDEX artists_name ON artists ( server_id, name, id ); "
+    "ANALYZE; ",
+
+    /* UPDATE OF fires whenever a column is assigned, even to the same value, and sync
+     * upserts assign all of them. Only reindex rows whose indexed columns did change */
+    "DROP TRIGGER artists_fts_update; "
+    "CREATE TRIGGER artists_fts_update AFTER UPDATE OF name ON artists "
+    "WHEN old.name IS NOT new.name BEGIN "
+        "INSERT INTO artists_fts ( artists_fts, rowid, name ) "
+        "VALUES ( 'delete', old.rowid, old.name ); "
+        "INSERT INTO artists_fts ( rowid, name ) "
+        "VALUES ( new.rowid, new.name ); "
+    "END; "
+    "DROP TRIGGER albums_fts_update; "
+    "CREATE TRIGGER albums_fts_update AFTER UPDATE OF name, artist ON albums "
+    "WHEN old.name IS NOT new.name OR old.artist IS NOT new.artist BEGIN "
+        "INSERT INTO albums_fts ( albums_fts, rowid, name, artist ) "
+        "VALUES ( 'delete', old.rowid, old.name, old.artist ); "
+        "INSERT INTO albums_fts ( rowid, name, artist ) "
+        "VALUES ( new.rowid, new.name, new.artist ); "
+    "END; "
+    "DROP TRIGGER songs_fts_update; "
+    "CREATE TRIGGER songs_fts_update AFTER UPDATE OF title, artist, album ON songs "
+    "WHEN old.title IS NOT new.title OR old.artist IS NOT new.artist "
+        "OR old.album IS NOT new.album BEGIN "
+        "INSERT INTO songs_fts ( songs_fts, rowid, title, artist, album ) "
+        "VALUES ( 'delete', old.rowid, old.title, old.artist, old.album ); "
+        "INSERT INTO songs_fts ( rowid, title, artist, album ) "
+        "VALUES ( new.rowid, new.title, new.artist, new.album ); "
+    "END; ",
+};
+
+static bool run_migrations(void) {
+    struct sqlite3_stmt *stmt = NULL;
+    int ret = sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, NULL);
+    if (ret != SQLITE_OK || sqlite3_step(stmt) != SQLITE_ROW) {
+        ERROR("failed to get db version: %s", sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    const int version = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+
+    for (int i = version; i < (int)SIZEOF_VEC(migrations); i++) {
+        [[gnu::cleanup(cleanup_free)]] char *sql = NULL;
+        xasprintf(&sql, "BEGIN; %s PRAGMA user_version = %d; COMMIT;", migrations[i], i + 1);
+
+        INFO("migrating db from version %d to %d", i, i + 1);
+        ret = sqlite3_exec(db, sql, NULL, NULL, NULL);
+        if (ret != SQLITE_OK) {
+            ERROR("failed to migrate db to version %d: %s", i + 1, sqlite3_errmsg(db));
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool prepare_batch_insert(struct sqlite_batch_insert *b, int rows,
+                                 struct sqlite3_stmt **stmt) {
+    [[gnu::cleanup(string_free)]] struct string sql = {0};
+
+    string_append(&sql, b->head);
+    for (int i = 0; i < rows; i++) {
+        if (i > 0) {
+            string_append(&sql, ", ");
+        }
+        string_append(&sql, b->row);
+    }
+    string_append(&sql, b->tail);
+
+    /* these are prepared once and reused for every page of every sync */
+    int ret = sqlite3_prepare_v3(db, sql.str, -1, SQLITE_PREPARE_PERSISTENT, stmt, NULL);
+    if (ret != SQLITE_OK) {
+        ERROR("failed to prepare sql stmt: %s", sqlite3_errmsg(db));
+        log_println(LOG_ERROR, "%s", sql.str);
+        return false;
+    }
+    assert(sqlite3_bind_parameter_count(*stmt) == rows * b->columns);
+
+    return true;
+}
+
+static bool open_connection(void) {
     int ret = 0;
     [[gnu::cleanup(cleanup_free)]] char *db_path = NULL;
 
@@ -277,12 +569,61 @@ bool db_init(void) {
     ret = sqlite3_open(db_path, &db);
     if (ret != SQLITE_OK) {
         ERROR("failed to open db at %s: %s", db_path, sqlite3_errstr(ret));
-        goto err;
+        return false;
     }
 
+    /* connections of other threads might be holding a lock for a short while */
+    sqlite3_busy_timeout(db, 5000);
+
     ret = sqlite3_exec(db, statements[STATEMENT_ENABLE_FOREIGN_KEYS].src, NULL, NULL, NULL);
     if (ret != SQLITE_OK) {
         ERROR("failed to enable foreign key support: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    /*
+     * WAL lets readers work while sync is writing, and with it synchronous = NORMAL
+     * only syncs on checkpoints. Worst case a crash loses the last transaction,
+     * which for us is a sync that can be redone.
+     */
+    ret = sqlite3_exec(db,
+                       "PRAGMA journal_mode = WAL; "
+                       "PRAGMA synchronous = NORMAL; "
+                       "PRAGMA temp_store = MEMORY; "
+                       "PRAGMA mmap_size = 268435456; ",
+                       NULL, NULL, NULL);
+    if (ret != SQLITE_OK) {
+        ERROR("failed to set db pragmas: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+static bool prepare_statements(void) {
+    for (size_t i = 0; i < SIZEOF_VEC(statements); i++) {
+        int ret = sqlite3_prepare_v2(db, statements[i].src, -1, &statements[i].stmt, NULL);
+        if (ret != SQLITE_OK) {
+            ERROR("failed to prepare sql stmt: %s", sqlite3_errmsg(db));
+            log_println(LOG_ERROR, "%s", statements[i].src);
+            return false;
+        }
+    }
+    for (size_t i = 0; i < SIZEOF_VEC(batch_inserts); i++) {
+        struct sqlite_batch_insert *b = &batch_inserts[i];
+        if (!prepare_batch_insert(b, BATCH_INSERT_ROWS, &b->batch)
+            || !prepare_batch_insert(b, 1, &b->single)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool db_init(void) {
+    int ret = 0;
+
+    if (!open_connection()) {
         goto err;
     }
 
@@ -311,25 +652,80 @@ bool db_init(void) {
         ERROR("failed to create song cache table: %s", sqlite3_errmsg(db));
         goto err;
     }
+    ret = sqlite3_exec(db, statements[STATEMENT_CREATE_INDEX_CACHED_SONGS_ACCESSED].src,
+                       NULL, NULL, NULL);
+    if (ret != SQLITE_OK) {
+        ERROR("failed to create song cache index: %s", sqlite3_errmsg(db));
+        goto err;
+    }
 
-    /* prepare statements */
-    for (size_t i = 0; i < SIZEOF_VEC(statements); i++) {
-        ret = sqlite3_prepare_v2(db, statements[i].src, -1, &statements[i].stmt, NULL);
-        if (ret != SQLITE_OK) {
-            ERROR("failed to prepare sql stmt: %s", sqlite3_errmsg(db));
-            log_println(LOG_ERROR, "%s", statements[i].src);
-            goto err;
-        }
+    if (!run_migrations()) {
+        goto err;
+    }
+
+    if (!prepare_statements()) {
+        goto err;
     }
 
     return true;
 
 err:
-    sqlite3_close(db);
+    db_cleanup();
     return false;
 }
 
+bool db_init_thread(void) {
+    if (!open_connection() || !prepare_statements()) {
+        db_cleanup();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Threads we don't own, like the ones mpv opens streams on, get a connection on first use.
+ * Nobody calls db_cleanup on them, so it is done by the key destructor when the thread exits.
+ */
+static pthread_key_t lazy_connection_key;
+static pthread_once_t lazy_connection_once = PTHREAD_ONCE_INIT;
+
+static void lazy_connection_close(void *data) {
+    db_cleanup();
+}
+
+static void lazy_connection_key_create(void) {
+    pthread_key_create(&lazy_connection_key, lazy_connection_close);
+}
+
+bool db_ensure_connection(void) {
+    if (db != NULL) {
+        return true;
+    }
+
+    if (!db_init_thread()) {
+        return false;
+    }
+
+    pthread_once(&lazy_connection_once, lazy_connection_key_create);
+    /* destructor is only called for non-NULL values */
+    pthread_setspecific(lazy_connection_key, db);
+
+    return true;
+}
+
 void db_cleanup(void) {
+    for (size_t i = 0; i < SIZEOF_VEC(statements); i++) {
+        sqlite3_finalize(statements[i].stmt);
+        statements[i].stmt = NULL;
+    }
+    for (size_t i = 0; i < SIZEOF_VEC(batch_inserts); i++) {
+        sqlite3_finalize(batch_inserts[i].batch);
+        sqlite3_finalize(batch_inserts[i].single);
+        batch_inserts[i].batch = batch_inserts[i].single = NULL;
+    }
+
+    /* fails if any statements are not finalized */
     sqlite3_close(db);
     db = NULL;
 }
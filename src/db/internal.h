@@ -10,6 +10,8 @@ struct sqlite_statement {
 
 enum sqlite_statement_type {
     STATEMENT_ENABLE_FOREIGN_KEYS,
+    STATEMENT_SYNC_CACHE_SIZE,
+    STATEMENT_DEFAULT_CACHE_SIZE,
 
     STATEMENT_BEGIN,
     STATEMENT_COMMIT,
@@ -20,6 +22,7 @@ enum sqlite_statement_type {
     STATEMENT_CREATE_TABLE_ALBUMS,
     STATEMENT_CREATE_TABLE_SONGS,
     STATEMENT_CREATE_TABLE_CACHED_SONGS,
+    STATEMENT_CREATE_INDEX_CACHED_SONGS_ACCESSED,
 
     STATEMENT_INSERT_SERVER,
     STATEMENT_GET_SERVER_ID,
@@ -29,19 +32,28 @@ enum sqlite_statement_type {
     STATEMENT_MARK_ARTISTS_AS_DELETED,
     STATEMENT_MARK_ALBUMS_AS_DELETED,
     STATEMENT_MARK_SONGS_AS_DELETED,
+    STATEMENT_UNMARK_SONGS_AS_DELETED,
+    STATEMENT_MARK_SONGS_OF_DELETED_ALBUMS_AS_DELETED,
+    STATEMENT_UNMARK_REFERENCED_ARTISTS,
+    STATEMENT_MARK_ALBUM_SONGS_AS_DELETED,
+    STATEMENT_ALBUM_NEEDS_SYNC,
     STATEMENT_DELETE_DELETED_ARTISTS,
     STATEMENT_DELETE_DELETED_ALBUMS,
     STATEMENT_DELETE_DELETED_SONGS,
 
-    STATEMENT_INSERT_ARTIST,
-    STATEMENT_INSERT_ALBUM,
-    STATEMENT_INSERT_SONG,
+    STATEMENT_COUNT_ARTISTS,
+    STATEMENT_COUNT_ALBUMS,
+    STATEMENT_COUNT_SONGS,
 
     STATEMENT_GET_ARTISTS_WITH_PAGINATION,
+    STATEMENT_GET_ARTISTS_AFTER,
     STATEMENT_SEARCH_ARTISTS_WITH_PAGINATION,
     STATEMENT_GET_ALBUMS_WITH_PAGINATION,
+    STATEMENT_GET_ALBUMS_AFTER,
     STATEMENT_SEARCH_ALBUMS_WITH_PAGINATION,
     STATEMENT_GET_SONGS_WITH_PAGINATION,
+    STATEMENT_GET_SONGS_AFTER,
+    STATEMENT_SEARCH_SONGS_WITH_PAGINATION,
 
     STATEMENT_GET_SONGS_IN_ALBUM,
 
@@ -52,16 +64,48 @@ enum sqlite_statement_type {
     STATEMENT_DELETE_CACHED_SONG,
     STATEMENT_ADD_CACHED_SONG,
     STATEMENT_TOUCH_CACHED_SONG,
+    STATEMENT_GET_CACHED_SONGS_OVER_LIMIT,
 
     SQLITE_STATEMENT_TYPE_COUNT
 };
 
-extern struct sqlite_statement statements[SQLITE_STATEMENT_TYPE_COUNT];
+extern thread_local struct sqlite_statement statements[SQLITE_STATEMENT_TYPE_COUNT];
 
-extern struct sqlite3 *db;
+/* every thread that uses the db has its own connection, see db_init_thread */
+extern thread_local struct sqlite3 *db;
+
+/*
+ * Opens a connection for the calling thread if it doesn't have one yet.
+ * For functions that can be called from threads that never call db_init_thread.
+ */
+bool db_ensure_connection(void);
 
 /* for use with [[gnu::cleanup()]] */
 void statement_resetp(struct sqlite3_stmt *const *stmt);
 /* for running simple statements that dont take arguments and dont return anything */
 bool statement_execute(enum sqlite_statement_type index);
 
+/*
+ * Multi-row INSERT statements used by sync. Parameters are positional, column c
+ * of row r is bound at index r * columns + c + 1, so no name lookups are needed.
+ * Every batch has two statements prepared: one for full batches of BATCH_INSERT_ROWS
+ * rows and one for a single row, which is used for whatever is left over.
+ */
+#define BATCH_INSERT_ROWS 64
+
+struct sqlite_batch_insert {
+    const char *head, *row, *tail;
+    int columns;
+    struct sqlite3_stmt *batch;
+    struct sqlite3_stmt *single;
+};
+
+enum sqlite_batch_insert_type {
+    BATCH_INSERT_ARTISTS,
+    BATCH_INSERT_ALBUMS,
+    BATCH_INSERT_SONGS,
+
+    SQLITE_BATCH_INSERT_TYPE_COUNT
+};
+
+extern thread_local struct sqlite_batch_insert batch_inserts[SQLITE_BATCH_INSERT_TYPE_COUNT];
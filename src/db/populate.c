@@ -1,6 +1,11 @@
+#include <assert.h>
+
 #include "db/populate.h"
 #include "db/internal.h"
+#include "db/query.h"
 #include "api/requests.h"
+#include "xmalloc.h"
+#include "macros.h"
 #include "config.h"
 
 static bool mark_all_as_deleted(void) {
@@ -44,225 +49,775 @@ static bool delete_all_deleted(void) {
     return true;
 }
 
-static bool insert_artist(const struct api_type_artist_id3 *a) {
-    [[gnu::cleanup(statement_resetp)]]
-    struct sqlite3_stmt *stmt = statements[STATEMENT_INSERT_ARTIST].stmt;
+static void bind_artist(struct sqlite3_stmt *stmt, int i, const void *row) {
+    const struct api_type_artist_id3 *a = row;
 
-    STMT_BIND(stmt, int64, "$server_id", config.server_id);
+    sqlite3_bind_text(stmt, i++, a->id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, a->name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, i++, config.server_id);
+}
 
-    STMT_BIND(stmt, text, "$id", a->id, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, text, "$name", a->name, -1, SQLITE_STATIC);
+static void bind_album(struct sqlite3_stmt *stmt, int i, const void *row) {
+    const struct api_type_album_id3 *a = row;
+
+    sqlite3_bind_text(stmt, i++, a->id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, a->name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, a->artist, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, i++, a->song_count);
+    sqlite3_bind_int64(stmt, i++, a->duration);
+    sqlite3_bind_text(stmt, i++, a->created, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, a->artist_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, i++, config.server_id);
+}
 
-    int ret = sqlite3_step(stmt);
-    if (ret != SQLITE_DONE) {
-        ERROR("failed to insert artist %s into db: %s", a->id, sqlite3_errmsg(db));
+static void bind_song(struct sqlite3_stmt *stmt, int i, const void *row) {
+    const struct api_type_child *s = row;
+
+    sqlite3_bind_text(stmt, i++, s->id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, s->title, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, s->artist, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, s->album, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, i++, s->track);
+    sqlite3_bind_int64(stmt, i++, s->year);
+    sqlite3_bind_int64(stmt, i++, s->duration);
+    sqlite3_bind_int64(stmt, i++, s->bit_rate);
+    sqlite3_bind_int64(stmt, i++, s->size);
+    sqlite3_bind_text(stmt, i++, s->suffix, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, s->artist_id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, i++, s->album_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, i++, config.server_id);
+}
+
+/* inserts count rows of given size, BATCH_INSERT_ROWS at a time */
+static bool insert_rows(enum sqlite_batch_insert_type type, const char *name,
+                        const void *rows, size_t size, size_t count,
+                        void (*bind)(struct sqlite3_stmt *stmt, int i, const void *row)) {
+    const struct sqlite_batch_insert *b = &batch_inserts[type];
+
+    for (size_t i = 0; i < count;) {
+        const size_t n = (count - i >= BATCH_INSERT_ROWS) ? BATCH_INSERT_ROWS : 1;
+
+        [[gnu::cleanup(statement_resetp)]]
+        struct sqlite3_stmt *stmt = (n == BATCH_INSERT_ROWS) ? b->batch : b->single;
+
+        for (size_t j = 0; j < n; j++) {
+            bind(stmt, j * b->columns + 1, (const char *)rows + (i + j) * size);
+        }
+
+        int ret = sqlite3_step(stmt);
+        if (ret != SQLITE_DONE) {
+            ERROR("failed to insert %zu %s into db: %s", n, name, sqlite3_errmsg(db));
+            return false;
+        }
+
+        i += n;
+    }
+
+    return true;
+}
+
+static bool insert_artists(const struct api_type_artist_id3 *a, size_t count) {
+    return insert_rows(BATCH_INSERT_ARTISTS, "artists", a, sizeof(*a), count, bind_artist);
+}
+
+static bool insert_albums(const struct api_type_album_id3 *a, size_t count) {
+    return insert_rows(BATCH_INSERT_ALBUMS, "albums", a, sizeof(*a), count, bind_album);
+}
+
+static bool insert_songs(const struct api_type_child *s, size_t count) {
+    return insert_rows(BATCH_INSERT_SONGS, "songs", s, sizeof(*s), count, bind_song);
+}
+
+/* in the order they reference each other */
+enum db_populate_type {
+    ARTISTS,
+    ALBUMS,
+    SONGS,
+    TYPE_COUNT,
+};
+
+static const char *const type_names[] = {
+    [ARTISTS] = "artists",
+    [ALBUMS] = "albums",
+    [SONGS] = "songs",
+};
+static_assert(SIZEOF_VEC(type_names) == TYPE_COUNT);
+
+/*
+ * Up to config.sync_max_requests pages are requested at once. Every page is committed
+ * as soon as it arrives, so types go one after another: albums can only be inserted
+ * once all artists are, and songs once all albums are. Once a page shorter than count
+ * is received, no more pages of that type are requested, and the next type starts when
+ * the pages of this one that are still in flight arrive. Deleted entries are removed
+ * when all types are done and there are no more requests in flight.
+ */
+struct db_populate_data {
+    bool running, failed;
+    size_t count;
+    int in_flight;
+
+    db_populate_callback_t callback;
+    void *callback_data;
+
+    struct {
+        size_t next_offset;
+        int in_flight;
+        bool done;
+    } types[TYPE_COUNT];
+    enum db_populate_type type; /* the one being requested */
+};
+
+struct db_populate_page {
+    struct db_populate_data *d;
+    enum db_populate_type type;
+    size_t offset;
+};
+
+static void on_db_populate_response(const char *errmsg,
+                                    const struct subsonic_response *resp, void *data);
+
+static void populate_done(struct db_populate_data *d, bool changed) {
+    d->running = false;
+    if (d->callback != NULL) {
+        d->callback(changed, d->callback_data);
+    }
+}
+
+static bool request_page(struct db_populate_data *d, enum db_populate_type type) {
+    struct db_populate_page *page = xmalloc(sizeof(*page));
+    *page = (struct db_populate_page){
+        .d = d,
+        .type = type,
+        .offset = d->types[type].next_offset,
+    };
+
+    DEBUG("db_populate: requesting %zu %s at offset %zu", d->count, type_names[type], page->offset);
+
+    bool ret = false;
+    switch (type) {
+    case ARTISTS:
+        ret = api_search3("", d->count, page->offset, 0, 0, 0, 0, NULL,
+                          on_db_populate_response, page);
+        break;
+    case ALBUMS:
+        ret = api_search3("", 0, 0, d->count, page->offset, 0, 0, NULL,
+                          on_db_populate_response, page);
+        break;
+    case SONGS:
+        ret = api_search3("", 0, 0, 0, 0, d->count, page->offset, NULL,
+                          on_db_populate_response, page);
+        break;
+    case TYPE_COUNT:
+        assert(0 && "UNREACHABLE: TYPE_COUNT");
+    }
+
+    if (!ret) {
+        free(page);
+        return false;
+    }
+
+    d->types[type].next_offset += d->count;
+    d->types[type].in_flight += 1;
+    d->in_flight += 1;
+
+    return true;
+}
+
+/* keeps requesting pages until there are enough requests in flight or nothing left to request */
+static bool request_more_pages(struct db_populate_data *d) {
+    while (d->in_flight < config.sync_max_requests) {
+        if (d->types[d->type].done) {
+            if (d->types[d->type].in_flight > 0 || d->type + 1 == TYPE_COUNT) {
+                break;
+            }
+            d->type += 1;
+            continue;
+        }
+
+        if (!request_page(d, d->type)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool insert_page(enum db_populate_type type, const struct api_type_search_result_3 *sr3,
+                        size_t *count) {
+    switch (type) {
+    case ARTISTS:
+        if (!insert_artists(VEC_DATA(&sr3->artist), VEC_SIZE(&sr3->artist))) {
+            return false;
+        }
+        *count = VEC_SIZE(&sr3->artist);
+        break;
+    case ALBUMS:
+        if (!insert_albums(VEC_DATA(&sr3->album), VEC_SIZE(&sr3->album))) {
+            return false;
+        }
+        *count = VEC_SIZE(&sr3->album);
+        break;
+    case SONGS:
+        if (!insert_songs(VEC_DATA(&sr3->song), VEC_SIZE(&sr3->song))) {
+            return false;
+        }
+        *count = VEC_SIZE(&sr3->song);
+        break;
+    case TYPE_COUNT:
+        assert(0 && "UNREACHABLE: TYPE_COUNT");
+    }
+
+    return true;
+}
+
+/* big page cache keeps indexes of tables being written to in memory during sync */
+static void grow_cache(void) {
+    if (!statement_execute(STATEMENT_SYNC_CACHE_SIZE)) {
+        WARN("failed to grow db cache: %s", sqlite3_errmsg(db));
+    }
+}
+
+static void shrink_cache(void) {
+    if (!statement_execute(STATEMENT_DEFAULT_CACHE_SIZE)) {
+        WARN("failed to shrink db cache: %s", sqlite3_errmsg(db));
+    }
+}
+
+/*
+ * Every response is written in its own transaction, so the write lock is never held
+ * while waiting for the network, and other connections (mpv threads opening cached songs,
+ * cache bookkeeping on the main loop) wait for one page at most. Rows are only deleted
+ * in the last one, so a sync that fails halfway leaves everything that was there.
+ */
+static bool begin(void) {
+    if (!statement_execute(STATEMENT_BEGIN)) {
+        ERROR("db_populate: failed to start transaction: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+static bool commit(void) {
+    if (!statement_execute(STATEMENT_COMMIT)) {
+        ERROR("db_populate: failed to commit transaction: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+/* shared by full and incremental sync, commits the transaction started by caller */
+static bool finish(void) {
+    DEBUG("db_populate: deleting deleted entries");
+    if (!delete_all_deleted()) {
+        return false;
+    };
+
+    if (!db_update_server_last_sync()) {
+        return false;
+    }
+
+    DEBUG("db_populate: committing transaction");
+    if (!commit()) {
+        return false;
+    }
+    shrink_cache();
+
+    DEBUG("db_populate: done.");
+
+    return true;
+}
+
+static void rollback(void) {
+    /* might've failed between transactions */
+    if (!sqlite3_get_autocommit(db)) {
+        DEBUG("db_populate: rolling back transaction");
+        if (!statement_execute(STATEMENT_ROLLBACK)) {
+            ERROR("db_populate: failed to rollback transaction: %s", sqlite3_errmsg(db));
+        }
+    }
+    shrink_cache();
+}
+
+static void fail(struct db_populate_data *d) {
+    rollback();
+
+    /* responses to requests that are still in flight will be ignored */
+    d->failed = true;
+}
+
+static void on_db_populate_response(const char *errmsg,
+                                    const struct subsonic_response *resp, void *data) {
+    struct db_populate_page *page = data;
+    struct db_populate_data *d = page->d;
+    const enum db_populate_type type = page->type;
+    const size_t offset = page->offset;
+    free(page);
+
+    d->in_flight -= 1;
+    d->types[type].in_flight -= 1;
+
+    if (d->failed) {
+        goto out;
+    } else if (errmsg != NULL) {
+        ERROR("while populating db: api error: %s", errmsg);
+        goto err;
+    }
+
+    size_t count = 0;
+    if (!begin()
+        || !insert_page(type, &resp->inner_object.search_result_3, &count)
+        || !commit()) {
+        goto err;
+    }
+    TRACE("db_populate: got %zu %s at offset %zu", count, type_names[type], offset);
+
+    if (count < d->count) {
+        /* there are no more entries of this type */
+        d->types[type].done = true;
+    }
+
+    if (!request_more_pages(d)) {
+        goto err;
+    }
+
+    if (d->in_flight == 0) {
+        /* every type is done and every page is received */
+        if (!begin() || !finish()) {
+            goto err;
+        }
+        populate_done(d, true);
+    }
+
+    return;
+
+err:
+    fail(d);
+out:
+    if (d->in_flight == 0) {
+        populate_done(d, false);
+    }
+}
+
+/*
+ * Incremental sync. getIndexes with ifModifiedSince is used to check if anything
+ * changed at all. If it did, all artists are re-read with getArtists (it's a single
+ * request), and all albums are listed with getAlbumList2, newest first. Albums that
+ * are not in db yet, were added after last sync, or whose name, artist, song count
+ * or duration differ from what's stored are fetched with getAlbum to get their songs.
+ * Albums that were not listed are gone from the server, they are deleted together
+ * with their songs. Songs of other albums are left alone, so a retag that doesn't
+ * change any of the above is only picked up by db_populate.
+ */
+struct db_sync_data {
+    bool running, failed;
+    time_t last_sync;
+    int in_flight;
+
+    size_t album_list_count;
+    size_t album_list_offset;
+    bool album_list_done;
+
+    VEC(char *) pending_albums; /* ids of albums that need getAlbum */
+    size_t albums_fetched;
+
+    db_populate_callback_t callback;
+    void *callback_data;
+};
+
+static struct db_populate_data populate_data;
+static struct db_sync_data sync_data;
+
+bool db_populate(db_populate_callback_t callback, void *callback_data) {
+    struct db_populate_data *const d = &populate_data;
+
+    if (d->running || sync_data.running) {
+        ERROR("another db_populate is still not finished");
         return false;
     }
 
+    *d = (struct db_populate_data){
+        .running = true,
+        .count = 5000,
+        .callback = callback,
+        .callback_data = callback_data,
+    };
+
+    grow_cache();
+
+    DEBUG("db_populate: marking all entries as deleted");
+    if (!begin() || !mark_all_as_deleted() || !commit()) {
+        goto err;
+    }
+
+    if (!request_more_pages(d)) {
+        ERROR("db_populate: failed to make requests");
+        goto err;
+    }
+
     return true;
+
+err:
+    fail(d);
+    /* caller knows it failed already */
+    d->callback = NULL;
+    /* some pages might've been requested already, the last response to arrive clears it */
+    if (d->in_flight == 0) {
+        d->running = false;
+    }
+    return false;
+}
+
+static void sync_fail(struct db_sync_data *d) {
+    rollback();
+
+    /* responses to requests that are still in flight will be ignored */
+    d->failed = true;
+}
+
+static void sync_cleanup(struct db_sync_data *d) {
+    VEC_FOREACH(&d->pending_albums, i) {
+        free(*VEC_AT(&d->pending_albums, i));
+    }
+    VEC_FREE(&d->pending_albums);
+    d->running = false;
 }
 
-static bool insert_album(const struct api_type_album_id3 *a) {
+static void sync_done(struct db_sync_data *d, bool changed) {
+    sync_cleanup(d);
+    if (d->callback != NULL) {
+        d->callback(changed, d->callback_data);
+    }
+}
+
+static void on_sync_album_list_response(const char *errmsg,
+                                        const struct subsonic_response *resp, void *data);
+static void on_sync_album_response(const char *errmsg,
+                                   const struct subsonic_response *resp, void *data);
+
+static bool album_needs_sync(const struct db_sync_data *d, const struct api_type_album_id3 *a,
+                             bool *needs_sync) {
     [[gnu::cleanup(statement_resetp)]]
-    struct sqlite3_stmt *stmt = statements[STATEMENT_INSERT_ALBUM].stmt;
+    struct sqlite3_stmt *stmt = statements[STATEMENT_ALBUM_NEEDS_SYNC].stmt;
 
     STMT_BIND(stmt, int64, "$server_id", config.server_id);
-
     STMT_BIND(stmt, text, "$id", a->id, -1, SQLITE_STATIC);
     STMT_BIND(stmt, text, "$name", a->name, -1, SQLITE_STATIC);
     STMT_BIND(stmt, text, "$artist", a->artist, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, text, "$artist_id", a->artist_id, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, text, "$created", a->created, -1, SQLITE_STATIC);
     STMT_BIND(stmt, int64, "$song_count", a->song_count);
     STMT_BIND(stmt, int64, "$duration", a->duration);
+    STMT_BIND(stmt, text, "$created", a->created, -1, SQLITE_STATIC);
+    STMT_BIND(stmt, int64, "$last_sync", d->last_sync);
 
     int ret = sqlite3_step(stmt);
-    if (ret != SQLITE_DONE) {
-        ERROR("failed to insert album %s into db: %s", a->id, sqlite3_errmsg(db));
+    if (ret != SQLITE_ROW) {
+        ERROR("failed to check album %s: %s", a->id, sqlite3_errmsg(db));
         return false;
     }
 
+    *needs_sync = sqlite3_column_int(stmt, 0);
     return true;
 }
 
-static bool insert_song(const struct api_type_child *s) {
+static bool mark_album_songs_as_deleted(const char *album_id) {
     [[gnu::cleanup(statement_resetp)]]
-    struct sqlite3_stmt *stmt = statements[STATEMENT_INSERT_SONG].stmt;
+    struct sqlite3_stmt *stmt = statements[STATEMENT_MARK_ALBUM_SONGS_AS_DELETED].stmt;
 
     STMT_BIND(stmt, int64, "$server_id", config.server_id);
-
-    STMT_BIND(stmt, text, "$id", s->id, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, text, "$title", s->title, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, text, "$artist", s->artist, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, text, "$album", s->album, -1, SQLITE_STATIC);
-
-    STMT_BIND(stmt, int64, "$track", s->track);
-    STMT_BIND(stmt, int64, "$year", s->year);
-    STMT_BIND(stmt, int64, "$duration", s->duration);
-    STMT_BIND(stmt, int64, "$bitrate", s->bit_rate);
-    STMT_BIND(stmt, int64, "$size", s->size);
-
-    STMT_BIND(stmt, text, "$filetype", s->suffix, -1, SQLITE_STATIC);
-
-    STMT_BIND(stmt, text, "$artist_id", s->artist_id, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, text, "$album_id", s->album_id, -1, SQLITE_STATIC);
+    STMT_BIND(stmt, text, "$album_id", album_id, -1, SQLITE_STATIC);
 
     int ret = sqlite3_step(stmt);
     if (ret != SQLITE_DONE) {
-        ERROR("failed to insert song %s into db: %s; song:", s->id, sqlite3_errmsg(db));
-        print_child(s, LOG_ERROR, 0);
+        ERROR("failed to mark songs of album %s as deleted: %s", album_id, sqlite3_errmsg(db));
         return false;
     }
 
     return true;
 }
 
-struct db_populate_data {
-    enum { START, ARTISTS, ALBUMS, SONGS, END } state;
-    size_t count, offset;
-};
+/* album list pages go first, since they fill pending_albums */
+static bool sync_request_more(struct db_sync_data *d) {
+    while (d->in_flight < config.sync_max_requests) {
+        if (!d->album_list_done) {
+            DEBUG("db_sync: requesting %zu albums at offset %zu",
+                  d->album_list_count, d->album_list_offset);
+            if (!api_get_album_list_2("newest", d->album_list_count, d->album_list_offset,
+                                      -1, -1, NULL, NULL, on_sync_album_list_response, d)) {
+                return false;
+            }
+            d->album_list_offset += d->album_list_count;
+        } else if (VEC_SIZE(&d->pending_albums) > 0) {
+            char *id = *VEC_AT(&d->pending_albums, -1);
+            VEC_ERASE(&d->pending_albums, -1);
+
+            DEBUG("db_sync: requesting album %s", id);
+            const bool ok = api_get_album(id, on_sync_album_response, d);
+            free(id);
+            if (!ok) {
+                return false;
+            }
+        } else {
+            break;
+        }
 
-static void on_db_populate_response(const char *errmsg,
-                                    const struct subsonic_response *resp, void *data) {
-    struct db_populate_data *d = data;
+        d->in_flight += 1;
+    }
 
-    if (errmsg != NULL) {
-        ERROR("while populating db: api error: %s", errmsg);
+    return true;
+}
+
+static void sync_continue(struct db_sync_data *d) {
+    if (!sync_request_more(d)) {
+        ERROR("db_sync: failed to make requests");
         goto err;
     }
 
-    const struct api_type_search_result_3 *sr3 = &resp->inner_object.search_result_3;
-    switch (d->state) {
-    case START: {
-        DEBUG("db_populate: starting transaction");
-        if (!statement_execute(STATEMENT_BEGIN)) {
-            ERROR("failed to start transaction: %s", sqlite3_errmsg(db));
-            return;
-        }
+    if (d->in_flight == 0) {
+        /* album list is done, all albums are fetched */
+        INFO("db_sync: fetched %zu new or changed albums", d->albums_fetched);
 
-        DEBUG("db_populate: marking all entries as deleted");
-        if (!mark_all_as_deleted()) {
+        if (!begin()) {
             goto err;
-        };
-
-        d->state = ARTISTS;
-        goto artists;
-    }
-    case ARTISTS: {
-        VEC_FOREACH(&sr3->artist, i) {
-            struct api_type_artist_id3 *artist = VEC_AT(&sr3->artist, i);
-            if (!insert_artist(artist)) {
-                goto err;
-            }
         }
-        if (VEC_SIZE(&sr3->artist) < d->count) {
-            /* there are no more entries of this type */
-            d->state = ALBUMS;
-            d->offset = 0;
-            goto albums;
-        } else {
-            d->offset += VEC_SIZE(&sr3->artist);
-            goto artists;
+        if (!statement_execute(STATEMENT_MARK_SONGS_OF_DELETED_ALBUMS_AS_DELETED)) {
+            ERROR("db_sync: failed to mark songs of deleted albums: %s", sqlite3_errmsg(db));
+            goto err;
         }
-        break;
-    }
-    case ALBUMS: {
-        VEC_FOREACH(&sr3->album, i) {
-            struct api_type_album_id3 *album = VEC_AT(&sr3->album, i);
-            if (!insert_album(album)) {
-                goto err;
-            }
+        if (!statement_execute(STATEMENT_UNMARK_REFERENCED_ARTISTS)) {
+            ERROR("db_sync: failed to unmark referenced artists: %s", sqlite3_errmsg(db));
+            goto err;
         }
-        if (VEC_SIZE(&sr3->album) < d->count) {
-            /* there are no more entries of this type */
-            d->state = SONGS;
-            d->offset = 0;
-            goto songs;
-        } else {
-            d->offset += VEC_SIZE(&sr3->album);
-            goto albums;
+        if (!finish()) {
+            goto err;
         }
-        break;
+        sync_done(d, true);
     }
-    case SONGS: {
-        VEC_FOREACH(&sr3->song, i) {
-            struct api_type_child *child = VEC_AT(&sr3->song, i);
-            if (!insert_song(child)) {
-                goto err;
-            }
+
+    return;
+
+err:
+    sync_fail(d);
+    if (d->in_flight == 0) {
+        sync_done(d, false);
+    }
+}
+
+static void on_sync_album_response(const char *errmsg,
+                                   const struct subsonic_response *resp, void *data) {
+    struct db_sync_data *d = data;
+
+    d->in_flight -= 1;
+
+    if (d->failed) {
+        goto out;
+    } else if (errmsg != NULL) {
+        ERROR("while syncing db: api error: %s", errmsg);
+        goto err;
+    }
+
+    const struct api_type_album_with_songs_id3 *a = &resp->inner_object.album_with_songs_id3;
+    if (!begin() || !insert_albums(&a->album, 1)) {
+        goto err;
+    }
+    /* songs that are not returned anymore will stay marked and get deleted */
+    if (!mark_album_songs_as_deleted(a->album.id)) {
+        goto err;
+    }
+    if (!insert_songs(VEC_DATA(&a->song), VEC_SIZE(&a->song)) || !commit()) {
+        goto err;
+    }
+    d->albums_fetched += 1;
+
+    sync_continue(d);
+    return;
+
+err:
+    sync_fail(d);
+out:
+    if (d->in_flight == 0) {
+        sync_done(d, false);
+    }
+}
+
+static void on_sync_album_list_response(const char *errmsg,
+                                        const struct subsonic_response *resp, void *data) {
+    struct db_sync_data *d = data;
+    VEC(struct api_type_album_id3) unchanged = {0};
+
+    d->in_flight -= 1;
+
+    if (d->failed) {
+        goto out;
+    } else if (errmsg != NULL) {
+        ERROR("while syncing db: api error: %s", errmsg);
+        goto err;
+    }
+
+    if (!begin()) {
+        goto err;
+    }
+
+    const struct api_type_album_list_2 *list = &resp->inner_object.album_list_2;
+    VEC_FOREACH(&list->album, i) {
+        const struct api_type_album_id3 *a = VEC_AT(&list->album, i);
+
+        bool needs_sync;
+        if (!album_needs_sync(d, a, &needs_sync)) {
+            goto err;
         }
-        if (VEC_SIZE(&sr3->song) < d->count) {
-            /* there are no more entries of this type */
-            goto fin;
+        /*
+         * Changed albums are inserted together with their songs. If sync fails before
+         * that, they must still look changed to the next one.
+         */
+        if (needs_sync) {
+            char *id = xstrdup(a->id);
+            VEC_APPEND(&d->pending_albums, &id);
         } else {
-            d->offset += VEC_SIZE(&sr3->song);
-            goto songs;
+            VEC_APPEND(&unchanged, a);
         }
-        break;
     }
-    case END: {
-        assert(0 && "UNREACHABLE: END");
+    /* unmarks them as deleted */
+    if (!insert_albums(VEC_DATA(&unchanged), VEC_SIZE(&unchanged)) || !commit()) {
+        goto err;
     }
+    VEC_FREE(&unchanged);
+
+    if (VEC_SIZE(&list->album) < d->album_list_count) {
+        d->album_list_done = true;
     }
 
-artists:
-    DEBUG("db_populate: requesting %zu artists at offset %zu", d->count, d->offset);
-    api_search3("", d->count, d->offset, 0, 0, 0, 0, NULL, on_db_populate_response, d);
+    sync_continue(d);
     return;
 
-albums:
-    DEBUG("db_populate: requesting %zu albums at offset %zu", d->count, d->offset);
-    api_search3("", 0, 0, d->count, d->offset, 0, 0, NULL, on_db_populate_response, d);
-    return;
+err:
+    VEC_FREE(&unchanged);
+    sync_fail(d);
+out:
+    if (d->in_flight == 0) {
+        sync_done(d, false);
+    }
+}
 
-songs:
-    DEBUG("db_populate: requesting %zu songs at offset %zu", d->count, d->offset);
-    api_search3("", 0, 0, 0, 0, d->count, d->offset, NULL, on_db_populate_response, d);
-    return;
+static void on_sync_artists_response(const char *errmsg,
+                                     const struct subsonic_response *resp, void *data) {
+    struct db_sync_data *d = data;
 
-fin:
-    DEBUG("db_populate: deleting deleted entries");
-    if (!delete_all_deleted()) {
-        goto err;
-    };
+    d->in_flight -= 1;
 
-    DEBUG("db_populate: committing transaction");
-    if (!statement_execute(STATEMENT_COMMIT)) {
-        ERROR("db_populate: failed to commit transaction: %s", sqlite3_errmsg(db));
+    if (errmsg != NULL) {
+        ERROR("while syncing db: api error: %s", errmsg);
         goto err;
     }
 
-    DEBUG("db_populate: done.");
-
-    d->state = END;
+    if (!begin()) {
+        goto err;
+    }
+    const struct api_type_artists_id3 *artists = &resp->inner_object.artists_id3;
+    VEC_FOREACH(&artists->index, i) {
+        const struct api_type_index_id3 *index = VEC_AT(&artists->index, i);
+        if (!insert_artists(VEC_DATA(&index->artist), VEC_SIZE(&index->artist))) {
+            goto err;
+        }
+    }
+    if (!commit()) {
+        goto err;
+    }
 
+    sync_continue(d);
     return;
 
 err:
-    DEBUG("db_populate: rolling back transaction");
-    if (!statement_execute(STATEMENT_ROLLBACK)) {
-        ERROR("db_populate: failed to rollback transaction: %s", sqlite3_errmsg(db));
+    sync_fail(d);
+    sync_done(d, false);
+}
+
+static void on_sync_indexes_response(const char *errmsg,
+                                     const struct subsonic_response *resp, void *data) {
+    struct db_sync_data *d = data;
+
+    d->in_flight -= 1;
+
+    if (errmsg != NULL) {
+        WARN("db_sync: getIndexes failed (%s), falling back to full sync", errmsg);
+        goto full;
     }
 
-    d->state = END;
+    const int64_t last_modified = resp->inner_object.indexes.last_modified;
+    if (last_modified > 0 && last_modified <= (int64_t)d->last_sync * 1000) {
+        INFO("db_sync: library did not change since last sync");
+        sync_done(d, false);
+        return;
+    }
+
+    grow_cache();
+
+    DEBUG("db_sync: marking entries as deleted");
+    if (!begin()) {
+        goto err;
+    }
+    /*
+     * Albums and artists that are still there will get unmarked. Songs are only marked
+     * album by album, but a full sync that failed halfway might've left all of them marked.
+     */
+    if (!statement_execute(STATEMENT_MARK_ARTISTS_AS_DELETED)
+        || !statement_execute(STATEMENT_MARK_ALBUMS_AS_DELETED)
+        || !statement_execute(STATEMENT_UNMARK_SONGS_AS_DELETED)) {
+        ERROR("failed to mark entries as deleted: %s", sqlite3_errmsg(db));
+        goto err;
+    }
+    if (!commit()) {
+        goto err;
+    }
+
+    DEBUG("db_sync: requesting artists");
+    if (!api_get_artists(NULL, on_sync_artists_response, d)) {
+        goto err;
+    }
+    d->in_flight += 1;
 
     return;
+
+err:
+    sync_fail(d);
+    sync_done(d, false);
+    return;
+
+full:
+    sync_cleanup(d);
+    if (!db_populate(d->callback, d->callback_data) && d->callback != NULL) {
+        d->callback(false, d->callback_data);
+    }
 }
 
-bool db_populate(void) {
-    static struct db_populate_data data = {
-        .count = 5000,
-        .offset = 0,
-        .state = END,
+bool db_sync(db_populate_callback_t callback, void *callback_data) {
+    struct db_sync_data *const d = &sync_data;
+
+    if (d->running || populate_data.running) {
+        ERROR("another db_populate is still not finished");
+        return false;
+    }
+
+    const time_t last_sync = db_get_server_last_sync();
+    if (last_sync <= 0) {
+        DEBUG("db_sync: never synced before, doing full sync");
+        return db_populate(callback, callback_data);
+    }
+
+    *d = (struct db_sync_data){
+        .running = true,
+        .last_sync = last_sync,
+        .album_list_count = 500, /* max allowed by api */
+        .callback = callback,
+        .callback_data = callback_data,
     };
 
-    if (data.state != END) {
-        ERROR("state is not END (another db_populate is still not finished?)");
+    DEBUG("db_sync: checking for changes since %li", last_sync);
+    if (!api_get_indexes(NULL, (int64_t)last_sync * 1000, on_sync_indexes_response, d)) {
+        d->running = false;
         return false;
     }
+    d->in_flight += 1;
 
-    data.state = START;
-    on_db_populate_response(NULL, NULL, &data); /* kickstart it */
     return true;
 }
-
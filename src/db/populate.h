@@ -1,7 +1,16 @@
 #ifndef SRC_DB_POPULATE_H
 #define SRC_DB_POPULATE_H
 
-bool db_populate(void);
+/*
+ * Called on the main loop once sync is over, unless starting it failed.
+ * changed is false if sync failed or there was nothing new on the server.
+ */
+typedef void (*db_populate_callback_t)(bool changed, void *userdata);
+
+/* downloads the entire library from the server */
+bool db_populate(db_populate_callback_t callback, void *callback_data);
+/* only downloads what changed since last sync, falls back to db_populate if it can't */
+bool db_sync(db_populate_callback_t callback, void *callback_data);
 
 #endif /* #ifndef SRC_DB_POPULATE_H */
 
@@ -1,10 +1,47 @@
+#include <string.h>
+
 #include "db/query.h"
 #include "db/internal.h"
 #include "collections/vec.h"
+#include "collections/string.h"
+#include "collections/intern.h"
 #include "xmalloc.h"
 #include "config.h"
 #include "log.h"
 
+/* read a row returned by one of the statements, they all select columns in the same order */
+static void column_artist(struct sqlite3_stmt *stmt, struct artist *a) {
+    a->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
+    a->name = xstrdup((char *)sqlite3_column_text(stmt, 1));
+}
+
+static void column_album(struct sqlite3_stmt *stmt, struct album *a) {
+    a->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
+    a->name = xstrdup((char *)sqlite3_column_text(stmt, 1));
+    a->artist = intern((char *)sqlite3_column_text(stmt, 2));
+    a->artist_id = intern((char *)sqlite3_column_text(stmt, 3));
+    a->song_count = sqlite3_column_int(stmt, 4);
+    a->duration = sqlite3_column_int(stmt, 5);
+    a->created = sqlite3_column_int64(stmt, 6);
+}
+
+static void column_song(struct sqlite3_stmt *stmt, struct song *s) {
+    s->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
+    s->title = xstrdup((char *)sqlite3_column_text(stmt, 1));
+    s->artist = intern((char *)sqlite3_column_text(stmt, 2));
+    s->album = intern((char *)sqlite3_column_text(stmt, 3));
+
+    s->track = sqlite3_column_int(stmt, 4);
+    s->year = sqlite3_column_int(stmt, 5);
+    s->duration = sqlite3_column_int(stmt, 6);
+    s->bitrate = sqlite3_column_int(stmt, 7);
+    s->size = sqlite3_column_int(stmt, 8);
+
+    s->filetype = xstrdup((char *)sqlite3_column_text(stmt, 9));
+    s->artist_id = intern((char *)sqlite3_column_text(stmt, 10));
+    s->album_id = intern((char *)sqlite3_column_text(stmt, 11));
+}
+
 int64_t db_add_server(const char *url) {
     [[gnu::cleanup(statement_resetp)]]
     struct sqlite3_stmt *stmt = statements[STATEMENT_INSERT_SERVER].stmt;
@@ -41,14 +78,103 @@ int64_t db_get_server_id(const char *url) {
     return id;
 }
 
-size_t db_search_artists(struct artist **partists, const char *query,
-                         size_t page, size_t artists_per_page) {
+static size_t count_rows(enum sqlite_statement_type type, const char *what) {
+    [[gnu::cleanup(statement_resetp)]]
+    struct sqlite3_stmt *stmt = statements[type].stmt;
+
+    STMT_BIND(stmt, int64, "$server_id", config.server_id);
+
+    int ret = sqlite3_step(stmt);
+    if (ret != SQLITE_ROW) {
+        ERROR("failed to count %s in the db: %s", what, sqlite3_errmsg(db));
+        return 0;
+    }
+
+    return sqlite3_column_int64(stmt, 0);
+}
+
+size_t db_count_artists(void) {
+    return count_rows(STATEMENT_COUNT_ARTISTS, "artists");
+}
+
+size_t db_count_albums(void) {
+    return count_rows(STATEMENT_COUNT_ALBUMS, "albums");
+}
+
+size_t db_count_songs(void) {
+    return count_rows(STATEMENT_COUNT_SONGS, "songs");
+}
+
+/*
+ * Turns user input into fts5 query where every word is matched as a prefix,
+ * so "pink flo" becomes "pink"* "flo"*. Returns false if there are no words.
+ */
+static bool fts_query(struct string *out, const char *query) {
+    bool empty = true;
+
+    while (*query != '\0') {
+        const size_t skip = strspn(query, " \t\n");
+        query += skip;
+        const size_t len = strcspn(query, " \t\n");
+        if (len == 0) {
+            break;
+        }
+
+        string_append(out, empty ? "\"" : " \"");
+        for (size_t i = 0; i < len; i++) {
+            /* double quotes are escaped by doubling them */
+            string_append(out, query[i] == '"' ? "\"\"" : (char[]){ query[i], '\0' });
+        }
+        string_append(out, "\"*");
+
+        query += len;
+        empty = false;
+    }
+
+    return !empty;
+}
+
+time_t db_get_server_last_sync(void) {
+    [[gnu::cleanup(statement_resetp)]]
+    struct sqlite3_stmt *stmt = statements[STATEMENT_GET_SERVER_LAST_SYNC].stmt;
+
+    STMT_BIND(stmt, int64, "$id", config.server_id);
+
+    int ret = sqlite3_step(stmt);
+    if (ret != SQLITE_ROW) {
+        ERROR("failed to get last sync time for server %li: %s",
+              config.server_id, sqlite3_errmsg(db));
+        return 0;
+    }
+
+    return sqlite3_column_int64(stmt, 0);
+}
+
+bool db_update_server_last_sync(void) {
+    [[gnu::cleanup(statement_resetp)]]
+    struct sqlite3_stmt *stmt = statements[STATEMENT_UPDATE_SERVER_LAST_SYNC].stmt;
+
+    STMT_BIND(stmt, int64, "$id", config.server_id);
+
+    int ret = sqlite3_step(stmt);
+    if (ret != SQLITE_DONE) {
+        ERROR("failed to update last sync time for server %li: %s",
+              config.server_id, sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+static size_t select_artists(struct artist **partists, const char *query,
+                             size_t offset, size_t count) {
     [[gnu::cleanup(statement_resetp)]]
     struct sqlite3_stmt *stmt = NULL;
 
     VEC(struct artist) artists = {0};
 
-    if (query == NULL) {
+    [[gnu::cleanup(string_free)]] struct string fts = {0};
+    if (query == NULL || !fts_query(&fts, query)) {
         stmt = statements[STATEMENT_GET_ARTISTS_WITH_PAGINATION].stmt;
     } else {
         stmt = statements[STATEMENT_SEARCH_ARTISTS_WITH_PAGINATION].stmt;
@@ -56,18 +182,15 @@ size_t db_search_artists(struct artist **partists, const char *query,
 
     STMT_BIND(stmt, int64, "$server_id", config.server_id);
 
-    STMT_BIND(stmt, int64, "$select_count", artists_per_page);
-    STMT_BIND(stmt, int64, "$select_offset", page * artists_per_page);
-    if (query != NULL) {
-        STMT_BIND(stmt, text, "$query", query, -1, SQLITE_STATIC);
+    STMT_BIND(stmt, int64, "$select_count", count);
+    STMT_BIND(stmt, int64, "$select_offset", offset);
+    if (fts.str != NULL) {
+        STMT_BIND(stmt, text, "$query", fts.str, -1, SQLITE_STATIC);
     }
 
     int ret;
     while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
-        struct artist *a = VEC_EMPLACE_BACK(&artists);
-
-        a->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
-        a->name = xstrdup((char *)sqlite3_column_text(stmt, 1));
+        column_artist(stmt, VEC_EMPLACE_BACK(&artists));
     }
     if (ret != SQLITE_DONE) {
         ERROR("failed to fetch albums from db: %s", sqlite3_errmsg(db));
@@ -80,18 +203,24 @@ size_t db_search_artists(struct artist **partists, const char *query,
     return VEC_SIZE(&artists);
 }
 
-size_t db_get_artists(struct artist **artists, size_t page, size_t artists_per_page) {
-    return db_search_artists(artists, NULL, page, artists_per_page);
+size_t db_search_artists(struct artist **partists, const char *query,
+                         size_t page, size_t artists_per_page) {
+    return select_artists(partists, query, page * artists_per_page, artists_per_page);
 }
 
-size_t db_search_albums(struct album **palbums, const char *query,
-                        size_t page, size_t albums_per_page) {
+size_t db_get_artists(struct artist **partists, size_t offset, size_t count) {
+    return select_artists(partists, NULL, offset, count);
+}
+
+static size_t select_albums(struct album **palbums, const char *query,
+                            size_t offset, size_t count) {
     [[gnu::cleanup(statement_resetp)]]
     struct sqlite3_stmt *stmt = NULL;
 
     VEC(struct album) albums = {0};
 
-    if (query == NULL) {
+    [[gnu::cleanup(string_free)]] struct string fts = {0};
+    if (query == NULL || !fts_query(&fts, query)) {
         stmt = statements[STATEMENT_GET_ALBUMS_WITH_PAGINATION].stmt;
     } else {
         stmt = statements[STATEMENT_SEARCH_ALBUMS_WITH_PAGINATION].stmt;
@@ -99,22 +228,15 @@ size_t db_search_albums(struct album **palbums, const char *query,
 
     STMT_BIND(stmt, int64, "$server_id", config.server_id);
 
-    STMT_BIND(stmt, int64, "$select_count", albums_per_page);
-    STMT_BIND(stmt, int64, "$select_offset", page * albums_per_page);
-    if (query != NULL) {
-        STMT_BIND(stmt, text, "$query", query, -1, SQLITE_STATIC);
+    STMT_BIND(stmt, int64, "$select_count", count);
+    STMT_BIND(stmt, int64, "$select_offset", offset);
+    if (fts.str != NULL) {
+        STMT_BIND(stmt, text, "$query", fts.str, -1, SQLITE_STATIC);
     }
 
     int ret;
     while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
-        struct album *a = VEC_EMPLACE_BACK(&albums);
-
-        a->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
-        a->name = xstrdup((char *)sqlite3_column_text(stmt, 1));
-        a->artist = xstrdup((char *)sqlite3_column_text(stmt, 2));
-        a->artist_id = xstrdup((char *)sqlite3_column_text(stmt, 3));
-        a->song_count = sqlite3_column_int(stmt, 4);
-        a->duration = sqlite3_column_int(stmt, 5);
+        column_album(stmt, VEC_EMPLACE_BACK(&albums));
     }
     if (ret != SQLITE_DONE) {
         ERROR("failed to fetch albums from db: %s", sqlite3_errmsg(db));
@@ -127,8 +249,13 @@ size_t db_search_albums(struct album **palbums, const char *query,
     return VEC_SIZE(&albums);
 }
 
-size_t db_get_albums(struct album **palbums, size_t page, size_t albums_per_page) {
-    return db_search_albums(palbums, NULL, page, albums_per_page);
+size_t db_search_albums(struct album **palbums, const char *query,
+                        size_t page, size_t albums_per_page) {
+    return select_albums(palbums, query, page * albums_per_page, albums_per_page);
+}
+
+size_t db_get_albums(struct album **palbums, size_t offset, size_t count) {
+    return select_albums(palbums, NULL, offset, count);
 }
 
 size_t db_get_songs_in_album(struct song **psongs, const struct album *album) {
@@ -142,22 +269,7 @@ size_t db_get_songs_in_album(struct song **psongs, const struct album *album) {
 
     int ret;
     while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
-        struct song *s = VEC_EMPLACE_BACK(&songs);
-
-        s->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
-        s->title = xstrdup((char *)sqlite3_column_text(stmt, 1));
-        s->artist = xstrdup((char *)sqlite3_column_text(stmt, 2));
-        s->album = xstrdup((char *)sqlite3_column_text(stmt, 3));
-
-        s->track = sqlite3_column_int(stmt, 4);
-        s->year = sqlite3_column_int(stmt, 5);
-        s->duration = sqlite3_column_int(stmt, 6);
-        s->bitrate = sqlite3_column_int(stmt, 7);
-        s->size = sqlite3_column_int(stmt, 8);
-
-        s->filetype = xstrdup((char *)sqlite3_column_text(stmt, 9));
-        s->artist_id = xstrdup((char *)sqlite3_column_text(stmt, 10));
-        s->album_id = xstrdup((char *)sqlite3_column_text(stmt, 11));
+        column_song(stmt, VEC_EMPLACE_BACK(&songs));
     }
     if (ret != SQLITE_DONE) {
         ERROR("failed to fetch songs from db: %s", sqlite3_errmsg(db));
@@ -181,14 +293,7 @@ size_t db_get_albums_for_artist(struct album **palbums, const struct artist *art
 
     int ret;
     while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
-        struct album *a = VEC_EMPLACE_BACK(&albums);
-
-        a->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
-        a->name = xstrdup((char *)sqlite3_column_text(stmt, 1));
-        a->artist = xstrdup((char *)sqlite3_column_text(stmt, 2));
-        a->artist_id = xstrdup((char *)sqlite3_column_text(stmt, 3));
-        a->song_count = sqlite3_column_int(stmt, 4);
-        a->duration = sqlite3_column_int(stmt, 5);
+        column_album(stmt, VEC_EMPLACE_BACK(&albums));
     }
     if (ret != SQLITE_DONE) {
         ERROR("failed to fetch albums from db: %s", sqlite3_errmsg(db));
@@ -212,22 +317,43 @@ size_t db_get_songs_for_artist(struct song **psongs, const struct artist *artist
 
     int ret;
     while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
-        struct song *s = VEC_EMPLACE_BACK(&songs);
+        column_song(stmt, VEC_EMPLACE_BACK(&songs));
+    }
+    if (ret != SQLITE_DONE) {
+        ERROR("failed to fetch songs from db: %s", sqlite3_errmsg(db));
+        VEC_FREE(&songs);
+        *psongs = NULL;
+        return 0;
+    }
 
-        s->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
-        s->title = xstrdup((char *)sqlite3_column_text(stmt, 1));
-        s->artist = xstrdup((char *)sqlite3_column_text(stmt, 2));
-        s->album = xstrdup((char *)sqlite3_column_text(stmt, 3));
+    *psongs = VEC_DATA(&songs);
+    return VEC_SIZE(&songs);
+}
 
-        s->track = sqlite3_column_int(stmt, 4);
-        s->year = sqlite3_column_int(stmt, 5);
-        s->duration = sqlite3_column_int(stmt, 6);
-        s->bitrate = sqlite3_column_int(stmt, 7);
-        s->size = sqlite3_column_int(stmt, 8);
+static size_t select_songs(struct song **psongs, const char *query,
+                           size_t offset, size_t count) {
+    [[gnu::cleanup(statement_resetp)]]
+    struct sqlite3_stmt *stmt = NULL;
+
+    VEC(struct song) songs = {0};
+
+    [[gnu::cleanup(string_free)]] struct string fts = {0};
+    if (query == NULL || !fts_query(&fts, query)) {
+        stmt = statements[STATEMENT_GET_SONGS_WITH_PAGINATION].stmt;
+    } else {
+        stmt = statements[STATEMENT_SEARCH_SONGS_WITH_PAGINATION].stmt;
+    }
 
-        s->filetype = xstrdup((char *)sqlite3_column_text(stmt, 9));
-        s->artist_id = xstrdup((char *)sqlite3_column_text(stmt, 10));
-        s->album_id = xstrdup((char *)sqlite3_column_text(stmt, 11));
+    STMT_BIND(stmt, int64, "$server_id", config.server_id);
+    STMT_BIND(stmt, int64, "$select_count", count);
+    STMT_BIND(stmt, int64, "$select_offset", offset);
+    if (fts.str != NULL) {
+        STMT_BIND(stmt, text, "$query", fts.str, -1, SQLITE_STATIC);
+    }
+
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        column_song(stmt, VEC_EMPLACE_BACK(&songs));
     }
     if (ret != SQLITE_DONE) {
         ERROR("failed to fetch songs from db: %s", sqlite3_errmsg(db));
@@ -240,34 +366,96 @@ size_t db_get_songs_for_artist(struct song **psongs, const struct artist *artist
     return VEC_SIZE(&songs);
 }
 
-size_t db_get_songs(struct song **psongs, size_t page, size_t songs_per_page) {
+size_t db_search_songs(struct song **psongs, const char *query,
+                       size_t page, size_t songs_per_page) {
+    return select_songs(psongs, query, page * songs_per_page, songs_per_page);
+}
+
+size_t db_get_songs(struct song **psongs, size_t offset, size_t count) {
+    return select_songs(psongs, NULL, offset, count);
+}
+
+size_t db_get_artists_after(struct artist **partists, const struct artist *after, size_t count) {
     [[gnu::cleanup(statement_resetp)]]
-    struct sqlite3_stmt *const stmt = statements[STATEMENT_GET_SONGS_WITH_PAGINATION].stmt;
+    struct sqlite3_stmt *const stmt = after == NULL
+        ? statements[STATEMENT_GET_ARTISTS_WITH_PAGINATION].stmt
+        : statements[STATEMENT_GET_ARTISTS_AFTER].stmt;
 
-    VEC(struct song) songs = {0};
+    VEC(struct artist) artists = {0};
+
+    STMT_BIND(stmt, int64, "$server_id", config.server_id);
+    STMT_BIND(stmt, int64, "$select_count", count);
+    STMT_BIND(stmt, int64, "$select_offset", 0);
+    if (after != NULL) {
+        STMT_BIND(stmt, text, "$after_id", after->id, -1, SQLITE_STATIC);
+        STMT_BIND(stmt, text, "$after_name", after->name, -1, SQLITE_STATIC);
+    }
+
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        column_artist(stmt, VEC_EMPLACE_BACK(&artists));
+    }
+    if (ret != SQLITE_DONE) {
+        ERROR("failed to fetch artists from db: %s", sqlite3_errmsg(db));
+        VEC_FREE(&artists);
+        *partists = NULL;
+        return 0;
+    }
+
+    *partists = VEC_DATA(&artists);
+    return VEC_SIZE(&artists);
+}
+
+size_t db_get_albums_after(struct album **palbums, const struct album *after, size_t count) {
+    [[gnu::cleanup(statement_resetp)]]
+    struct sqlite3_stmt *const stmt = after == NULL
+        ? statements[STATEMENT_GET_ALBUMS_WITH_PAGINATION].stmt
+        : statements[STATEMENT_GET_ALBUMS_AFTER].stmt;
+
+    VEC(struct album) albums = {0};
 
     STMT_BIND(stmt, int64, "$server_id", config.server_id);
-    STMT_BIND(stmt, int64, "$select_count", songs_per_page);
-    STMT_BIND(stmt, int64, "$select_offset", page * songs_per_page);
+    STMT_BIND(stmt, int64, "$select_count", count);
+    STMT_BIND(stmt, int64, "$select_offset", 0);
+    if (after != NULL) {
+        STMT_BIND(stmt, text, "$after_id", after->id, -1, SQLITE_STATIC);
+        STMT_BIND(stmt, int64, "$after_created", after->created);
+    }
 
     int ret;
     while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
-        struct song *s = VEC_EMPLACE_BACK(&songs);
+        column_album(stmt, VEC_EMPLACE_BACK(&albums));
+    }
+    if (ret != SQLITE_DONE) {
+        ERROR("failed to fetch albums from db: %s", sqlite3_errmsg(db));
+        VEC_FREE(&albums);
+        *palbums = NULL;
+        return 0;
+    }
+
+    *palbums = VEC_DATA(&albums);
+    return VEC_SIZE(&albums);
+}
 
-        s->id = xstrdup((char *)sqlite3_column_text(stmt, 0));
-        s->title = xstrdup((char *)sqlite3_column_text(stmt, 1));
-        s->artist = xstrdup((char *)sqlite3_column_text(stmt, 2));
-        s->album = xstrdup((char *)sqlite3_column_text(stmt, 3));
+size_t db_get_songs_after(struct song **psongs, const struct song *after, size_t count) {
+    [[gnu::cleanup(statement_resetp)]]
+    struct sqlite3_stmt *const stmt = after == NULL
+        ? statements[STATEMENT_GET_SONGS_WITH_PAGINATION].stmt
+        : statements[STATEMENT_GET_SONGS_AFTER].stmt;
+
+    VEC(struct song) songs = {0};
 
-        s->track = sqlite3_column_int(stmt, 4);
-        s->year = sqlite3_column_int(stmt, 5);
-        s->duration = sqlite3_column_int(stmt, 6);
-        s->bitrate = sqlite3_column_int(stmt, 7);
-        s->size = sqlite3_column_int(stmt, 8);
+    STMT_BIND(stmt, int64, "$server_id", config.server_id);
+    STMT_BIND(stmt, int64, "$select_count", count);
+    STMT_BIND(stmt, int64, "$select_offset", 0);
+    if (after != NULL) {
+        STMT_BIND(stmt, text, "$after_id", after->id, -1, SQLITE_STATIC);
+        STMT_BIND(stmt, text, "$after_title", after->title, -1, SQLITE_STATIC);
+    }
 
-        s->filetype = xstrdup((char *)sqlite3_column_text(stmt, 9));
-        s->artist_id = xstrdup((char *)sqlite3_column_text(stmt, 10));
-        s->album_id = xstrdup((char *)sqlite3_column_text(stmt, 11));
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        column_song(stmt, VEC_EMPLACE_BACK(&songs));
     }
     if (ret != SQLITE_DONE) {
         ERROR("failed to fetch songs from db: %s", sqlite3_errmsg(db));
@@ -279,4 +467,3 @@ size_t db_get_songs(struct song **psongs, size_t page, size_t songs_per_page) {
     *psongs = VEC_DATA(&songs);
     return VEC_SIZE(&songs);
 }
-
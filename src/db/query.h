@@ -15,12 +15,18 @@ int64_t db_add_server(const char *url);
 time_t db_get_server_last_sync(void);
 bool db_update_server_last_sync(void);
 
-size_t db_get_artists(struct artist **artists, size_t page, size_t artists_per_page);
+/* Number of rows db_get_* would walk through, 0 on error */
+size_t db_count_artists(void);
+size_t db_count_albums(void);
+size_t db_count_songs(void);
+
+/* db_get_* return up to count entries starting at offset, db_search_* work in pages */
+size_t db_get_artists(struct artist **artists, size_t offset, size_t count);
 
 size_t db_search_artists(struct artist **artists, const char *query,
                          size_t page, size_t artists_per_page);
 
-size_t db_get_albums(struct album **albums, size_t page, size_t albums_per_page);
+size_t db_get_albums(struct album **albums, size_t offset, size_t count);
 
 size_t db_search_albums(struct album **albums, const char *query,
                         size_t page, size_t albums_per_page);
@@ -30,7 +36,21 @@ size_t db_get_songs_in_album(struct song **songs, const struct album *album);
 size_t db_get_albums_for_artist(struct album **palbums, const struct artist *artist);
 size_t db_get_songs_for_artist(struct song **psongs, const struct artist *artist);
 
-size_t db_get_songs(struct song **songs, size_t page, size_t songs_per_page);
+/* query is matched against title, artist and album, results are sorted by relevance */
+size_t db_search_songs(struct song **songs, const char *query,
+                       size_t page, size_t songs_per_page);
+
+size_t db_get_songs(struct song **songs, size_t offset, size_t count);
+
+/*
+ * Keyset pagination: return up to count entries that come after the given one, in the
+ * same order as db_get_*. Only its id and sort key are used, so it doesn't have to be
+ * in db anymore. Pass NULL after to get the first page.
+ * Unlike page numbers, this doesn't get slower the further you go.
+ */
+size_t db_get_artists_after(struct artist **artists, const struct artist *after, size_t count);
+size_t db_get_albums_after(struct album **albums, const struct album *after, size_t count);
+size_t db_get_songs_after(struct song **songs, const struct song *after, size_t count);
 
 #endif /* #ifndef SRC_DB_QUERY_H */
 
@@ -0,0 +1,188 @@
+#include "db/worker.h"
+#include "db/init.h"
+#include "db/query.h"
+#include "worker_thread.h"
+#include "xmalloc.h"
+#include "log.h"
+
+enum db_job_type {
+    DB_JOB_SEARCH_ARTISTS,
+    DB_JOB_SEARCH_ALBUMS,
+    DB_JOB_SEARCH_SONGS,
+};
+
+struct db_job {
+    struct worker_job base;
+
+    enum db_job_type type;
+
+    /* arguments */
+    char *query;
+    size_t page, count;
+
+    /* result, which member is set depends on type */
+    union {
+        struct artist *artists;
+        struct album *albums;
+        struct song *songs;
+    } result;
+    size_t nresult;
+
+    union {
+        db_artists_callback_t artists;
+        db_albums_callback_t albums;
+        db_songs_callback_t songs;
+    } callback;
+    void *callback_data;
+};
+
+/* sqlite connections should not be shared between threads, worker opens its own */
+static bool connected = false;
+
+static void db_job_free(struct db_job *job) {
+    for (size_t i = 0; i < job->nresult; i++) {
+        switch (job->type) {
+        case DB_JOB_SEARCH_ARTISTS:
+            artist_free_contents(&job->result.artists[i]);
+            break;
+        case DB_JOB_SEARCH_ALBUMS:
+            album_free_contents(&job->result.albums[i]);
+            break;
+        case DB_JOB_SEARCH_SONGS:
+            song_free_contents(&job->result.songs[i]);
+            break;
+        }
+    }
+    /* all members of the union are pointers, doesn't matter which one gets freed */
+    free(job->result.songs);
+
+    free(job->query);
+    free(job);
+}
+
+/* runs on worker thread */
+static void worker_thread_init(void) {
+    connected = db_init_thread();
+    if (!connected) {
+        ERROR("db worker failed to connect to the db, all queries will return nothing");
+    }
+}
+
+/* runs on worker thread */
+static void worker_thread_cleanup(void) {
+    db_cleanup();
+}
+
+/* runs on worker thread */
+static void db_job_run(struct worker_job *wjob) {
+    struct db_job *job;
+    LIST_GET(job, wjob, base);
+
+    if (!connected) {
+        return;
+    }
+
+    switch (job->type) {
+    case DB_JOB_SEARCH_ARTISTS:
+        job->nresult = db_search_artists(&job->result.artists, job->query, job->page, job->count);
+        break;
+    case DB_JOB_SEARCH_ALBUMS:
+        job->nresult = db_search_albums(&job->result.albums, job->query, job->page, job->count);
+        break;
+    case DB_JOB_SEARCH_SONGS:
+        job->nresult = db_search_songs(&job->result.songs, job->query, job->page, job->count);
+        break;
+    }
+}
+
+/* runs on main loop */
+static void db_job_done(struct worker_job *wjob, bool cleanup) {
+    struct db_job *job;
+    LIST_GET(job, wjob, base);
+
+    if (cleanup) {
+        db_job_free(job);
+        return;
+    }
+
+    switch (job->type) {
+    case DB_JOB_SEARCH_ARTISTS:
+        job->callback.artists(job->result.artists, job->nresult, job->callback_data);
+        break;
+    case DB_JOB_SEARCH_ALBUMS:
+        job->callback.albums(job->result.albums, job->nresult, job->callback_data);
+        break;
+    case DB_JOB_SEARCH_SONGS:
+        job->callback.songs(job->result.songs, job->nresult, job->callback_data);
+        break;
+    }
+
+    /* callback owns the result now */
+    job->result.songs = NULL;
+    job->nresult = 0;
+    db_job_free(job);
+}
+
+/* there is nothing to lose by dropping queries, so pending ones are not finished on exit */
+static struct worker worker = {
+    .name = "db worker",
+    .thread_init = worker_thread_init,
+    .thread_cleanup = worker_thread_cleanup,
+    .run = db_job_run,
+    .done = db_job_done,
+    WORKER_INITIALISER(&worker),
+};
+
+static bool submit_job(struct db_job *job) {
+    if (!worker_submit(&worker, &job->base)) {
+        db_job_free(job);
+        return false;
+    }
+
+    return true;
+}
+
+static struct db_job *db_job_create(enum db_job_type type, void *callback_data) {
+    struct db_job *job = xcalloc(1, sizeof(*job));
+    job->type = type;
+    job->callback_data = callback_data;
+    return job;
+}
+
+bool db_search_artists_async(const char *query, size_t page, size_t artists_per_page,
+                             db_artists_callback_t callback, void *callback_data) {
+    struct db_job *job = db_job_create(DB_JOB_SEARCH_ARTISTS, callback_data);
+    job->query = xstrdup(query);
+    job->page = page;
+    job->count = artists_per_page;
+    job->callback.artists = callback;
+    return submit_job(job);
+}
+
+bool db_search_albums_async(const char *query, size_t page, size_t albums_per_page,
+                            db_albums_callback_t callback, void *callback_data) {
+    struct db_job *job = db_job_create(DB_JOB_SEARCH_ALBUMS, callback_data);
+    job->query = xstrdup(query);
+    job->page = page;
+    job->count = albums_per_page;
+    job->callback.albums = callback;
+    return submit_job(job);
+}
+
+bool db_search_songs_async(const char *query, size_t page, size_t songs_per_page,
+                           db_songs_callback_t callback, void *callback_data) {
+    struct db_job *job = db_job_create(DB_JOB_SEARCH_SONGS, callback_data);
+    job->query = xstrdup(query);
+    job->page = page;
+    job->count = songs_per_page;
+    job->callback.songs = callback;
+    return submit_job(job);
+}
+
+bool db_worker_init(void) {
+    return worker_init(&worker);
+}
+
+void db_worker_cleanup(void) {
+    worker_cleanup(&worker);
+}
@@ -0,0 +1,37 @@
+#ifndef SRC_DB_WORKER_H
+#define SRC_DB_WORKER_H
+
+#include <stddef.h>
+
+#include "types/artist.h"
+#include "types/album.h"
+#include "types/song.h"
+
+/*
+ * Async versions of db_search_* from db/query.h. Queries run on the db worker thread
+ * which has its own connection, results are delivered to the main loop.
+ * Callback takes ownership of the array and has to free it along with its contents.
+ * Arguments are copied, so they don't need to outlive the call.
+ *
+ * There are no async db_get_*: tabs are virtual menus that only fetch the rows on screen
+ * with indexed queries, those don't block for long. Worker doesn't own the only connection
+ * either, every thread that uses the db has its own (see db_init_thread) and sync writes
+ * from the main loop. With WAL, readers don't wait for the writer, and the writer only
+ * holds the lock for one page of sync at a time.
+ */
+typedef void (*db_artists_callback_t)(struct artist *artists, size_t count, void *userdata);
+typedef void (*db_albums_callback_t)(struct album *albums, size_t count, void *userdata);
+typedef void (*db_songs_callback_t)(struct song *songs, size_t count, void *userdata);
+
+bool db_worker_init(void);
+/* Callbacks of queries that didn't finish yet are not called */
+void db_worker_cleanup(void);
+
+bool db_search_artists_async(const char *query, size_t page, size_t artists_per_page,
+                             db_artists_callback_t callback, void *callback_data);
+bool db_search_albums_async(const char *query, size_t page, size_t albums_per_page,
+                            db_albums_callback_t callback, void *callback_data);
+bool db_search_songs_async(const char *query, size_t page, size_t songs_per_page,
+                           db_songs_callback_t callback, void *callback_data);
+
+#endif /* #ifndef SRC_DB_WORKER_H */
@@ -1,10 +1,19 @@
+#include <stdatomic.h>
+#include <inttypes.h>
 #include <semaphore.h>
+#include <pthread.h>
 #include <strings.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <time.h>
 
 #include "log.h"
+#include "collections/mpsc.h"
+#include "xmalloc.h"
+#include "macros.h"
 
 #define LOG_ANSI_COLORS_ERROR "\033[1;31m"
 #define LOG_ANSI_COLORS_WARN  "\033[1;33m"
@@ -12,16 +21,42 @@
 #define LOG_ANSI_COLORS_TRACE "\033[2m"
 #define LOG_ANSI_COLORS_RESET "\033[0m"
 
+/* lines longer than this are formatted straight into their queue node */
+#define LOG_LINE_BUF_SIZE 1024
+/* lines logged while this many are waiting to be written are dropped */
+#define LOG_QUEUE_MAX_LINES 16384
+/* flush thread is woken up early when this many lines are queued */
+#define LOG_FLUSH_BATCH_LINES 256
+#define LOG_FLUSH_INTERVAL_MS 100
+#define LOG_WRITE_BUF_SIZE 65536
+
+struct log_line {
+    struct mpsc_node node;
+    size_t len;
+    char str[];
+};
+
+enum log_level log_runtime_level = LOG_INFO;
+
 struct log_config {
-    FILE *stream;
-    enum log_level loglevel;
+    int fd;
     bool colors;
+
+    /* used when flush thread isn't running, and to keep writes of one line together */
     sem_t sem;
+
+    struct mpsc_queue queue;
+    atomic_size_t queued;
+    atomic_uint_fast64_t dropped, dropped_total;
+
+    pthread_t thread;
+    sem_t wakeup;
+    atomic_bool running;
+    atomic_bool quit;
 };
 
 static struct log_config log_config = {
-    .stream = NULL,
-    .loglevel = LOG_INFO,
+    .fd = -1,
     .colors = false,
 };
 
@@ -43,43 +78,150 @@ enum log_level log_str_to_loglevel(const char *str) {
     }
 }
 
-void log_init(FILE *stream, enum log_level level, bool force_colors) {
-    log_config.stream = stream;
-    log_config.loglevel = level;
-    log_config.colors = force_colors ? true : isatty(fileno(stream));
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        const ssize_t ret = write(log_config.fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return; /* nowhere to report it anyway */
+        }
+        buf += ret;
+        len -= ret;
+    }
+}
+
+/* returns false if queue is empty */
+static bool flush_queued_lines(void) {
+    static char buf[LOG_WRITE_BUF_SIZE];
+    size_t len = 0;
+    bool flushed = false;
+
+    struct mpsc_node *node;
+    while ((node = mpsc_queue_pop(&log_config.queue)) != NULL) {
+        struct log_line *line = CONTAINER_OF(node, line, node);
+        atomic_fetch_sub_explicit(&log_config.queued, 1, memory_order_relaxed);
+        flushed = true;
+
+        if (len + line->len > sizeof(buf)) {
+            write_all(buf, len);
+            len = 0;
+        }
+        if (line->len > sizeof(buf)) {
+            write_all(line->str, line->len);
+        } else {
+            memcpy(&buf[len], line->str, line->len);
+            len += line->len;
+        }
+
+        free(line);
+    }
 
-    sem_init(&log_config.sem, 0, 1);
+    const uint64_t dropped = atomic_exchange_explicit(&log_config.dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        const int ret = snprintf(&buf[len], sizeof(buf) - len,
+                                 "W %d logger: dropped %" PRIu64 " lines\n", gettid(), dropped);
+        if (ret > 0 && (size_t)ret < sizeof(buf) - len) {
+            len += ret;
+        }
+    }
+
+    write_all(buf, len);
+
+    return flushed;
 }
 
-static void log_print_internal(enum log_level level, bool newline, char *message, va_list args) {
-    if (log_config.stream == NULL) {
+static void *log_thread_func(void *) {
+    while (true) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_FLUSH_INTERVAL_MS * 1'000'000;
+        deadline.tv_sec += deadline.tv_nsec / 1'000'000'000;
+        deadline.tv_nsec %= 1'000'000'000;
+
+        while (sem_timedwait(&log_config.wakeup, &deadline) < 0 && errno == EINTR);
+
+        const bool quit = atomic_load(&log_config.quit);
+
+        sem_wait(&log_config.sem);
+        flush_queued_lines();
+        sem_post(&log_config.sem);
+
+        if (quit) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+void log_cleanup(void) {
+    if (!atomic_load(&log_config.running)) {
         return;
     }
 
-    if (level > log_config.loglevel) {
+    /* stop queueing new lines, then write out whatever is left */
+    atomic_store(&log_config.running, false);
+    atomic_store(&log_config.quit, true);
+    sem_post(&log_config.wakeup);
+    pthread_join(log_config.thread, NULL);
+}
+
+void log_init(FILE *stream, enum log_level level, bool force_colors) {
+    static bool initialised = false;
+    if (!initialised) {
+        sem_init(&log_config.sem, 0, 1);
+        sem_init(&log_config.wakeup, 0, 0);
+        mpsc_queue_init(&log_config.queue);
+        atexit(log_cleanup);
+        initialised = true;
+    }
+
+    log_cleanup();
+
+    log_config.fd = (stream != NULL) ? fileno(stream) : -1;
+    log_runtime_level = level;
+    log_config.colors = force_colors ? true : (stream != NULL && isatty(fileno(stream)));
+
+    if (log_config.fd < 0) {
         return;
     }
 
-    sem_wait(&log_config.sem);
+    atomic_store(&log_config.quit, false);
+    int ret = pthread_create(&log_config.thread, NULL, log_thread_func, NULL);
+    if (ret != 0) {
+        fprintf(stderr, "logger error: failed to create flush thread: %s, "
+                        "logging synchronously\n", strerror(ret));
+        return;
+    }
+    atomic_store(&log_config.running, true);
+}
+
+uint64_t log_dropped_lines(void) {
+    return atomic_load_explicit(&log_config.dropped_total, memory_order_relaxed);
+}
 
+static size_t log_format(char *buf, size_t size, enum log_level level, bool newline,
+                         const char *message, va_list args) {
+    static thread_local pid_t tid = 0;
+    if (tid == 0) {
+        tid = gettid();
+    }
+
+    const char *color = "";
     char level_char = '?';
     switch (level) {
     case LOG_ERROR:
-        if (log_config.colors) {
-            fprintf(log_config.stream, LOG_ANSI_COLORS_ERROR);
-        }
+        color = LOG_ANSI_COLORS_ERROR;
         level_char = 'E';
         break;
     case LOG_WARN:
-        if (log_config.colors) {
-            fprintf(log_config.stream, LOG_ANSI_COLORS_WARN);
-        }
+        color = LOG_ANSI_COLORS_WARN;
         level_char = 'W';
         break;
     case LOG_INFO:
-        if (log_config.colors) {
-            fprintf(log_config.stream, LOG_ANSI_COLORS_INFO);
-        }
+        color = LOG_ANSI_COLORS_INFO;
         level_char = 'I';
         break;
     case LOG_DEBUG:
@@ -87,31 +229,92 @@ static void log_print_internal(enum log_level level, bool newline, char *message
         level_char = 'D';
         break;
     case LOG_TRACE:
-        if (log_config.colors) {
-            fprintf(log_config.stream, LOG_ANSI_COLORS_TRACE);
-        }
+        color = LOG_ANSI_COLORS_TRACE;
         level_char = 'T';
         break;
     default:
         fprintf(stderr, "logger error: unknown loglevel %d\n", level);
         abort();
     }
+    if (!log_config.colors) {
+        color = "";
+    }
+
+    size_t len = 0;
+    #define APPEND(func, ...) \
+        do { \
+            const int ret = func(&buf[MIN(len, size)], size - MIN(len, size), __VA_ARGS__); \
+            if (ret > 0) { \
+                len += ret; \
+            } \
+        } while (0)
+
+    APPEND(snprintf, "%s%c %d ", color, level_char, tid);
+    APPEND(vsnprintf, message, args);
+    APPEND(snprintf, "%s%s", (color[0] != '\0') ? LOG_ANSI_COLORS_RESET : "", newline ? "\n" : "");
+
+    #undef APPEND
+
+    return len;
+}
+
+static void log_print_internal(enum log_level level, bool newline, char *message, va_list args) {
+    if (log_config.fd < 0) {
+        return;
+    }
 
-    fprintf(log_config.stream, "%c ", level_char);
-    fprintf(log_config.stream, "%d ", gettid());
+    if (!log_level_enabled(level)) {
+        return;
+    }
+
+    /* warnings and errors are written right away, there might be a crash coming */
+    const bool async = level > LOG_WARN
+        && atomic_load_explicit(&log_config.running, memory_order_relaxed);
+    size_t queued = 0;
+    if (async) {
+        queued = atomic_fetch_add_explicit(&log_config.queued, 1, memory_order_relaxed);
+        if (queued >= LOG_QUEUE_MAX_LINES) {
+            atomic_fetch_sub_explicit(&log_config.queued, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&log_config.dropped, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&log_config.dropped_total, 1, memory_order_relaxed);
+            return;
+        }
+    }
 
-    vfprintf(log_config.stream, message, args);
+    static thread_local char buf[LOG_LINE_BUF_SIZE];
+    va_list args_copy;
+    va_copy(args_copy, args);
+    const size_t len = log_format(buf, sizeof(buf), level, newline, message, args_copy);
+    va_end(args_copy);
 
-    if (log_config.colors) {
-        fprintf(log_config.stream, LOG_ANSI_COLORS_RESET);
+    struct log_line *line = xmalloc(sizeof(*line) + len + 1);
+    line->len = len;
+    if (len < sizeof(buf)) {
+        memcpy(line->str, buf, len + 1);
+    } else {
+        log_format(line->str, len + 1, level, newline, message, args);
     }
-    if (newline) {
-        fprintf(log_config.stream, "\n");
+
+    if (!async) {
+        sem_wait(&log_config.sem);
+        /* whatever is queued came before this line */
+        flush_queued_lines();
+        write_all(line->str, line->len);
+        sem_post(&log_config.sem);
+        free(line);
+        return;
     }
 
-    fflush(log_config.stream);
+    mpsc_queue_push(&log_config.queue, &line->node);
 
-    sem_post(&log_config.sem);
+    if (!atomic_load(&log_config.running)) {
+        /* log_cleanup happened meanwhile and flush thread might've missed this line */
+        sem_wait(&log_config.sem);
+        flush_queued_lines();
+        sem_post(&log_config.sem);
+    } else if ((queued + 1) % LOG_FLUSH_BATCH_LINES == 0) {
+        sem_post(&log_config.wakeup);
+    }
 }
 
 void log_print(enum log_level level, char *message, ...) {
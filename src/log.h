@@ -2,6 +2,7 @@
 #define SRC_LOG_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 enum log_level {
@@ -16,48 +17,54 @@ enum log_level {
 
 enum log_level log_str_to_loglevel(const char *str);
 
+/*
+ * Lines are formatted by the calling thread and written out in batches by a
+ * background thread. If it falls too far behind, new lines are dropped and counted.
+ * Warnings and errors are written before returning, along with everything queued.
+ * Can be called again to switch streams, queued lines go to the old one first.
+ */
 void log_init(FILE *stream, enum log_level level, bool force_colors);
+/* Writes out everything queued and stops the flush thread. Registered with atexit. */
+void log_cleanup(void);
+
+/* Number of lines dropped since start because the queue was full */
+uint64_t log_dropped_lines(void);
 
 [[gnu::format(printf, 2, 3)]]
 void log_print(enum log_level level, char *msg, ...);
 [[gnu::format(printf, 2, 3)]]
 void log_println(enum log_level level, char *msg, ...);
 
-#define TRACE(fmt, ...) \
-    do { \
-        log_println(LOG_TRACE, \
-                    "%s:%-3d " fmt, \
-                    __FILE__, __LINE__ __VA_OPT__(,) __VA_ARGS__); \
-    } while (0)
-
-#define DEBUG(fmt, ...) \
-    do { \
-        log_println(LOG_DEBUG, \
-                    "%s:%-3d " fmt, \
-                    __FILE__, __LINE__ __VA_OPT__(,) __VA_ARGS__); \
-    } while (0)
+/*
+ * Lines below this level are compiled out (set with -Dlog_level=... in meson).
+ * Calls are still type checked, but arguments are never evaluated.
+ */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_TRACE
+#endif
 
-#define INFO(fmt, ...) \
-    do { \
-        log_println(LOG_INFO, \
-                    "%s:%-3d " fmt, \
-                    __FILE__, __LINE__ __VA_OPT__(,) __VA_ARGS__); \
-    } while (0)
+/* set by log_init, don't touch */
+extern enum log_level log_runtime_level;
 
+/* Use this to skip building anything that only gets logged */
+static inline bool log_level_enabled(enum log_level level) {
+    return level <= LOG_MIN_LEVEL && level <= log_runtime_level;
+}
 
-#define WARN(fmt, ...) \
+#define LOG_AT(level, fmt, ...) \
     do { \
-        log_println(LOG_WARN, \
-                    "%s:%-3d " fmt, \
-                    __FILE__, __LINE__ __VA_OPT__(,) __VA_ARGS__); \
+        if (log_level_enabled(level)) { \
+            log_println((level), \
+                        "%s:%-3d " fmt, \
+                        __FILE__, __LINE__ __VA_OPT__(,) __VA_ARGS__); \
+        } \
     } while (0)
 
-#define ERROR(fmt, ...) \
-    do { \
-        log_println(LOG_ERROR, \
-                    "%s:%-3d " fmt, \
-                    __FILE__, __LINE__ __VA_OPT__(,) __VA_ARGS__); \
-    } while (0)
+#define TRACE(fmt, ...) LOG_AT(LOG_TRACE, fmt __VA_OPT__(,) __VA_ARGS__)
+#define DEBUG(fmt, ...) LOG_AT(LOG_DEBUG, fmt __VA_OPT__(,) __VA_ARGS__)
+#define INFO(fmt, ...) LOG_AT(LOG_INFO, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WARN(fmt, ...) LOG_AT(LOG_WARN, fmt __VA_OPT__(,) __VA_ARGS__)
+#define ERROR(fmt, ...) LOG_AT(LOG_ERROR, fmt __VA_OPT__(,) __VA_ARGS__)
 
 #endif /* #ifndef SRC_LOG_H */
 
@@ -1,68 +1,69 @@
+#include <stdatomic.h>
 #include <pthread.h>
+#include <string.h>
 #include <errno.h>
+#include <stdio.h>
 
 #include <curl/curl.h>
 
 #include "network/init.h"
 #include "network/request.h"
 #include "network/events.h"
+#include "collections/mpsc.h"
+#include "config.h"
 #include "collections/vec.h"
 #include "eventloop.h"
 #include "xmalloc.h"
 #include "log.h"
 
-#if 0
+/*
+ * All curl stuff lives in a separate thread with its own event loop, so libcurl is only ever
+ * touched by one thread and no locking is needed. Other threads submit requests through
+ * a lock-free queue and wake the network thread up with an eventfd. Completed requests
+ * are sent back to the main loop the same way, and their callbacks are called there.
+ *
+ * The exception are stream data callbacks, they are called on the network thread
+ * as data arrives so it doesn't have to make a round trip through the main loop.
+ */
 
-#define MTX_LOCK(mutex) \
-    do { \
-        TRACE("%s: trying to lock mutex", __func__); \
-        pthread_mutex_lock(mutex); \
-        TRACE("%s: locked mutex", __func__); \
-    } while (0)
-
-#define MTX_UNLOCK(mutex) \
-    do { \
-        TRACE("%s: trying to unlock mutex", __func__); \
-        pthread_mutex_unlock(mutex); \
-        TRACE("%s: unlocked mutex", __func__); \
-    } while (0)
-
-#else
-
-#define MTX_LOCK(mutex) pthread_mutex_lock(mutex)
-#define MTX_UNLOCK(mutex) pthread_mutex_unlock(mutex)
-
-#endif
+/* how many idle easy handles to keep around for reuse */
+#define EASY_POOL_MAX 16
 
 static struct network_state {
     CURLM *multi;
+    /* dns cache, tls sessions and connections are shared between all requests */
+    CURLSH *share;
+
+    pthread_t thread;
+    bool thread_running;
+    atomic_bool quit;
+
+    /* everything below is only touched by the network thread */
+    struct pollen_loop *loop;
     struct pollen_callback *timer;
+    struct pollen_callback *wakeup;
+    struct mpsc_queue requests;
+    VEC(CURL *) easy_pool;
+
+    /* completed requests, consumed by the main loop */
+    struct pollen_callback *completed_callback;
+    struct mpsc_queue completed;
 
-    /* some stuff for events */
+    /* network thread emits these directly, bursts are coalesced by the emitter */
     struct signal_emitter emitter;
-    int n_connections;
-    size_t download, upload;
+    /* only touched by the network thread */
+    size_t download, upload, n_connections;
     struct timespec last_event_time;
-
-    /* libcurl throws errors when its functions are called from within callbacks,
-     * which won't happen in single-threaded scenarios, but since libmpv lives in
-     * another thread and poisons my entire code with multithreadiness, I need to
-     * slap a mutex on callbacks and libcurl functions */
-    pthread_mutex_t mutex;
-} state = {
-    /* IMPORTANT: IT MUST BE RECURSIVE!!!
-     * curl_multi_add_handle internally calls multi_timerfunction, both of those
-     * lock the mutex. Using a regular mutex causes a DEADLOCK! */
-    .mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP,
-};
+} state;
 
 struct connection_data {
     CURL *easy;
     char *url;
     struct response_headers headers;
     char error[CURL_ERROR_SIZE];
+    const char *errmsg; /* NULL if request succeeded */
 
-    bool stream;
+    struct request_options options;
     VEC(uint8_t) received;
 
     /* for events */
@@ -71,6 +72,8 @@ struct connection_data {
     bool cancelled;
     request_callback_t callback;
     void *callback_data;
+
+    struct mpsc_node node;
 };
 
 struct socket_data {
@@ -113,9 +116,42 @@ static int timespec_cmp(const struct timespec *lhs, const struct timespec *rhs)
     }
 }
 
-static size_t easy_writefunction(void *ptr, size_t size, size_t nmemb, void *data) {
-    MTX_LOCK(&state.mutex);
+/* runs on network thread */
+static CURL *easy_get(struct network_state *global_data) {
+    if (VEC_SIZE(&global_data->easy_pool) > 0) {
+        CURL *easy = *VEC_AT(&global_data->easy_pool, -1);
+        VEC_ERASE(&global_data->easy_pool, -1);
+
+        /* keeps live connections, dns cache and tls session cache */
+        curl_easy_reset(easy);
+        return easy;
+    }
+
+    return curl_easy_init();
+}
 
+/* runs on network thread */
+static void easy_put(struct network_state *global_data, CURL *easy) {
+    if (VEC_SIZE(&global_data->easy_pool) < EASY_POOL_MAX) {
+        VEC_APPEND(&global_data->easy_pool, &easy);
+    } else {
+        curl_easy_cleanup(easy);
+    }
+}
+
+static void connection_data_free(struct connection_data *conn) {
+    VEC_FREE(&conn->received);
+    free(conn->url);
+    if (conn->headers.content_type.present) {
+        free(conn->headers.content_type.str);
+    }
+    if (conn->headers.accept_ranges.present) {
+        free(conn->headers.accept_ranges.str);
+    }
+    free(conn);
+}
+
+static size_t easy_writefunction(void *ptr, size_t size, size_t nmemb, void *data) {
     struct connection_data *conn_data = data;
     size_t ret = size * nmemb;
 
@@ -140,12 +176,35 @@ static size_t easy_writefunction(void *ptr, size_t size, size_t nmemb, void *dat
             }
         }
 
-        if (!conn_data->stream) {
+        if (!conn_data->options.stream) {
             VEC_RESERVE(&conn_data->received, conn_data->headers.content_length.size);
         }
     }
+    if (!conn_data->headers.content_range.present) {
+        struct curl_header *h;
+        int ret = curl_easy_header(conn_data->easy, "Content-Range", 0, CURLH_HEADER, -1, &h);
+        if (ret == CURLHE_OK) {
+            struct response_header *range = &conn_data->headers.content_range;
+            if (sscanf(h->value, "bytes %zu-%zu/%zu",
+                       &range->range.start, &range->range.end, &range->range.total) >= 2) {
+                range->present = true;
+                TRACE("got Content-Range: %s", h->value);
+            }
+        }
+    }
+    if (!conn_data->headers.accept_ranges.present) {
+        struct curl_header *h;
+        int ret = curl_easy_header(conn_data->easy, "Accept-Ranges", 0, CURLH_HEADER, -1, &h);
+        if (ret == CURLHE_OK) {
+            conn_data->headers.accept_ranges.present = true;
+            conn_data->headers.accept_ranges.str = xstrdup(h->value);
+            TRACE("got Accept-Ranges: %s", conn_data->headers.accept_ranges.str);
+        }
+    }
 
-    if (!conn_data->stream) {
+    if (size * nmemb == 0) {
+        /* curl does this for empty bodies. Size 0 means EOF to callbacks, that comes later */
+    } else if (!conn_data->options.stream) {
         VEC_APPEND_N(&conn_data->received, (uint8_t *)ptr, size * nmemb);
     } else if (!conn_data->callback(NULL, &conn_data->headers,
                                     ptr, size * nmemb,
@@ -154,16 +213,12 @@ static size_t easy_writefunction(void *ptr, size_t size, size_t nmemb, void *dat
         ret = CURL_WRITEFUNC_ERROR;
     }
 
-    MTX_UNLOCK(&state.mutex);
-
     return ret;
 }
 
 static int easy_xferinfofunction(void *data,
                                  curl_off_t dltotal, curl_off_t dlnow,
                                  curl_off_t ultotal, curl_off_t ulnow) {
-    MTX_LOCK(&state.mutex);
-
     struct connection_data *conn = data;
 
     state.download += dlnow - conn->prev_download;
@@ -195,7 +250,52 @@ static int easy_xferinfofunction(void *data,
         state.last_event_time = t;
     }
 
-    MTX_UNLOCK(&state.mutex);
+    return 0;
+}
+
+/* runs on network thread */
+static void complete_connection(struct connection_data *conn, const char *errmsg) {
+    if (conn->easy != NULL) {
+        easy_put(&state, conn->easy);
+        conn->easy = NULL;
+    }
+
+    if (conn->cancelled && !conn->options.report_cancel) {
+        /* no need to do anything. user doesn't want any more callbacks. */
+        connection_data_free(conn);
+    } else {
+        conn->errmsg = (conn->cancelled && errmsg == NULL) ? "cancelled" : errmsg;
+        mpsc_queue_push(&state.completed, &conn->node);
+        pollen_efd_trigger(state.completed_callback);
+    }
+}
+
+/* runs on main loop */
+static int completed_callback_func(struct pollen_callback *callback, uint64_t val, void *data) {
+    struct mpsc_node *node;
+    while ((node = mpsc_queue_pop(&state.completed)) != NULL) {
+        struct connection_data *conn_data = CONTAINER_OF(node, conn_data, node);
+
+        if (conn_data->errmsg != NULL) {
+            /* error, both stream and regular */
+            conn_data->callback(conn_data->errmsg, &conn_data->headers,
+                                NULL, -1,
+                                conn_data->callback_data);
+        } else if (conn_data->options.stream) {
+            /* EOF, stream callback */
+            conn_data->callback(NULL, &conn_data->headers,
+                                NULL, 0,
+                                conn_data->callback_data);
+        } else {
+            /* EOF, regular callback */
+            conn_data->callback(NULL, &conn_data->headers,
+                                VEC_DATA(&conn_data->received),
+                                VEC_SIZE(&conn_data->received),
+                                conn_data->callback_data);
+        }
+
+        connection_data_free(conn_data);
+    }
 
     return 0;
 }
@@ -205,67 +305,32 @@ static void check_multi_info(struct network_state *global_data) {
     int msgs_left;
     CURLMsg *msg;
 
-    while (true) {
-        MTX_LOCK(&state.mutex);
-        msg = curl_multi_info_read(global_data->multi, &msgs_left);
-        MTX_UNLOCK(&state.mutex);
-
-        if (msg == NULL) {
-            break;
-        } else if (msg->msg != CURLMSG_DONE) {
+    while ((msg = curl_multi_info_read(global_data->multi, &msgs_left)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
             WARN("curl_multi_info_read returned message other than CURLMSG_DONE! Check docs!");
             continue;
         }
 
         CURL *easy = msg->easy_handle;
-
-        MTX_LOCK(&state.mutex);
         curl_multi_remove_handle(global_data->multi, easy);
-        MTX_UNLOCK(&state.mutex);
 
         struct connection_data *conn_data;
-        const char *effective_url;
         curl_easy_getinfo(easy, CURLINFO_PRIVATE, &conn_data);
-        curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &effective_url);
 
         const CURLcode res = msg->data.result;
-        if (conn_data->cancelled) {
-            /* no need to do anything. user doesn't want any more callbacks. */
-        } else if (res != CURLE_OK) {
-            const char *errmsg = NULL;
+        const char *errmsg = NULL;
+        if (res != CURLE_OK) {
             if (conn_data->error[0] == '\0') {
                 errmsg = curl_easy_strerror(res);
             } else {
                 errmsg = conn_data->error;
             }
-
-            /* error, both stream and regular */
-            conn_data->callback(errmsg, &conn_data->headers,
-                                NULL, -1,
-                                conn_data->callback_data);
-        } else if (conn_data->stream) {
-            /* EOF, stream callback */
-            conn_data->callback(NULL, &conn_data->headers,
-                                NULL, 0,
-                                conn_data->callback_data);
-        } else {
-            /* EOF, regular callback */
-            conn_data->callback(NULL, &conn_data->headers,
-                                VEC_DATA(&conn_data->received),
-                                VEC_SIZE(&conn_data->received),
-                                conn_data->callback_data);
         }
 
-        curl_easy_cleanup(easy);
+        complete_connection(conn_data, errmsg);
 
-        VEC_FREE(&conn_data->received);
-        free(conn_data->url);
-        if (conn_data->headers.content_type.present) {
-            free(conn_data->headers.content_type.str);
-        }
-        free(conn_data);
-
-        signal_emit_u64(&state.emitter, NETWORK_EVENT_CONNECTIONS, --state.n_connections);
+        state.n_connections -= 1;
+        signal_emit_u64(&state.emitter, NETWORK_EVENT_CONNECTIONS, state.n_connections);
     }
 }
 
@@ -277,11 +342,8 @@ static int socket_callback(struct pollen_callback *callback, int fd, uint32_t ev
         ((events & EPOLLIN) ? CURL_CSELECT_IN : 0) | ((events & EPOLLOUT) ? CURL_CSELECT_OUT : 0);
 
     /* notify curl that fd is available for reading/writing */
-    MTX_LOCK(&state.mutex);
     int remaining;
     rc = curl_multi_socket_action(global_data->multi, fd, action, &remaining);
-    MTX_UNLOCK(&state.mutex);
-
     if (rc != CURLM_OK) {
         ERROR("curl_multi_socket_action() failed: %s", curl_multi_strerror(rc));
         return -1;
@@ -301,11 +363,8 @@ static int timer_callback(struct pollen_callback *callback, void *data) {
     CURLMcode rc;
 
     /* notify curl that timeout has expired */
-    MTX_LOCK(&state.mutex);
     int remaining;
     rc = curl_multi_socket_action(global_data->multi, CURL_SOCKET_TIMEOUT, 0, &remaining);
-    MTX_UNLOCK(&state.mutex);
-
     if (rc != CURLM_OK) {
         ERROR("curl_multi_socket_action() failed: %s", curl_multi_strerror(rc));
         return -1;
@@ -317,8 +376,6 @@ static int timer_callback(struct pollen_callback *callback, void *data) {
 }
 
 static int multi_timerfunction(CURLM *multi, long timeout_ms, void *multi_timerdata) {
-    MTX_LOCK(&state.mutex);
-
     struct network_state *global_data = multi_timerdata;
 
     if (timeout_ms > 0) {
@@ -334,15 +391,11 @@ static int multi_timerfunction(CURLM *multi, long timeout_ms, void *multi_timerd
         pollen_timer_disarm(global_data->timer);
     }
 
-    MTX_UNLOCK(&state.mutex);
-
     return 0;
 }
 
 static int multi_socketfunction(CURL *easy, int fd, int what,
                                 void *multi_socketdata, void *private_socket_data) {
-    MTX_LOCK(&state.mutex);
-
     struct network_state *global_data = multi_socketdata;
     struct socket_data *socket_data = private_socket_data;
 
@@ -358,7 +411,7 @@ static int multi_socketfunction(CURL *easy, int fd, int what,
             /* curl notifies us about new fd we need to start monitorign */
             socket_data = xcalloc(1, sizeof(*socket_data));
             socket_data->sock_fd = fd;
-            socket_data->callback = pollen_loop_add_fd(event_loop, fd, events, false,
+            socket_data->callback = pollen_loop_add_fd(global_data->loop, fd, events, false,
                                                        socket_callback, global_data);
 
             curl_multi_assign(global_data->multi, fd, socket_data);
@@ -368,26 +421,26 @@ static int multi_socketfunction(CURL *easy, int fd, int what,
         }
     }
 
-    MTX_UNLOCK(&state.mutex);
-
     return 0;
 }
 
-bool make_request(const char *url, bool stream, request_callback_t callback, void *callback_data) {
-    struct connection_data *conn = xcalloc(1, sizeof(*conn));
-    conn->callback_data = callback_data;
-    conn->callback = callback;
-    conn->url = xstrdup(url);
-    conn->stream = stream;
+/* runs on network thread */
+static bool connection_setup(struct network_state *global_data, struct connection_data *conn) {
+    const struct request_options *options = &conn->options;
 
-    conn->easy = curl_easy_init();
+    conn->easy = easy_get(global_data);
     if (conn->easy == NULL) {
         ERROR("curl_easy_init() failed");
-        goto err;
+        return false;
     }
 
-    curl_easy_setopt(conn->easy, CURLOPT_URL, url);
+    curl_easy_setopt(conn->easy, CURLOPT_URL, conn->url);
     curl_easy_setopt(conn->easy, CURLOPT_PRIVATE, conn);
+    curl_easy_setopt(conn->easy, CURLOPT_SHARE, global_data->share);
+    /* prefer HTTP/2 and wait for an existing connection to multiplex over
+     * instead of opening a new one */
+    curl_easy_setopt(conn->easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(conn->easy, CURLOPT_PIPEWAIT, 1L);
     /* setup write callback */
     curl_easy_setopt(conn->easy, CURLOPT_WRITEFUNCTION, easy_writefunction);
     curl_easy_setopt(conn->easy, CURLOPT_WRITEDATA, conn);
@@ -404,34 +457,94 @@ bool make_request(const char *url, bool stream, request_callback_t callback, voi
     /* set speed limit for aborting transfers that are too slow */
     curl_easy_setopt(conn->easy, CURLOPT_LOW_SPEED_TIME, 5L);
     curl_easy_setopt(conn->easy, CURLOPT_LOW_SPEED_LIMIT, 10L);
+    /* limit bandwidth */
+    if (options->max_recv_speed > 0) {
+        curl_easy_setopt(conn->easy, CURLOPT_MAX_RECV_SPEED_LARGE,
+                         (curl_off_t)options->max_recv_speed);
+    }
+    /* partial request */
+    if (options->range_start > 0 || options->range_end > 0) {
+        char range[64];
+        if (options->range_end > 0) {
+            snprintf(range, sizeof(range), "%zu-%zu", options->range_start, options->range_end - 1);
+        } else {
+            snprintf(range, sizeof(range), "%zu-", options->range_start);
+        }
+        curl_easy_setopt(conn->easy, CURLOPT_RANGE, range);
+    }
 
-    MTX_LOCK(&state.mutex);
-    CURLMcode rc = curl_multi_add_handle(state.multi, conn->easy);
-    MTX_UNLOCK(&state.mutex);
+    return true;
+}
 
-    if (rc != CURLM_OK) {
-        ERROR("curl_multi_add_handle() failed: %s", curl_multi_strerror(rc));
-        goto err;
+/* runs on network thread, picks up requests submitted by make_request */
+static int wakeup_callback(struct pollen_callback *callback, uint64_t val, void *data) {
+    struct network_state *global_data = data;
+
+    if (atomic_load(&global_data->quit)) {
+        pollen_loop_quit(global_data->loop, 0);
+        return 0;
     }
 
-    signal_emit_u64(&state.emitter, NETWORK_EVENT_CONNECTIONS, ++state.n_connections);
+    struct mpsc_node *node;
+    while ((node = mpsc_queue_pop(&global_data->requests)) != NULL) {
+        struct connection_data *conn = CONTAINER_OF(node, conn, node);
 
-    /* note that the add_handle() sets a timeout to trigger soon so that the
-     * necessary socket_action() call gets called by this app */
+        if (!connection_setup(global_data, conn)) {
+            complete_connection(conn, "Failed to set up request");
+            continue;
+        }
 
-    return true;
+        CURLMcode rc = curl_multi_add_handle(global_data->multi, conn->easy);
+        if (rc != CURLM_OK) {
+            ERROR("curl_multi_add_handle() failed: %s", curl_multi_strerror(rc));
+            complete_connection(conn, curl_multi_strerror(rc));
+            continue;
+        }
 
-err:
-    curl_easy_cleanup(conn->easy);
-    free(conn->url);
-    free(conn);
-    return false;
+        state.n_connections += 1;
+        signal_emit_u64(&state.emitter, NETWORK_EVENT_CONNECTIONS, state.n_connections);
+
+        /* note that the add_handle() sets a timeout to trigger soon so that the
+         * necessary socket_action() call gets called by this app */
+    }
+
+    return 0;
+}
+
+static void *network_thread_func(void *data) {
+    struct network_state *global_data = data;
+
+    pollen_loop_run(global_data->loop);
+
+    return NULL;
+}
+
+bool make_request(const char *url, const struct request_options *options,
+                  request_callback_t callback, void *callback_data) {
+    struct connection_data *conn = xcalloc(1, sizeof(*conn));
+    conn->callback_data = callback_data;
+    conn->callback = callback;
+    conn->url = xstrdup(url);
+    conn->options = *options;
+
+    /* hand it over to network thread, it will do the rest */
+    mpsc_queue_push(&state.requests, &conn->node);
+    pollen_efd_trigger(state.wakeup);
+
+    return true;
 }
 
 bool network_init(void) {
     CURLcode rc;
 
-    signal_emitter_init(&state.emitter);
+    if (!signal_emitter_init(&state.emitter, NETWORK_EVENT_SPEED_DL | NETWORK_EVENT_SPEED_UL |
+                                             NETWORK_EVENT_CONNECTIONS)) {
+        ERROR("failed to init network signal emitter");
+        return false;
+    }
+
+    mpsc_queue_init(&state.requests);
+    mpsc_queue_init(&state.completed);
 
     rc = curl_global_init_mem(CURL_GLOBAL_ALL, xmalloc, free, xrealloc, xstrdup, xcalloc);
     if (rc != CURLE_OK) {
@@ -449,21 +562,74 @@ bool network_init(void) {
     curl_multi_setopt(state.multi, CURLMOPT_SOCKETDATA, &state);
     curl_multi_setopt(state.multi, CURLMOPT_TIMERFUNCTION, multi_timerfunction);
     curl_multi_setopt(state.multi, CURLMOPT_TIMERDATA, &state);
+    /* multiplex requests over a single HTTP/2 connection when possible */
+    curl_multi_setopt(state.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(state.multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                      (long)config.max_host_connections);
+
+    /* all easy handles are only ever used on network thread, so no need for lock callbacks */
+    state.share = curl_share_init();
+    if (state.share == NULL) {
+        ERROR("failed to create curl share");
+        return false;
+    }
+    curl_share_setopt(state.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(state.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(state.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    state.completed_callback = pollen_loop_add_efd(event_loop, completed_callback_func, &state);
+    if (state.completed_callback == NULL) {
+        ERROR("failed to create completion callback");
+        return false;
+    }
+
+    state.loop = pollen_loop_create();
+    if (state.loop == NULL) {
+        ERROR("failed to create network event loop");
+        return false;
+    }
 
-    state.timer = pollen_loop_add_timer(event_loop, CLOCK_MONOTONIC, timer_callback, &state);
+    state.timer = pollen_loop_add_timer(state.loop, CLOCK_MONOTONIC, timer_callback, &state);
     if (state.timer == NULL) {
         ERROR("failed to create timer");
         return false;
     }
 
+    state.wakeup = pollen_loop_add_efd(state.loop, wakeup_callback, &state);
+    if (state.wakeup == NULL) {
+        ERROR("failed to create wakeup callback");
+        return false;
+    }
+
+    int ret = pthread_create(&state.thread, NULL, network_thread_func, &state);
+    if (ret != 0) {
+        ERROR("failed to create network thread: %s", strerror(ret));
+        return false;
+    }
+    state.thread_running = true;
+
     return true;
 }
 
 void network_cleanup(void) {
+    if (state.thread_running) {
+        atomic_store(&state.quit, true);
+        pollen_efd_trigger(state.wakeup);
+        pthread_join(state.thread, NULL);
+        state.thread_running = false;
+    }
+
     curl_multi_cleanup(state.multi);
+    VEC_FOREACH(&state.easy_pool, i) {
+        curl_easy_cleanup(*VEC_AT(&state.easy_pool, i));
+    }
+    VEC_FREE(&state.easy_pool);
+    curl_share_cleanup(state.share);
     pollen_loop_remove_callback(state.timer);
+    pollen_loop_remove_callback(state.wakeup);
+    pollen_loop_cleanup(state.loop);
+    pollen_loop_remove_callback(state.completed_callback);
     signal_emitter_cleanup(&state.emitter);
-    pthread_mutex_destroy(&state.mutex);
 }
 
 void network_event_subscribe(struct signal_listener *listener, enum network_event events,
@@ -8,21 +8,42 @@ struct response_header {
     union {
         char *str;
         size_t size;
+        struct {
+            size_t start, end, total; /* total is 0 if unknown */
+        } range;
     };
 };
 
 struct response_headers {
     struct response_header content_type; /* str */
     struct response_header content_length; /* size */
+    struct response_header content_range; /* range */
+    struct response_header accept_ranges; /* str */
 };
 
-/* for stream, return false to cancel transfer, no more callbacks will be called after that */
+struct request_options {
+    bool stream;
+    /* request only bytes [range_start, range_end), range_end of 0 means until the end */
+    size_t range_start, range_end;
+    /* in bytes per second, 0 means unlimited */
+    size_t max_recv_speed;
+    /* for stream, callback still gets its final call with size -1 after cancelling */
+    bool report_cancel;
+};
+
+/*
+ * Data of stream requests is passed as it arrives on network thread, size is never 0 there.
+ * Final callback is made on main loop, with size 0 on EOF or -1 on error.
+ * For stream, return false to cancel transfer, no more callbacks will be called after that
+ * unless report_cancel is set.
+ */
 typedef bool (*request_callback_t)(const char *errmsg,
                                    const struct response_headers *headers,
                                    const void *data, ssize_t size,
                                    void *userdata);
 
-bool make_request(const char *url, bool stream, request_callback_t callback, void *callback_data);
+bool make_request(const char *url, const struct request_options *options,
+                  request_callback_t callback, void *callback_data);
 
 #endif /* #ifndef SRC_NETWORK_REQUEST_H */
 
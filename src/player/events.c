@@ -147,6 +147,7 @@ void player_process_event(const struct mpv_event *ev) {
         if (s != NULL) {
             api_scrobble(s->id);
         }
+        player_prefetch_next();
         break;
     case MPV_EVENT_SEEK:
         int64_t pos;
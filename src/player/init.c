@@ -63,7 +63,18 @@ bool player_init(void) {
         return false;
     }
 
-    mpv_request_log_messages(player.mpv_handle, "v");
+    /* don't make mpv format messages that would get thrown away, see convert_loglevel */
+    const char *mpv_log_level = "no";
+    if (log_level_enabled(LOG_TRACE)) {
+        mpv_log_level = "v";
+    } else if (log_level_enabled(LOG_DEBUG)) {
+        mpv_log_level = "info";
+    } else if (log_level_enabled(LOG_WARN)) {
+        mpv_log_level = "warn";
+    } else if (log_level_enabled(LOG_ERROR)) {
+        mpv_log_level = "error";
+    }
+    mpv_request_log_messages(player.mpv_handle, mpv_log_level);
 
     #define OBSERVE_PROPERTY_OR_FAIL(event, property, format) \
         do { \
@@ -74,7 +85,12 @@ bool player_init(void) {
             } \
         } while (0)
 
-    signal_emitter_init(&player.emitter);
+    /* percent-pos and time-pos change all the time during playback */
+    if (!signal_emitter_init(&player.emitter, PLAYER_EVENT_PERCENT_POSITION |
+                                              PLAYER_EVENT_TIME_POSITION)) {
+        ERROR("failed to init player signal emitter");
+        return false;
+    }
     OBSERVE_PROPERTY_OR_FAIL(PLAYER_EVENT_PLAYLIST_POSITION, "playlist-pos", MPV_FORMAT_INT64);
     OBSERVE_PROPERTY_OR_FAIL(PLAYER_EVENT_PERCENT_POSITION, "percent-pos", MPV_FORMAT_INT64);
     OBSERVE_PROPERTY_OR_FAIL(PLAYER_EVENT_PAUSE, "pause", MPV_FORMAT_FLAG);
@@ -35,5 +35,8 @@ bool player_loadfile(const struct song *song);
 /* Stop playback and clear playlist. */
 bool player_stop(void);
 
+/* Start downloading upcoming songs into cache, if they aren't there yet */
+void player_prefetch_next(void);
+
 #endif /* #ifndef SRC_PLAYER_INTERNAL_H */
 
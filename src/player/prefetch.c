@@ -0,0 +1,52 @@
+#include "player/internal.h"
+#include "types/song.h"
+#include "stream/network.h"
+#include "stream/open.h"
+#include "config.h"
+#include "log.h"
+
+/* songs are downloaded one by one, so they don't fight each other for bandwidth */
+static bool prefetch_running = false;
+
+static void on_prefetch_done(const char *id, bool saved, void *userdata) {
+    prefetch_running = false;
+
+    if (saved) {
+        DEBUG("prefetched song %s", id);
+        player_prefetch_next();
+    } else {
+        /* don't retry right away, if server is down this will just spin. Try again next time */
+        WARN("failed to prefetch song %s", id);
+    }
+}
+
+void player_prefetch_next(void) {
+    const struct player_playlist *pl = &player.playlist;
+
+    if (prefetch_running || pl->current_song < 0) {
+        return;
+    }
+
+    for (int i = 1; i <= config.prefetch_count; i++) {
+        const size_t index = pl->current_song + i;
+        if (index >= VEC_SIZE(&pl->songs)) {
+            break;
+        }
+
+        const struct song *song = VEC_AT(&pl->songs, index);
+        if (stream_is_cached(song->id, config.preferred_audio_bitrate,
+                             config.preferred_audio_format)) {
+            continue;
+        }
+
+        DEBUG("prefetching song %s (playlist index %zu)", song->id, index);
+        prefetch_running = true;
+        if (!stream_prefetch(song->id, config.preferred_audio_bitrate,
+                             config.preferred_audio_format, config.prefetch_max_speed,
+                             on_prefetch_done, NULL)) {
+            prefetch_running = false;
+        }
+        break;
+    }
+}
+
@@ -1,35 +1,77 @@
+#include <string.h>
+#include <assert.h>
+
 #include "signals.h"
 #include "eventloop.h"
+#include "xmalloc.h"
+#include "macros.h"
+
+static void signal_emitter_dispatch(const struct signal_emitter *emitter,
+                                    uint64_t event, const struct signal_data *data) {
+    const struct signal_listener *listener;
+    LIST_FOREACH(listener, &emitter->listeners, link) {
+        if (event & listener->events) {
+            listener->callback(event, data, listener->callback_data);
+        }
+    }
+}
 
 static int signal_emitter_dispatch_events(struct pollen_callback *, uint64_t, void *data) {
     struct signal_emitter *emitter = data;
 
-    VEC_FOREACH(&emitter->queued_events, i) {
-        const struct signal_queued_event *ev = VEC_AT(&emitter->queued_events, i);
+    /* anything pushed after this will trigger efd again */
+    atomic_store(&emitter->wakeup_pending, false);
+
+    struct mpsc_node *node;
+    while ((node = mpsc_queue_pop(&emitter->queue)) != NULL) {
+        struct signal_queued_event *ev = CONTAINER_OF(node, ev, node);
+
+        if (ev->coalesced) {
+            struct signal_coalesced_event *c = CONTAINER_OF(ev, c, queued);
+
+            /* clear pending before reading value so newer values are never lost */
+            atomic_store(&c->pending, false);
+            struct signal_data data = { .type = atomic_load(&c->type) };
+            const uint64_t value = atomic_load(&c->value);
+            memcpy(&data.as, &value, sizeof(value));
 
-        const struct signal_listener *listener;
-        LIST_FOREACH(listener, &emitter->listeners, link) {
-            if (ev->event & listener->events) {
-                listener->callback(ev->event, &ev->data, listener->callback_data);
-            }
+            signal_emitter_dispatch(emitter, ev->event, &data);
+        } else {
+            signal_emitter_dispatch(emitter, ev->event, &ev->data);
+            free(ev);
         }
     }
-    VEC_CLEAR(&emitter->queued_events);
 
     return 0;
 }
 
-bool signal_emitter_init(struct signal_emitter *emitter) {
+bool signal_emitter_init(struct signal_emitter *emitter, uint64_t coalesce) {
     LIST_INIT(&emitter->listeners);
-    VEC_INIT(&emitter->queued_events);
+    mpsc_queue_init(&emitter->queue);
+    atomic_init(&emitter->wakeup_pending, false);
+
+    emitter->coalesce = coalesce;
+    for (size_t i = 0; i < SIZEOF_VEC(emitter->coalesced); i++) {
+        struct signal_coalesced_event *c = &emitter->coalesced[i];
+        c->queued.event = 1ULL << i;
+        c->queued.coalesced = true;
+        atomic_init(&c->pending, false);
+    }
 
     emitter->efd = pollen_loop_add_efd(event_loop, signal_emitter_dispatch_events, emitter);
-    return (emitter->efd == NULL);
+    return (emitter->efd != NULL);
 }
 
 void signal_emitter_cleanup(struct signal_emitter *emitter) {
     pollen_loop_remove_callback(emitter->efd);
-    VEC_FREE(&emitter->queued_events);
+
+    struct mpsc_node *node;
+    while ((node = mpsc_queue_pop(&emitter->queue)) != NULL) {
+        struct signal_queued_event *ev = CONTAINER_OF(node, ev, node);
+        if (!ev->coalesced) {
+            free(ev);
+        }
+    }
 }
 
 void signal_subscribe(struct signal_emitter *emitter, struct signal_listener *listener,
@@ -45,16 +87,37 @@ void signal_unsubscribe(struct signal_listener *listener) {
     LIST_REMOVE(&listener->link);
 }
 
-static void signal_emit_internal(const struct signal_emitter *emitter,
-                                 uint64_t event, struct signal_data *data) {
-    struct signal_queued_event *ev = VEC_EMPLACE_BACK(&emitter->queued_events);
-    ev->event = event;
-    ev->data = *data;
+static void signal_emit_internal(struct signal_emitter *emitter,
+                                 uint64_t event, const struct signal_data *data) {
+    if (event & emitter->coalesce) {
+        assert((event & (event - 1)) == 0);
+        struct signal_coalesced_event *c = &emitter->coalesced[__builtin_ctzll(event)];
+
+        uint64_t value;
+        static_assert(sizeof(value) == sizeof(data->as));
+        memcpy(&value, &data->as, sizeof(value));
+        atomic_store(&c->type, data->type);
+        atomic_store(&c->value, value);
+
+        if (atomic_exchange(&c->pending, true)) {
+            /* still queued, consumer will pick up the new value */
+            return;
+        }
+        mpsc_queue_push(&emitter->queue, &c->queued.node);
+    } else {
+        struct signal_queued_event *ev = xmalloc(sizeof(*ev));
+        ev->event = event;
+        ev->coalesced = false;
+        ev->data = *data;
+        mpsc_queue_push(&emitter->queue, &ev->node);
+    }
 
-    pollen_efd_trigger(emitter->efd);
+    if (!atomic_exchange(&emitter->wakeup_pending, true)) {
+        pollen_efd_trigger(emitter->efd);
+    }
 }
 
-void signal_emit_ptr(const struct signal_emitter *emitter, uint64_t event, void *ptr) {
+void signal_emit_ptr(struct signal_emitter *emitter, uint64_t event, void *ptr) {
     struct signal_data data = {
         .type = SIGNAL_DATA_TYPE_PTR,
         .as.ptr = ptr,
@@ -62,7 +125,7 @@ void signal_emit_ptr(const struct signal_emitter *emitter, uint64_t event, void
     signal_emit_internal(emitter, event, &data);
 }
 
-void signal_emit_str(const struct signal_emitter *emitter, uint64_t event, char *str) {
+void signal_emit_str(struct signal_emitter *emitter, uint64_t event, char *str) {
     struct signal_data data = {
         .type = SIGNAL_DATA_TYPE_STR,
         .as.str = str,
@@ -70,7 +133,7 @@ void signal_emit_str(const struct signal_emitter *emitter, uint64_t event, char
     signal_emit_internal(emitter, event, &data);
 }
 
-void signal_emit_u64(const struct signal_emitter *emitter, uint64_t event, uint64_t u64) {
+void signal_emit_u64(struct signal_emitter *emitter, uint64_t event, uint64_t u64) {
     struct signal_data data = {
         .type = SIGNAL_DATA_TYPE_U64,
         .as.u64 = u64,
@@ -78,7 +141,7 @@ void signal_emit_u64(const struct signal_emitter *emitter, uint64_t event, uint6
     signal_emit_internal(emitter, event, &data);
 }
 
-void signal_emit_i64(const struct signal_emitter *emitter, uint64_t event, int64_t i64) {
+void signal_emit_i64(struct signal_emitter *emitter, uint64_t event, int64_t i64) {
     struct signal_data data = {
         .type = SIGNAL_DATA_TYPE_I64,
         .as.i64 = i64,
@@ -86,7 +149,7 @@ void signal_emit_i64(const struct signal_emitter *emitter, uint64_t event, int64
     signal_emit_internal(emitter, event, &data);
 }
 
-void signal_emit_f64(const struct signal_emitter *emitter, uint64_t event, double f64) {
+void signal_emit_f64(struct signal_emitter *emitter, uint64_t event, double f64) {
     struct signal_data data = {
         .type = SIGNAL_DATA_TYPE_F64,
         .as.f64 = f64,
@@ -94,7 +157,7 @@ void signal_emit_f64(const struct signal_emitter *emitter, uint64_t event, doubl
     signal_emit_internal(emitter, event, &data);
 }
 
-void signal_emit_bool(const struct signal_emitter *emitter, uint64_t event, bool boolean) {
+void signal_emit_bool(struct signal_emitter *emitter, uint64_t event, bool boolean) {
     struct signal_data data = {
         .type = SIGNAL_DATA_TYPE_BOOLEAN,
         .as.boolean = boolean,
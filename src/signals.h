@@ -1,10 +1,11 @@
 #ifndef SRC_SIGNALS_H
 #define SRC_SIGNALS_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include "collections/list.h"
-#include "collections/vec.h"
+#include "collections/mpsc.h"
 
 enum signal_data_type {
     SIGNAL_DATA_TYPE_PTR,
@@ -40,18 +41,40 @@ struct signal_listener {
     LIST_ENTRY link;
 };
 
+struct signal_queued_event {
+    struct mpsc_node node;
+    uint64_t event;
+    bool coalesced; /* embedded in signal_coalesced_event, data is stored there */
+    struct signal_data data;
+};
+
+struct signal_coalesced_event {
+    struct signal_queued_event queued; /* sits in the queue while pending is set */
+    atomic_bool pending;
+    _Atomic enum signal_data_type type;
+    _Atomic uint64_t value; /* bits of signal_data.as */
+};
+
+/*
+ * Events can be emitted from any thread, listeners are always called on the main loop.
+ *
+ * Events in the coalesce mask only keep the latest value: if an event is emitted again
+ * before the previous one was dispatched, listeners only see the new value, delivered
+ * in the queue position of the old one. Only use that for single bit events carrying
+ * values that don't need freeing, and only when reordering them is harmless.
+ */
 struct signal_emitter {
     struct pollen_callback *efd;
+    atomic_bool wakeup_pending;
 
-    VEC(struct signal_queued_event {
-        uint64_t event;
-        struct signal_data data;
-    }) queued_events;
+    struct mpsc_queue queue;
+    uint64_t coalesce;
+    struct signal_coalesced_event coalesced[64]; /* indexed by event bit */
 
     LIST_HEAD listeners;
 };
 
-bool signal_emitter_init(struct signal_emitter *emitter);
+bool signal_emitter_init(struct signal_emitter *emitter, uint64_t coalesce);
 void signal_emitter_cleanup(struct signal_emitter *emitter);
 
 void signal_subscribe(struct signal_emitter *emitter, struct signal_listener *listener,
@@ -59,12 +82,12 @@ void signal_subscribe(struct signal_emitter *emitter, struct signal_listener *li
 
 void signal_unsubscribe(struct signal_listener *listener);
 
-void signal_emit_ptr(const struct signal_emitter *emitter, uint64_t event, void *ptr);
-void signal_emit_str(const struct signal_emitter *emitter, uint64_t event, char *str);
-void signal_emit_u64(const struct signal_emitter *emitter, uint64_t event, uint64_t u64);
-void signal_emit_i64(const struct signal_emitter *emitter, uint64_t event, int64_t i64);
-void signal_emit_f64(const struct signal_emitter *emitter, uint64_t event, double f64);
-void signal_emit_bool(const struct signal_emitter *emitter, uint64_t event, bool boolean);
+void signal_emit_ptr(struct signal_emitter *emitter, uint64_t event, void *ptr);
+void signal_emit_str(struct signal_emitter *emitter, uint64_t event, char *str);
+void signal_emit_u64(struct signal_emitter *emitter, uint64_t event, uint64_t u64);
+void signal_emit_i64(struct signal_emitter *emitter, uint64_t event, int64_t i64);
+void signal_emit_f64(struct signal_emitter *emitter, uint64_t event, double f64);
+void signal_emit_bool(struct signal_emitter *emitter, uint64_t event, bool boolean);
 
 #endif /* #ifndef SRC_SIGNALS_H */
 
@@ -0,0 +1,257 @@
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "stream/cache.h"
+#include "db/cache.h"
+#include "eventloop.h"
+#include "worker_thread.h"
+#include "cleanup.h"
+#include "xmalloc.h"
+#include "config.h"
+#include "log.h"
+
+/* how many files to remove per event loop iteration, so pruning doesn't freeze the ui */
+#define PRUNE_BATCH_SIZE 8
+
+static struct pollen_callback *prune_callback = NULL;
+
+/*
+ * Flushing and renaming files can take a long time on slow (or network) storage,
+ * so it happens on the cache writer thread. Finished jobs are sent back to the main loop,
+ * where the db is updated and callbacks are called.
+ */
+struct cache_job {
+    struct worker_job base;
+
+    bool save;
+    int fd;
+    char *partpath;
+    struct cached_song song; /* only id is set when discarding */
+
+    bool saved;
+    stream_cache_callback_t callback;
+    void *callback_data;
+};
+
+static void cache_job_free(struct cache_job *job) {
+    cached_song_free_contents(&job->song);
+    free(job->partpath);
+    free(job);
+}
+
+/* runs on writer thread */
+static bool cache_job_save(struct cache_job *job) {
+    [[gnu::cleanup(cleanup_free)]] char *filepath = NULL;
+
+    /* file might've been preallocated with a size that turned out to be wrong */
+    if (ftruncate(job->fd, job->song.size) < 0) {
+        ERROR("cannot save song into cache: failed to truncate %s: %m", job->partpath);
+        return false;
+    }
+
+    /* without this, a crash right after rename might leave a file of the right size
+     * but with garbage inside, which would pass integrity check in stream_open */
+    if (config.music_cache_fsync && fdatasync(job->fd) < 0) {
+        ERROR("cannot save song into cache: failed to sync %s: %m", job->partpath);
+        return false;
+    }
+
+    xasprintf(&filepath, "%s/%s", config.music_cache_dir, job->song.filename);
+    if (rename(job->partpath, filepath) < 0) {
+        ERROR("cannot save song into cache: failed to rename %s to %s: %m",
+              job->partpath, filepath);
+        return false;
+    }
+
+    return true;
+}
+
+/* runs on writer thread */
+static void cache_job_run(struct worker_job *wjob) {
+    struct cache_job *job;
+    LIST_GET(job, wjob, base);
+
+    if (job->save) {
+        job->saved = cache_job_save(job);
+    }
+
+    if (job->fd < 0) {
+        return;
+    }
+
+    if (!job->saved && unlink(job->partpath) < 0) {
+        WARN("failed to remove %s: %m", job->partpath);
+    }
+
+    close(job->fd);
+}
+
+/* runs on main loop */
+static void cache_job_done(struct worker_job *wjob, bool cleanup) {
+    struct cache_job *job;
+    LIST_GET(job, wjob, base);
+
+    /* songs still need to get into the db even if the rest of the program is gone already */
+    if (job->saved) {
+        if (db_add_cached_song(&job->song)) {
+            DEBUG("saved song %s into cache as %s", job->song.id, job->song.filename);
+            stream_cache_prune();
+        } else {
+            job->saved = false;
+        }
+    }
+
+    if (!cleanup && job->callback != NULL) {
+        job->callback(job->song.id, job->saved, job->callback_data);
+    }
+
+    cache_job_free(job);
+}
+
+/* downloaded files are flushed and moved into place even if we are quitting */
+static struct worker writer = {
+    .name = "cache writer",
+    .finish_pending = true,
+    .run = cache_job_run,
+    .done = cache_job_done,
+    WORKER_INITIALISER(&writer),
+};
+
+static void submit_job(struct cache_job *job) {
+    if (!worker_submit(&writer, &job->base)) {
+        /* don't leave the file open, it can't get into the cache anyway */
+        job->save = false;
+        cache_job_run(&job->base);
+        cache_job_free(job);
+    }
+}
+
+void stream_cache_save(int fd, const char *partpath, const struct cached_song *song,
+                       stream_cache_callback_t callback, void *callback_data) {
+    struct cache_job *job = xcalloc(1, sizeof(*job));
+    job->save = true;
+    job->fd = fd;
+    job->partpath = xstrdup(partpath);
+    cached_song_deep_copy(&job->song, song);
+    job->callback = callback;
+    job->callback_data = callback_data;
+
+    submit_job(job);
+}
+
+void stream_cache_discard(int fd, const char *partpath, const char *id,
+                          stream_cache_callback_t callback, void *callback_data) {
+    struct cache_job *job = xcalloc(1, sizeof(*job));
+    job->save = false;
+    job->fd = fd;
+    job->partpath = xstrdup(partpath);
+    job->song.id = xstrdup(id);
+    job->callback = callback;
+    job->callback_data = callback_data;
+
+    submit_job(job);
+}
+
+static bool remove_cached_song(const struct cached_song *song) {
+    [[gnu::cleanup(cleanup_free)]] char *filepath = NULL;
+
+    xasprintf(&filepath, "%s/%s", config.music_cache_dir, song->filename);
+    if (unlink(filepath) < 0 && errno != ENOENT) {
+        WARN("failed to remove %s from cache: %m", filepath);
+        return false;
+    }
+
+    if (!db_delete_cached_song(song)) {
+        return false;
+    }
+    DEBUG("removed song %s (%zu bytes) from cache", song->id, song->size);
+
+    return true;
+}
+
+static int prune_callback_func(struct pollen_callback *callback, uint64_t val, void *data) {
+    [[gnu::cleanup(cleanup_free)]] struct cached_song *songs = NULL;
+
+    if (config.music_cache_max_size == 0) {
+        return 0;
+    }
+
+    const size_t count = db_get_cached_songs_over_limit(&songs, config.music_cache_max_size,
+                                                        PRUNE_BATCH_SIZE);
+    size_t removed = 0;
+    for (size_t i = 0; i < count; i++) {
+        removed += remove_cached_song(&songs[i]);
+        cached_song_free_contents(&songs[i]);
+    }
+
+    /*
+     * There might be more, continue on the next iteration. Songs that failed to be
+     * removed stay in the db and would come back in the next batch, so if nothing
+     * was removed, give up until the next prune instead of spinning on them.
+     */
+    if (count == PRUNE_BATCH_SIZE && removed > 0) {
+        pollen_efd_trigger(prune_callback);
+    }
+
+    return 0;
+}
+
+/* leftovers from downloads that were interrupted by a crash */
+static void remove_partial_files(void) {
+    DIR *dir = opendir(config.music_cache_dir);
+    if (dir == NULL) {
+        WARN("failed to open %s: %m", config.music_cache_dir);
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strstr(ent->d_name, ".part.") == NULL) {
+            continue;
+        }
+
+        if (unlinkat(dirfd(dir), ent->d_name, 0) < 0) {
+            WARN("failed to remove %s: %m", ent->d_name);
+        } else {
+            DEBUG("removed stale partial file %s", ent->d_name);
+        }
+    }
+
+    closedir(dir);
+}
+
+bool stream_cache_init(void) {
+    remove_partial_files();
+
+    prune_callback = pollen_loop_add_efd(event_loop, prune_callback_func, NULL);
+    if (prune_callback == NULL) {
+        ERROR("failed to create cache pruning callback");
+        return false;
+    }
+
+    if (!worker_init(&writer)) {
+        return false;
+    }
+
+    /* limit might've changed since last run */
+    stream_cache_prune();
+
+    return true;
+}
+
+void stream_cache_cleanup(void) {
+    worker_cleanup(&writer);
+
+    pollen_loop_remove_callback(prune_callback);
+    prune_callback = NULL;
+}
+
+void stream_cache_prune(void) {
+    if (prune_callback != NULL) {
+        pollen_efd_trigger(prune_callback);
+    }
+}
+
@@ -0,0 +1,29 @@
+#ifndef SRC_STREAM_CACHE_H
+#define SRC_STREAM_CACHE_H
+
+#include "types/cached_song.h"
+
+/* Called on the main loop once the file is in cache (or failed to get there) */
+typedef void (*stream_cache_callback_t)(const char *id, bool saved, void *userdata);
+
+bool stream_cache_init(void);
+void stream_cache_cleanup(void);
+
+/*
+ * Hands a fully downloaded file over to the cache writer thread, which flushes it,
+ * renames it into place and then adds it to the db on the main loop.
+ * Takes ownership of fd. Does not take ownership of partpath and song.
+ * Safe to call from any thread. Callback can be NULL.
+ */
+void stream_cache_save(int fd, const char *partpath, const struct cached_song *song,
+                       stream_cache_callback_t callback, void *callback_data);
+/* Same, but the file is removed instead. fd can be -1 and partpath NULL if there is no file */
+void stream_cache_discard(int fd, const char *partpath, const char *id,
+                          stream_cache_callback_t callback, void *callback_data);
+
+/* Schedules removal of least recently used songs if cache is over the size limit.
+ * Safe to call from any thread. */
+void stream_cache_prune(void);
+
+#endif /* #ifndef SRC_STREAM_CACHE_H */
+
@@ -1,21 +1,46 @@
+#include <sys/stat.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
 #include <fcntl.h>
 
 #include "stream/network.h"
+#include "stream/cache.h"
 #include "api/requests.h"
-#include "collections/vec.h"
-#include "db/cache.h"
-#include "cleanup.h"
+#include "collections/range_set.h"
 #include "xmalloc.h"
 #include "config.h"
+#include "macros.h"
 #include "log.h"
 
+/* if requested position is this close to where the running transfer currently is,
+ * just wait for it to get there instead of making a new request */
+#define SEEK_WAIT_THRESHOLD (256 * 1024)
+
+/*
+ * Received data is not kept in memory. Instead, it is written into a file in music cache
+ * directory as it arrives, and mpv reads it back with pread (so it gets served from page cache).
+ * Once the whole file is received, that same file is renamed into place and becomes cache entry.
+ *
+ * If server supports range requests, seeking past received data starts a new transfer
+ * from the requested position. Downloaded parts of the file are tracked in a range set,
+ * and holes are filled in later so the file can still be saved into cache.
+ */
 struct network_stream_data {
-    VEC(uint8_t) data;
+    int fd;
+    struct range_set received; /* parts of the file that were written to fd */
+    size_t size; /* size of the whole file, 0 if unknown */
+    bool seekable;
+
     int64_t pos;
-    bool eof, error, closed;
+    bool complete, error, closed;
+
+    /* the transfer that currently receives data, can be NULL */
+    struct network_stream_transfer *active;
+    /* transfers that haven't received their final callback yet, including cancelled ones.
+     * Stream can only be freed when it's closed and this reaches 0 */
+    int transfers;
 
     bool new_data;
     pthread_cond_t cond;
@@ -25,58 +50,143 @@ struct network_stream_data {
     char *filetype;
     char *id;
 
-    int out_fd;
+    char *filename; /* final name of the file, relative to music cache dir */
+    char *partpath; /* path of the file while it's still being downloaded */
+
+    /* for background downloads */
+    size_t max_recv_speed;
+    stream_cache_callback_t prefetch_callback;
+    void *prefetch_callback_data;
 };
 
-static void network_stream_finalise(struct network_stream_data *d) {
-    /* TODO: do this asynchronously? this can potentially block for a long time on slow storage */
-    int fd = -1;
-    [[gnu::cleanup(cleanup_free)]] char *filepath = NULL;
-    [[gnu::cleanup(cleanup_free)]] char *filename = NULL;
+struct network_stream_transfer {
+    struct network_stream_data *stream;
+    size_t offset; /* where the next received byte goes */
+    size_t end; /* data past this point is already received, SIZE_MAX if none */
+    bool started, cancelled;
+};
 
-    if (!d->eof) {
+static void network_stream_finalise(struct network_stream_data *d) {
+    if (d->fd < 0) {
+        /* nothing to remove, but the callback still has to run on the main loop */
+        stream_cache_discard(-1, NULL, d->id, d->prefetch_callback, d->prefetch_callback_data);
+    } else if (!d->complete || d->error) {
         TRACE("network stream closed before entire file was received; not saving into cache");
-        goto out;
+        stream_cache_discard(d->fd, d->partpath, d->id,
+                             d->prefetch_callback, d->prefetch_callback_data);
+    } else {
+        /* the rest happens on cache writer thread, this one might be mpv's */
+        stream_cache_save(d->fd, d->partpath, &(struct cached_song){
+            .server_id = config.server_id,
+            .id = d->id,
+            .filetype = d->filetype,
+            .bitrate = d->bitrate,
+            .filename = d->filename,
+            .size = d->size,
+        }, d->prefetch_callback, d->prefetch_callback_data);
     }
 
-    xasprintf(&filename, "%li_%s", config.server_id, d->id);
-    xasprintf(&filepath, "%s/%s", config.music_cache_dir, filename);
-    TRACE("opening file at %s", filepath);
-    fd = open(filepath, O_TRUNC | O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
-    if (fd < 0) {
-        ERROR("cannot save song into cache: failed to create file %s: %m", filepath);
-        goto out;
+    range_set_free(&d->received);
+    free(d->partpath);
+    free(d->filename);
+    free(d->id);
+    free(d->filetype);
+    free(d);
+}
+
+static bool api_stream_data_callback(const char *errmsg, const struct api_stream_info *info,
+                                     const void *data, ssize_t data_size, void *userdata);
+
+/* must be called with lock held. Does not actually start anything, call transfer_start for that */
+static struct network_stream_transfer *transfer_new(struct network_stream_data *d, size_t offset) {
+    struct network_stream_transfer *t = xmalloc(sizeof(*t));
+    *t = (struct network_stream_transfer){
+        .stream = d,
+        .offset = offset,
+        .end = range_set_next_start(&d->received, offset),
+    };
+
+    if (d->active != NULL) {
+        d->active->cancelled = true;
     }
+    d->active = t;
+    d->transfers += 1;
 
-    size_t written = 0;
-    while (written < VEC_SIZE(&d->data)) {
-        ssize_t ret = write(fd, VEC_DATA(&d->data), VEC_SIZE(&d->data) - written);
-        if (ret < 0) {
-            ERROR("cannot save song into cache: failed to write to file: %m");
-            goto out;
-        }
-        written += ret;
+    return t;
+}
+
+/* must be called with lock held. Returns true if stream needs to be finalised */
+static bool transfer_release(struct network_stream_data *d, struct network_stream_transfer *t) {
+    if (d->active == t) {
+        d->active = NULL;
     }
+    d->transfers -= 1;
+    free(t);
 
-    if (db_add_cached_song(&(struct cached_song){
-        .id = d->id,
-        .filetype = d->filetype,
-        .bitrate = d->bitrate,
-        .filename = filename,
-        .size = VEC_SIZE(&d->data),
-    })) {
-        DEBUG("saved song %s into cache at %s", d->id, filepath);
+    return d->closed && d->transfers == 0;
+}
+
+/* must be called WITHOUT lock held, since it might end up calling into network code.
+ * On failure, transfer is released and stream is marked as failed */
+static bool transfer_start(struct network_stream_data *d, struct network_stream_transfer *t) {
+    if (t->offset > 0 || t->end != SIZE_MAX) {
+        DEBUG("requesting bytes %zu-%zu of song %s", t->offset, t->end, d->id);
     }
 
-out:
-    if (fd >= 0) {
-        close(fd);
+    if (api_stream(d->id, d->bitrate, d->filetype,
+                   t->offset, t->end == SIZE_MAX ? 0 : t->end, d->max_recv_speed,
+                   api_stream_data_callback, t)) {
+        return true;
     }
 
-    VEC_FREE(&d->data);
-    free(d->id);
-    free(d->filetype);
-    free(d);
+    pthread_mutex_lock(&d->mutex);
+    if (d->active == t) {
+        d->error = true;
+    }
+    const bool finalise = transfer_release(d, t);
+    d->new_data = true;
+    pthread_cond_signal(&d->cond);
+    pthread_mutex_unlock(&d->mutex);
+
+    if (finalise) {
+        network_stream_finalise(d);
+    }
+
+    return false;
+}
+
+/* must be called with lock held. Returns first position that is not yet received,
+ * preferring the ones after pos, or SIZE_MAX if the whole file is received */
+static size_t find_hole(const struct network_stream_data *d, size_t pos) {
+    const struct range *r = range_set_find(&d->received, pos);
+    if (r != NULL) {
+        pos = r->end;
+    }
+    if (pos < d->size) {
+        return pos;
+    }
+
+    r = range_set_find(&d->received, 0);
+    pos = (r == NULL) ? 0 : r->end;
+    if (pos < d->size) {
+        return pos;
+    }
+
+    return SIZE_MAX;
+}
+
+/* must be called with lock held. Returns true if there's a transfer which will soon deliver pos */
+static bool pos_is_coming(const struct network_stream_data *d, size_t pos) {
+    const struct network_stream_transfer *t = d->active;
+
+    if (t == NULL) {
+        return false;
+    } else if (!d->seekable) {
+        /* nothing else to do anyway */
+        return true;
+    } else {
+        return pos >= t->offset && pos < t->end && pos - t->offset <= SEEK_WAIT_THRESHOLD;
+    }
 }
 
 static int64_t network_stream_read(void *cookie, char *buf, uint64_t nbytes) {
@@ -85,27 +195,43 @@ static int64_t network_stream_read(void *cookie, char *buf, uint64_t nbytes) {
 
     pthread_mutex_lock(&d->mutex);
 
-again:
+again:;
+    const struct range *r = range_set_find(&d->received, d->pos);
     if (d->error) {
         ret = -1;
         goto out;
-    } if ((size_t)d->pos < VEC_SIZE(&d->data)) {
-        /* can return at least 1 byte before hitting end of buffer */
-        const uint64_t available = VEC_SIZE(&d->data) - d->pos;
+    } else if (r != NULL) {
+        /* can return at least 1 byte before hitting end of received data.
+         * Received data is never written to again, so no need to hold the lock */
+        const uint64_t available = r->end - d->pos;
         const uint64_t len = MIN(available, nbytes);
+        const int64_t pos = d->pos;
 
-        memcpy(buf, VEC_DATA(&d->data) + d->pos, len);
-        d->pos += len;
+        pthread_mutex_unlock(&d->mutex);
+        ret = pread(d->fd, buf, len, pos);
+        if (ret < 0) {
+            ERROR("failed to read from %s: %m", d->partpath);
+        }
+        pthread_mutex_lock(&d->mutex);
 
-        ret = len;
+        if (ret > 0) {
+            d->pos += ret;
+        }
         goto out;
-    } else if (d->eof) {
-        /* hit end of buffer and there's no more data to be received. Signal EOF */
+    } else if (d->complete || (d->size > 0 && (size_t)d->pos >= d->size)) {
+        /* hit end of file. Signal EOF */
         ret = 0;
         goto out;
-    } else /* if (!d->eof) */ {
-        /* hit end of buffer, but there might be more data to receive.
-         * Need to block until more data arrives and retry */
+    } else {
+        /* requested data is not here yet. Make sure something is downloading it,
+         * then block until more data arrives and retry */
+        if (!pos_is_coming(d, d->pos)) {
+            struct network_stream_transfer *t = transfer_new(d, d->pos);
+            pthread_mutex_unlock(&d->mutex);
+            transfer_start(d, t);
+            pthread_mutex_lock(&d->mutex);
+        }
+
         while (!d->new_data) {
             pthread_cond_wait(&d->cond, &d->mutex);
         }
@@ -125,16 +251,29 @@ static int64_t network_stream_seek(void *cookie, int64_t offset) {
 
     pthread_mutex_lock(&d->mutex);
 
-    d->pos = MIN(VEC_SIZE(&d->data), (size_t)offset);
+    if (d->size > 0) {
+        d->pos = MIN(d->size, (size_t)offset);
+    } else {
+        d->pos = offset;
+    }
+    const int64_t pos = d->pos;
 
     pthread_mutex_unlock(&d->mutex);
 
-    return d->pos;
+    return pos;
 }
 
 static int64_t network_stream_size(void *cookie) {
     struct network_stream_data *d = cookie;
-    return VEC_SIZE(&d->data);
+
+    pthread_mutex_lock(&d->mutex);
+    int64_t size = d->size;
+    if (size == 0 && VEC_SIZE(&d->received.ranges) > 0) {
+        size = VEC_AT(&d->received.ranges, -1)->end;
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    return size;
 }
 
 static void network_stream_close(void *cookie) {
@@ -142,58 +281,156 @@ static void network_stream_close(void *cookie) {
 
     pthread_mutex_lock(&d->mutex);
 
-    TRACE("close; eof %d error %d closed %d", d->eof, d->error, d->closed);
+    TRACE("close; complete %d error %d transfers %d", d->complete, d->error, d->transfers);
 
-    if (d->eof || d->error) {
-        /* api_stream_data_callback won't be called anymore, can free now */
-        pthread_mutex_unlock(&d->mutex);
+    d->closed = true;
+    if (d->active != NULL) {
+        d->active->cancelled = true;
+        d->active = NULL;
+    }
+    /* if there are transfers in flight, the last one to finish will free the stream */
+    const bool finalise = d->transfers == 0;
+
+    pthread_mutex_unlock(&d->mutex);
+
+    if (finalise) {
         network_stream_finalise(d);
-    } else {
-        d->closed = true;
-        pthread_mutex_unlock(&d->mutex);
     }
 }
 
-static bool api_stream_data_callback(const char *errmsg, size_t expected_size,
+static bool write_all(int fd, const void *data, size_t size, size_t offset) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t ret = pwrite(fd, (const uint8_t *)data + written, size - written, offset + written);
+        if (ret < 0) {
+            return false;
+        }
+        written += ret;
+    }
+
+    return true;
+}
+
+/* must be called with lock held, on the first chunk of data of each transfer */
+static void transfer_check_info(struct network_stream_transfer *t,
+                                const struct api_stream_info *info) {
+    struct network_stream_data *d = t->stream;
+
+    if (d->size == 0 && info->total_size > 0) {
+        d->size = info->total_size;
+        /* make the file sparse, this doesn't allocate any blocks on disk */
+        if (ftruncate(d->fd, d->size) < 0) {
+            WARN("failed to resize %s to %zu bytes: %m", d->partpath, d->size);
+        }
+    }
+
+    if (t->offset == 0) {
+        /* transcoding servers might claim to support ranges while not actually supporting
+         * them, only trust them with raw files. Also only enable it once size is known */
+        d->seekable = info->seekable && d->size > 0 && STREQ(d->filetype, "raw");
+        DEBUG("stream for song %s is %sseekable", d->id, d->seekable ? "" : "not ");
+    } else if (info->offset != t->offset) {
+        WARN("server ignored range request, wanted %zu got %zu", t->offset, info->offset);
+        d->seekable = false;
+        t->offset = info->offset;
+        t->end = SIZE_MAX;
+    }
+}
+
+static bool api_stream_data_callback(const char *errmsg, const struct api_stream_info *info,
                                      const void *data, ssize_t data_size, void *userdata) {
-    struct network_stream_data *d = userdata;
+    struct network_stream_transfer *t = userdata;
+    struct network_stream_data *d = t->stream;
+    struct network_stream_transfer *next = NULL;
+    bool finalise = false;
+    bool ret = true;
 
     pthread_mutex_lock(&d->mutex);
 
-    if (d->closed) {
-        /* mpv doesn't need this stream anymore */
-        pthread_mutex_unlock(&d->mutex);
-        network_stream_finalise(d);
-        return false;
+    if (t->cancelled) {
+        /* mpv doesn't need this transfer or the entire stream anymore */
+        finalise = transfer_release(d, t);
+        ret = false;
+        goto out;
     }
 
     switch (data_size) {
     case -1: /* error */
-        d->error = true;
         ERROR("data: %s", errmsg);
-        /* fall through */
+        d->error = true;
+        finalise = transfer_release(d, t);
+        break;
     case 0: /* EOF */
-        d->eof = true;
+        if (!t->started) {
+            ERROR("server returned no data for song %s", d->id);
+            d->error = true;
+        } else if (!d->seekable) {
+            /* whatever was received in one go is the entire file */
+            d->size = t->offset;
+            d->complete = true;
+        } else if (range_set_covers(&d->received, 0, d->size)) {
+            d->complete = true;
+        } else if (!d->closed) {
+            /* fill the holes left by seeking, so the file can be saved into cache */
+            const size_t hole = find_hole(d, d->pos);
+            if (hole != SIZE_MAX) {
+                next = transfer_new(d, hole);
+            }
+        }
+        finalise = transfer_release(d, t);
         break;
     default: /* data */
-        if (VEC_SIZE(&d->data) == 0 && expected_size > 0) {
-            VEC_RESERVE(&d->data, expected_size);
+        if (!t->started) {
+            transfer_check_info(t, info);
+            t->started = true;
+        }
+
+        const size_t len = MIN((size_t)data_size, t->end - t->offset);
+        if (len == 0) {
+            /* got more than asked for. Ignore it, EOF will come eventually */
+            break;
+        }
+
+        /* nobody else writes to this part of the file, so no need to hold the lock */
+        const size_t offset = t->offset;
+        pthread_mutex_unlock(&d->mutex);
+        const bool ok = write_all(d->fd, data, len, offset);
+        pthread_mutex_lock(&d->mutex);
+
+        if (!ok) {
+            ERROR("failed to write to %s: %m", d->partpath);
+            d->error = true;
+            finalise = transfer_release(d, t);
+            ret = false;
+        } else {
+            range_set_add(&d->received, offset, offset + len);
+            t->offset += len;
         }
-        VEC_APPEND_N(&d->data, (uint8_t *)data, data_size);
         break;
     }
+
+out:
     d->new_data = true;
     pthread_cond_signal(&d->cond);
 
     pthread_mutex_unlock(&d->mutex);
 
-    return true;
+    if (next != NULL) {
+        transfer_start(d, next);
+    }
+    if (finalise) {
+        network_stream_finalise(d);
+    }
+
+    return ret;
 }
 
-bool stream_open_from_network(const char *id, int bitrate, const char *filetype,
-                              struct stream_functions *funcs, void **userdata) {
+static struct network_stream_data *network_stream_new(const char *id, int bitrate,
+                                                      const char *filetype) {
     struct network_stream_data *d = xmalloc(sizeof(*d));
     *d = (struct network_stream_data){
+        .fd = -1,
+
         .cond = PTHREAD_COND_INITIALIZER,
         .mutex = PTHREAD_MUTEX_INITIALIZER,
 
@@ -202,7 +439,36 @@ bool stream_open_from_network(const char *id, int bitrate, const char *filetype,
         .filetype = xstrdup(filetype),
     };
 
-    if (!api_stream(id, bitrate, filetype, api_stream_data_callback, d)) {
+    xasprintf(&d->filename, "%li_%s", config.server_id, id);
+    /* unique name, the same song might be downloaded by several streams at once */
+    xasprintf(&d->partpath, "%s/%s.part.XXXXXX", config.music_cache_dir, d->filename);
+
+    d->fd = mkostemp(d->partpath, O_CLOEXEC);
+    if (d->fd < 0) {
+        ERROR("failed to create file %s: %m", d->partpath);
+        return d;
+    }
+    TRACE("opened file at %s", d->partpath);
+    /* mkostemp creates it as 0600, cache is fine without it being readable by others */
+    if (fchmod(d->fd, 0644) < 0) {
+        WARN("failed to change mode of %s: %m", d->partpath);
+    }
+
+    return d;
+}
+
+bool stream_open_from_network(const char *id, int bitrate, const char *filetype,
+                              struct stream_functions *funcs, void **userdata) {
+    struct network_stream_data *d = network_stream_new(id, bitrate, filetype);
+    if (d->fd < 0) {
+        goto err;
+    }
+
+    pthread_mutex_lock(&d->mutex);
+    struct network_stream_transfer *t = transfer_new(d, 0);
+    pthread_mutex_unlock(&d->mutex);
+
+    if (!transfer_start(d, t)) {
         goto err;
     }
 
@@ -222,3 +488,26 @@ err:
     return false;
 }
 
+bool stream_prefetch(const char *id, int bitrate, const char *filetype, size_t max_recv_speed,
+                     stream_cache_callback_t callback, void *callback_data) {
+    struct network_stream_data *d = network_stream_new(id, bitrate, filetype);
+    d->prefetch_callback = callback;
+    d->prefetch_callback_data = callback_data;
+    d->max_recv_speed = max_recv_speed;
+
+    if (d->fd < 0) {
+        network_stream_finalise(d);
+        return false;
+    }
+
+    /* nobody is going to read from it, so it's closed from the start.
+     * It will be finalised (and saved into cache) once the transfer completes */
+    d->closed = true;
+
+    pthread_mutex_lock(&d->mutex);
+    struct network_stream_transfer *t = transfer_new(d, 0);
+    pthread_mutex_unlock(&d->mutex);
+
+    return transfer_start(d, t);
+}
+
@@ -1,10 +1,20 @@
 #ifndef SRC_STREAM_NETWORK_H
 #define SRC_STREAM_NETWORK_H
 
+#include <stddef.h>
+
 #include "stream/open.h"
+#include "stream/cache.h"
 
 bool stream_open_from_network(const char *id, int bitrate, const char *filetype,
                               struct stream_functions *funcs, void **userdata);
 
+/*
+ * Downloads song into cache in background without opening a stream.
+ * Callback is called exactly once when download is over, even if this function fails.
+ */
+bool stream_prefetch(const char *id, int bitrate, const char *filetype, size_t max_recv_speed,
+                     stream_cache_callback_t callback, void *callback_data);
+
 #endif /* #ifndef SRC_STREAM_NETWORK_H */
 
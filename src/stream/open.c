@@ -31,6 +31,16 @@ static bool should_fetch_again(const char *cached_filetype, int cached_bitrate,
     }
 }
 
+bool stream_is_cached(const char *song_id, int bitrate, const char *filetype) {
+    [[gnu::cleanup(cached_song_free_contents)]] struct cached_song cached_song = {0};
+
+    if (!db_get_cached_song(&cached_song, song_id)) {
+        return false;
+    }
+
+    return !should_fetch_again(cached_song.filetype, cached_song.bitrate, filetype, bitrate);
+}
+
 bool stream_open(const char *song_id, int bitrate, const char *filetype,
                  struct stream_functions *functions, void **userdata) {
     [[gnu::cleanup(cleanup_free)]] char *filepath = NULL;
@@ -18,5 +18,8 @@ struct stream_functions {
 bool stream_open(const char *song_id, int bitrate, const char *filetype,
                  struct stream_functions *functions, void **userdata);
 
+/* returns true if song is in cache and does not need to be fetched again */
+bool stream_is_cached(const char *song_id, int bitrate, const char *filetype);
+
 #endif /* #ifndef SRC_STREAM_OPEN_H */
 
@@ -1,8 +1,71 @@
+#include <time.h>
+
 #include "tui/draw.h"
 #include "tui/internal.h"
 #include "player/playlist.h"
+#include "eventloop.h"
 #include "log.h"
 
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+}
+
+static int frame_callback(struct pollen_callback *, void *) {
+    const uint32_t damage = tui.frame.pending;
+    tui.frame.pending = 0;
+    tui.frame.last_frame_ns = now_ns();
+
+    if (damage & DRAW_DAMAGE_TAB_BAR) {
+        draw_tab_bar();
+    }
+    if (damage & DRAW_DAMAGE_STATUS_BAR) {
+        draw_status_bar();
+    }
+    if (damage & DRAW_DAMAGE_MENU) {
+        tui_menu_flush(&tui.tabs[tui.tab].menu);
+    }
+
+    doupdate();
+
+    return 0;
+}
+
+void draw_damage(uint32_t damage) {
+    if (damage == 0) {
+        return;
+    }
+
+    const bool scheduled = (tui.frame.pending != 0);
+    tui.frame.pending |= damage;
+    if (scheduled || tui.frame.timer == NULL) {
+        return;
+    }
+
+    /* 0 would disarm the timer */
+    const uint64_t now = now_ns();
+    const uint64_t next_frame = tui.frame.last_frame_ns + DRAW_FRAME_MS * 1'000'000ull;
+    pollen_timer_arm_ns(tui.frame.timer, false, (next_frame > now) ? next_frame - now : 1, 0);
+}
+
+bool draw_init(void) {
+    tui.frame.timer = pollen_loop_add_timer(event_loop, CLOCK_MONOTONIC, frame_callback, NULL);
+    if (tui.frame.timer == NULL) {
+        ERROR("failed to create frame timer");
+        return false;
+    }
+
+    return true;
+}
+
+void draw_cleanup(void) {
+    if (tui.frame.timer != NULL) {
+        pollen_loop_remove_callback(tui.frame.timer);
+        tui.frame.timer = NULL;
+    }
+}
+
 static const char *tab_names[] = {
     [TUI_TAB_PLAYLIST] = "Playlist",
     [TUI_TAB_ARTISTS] = "Artists",
@@ -27,6 +90,18 @@ void draw_tab_bar(void) {
         }
     }
 
+    const struct string *filter = &tui.tabs[tui.tab].filter;
+    if (tui.filter_editing || filter->len > 0) {
+        if (tui.filter_editing) {
+            wattron(tui.tabbar_win, A_REVERSE);
+        }
+        wprintw(tui.tabbar_win, "/%s", filter->len > 0 ? filter->str : "");
+        if (tui.filter_editing) {
+            wattroff(tui.tabbar_win, A_REVERSE);
+        }
+    }
+    wclrtoeol(tui.tabbar_win);
+
     wnoutrefresh(tui.tabbar_win);
 }
 
@@ -1,6 +1,28 @@
 #ifndef SRC_TUI_DRAW_H
 #define SRC_TUI_DRAW_H
 
+#include <stdint.h>
+
+/*
+ * Nothing calls doupdate directly. Whatever changed is marked as damaged instead,
+ * and all damage within one frame is drawn at once with a single doupdate.
+ * First damage after a quiet period gets drawn on the next loop iteration.
+ */
+#define DRAW_FRAME_MS 16
+
+enum draw_damage {
+    DRAW_DAMAGE_TAB_BAR = 1 << 0,
+    DRAW_DAMAGE_STATUS_BAR = 1 << 1,
+    DRAW_DAMAGE_MENU = 1 << 2, /* dirty rows of current tab menu, see tui_menu_flush */
+
+    DRAW_DAMAGE_ALL = DRAW_DAMAGE_TAB_BAR | DRAW_DAMAGE_STATUS_BAR | DRAW_DAMAGE_MENU,
+};
+
+bool draw_init(void);
+void draw_cleanup(void);
+
+void draw_damage(uint32_t damage);
+
 void draw_tab_bar(void);
 void draw_status_bar(void);
 void draw_mainwin(void);
@@ -1,4 +1,7 @@
 #include <assert.h>
+#include <limits.h>
+#include <wchar.h>
+#include <wctype.h>
 
 #include "tui/events.h"
 #include "tui/internal.h"
@@ -21,7 +24,6 @@ void tui_handle_resize(int width, int height) {
     for (int i = 0; i < TUI_TAB_COUNT; i++) {
         tui_menu_position(&tui.tabs[i].menu, 0, 1, COLS, LINES - STATUSBAR_HEIGHT - 1);
     }
-    tui_menu_draw(&tui.tabs[tui.tab].menu);
 
     if (tui.statusbar.win != NULL) {
         delwin(tui.statusbar.win);
@@ -30,20 +32,88 @@ void tui_handle_resize(int width, int height) {
     nodelay(tui.statusbar.win, true); /* makes getch() return ERR instead of blocking */
     keypad(tui.statusbar.win, true); /* enable recognition of escape sequences */
     leaveok(tui.statusbar.win, true);
-    draw_status_bar();
 
     if (tui.tabbar_win != NULL) {
         delwin(tui.tabbar_win);
     }
     tui.tabbar_win = newwin(1, COLS, 0, 0);
     leaveok(tui.tabbar_win, true);
-    draw_tab_bar();
 
-    doupdate();
+    draw_damage(DRAW_DAMAGE_ALL);
+}
+
+static void tui_handle_filter_key(uint32_t key) {
+    struct string *filter = &tui.tabs[tui.tab].filter;
+
+    switch (key) {
+    case '\n':
+    case '\r':
+        /* done typing, filter stays */
+        tui.filter_editing = false;
+        break;
+    case 27: /* escape */
+        tui.filter_editing = false;
+        string_clear(filter);
+        tui_tab_filter();
+        break;
+    case 127: /* backspace */
+    case '\b':
+        if (filter->len == 0) {
+            return;
+        }
+        /* remove the whole utf-8 sequence, not just its last byte */
+        do {
+            filter->len -= 1;
+        } while (filter->len > 0 && ((unsigned char)filter->str[filter->len] & 0xC0) == 0x80);
+        filter->str[filter->len] = '\0';
+        tui_tab_filter();
+        break;
+    default: {
+        if (!iswprint(key)) {
+            return;
+        }
+
+        char mb[MB_LEN_MAX + 1];
+        const size_t len = wcrtomb(mb, key, &(mbstate_t){0});
+        if (len == (size_t)-1) {
+            return;
+        }
+        mb[len] = '\0';
+
+        string_append(filter, mb);
+        tui_tab_filter();
+        break;
+    }
+    }
+
+    draw_damage(DRAW_DAMAGE_TAB_BAR);
+}
+
+static void on_db_synced(bool changed, void *data) {
+    if (!changed) {
+        return;
+    }
+
+    /* current one is re-read right away, the rest when activated */
+    tui.tabs[TUI_TAB_ARTISTS].artists.populated = false;
+    tui.tabs[TUI_TAB_ALBUMS].albums.populated = false;
+    tui.tabs[TUI_TAB_SONGS].songs.populated = false;
+    tui_tab_refresh();
 }
 
 void tui_handle_key(uint32_t key) {
+    if (tui.filter_editing) {
+        tui_handle_filter_key(key);
+        return;
+    }
+
     switch (key) {
+    case '/':
+        tui.filter_editing = true;
+        string_clear(&tui.tabs[tui.tab].filter);
+        tui_tab_filter();
+        draw_damage(DRAW_DAMAGE_TAB_BAR);
+        break;
     case 'l':
         player_seek(5, true);
         break;
@@ -75,42 +145,19 @@ void tui_handle_key(uint32_t key) {
         player_toggle_pause();
         break;
     case 'R':
-        db_populate();
+        db_sync(on_db_synced, NULL);
+        break;
+    case 18: /* ctrl+r, full resync for changes incremental sync can't see */
+        db_populate(on_db_synced, NULL);
         break;
     case 'r':
-        switch (tui.tab) {
-        case TUI_TAB_ARTISTS:
-            tui_tab_artists_populate();
-            break;
-        case TUI_TAB_ALBUMS:
-            tui_tab_albums_populate();
-            break;
-        case TUI_TAB_SONGS:
-            tui_tab_songs_populate();
-            break;
-        case TUI_TAB_ARTIST:
-            if (tui.tabs[TUI_TAB_ARTIST].artist.artist != NULL) {
-                tui_tab_artist_populate(tui.tabs[TUI_TAB_ARTIST].artist.artist);
-            }
-            break;
-        case TUI_TAB_ALBUM:
-            if (tui.tabs[TUI_TAB_ALBUM].album.album != NULL) {
-                tui_tab_album_populate(tui.tabs[TUI_TAB_ALBUM].album.album);
-            }
-            break;
-        default:
-        }
-        doupdate();
+        tui_tab_refresh();
         break;
     case 'k':
-        if (tui_menu_select_prev(&tui.tabs[tui.tab].menu)) {
-            doupdate();
-        }
+        tui_menu_select_prev(&tui.tabs[tui.tab].menu);
         break;
     case 'j':
-        if (tui_menu_select_next(&tui.tabs[tui.tab].menu)) {
-            doupdate();
-        }
+        tui_menu_select_next(&tui.tabs[tui.tab].menu);
         break;
     case 'a':
         tui_menu_action_append(&tui.tabs[tui.tab].menu);
@@ -121,27 +168,21 @@ void tui_handle_key(uint32_t key) {
         break;
     case 'p':
         tui_tab_playlist_activate();
-        doupdate();
         break;
     case '1':
         tui_tab_artists_activate();
-        doupdate();
         break;
     case '2':
         tui_tab_albums_activate();
-        doupdate();
         break;
     case '3':
         tui_tab_songs_activate();
-        doupdate();
         break;
     case '4':
         tui_tab_artist_activate(NULL);
-        doupdate();
         break;
     case '5':
         tui_tab_album_activate(NULL);
-        doupdate();
         break;
     case 'q':
         player_quit();
@@ -151,24 +192,33 @@ void tui_handle_key(uint32_t key) {
     }
 }
 
+/* assigns val to field and evaluates to true if that changed what's on screen */
+#define STATUSBAR_SET(field, val) \
+    ({ const typeof(field) v__ = (val); const bool c__ = (field != v__); field = v__; c__; })
+
 void tui_handle_player_events(uint64_t event, const struct signal_data *data, void *userdata) {
+    bool damage = false;
+
     switch ((enum player_event)event) {
     case PLAYER_EVENT_VOLUME:
-        tui.statusbar.volume = data->as.i64;
+        damage = STATUSBAR_SET(tui.statusbar.volume, data->as.i64);
         break;
     case PLAYER_EVENT_MUTE:
-        tui.statusbar.mute = data->as.boolean;
+        damage = STATUSBAR_SET(tui.statusbar.mute, data->as.boolean);
         break;
     case PLAYER_EVENT_PAUSE:
-        tui.statusbar.pause = data->as.boolean;
+        damage = STATUSBAR_SET(tui.statusbar.pause, data->as.boolean);
         break;
     case PLAYER_EVENT_PERCENT_POSITION:
-        tui.statusbar.pos = data->as.i64;
+        damage = STATUSBAR_SET(tui.statusbar.pos, data->as.i64);
         break;
     case PLAYER_EVENT_DURATION:
+        /* only whole seconds are shown */
+        damage = (tui.statusbar.duration / 1'000 != data->as.u64 / 1'000);
         tui.statusbar.duration = data->as.u64;
         break;
     case PLAYER_EVENT_TIME_POSITION:
+        damage = (tui.statusbar.time_pos / 1'000 != data->as.u64 / 1'000);
         tui.statusbar.time_pos = data->as.u64;
         break;
     case PLAYER_EVENT_PLAYLIST_POSITION: {
@@ -184,7 +234,7 @@ void tui_handle_player_events(uint64_t event, const struct signal_data *data, vo
             struct tui_menu_item *old = tui_menu_get_item(&tab->menu, old_index);
             assert(old->type == TUI_MENU_ITEM_TYPE_PLAYLIST_ITEM);
             old->as.playlist_item.current = false;
-            tui_menu_draw_item(&tab->menu, old_index);
+            tui_menu_redraw_item(&tab->menu, old_index);
         }
 
         /* mark new one as current */
@@ -192,10 +242,12 @@ void tui_handle_player_events(uint64_t event, const struct signal_data *data, vo
             struct tui_menu_item *new = tui_menu_get_item(&tab->menu, new_index);
             assert(new->type == TUI_MENU_ITEM_TYPE_PLAYLIST_ITEM);
             new->as.playlist_item.current = true;
-            tui_menu_draw_item(&tab->menu, new_index);
+            tui_menu_redraw_item(&tab->menu, new_index);
         }
 
         tab->playlist.current = new_index;
+        /* current song title is in the status bar */
+        damage = (new_index != old_index);
 
         break;
     }
@@ -214,31 +266,36 @@ void tui_handle_player_events(uint64_t event, const struct signal_data *data, vo
             },
         };
         tui_menu_insert_or_replace_item(&tui.tabs[TUI_TAB_PLAYLIST].menu, index, &item);
+        damage = item.as.playlist_item.current;
         break;
     }
     }
 
-    draw_status_bar();
-    doupdate();
+    if (damage) {
+        draw_damage(DRAW_DAMAGE_STATUS_BAR);
+    }
 }
 
 void tui_handle_network_events(uint64_t event, const struct signal_data *data, void *userdata) {
+    bool damage = false;
+
     switch ((enum network_event)event) {
     case NETWORK_EVENT_SPEED_DL:
-        tui.statusbar.net_speed[NET_SPEED_DL] = data->as.u64;
+        damage = STATUSBAR_SET(tui.statusbar.net_speed[NET_SPEED_DL], data->as.u64);
         break;
     case NETWORK_EVENT_SPEED_UL:
-        tui.statusbar.net_speed[NET_SPEED_UL] = data->as.u64;
+        damage = STATUSBAR_SET(tui.statusbar.net_speed[NET_SPEED_UL], data->as.u64);
         break;
     case NETWORK_EVENT_CONNECTIONS:
-        tui.statusbar.net_conns = data->as.u64;
+        damage = STATUSBAR_SET(tui.statusbar.net_conns, data->as.u64);
         if (tui.statusbar.net_conns == 0) {
             tui.statusbar.net_speed[0] = tui.statusbar.net_speed[1] = 0;
         }
         break;
     }
 
-    draw_status_bar();
-    doupdate();
+    if (damage) {
+        draw_damage(DRAW_DAMAGE_STATUS_BAR);
+    }
 }
 
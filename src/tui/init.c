@@ -7,6 +7,7 @@
 #include "tui/utils.h"
 #include "tui/internal.h"
 #include "tui/events.h"
+#include "tui/draw.h"
 #include "player/events.h"
 #include "network/events.h"
 #include "log.h"
@@ -90,6 +91,10 @@ bool tui_init(void) {
 
     pollen_loop_add_fd(event_loop, 0 /* stdin */, EPOLLIN, false, stdin_handler, NULL);
 
+    if (!draw_init()) {
+        return false;
+    }
+
     tui.resize_callback = pollen_loop_add_efd(event_loop, sigwinch_handler_deferred, NULL);
     sigaction(SIGWINCH, &(struct sigaction){
         /* From mpv/client.h:
@@ -119,6 +124,8 @@ bool tui_init(void) {
 }
 
 void tui_cleanup(void) {
+    draw_cleanup();
+
     if (tui.statusbar.win != NULL) {
         delwin(tui.statusbar.win);
     }
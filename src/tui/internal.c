@@ -1,10 +1,11 @@
 #include <stdlib.h>
-#include <limits.h>
 
 #include "tui/internal.h"
 #include "tui/draw.h"
 #include "cleanup.h"
 #include "db/query.h"
+#include "db/worker.h"
+#include "xmalloc.h"
 
 struct tui tui = {
     .tab = TUI_TAB_SONGS,
@@ -23,25 +24,55 @@ void tui_tab_playlist_activate(void) {
     tui.tab = TUI_TAB_PLAYLIST;
     tui_menu_show(&tui.tabs[tui.tab].menu);
 
-    draw_tab_bar();
-    doupdate();
+    draw_damage(DRAW_DAMAGE_TAB_BAR);
+}
+
+/*
+ * Sources of virtual menus of songs, albums and artists tabs. Rows are moved out of
+ * arrays returned by db, so nothing is copied twice.
+ */
+static size_t fetch_songs(size_t first, size_t count, const struct tui_menu_item *prev,
+                          struct tui_menu_item *items, void *data) {
+    struct song *songs = NULL;
+    size_t nsongs = 0;
+    if (prev != NULL && prev->type == TUI_MENU_ITEM_TYPE_SONG) {
+        nsongs = db_get_songs_after(&songs, prev->as.song.song, count);
+    } else {
+        nsongs = db_get_songs(&songs, first, count);
+    }
+
+    for (size_t i = 0; i < nsongs; i++) {
+        items[i].type = TUI_MENU_ITEM_TYPE_SONG;
+        items[i].as.song.song = xmalloc(sizeof(struct song));
+        *items[i].as.song.song = songs[i];
+    }
+    free(songs);
+
+    return nsongs;
 }
 
 void tui_tab_songs_populate(void) {
-    [[gnu::cleanup(cleanup_free)]] struct song *songs = NULL;
-    const size_t nsongs = db_get_songs(&songs, 0, INT64_MAX);
+    tui_menu_set_source(&tui.tabs[TUI_TAB_SONGS].menu, db_count_songs(), fetch_songs, NULL);
+}
 
-    tui_menu_clear(&tui.tabs[tui.tab].menu);
+/* results of searches made by tui_tab_filter arrive here */
+static void on_songs_found(struct song *songs, size_t nsongs, void *data) {
+    struct tui_tab *tab = &tui.tabs[TUI_TAB_SONGS];
+    const bool stale = ((uintptr_t)data != tab->songs.search);
+
+    if (!stale) {
+        tui_menu_clear(&tab->menu);
+    }
     for (size_t i = 0; i < nsongs; i++) {
-        struct song *s = &songs[i];
-        tui_menu_append_item(&tui.tabs[tui.tab].menu, &(struct tui_menu_item){
-            .type = TUI_MENU_ITEM_TYPE_SONG,
-            .as.song = {
-                .song = s,
-            },
-        });
-        song_free_contents(s);
+        if (!stale) {
+            tui_menu_append_item(&tab->menu, &(struct tui_menu_item){
+                .type = TUI_MENU_ITEM_TYPE_SONG,
+                .as.song.song = &songs[i],
+            });
+        }
+        song_free_contents(&songs[i]);
     }
+    free(songs);
 }
 
 void tui_tab_songs_activate(void) {
@@ -50,30 +81,55 @@ void tui_tab_songs_activate(void) {
     tui_menu_show(&tui.tabs[tui.tab].menu);
 
     if (!tui.tabs[tui.tab].songs.populated) {
-        tui_tab_songs_populate();
+        /* populates it, or searches if it was left with a filter */
+        tui_tab_filter();
         tui.tabs[tui.tab].songs.populated = true;
     }
 
-    draw_tab_bar();
-    doupdate();
+    draw_damage(DRAW_DAMAGE_TAB_BAR);
 }
 
-void tui_tab_albums_populate(void) {
-    [[gnu::cleanup(cleanup_free)]] struct album *albums = NULL;
-    const size_t nalbums = db_get_albums(&albums, 0, INT64_MAX);
+static size_t fetch_albums(size_t first, size_t count, const struct tui_menu_item *prev,
+                           struct tui_menu_item *items, void *data) {
+    struct album *albums = NULL;
+    size_t nalbums = 0;
+    if (prev != NULL && prev->type == TUI_MENU_ITEM_TYPE_ALBUM) {
+        nalbums = db_get_albums_after(&albums, prev->as.album.album, count);
+    } else {
+        nalbums = db_get_albums(&albums, first, count);
+    }
 
-    tui_menu_clear(&tui.tabs[tui.tab].menu);
     for (size_t i = 0; i < nalbums; i++) {
-        struct album *s = &albums[i];
+        items[i].type = TUI_MENU_ITEM_TYPE_ALBUM;
+        items[i].as.album.album = xmalloc(sizeof(struct album));
+        *items[i].as.album.album = albums[i];
+    }
+    free(albums);
 
-        tui_menu_append_item(&tui.tabs[tui.tab].menu, &(struct tui_menu_item){
-            .type = TUI_MENU_ITEM_TYPE_ALBUM,
-            .as.album = {
-                .album = s,
-            },
-        });
-        album_free_contents(s);
+    return nalbums;
+}
+
+void tui_tab_albums_populate(void) {
+    tui_menu_set_source(&tui.tabs[TUI_TAB_ALBUMS].menu, db_count_albums(), fetch_albums, NULL);
+}
+
+static void on_albums_found(struct album *albums, size_t nalbums, void *data) {
+    struct tui_tab *tab = &tui.tabs[TUI_TAB_ALBUMS];
+    const bool stale = ((uintptr_t)data != tab->albums.search);
+
+    if (!stale) {
+        tui_menu_clear(&tab->menu);
     }
+    for (size_t i = 0; i < nalbums; i++) {
+        if (!stale) {
+            tui_menu_append_item(&tab->menu, &(struct tui_menu_item){
+                .type = TUI_MENU_ITEM_TYPE_ALBUM,
+                .as.album.album = &albums[i],
+            });
+        }
+        album_free_contents(&albums[i]);
+    }
+    free(albums);
 }
 
 void tui_tab_albums_activate(void) {
@@ -83,30 +139,55 @@ void tui_tab_albums_activate(void) {
     tui_menu_show(&tui.tabs[tui.tab].menu);
 
     if (!tui.tabs[tui.tab].albums.populated) {
-        tui_tab_albums_populate();
+        /* populates it, or searches if it was left with a filter */
+        tui_tab_filter();
         tui.tabs[tui.tab].albums.populated = true;
     }
 
-    draw_tab_bar();
-    doupdate();
+    draw_damage(DRAW_DAMAGE_TAB_BAR);
 }
 
-void tui_tab_artists_populate(void) {
-    [[gnu::cleanup(cleanup_free)]] struct artist *artists = NULL;
-    const size_t nartists = db_get_artists(&artists, 0, INT64_MAX);
+static size_t fetch_artists(size_t first, size_t count, const struct tui_menu_item *prev,
+                            struct tui_menu_item *items, void *data) {
+    struct artist *artists = NULL;
+    size_t nartists = 0;
+    if (prev != NULL && prev->type == TUI_MENU_ITEM_TYPE_ARTIST) {
+        nartists = db_get_artists_after(&artists, prev->as.artist.artist, count);
+    } else {
+        nartists = db_get_artists(&artists, first, count);
+    }
 
-    tui_menu_clear(&tui.tabs[tui.tab].menu);
     for (size_t i = 0; i < nartists; i++) {
-        struct artist *s = &artists[i];
+        items[i].type = TUI_MENU_ITEM_TYPE_ARTIST;
+        items[i].as.artist.artist = xmalloc(sizeof(struct artist));
+        *items[i].as.artist.artist = artists[i];
+    }
+    free(artists);
 
-        tui_menu_append_item(&tui.tabs[tui.tab].menu, &(struct tui_menu_item){
-            .type = TUI_MENU_ITEM_TYPE_ARTIST,
-            .as.artist = {
-                .artist = s,
-            },
-        });
-        artist_free_contents(s);
+    return nartists;
+}
+
+void tui_tab_artists_populate(void) {
+    tui_menu_set_source(&tui.tabs[TUI_TAB_ARTISTS].menu, db_count_artists(), fetch_artists, NULL);
+}
+
+static void on_artists_found(struct artist *artists, size_t nartists, void *data) {
+    struct tui_tab *tab = &tui.tabs[TUI_TAB_ARTISTS];
+    const bool stale = ((uintptr_t)data != tab->artists.search);
+
+    if (!stale) {
+        tui_menu_clear(&tab->menu);
+    }
+    for (size_t i = 0; i < nartists; i++) {
+        if (!stale) {
+            tui_menu_append_item(&tab->menu, &(struct tui_menu_item){
+                .type = TUI_MENU_ITEM_TYPE_ARTIST,
+                .as.artist.artist = &artists[i],
+            });
+        }
+        artist_free_contents(&artists[i]);
     }
+    free(artists);
 }
 
 void tui_tab_artists_activate(void) {
@@ -116,12 +197,12 @@ void tui_tab_artists_activate(void) {
     tui_menu_show(&tui.tabs[tui.tab].menu);
 
     if (!tui.tabs[tui.tab].artists.populated) {
-        tui_tab_artists_populate();
+        /* populates it, or searches if it was left with a filter */
+        tui_tab_filter();
         tui.tabs[tui.tab].artists.populated = true;
     }
 
-    draw_tab_bar();
-    doupdate();
+    draw_damage(DRAW_DAMAGE_TAB_BAR);
 }
 
 void tui_tab_album_populate(const struct album *album) {
@@ -146,6 +227,8 @@ void tui_tab_album_populate(const struct album *album) {
 
         song_free_contents(&songs[i]);
     }
+
+    tui_menu_filter(&tui.tabs[tui.tab].menu, tui.tabs[tui.tab].filter.str);
 }
 
 void tui_tab_album_activate(const struct album *album) {
@@ -158,8 +241,7 @@ void tui_tab_album_activate(const struct album *album) {
         tui_tab_album_populate(album);
     }
 
-    draw_tab_bar();
-    doupdate();
+    draw_damage(DRAW_DAMAGE_TAB_BAR);
 }
 
 void tui_tab_artist_populate(const struct artist *artist) {
@@ -209,6 +291,8 @@ void tui_tab_artist_populate(const struct artist *artist) {
 
         song_free_contents(&songs[i]);
     }
+
+    tui_menu_filter(&tui.tabs[tui.tab].menu, tui.tabs[tui.tab].filter.str);
 }
 
 void tui_tab_artist_activate(const struct artist *artist) {
@@ -221,7 +305,77 @@ void tui_tab_artist_activate(const struct artist *artist) {
         tui_tab_artist_populate(artist);
     }
 
-    draw_tab_bar();
-    doupdate();
+    draw_damage(DRAW_DAMAGE_TAB_BAR);
 }
 
+void tui_tab_filter(void) {
+    struct tui_tab *tab = &tui.tabs[tui.tab];
+    const char *query = tab->filter.str;
+    const bool empty = (query == NULL || query[0] == '\0');
+
+    /* these are too big to keep in memory and scan, so fts5 does it on the db worker */
+    switch (tui.tab) {
+    case TUI_TAB_SONGS:
+        tab->songs.search += 1;
+        if (empty) {
+            tui_tab_songs_populate();
+        } else {
+            db_search_songs_async(query, 0, TUI_SEARCH_RESULTS,
+                                  on_songs_found, (void *)tab->songs.search);
+        }
+        break;
+    case TUI_TAB_ALBUMS:
+        tab->albums.search += 1;
+        if (empty) {
+            tui_tab_albums_populate();
+        } else {
+            db_search_albums_async(query, 0, TUI_SEARCH_RESULTS,
+                                   on_albums_found, (void *)tab->albums.search);
+        }
+        break;
+    case TUI_TAB_ARTISTS:
+        tab->artists.search += 1;
+        if (empty) {
+            tui_tab_artists_populate();
+        } else {
+            db_search_artists_async(query, 0, TUI_SEARCH_RESULTS,
+                                    on_artists_found, (void *)tab->artists.search);
+        }
+        break;
+    default:
+        tui_menu_filter(&tab->menu, query);
+        break;
+    }
+}
+
+void tui_tab_refresh(void) {
+    struct tui_tab *tab = &tui.tabs[tui.tab];
+
+    /* tui_tab_filter populates virtual tabs when there's no filter */
+    switch (tui.tab) {
+    case TUI_TAB_ARTISTS:
+        tab->artists.populated = true;
+        tui_tab_filter();
+        break;
+    case TUI_TAB_ALBUMS:
+        tab->albums.populated = true;
+        tui_tab_filter();
+        break;
+    case TUI_TAB_SONGS:
+        tab->songs.populated = true;
+        tui_tab_filter();
+        break;
+    case TUI_TAB_ARTIST:
+        if (tab->artist.artist != NULL) {
+            tui_tab_artist_populate(tab->artist.artist);
+        }
+        break;
+    case TUI_TAB_ALBUM:
+        if (tab->album.album != NULL) {
+            tui_tab_album_populate(tab->album.album);
+        }
+        break;
+    default:
+        break;
+    }
+}
@@ -4,6 +4,7 @@
 #include <ncurses.h>
 
 #include "tui/menu.h"
+#include "collections/string.h"
 #include "signals.h"
 
 #define STATUSBAR_HEIGHT 4
@@ -24,20 +25,28 @@ enum tui_tab_type {
     TUI_TAB_COUNT,
 };
 
+/* songs, albums and artists tabs show up to this many search results */
+#define TUI_SEARCH_RESULTS 1000
+
 struct tui_tab {
     struct tui_menu menu;
+    struct string filter; /* typed after "/", see tui_tab_filter */
     union {
         struct tui_tab_playlist {
             int current;
         } playlist;
+        /* search results that arrive after the filter changed again are dropped */
         struct tui_tab_songs {
             bool populated;
+            uintptr_t search;
         } songs;
         struct tui_tab_albums {
             bool populated;
+            uintptr_t search;
         } albums;
         struct tui_tab_artists {
             bool populated;
+            uintptr_t search;
         } artists;
         struct tui_tab_artist {
             struct artist *artist;
@@ -66,8 +75,16 @@ struct tui {
 
     WINDOW *tabbar_win;
 
+    struct {
+        struct pollen_callback *timer;
+        uint32_t pending; /* enum draw_damage */
+        uint64_t last_frame_ns;
+    } frame;
+
     enum tui_tab_type tab;
     struct tui_tab tabs[TUI_TAB_COUNT];
+
+    bool filter_editing; /* keys go to filter of current tab */
 };
 
 extern struct tui tui;
@@ -79,6 +96,11 @@ void tui_tab_artists_populate(void);
 void tui_tab_album_populate(const struct album *album);
 void tui_tab_artist_populate(const struct artist *artist);
 
+/* Applies filter of the current tab to its menu */
+void tui_tab_filter(void);
+/* Re-reads current tab from db, its filter stays applied */
+void tui_tab_refresh(void);
+
 void tui_tab_playlist_activate(void);
 void tui_tab_songs_activate(void);
 void tui_tab_albums_activate(void);
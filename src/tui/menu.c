@@ -1,8 +1,13 @@
+#include <string.h>
+
 #include "tui/menu.h"
 #include "tui/internal.h"
+#include "tui/draw.h"
 #include "player/control.h"
 #include "player/playlist.h"
 #include "db/query.h"
+#include "collections/string.h"
+#include "eventloop.h"
 #include "xmalloc.h"
 #include "macros.h"
 #include "log.h"
@@ -17,6 +22,13 @@ static void tui_menu_item_artist_draw(const struct tui_menu_item *self,
     wclrtoeol(win);
 }
 
+static void tui_menu_item_artist_key(const struct tui_menu_item *self, struct string *out) {
+    const struct artist *a = self->as.artist.artist;
+    if (a->name != NULL) {
+        string_append(out, a->name);
+    }
+}
+
 static void tui_menu_item_artist_free_contents(struct tui_menu_item *self) {
     struct tui_menu_item_artist *s = &self->as.artist;
 
@@ -69,6 +81,17 @@ static void tui_menu_item_album_draw(const struct tui_menu_item *self,
     wclrtoeol(win);
 }
 
+static void tui_menu_item_album_key(const struct tui_menu_item *self, struct string *out) {
+    const struct album *a = self->as.album.album;
+    if (a->artist != NULL) {
+        string_append(out, a->artist);
+    }
+    string_append(out, " - ");
+    if (a->name != NULL) {
+        string_append(out, a->name);
+    }
+}
+
 static void tui_menu_item_album_free_contents(struct tui_menu_item *self) {
     struct tui_menu_item_album *s = &self->as.album;
 
@@ -121,6 +144,17 @@ static void tui_menu_item_song_draw(const struct tui_menu_item *self,
     wclrtoeol(win);
 }
 
+static void tui_menu_item_song_key(const struct tui_menu_item *self, struct string *out) {
+    const struct song *s = self->as.song.song;
+    if (s->artist != NULL) {
+        string_append(out, s->artist);
+    }
+    string_append(out, " - ");
+    if (s->title != NULL) {
+        string_append(out, s->title);
+    }
+}
+
 static void tui_menu_item_song_free_contents(struct tui_menu_item *self) {
     struct tui_menu_item_song *s = &self->as.song;
 
@@ -159,6 +193,10 @@ static void tui_menu_item_empty_draw(const struct tui_menu_item *self,
     wclrtoeol(win);
 }
 
+static void tui_menu_item_empty_key(const struct tui_menu_item *self, struct string *out) {
+    /* no-op, never matches */
+}
+
 static void tui_menu_item_empty_free_contents(struct tui_menu_item *self) {
     /* no-op */
 }
@@ -204,6 +242,12 @@ static void tui_menu_item_playlist_item_draw(const struct tui_menu_item *self,
     }
 }
 
+static void tui_menu_item_playlist_item_key(const struct tui_menu_item *self,
+                                            struct string *out) {
+    const struct song *s = self->as.playlist_item.song;
+    string_appendf(out, "%s - %s", s->artist, s->title);
+}
+
 static void tui_menu_item_playlist_item_free_contents(struct tui_menu_item *self) {
     struct tui_menu_item_playlist_item *i = &self->as.playlist_item;
 
@@ -243,6 +287,10 @@ static void tui_menu_item_label_draw(const struct tui_menu_item *self,
     wclrtoeol(win);
 }
 
+static void tui_menu_item_label_key(const struct tui_menu_item *self, struct string *out) {
+    /* no-op, labels only make sense around what they are labeling */
+}
+
 static void tui_menu_item_label_free_contents(struct tui_menu_item *self) {
     struct tui_menu_item_label *l = &self->as.label;
     free(l->str);
@@ -272,6 +320,8 @@ static void tui_menu_item_label_copy(const struct tui_menu_item *self,
 typedef void (*tui_menu_item_method_draw)(const struct tui_menu_item *self,
                                           WINDOW *win, int ypos, int width);
 
+typedef void (*tui_menu_item_method_key)(const struct tui_menu_item *self, struct string *out);
+
 typedef void (*tui_menu_item_method_free_contents)(struct tui_menu_item *self);
 
 typedef bool (*tui_menu_item_method_is_selectable)(const struct tui_menu_item *self);
@@ -285,6 +335,7 @@ typedef void (*tui_menu_item_method_copy)(const struct tui_menu_item *self,
 
 struct tui_menu_item_methods {
     const tui_menu_item_method_draw draw;
+    const tui_menu_item_method_key key;
     const tui_menu_item_method_free_contents free_contents;
     const tui_menu_item_method_is_selectable is_selectable;
     const tui_menu_item_method_append append;
@@ -295,6 +346,7 @@ struct tui_menu_item_methods {
 static const struct tui_menu_item_methods tui_menu_item_methods[] = {
     [TUI_MENU_ITEM_TYPE_EMPTY] = {
         .draw = tui_menu_item_empty_draw,
+        .key = tui_menu_item_empty_key,
         .free_contents = tui_menu_item_empty_free_contents,
         .is_selectable = tui_menu_item_empty_is_selectable,
         .append = tui_menu_item_empty_append,
@@ -303,6 +355,7 @@ static const struct tui_menu_item_methods tui_menu_item_methods[] = {
     },
     [TUI_MENU_ITEM_TYPE_LABEL] = {
         .draw = tui_menu_item_label_draw,
+        .key = tui_menu_item_label_key,
         .free_contents = tui_menu_item_label_free_contents,
         .is_selectable = tui_menu_item_label_is_selectable,
         .append = tui_menu_item_label_append,
@@ -311,6 +364,7 @@ static const struct tui_menu_item_methods tui_menu_item_methods[] = {
     },
     [TUI_MENU_ITEM_TYPE_PLAYLIST_ITEM] = {
         .draw = tui_menu_item_playlist_item_draw,
+        .key = tui_menu_item_playlist_item_key,
         .free_contents = tui_menu_item_playlist_item_free_contents,
         .is_selectable = tui_menu_item_playlist_item_is_selectable,
         .append = tui_menu_item_playlist_item_append,
@@ -319,6 +373,7 @@ static const struct tui_menu_item_methods tui_menu_item_methods[] = {
     },
     [TUI_MENU_ITEM_TYPE_SONG] = {
         .draw = tui_menu_item_song_draw,
+        .key = tui_menu_item_song_key,
         .free_contents = tui_menu_item_song_free_contents,
         .is_selectable = tui_menu_item_song_is_selectable,
         .append = tui_menu_item_song_append,
@@ -327,6 +382,7 @@ static const struct tui_menu_item_methods tui_menu_item_methods[] = {
     },
     [TUI_MENU_ITEM_TYPE_ALBUM] = {
         .draw = tui_menu_item_album_draw,
+        .key = tui_menu_item_album_key,
         .free_contents = tui_menu_item_album_free_contents,
         .is_selectable = tui_menu_item_album_is_selectable,
         .append = tui_menu_item_album_append,
@@ -335,6 +391,7 @@ static const struct tui_menu_item_methods tui_menu_item_methods[] = {
     },
     [TUI_MENU_ITEM_TYPE_ARTIST] = {
         .draw = tui_menu_item_artist_draw,
+        .key = tui_menu_item_artist_key,
         .free_contents = tui_menu_item_artist_free_contents,
         .is_selectable = tui_menu_item_artist_is_selectable,
         .append = tui_menu_item_artist_append,
@@ -347,6 +404,275 @@ static_assert(SIZEOF_VEC(tui_menu_item_methods) == TUI_MENU_ITEM_TYPE_COUNT);
 #define METHOD_CALL(pobj, method, ...) \
     tui_menu_item_methods[(pobj)->type].method((pobj) __VA_OPT__(,) __VA_ARGS__)
 
+static struct tui_menu_page *tui_menu_find_page(struct tui_menu *menu, size_t first) {
+    for (size_t i = 0; i < TUI_MENU_PAGES; i++) {
+        struct tui_menu_page *page = &menu->source.pages[i];
+        if (page->loaded && page->first == first) {
+            return page;
+        }
+    }
+    return NULL;
+}
+
+static void tui_menu_page_unload(struct tui_menu *menu, struct tui_menu_page *page) {
+    if (!page->loaded) {
+        return;
+    }
+
+    const size_t count = MIN((size_t)TUI_MENU_PAGE_SIZE, menu->source.count - page->first);
+    for (size_t i = 0; i < count; i++) {
+        METHOD_CALL(&page->items[i], free_contents);
+    }
+    page->loaded = false;
+}
+
+static struct tui_menu_page *tui_menu_load_page(struct tui_menu *menu, size_t first) {
+    struct tui_menu_page *prev_page = NULL;
+    const struct tui_menu_item *prev = NULL;
+    if (first > 0 && (prev_page = tui_menu_find_page(menu, first - TUI_MENU_PAGE_SIZE))) {
+        prev = &prev_page->items[TUI_MENU_PAGE_SIZE - 1];
+    }
+
+    /* prev has to survive until fetch is done, so it's never the one to go */
+    struct tui_menu_page *page = NULL;
+    for (size_t i = 0; i < TUI_MENU_PAGES; i++) {
+        struct tui_menu_page *p = &menu->source.pages[i];
+        if (p == prev_page) {
+            continue;
+        } else if (!p->loaded) {
+            page = p;
+            break;
+        } else if (page == NULL || p->last_used < page->last_used) {
+            page = p;
+        }
+    }
+    tui_menu_page_unload(menu, page);
+
+    const size_t count = MIN((size_t)TUI_MENU_PAGE_SIZE, menu->source.count - first);
+    size_t fetched = menu->source.fetch(first, count, prev, page->items, menu->source.data);
+    if (fetched < count) {
+        /* db changed under us or query failed, don't leave holes */
+        WARN("virtual menu expected %zu items at %zu, got %zu", count, first, fetched);
+        for (size_t i = fetched; i < count; i++) {
+            page->items[i].type = TUI_MENU_ITEM_TYPE_EMPTY;
+        }
+    }
+
+    page->first = first;
+    page->loaded = true;
+
+    return page;
+}
+
+/* same as VEC_AT(&menu->items, index), but also works for virtual and filtered menus */
+static struct tui_menu_item *tui_menu_item_at(struct tui_menu *menu, size_t index) {
+    if (menu->source.fetch == NULL) {
+        if (menu->filter.query != NULL) {
+            index = *VEC_AT(&menu->filter.matches, index);
+        }
+        return VEC_AT(&menu->items, index);
+    }
+
+    const size_t first = index - index % TUI_MENU_PAGE_SIZE;
+    struct tui_menu_page *page = tui_menu_find_page(menu, first);
+    if (page == NULL) {
+        page = tui_menu_load_page(menu, first);
+    }
+    page->last_used = ++menu->source.clock;
+
+    return &page->items[index - first];
+}
+
+size_t tui_menu_count(const struct tui_menu *menu) {
+    if (menu->source.fetch != NULL) {
+        return menu->source.count;
+    } else if (menu->filter.query != NULL) {
+        return VEC_SIZE(&menu->filter.matches);
+    }
+    return VEC_SIZE(&menu->items);
+}
+
+/* big enough for memmem to dominate, small enough to not be noticed between keypresses */
+#define TUI_MENU_FILTER_CHUNK 4096
+
+static void fold_case(char *str, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (str[i] >= 'A' && str[i] <= 'Z') {
+            str[i] += 'a' - 'A';
+        }
+    }
+}
+
+static bool tui_menu_filter_item_matches(struct tui_menu *menu, size_t index) {
+    struct tui_menu_filter_key *key = VEC_AT(&menu->filter.keys, index);
+    if (key->str == NULL) {
+        struct string s = {0};
+        METHOD_CALL(VEC_AT(&menu->items, index), key, &s);
+        key->str = (s.str != NULL) ? s.str : xstrdup("");
+        key->len = s.len;
+        fold_case(key->str, key->len);
+    }
+
+    return memmem(key->str, key->len, menu->filter.query, menu->filter.query_len) != NULL;
+}
+
+static void tui_menu_filter_forget_key(struct tui_menu *menu, size_t index) {
+    struct tui_menu_filter_key *key = VEC_AT(&menu->filter.keys, index);
+    free(key->str);
+    key->str = NULL;
+    key->len = 0;
+}
+
+/* checks next chunk of items, returns true if anything new matched */
+static bool tui_menu_filter_step(struct tui_menu *menu) {
+    const size_t total = menu->filter.narrowing
+        ? VEC_SIZE(&menu->filter.candidates)
+        : VEC_SIZE(&menu->items);
+    const size_t end = MIN(total, menu->filter.scanned + TUI_MENU_FILTER_CHUNK);
+    const size_t old_count = VEC_SIZE(&menu->filter.matches);
+
+    for (size_t i = menu->filter.scanned; i < end; i++) {
+        const size_t index = menu->filter.narrowing ? *VEC_AT(&menu->filter.candidates, i) : i;
+        if (tui_menu_filter_item_matches(menu, index)) {
+            VEC_APPEND(&menu->filter.matches, &index);
+        }
+    }
+
+    menu->filter.scanned = end;
+    if (end == total) {
+        menu->filter.scanning = false;
+        menu->filter.narrowing = false;
+        VEC_CLEAR(&menu->filter.candidates);
+    }
+
+    return VEC_SIZE(&menu->filter.matches) != old_count;
+}
+
+static int tui_menu_filter_scan_callback(struct pollen_callback *callback, uint64_t, void *data) {
+    struct tui_menu *menu = data;
+    if (!menu->filter.scanning) {
+        return 0;
+    }
+
+    if (tui_menu_filter_step(menu)) {
+        tui_menu_draw(menu);
+    }
+
+    /* yield to other events between chunks */
+    if (menu->filter.scanning) {
+        pollen_efd_trigger(callback);
+    }
+
+    return 0;
+}
+
+/* first chunk is checked right away, so there's something to draw before returning */
+static void tui_menu_filter_start(struct tui_menu *menu, bool narrowing) {
+    if (narrowing) {
+        /* previous matches become candidates, both are VEC(size_t) */
+        struct vec_generic *candidates = (struct vec_generic *)&menu->filter.candidates;
+        struct vec_generic *matches = (struct vec_generic *)&menu->filter.matches;
+        const struct vec_generic tmp = *candidates;
+        *candidates = *matches;
+        *matches = tmp;
+    } else {
+        VEC_CLEAR(&menu->filter.candidates);
+    }
+    VEC_CLEAR(&menu->filter.matches);
+
+    menu->filter.narrowing = narrowing;
+    menu->filter.scanned = 0;
+    menu->filter.scanning = true;
+    menu->scroll = 0;
+    menu->selected = 0;
+
+    tui_menu_filter_step(menu);
+
+    if (menu->filter.scanning) {
+        if (menu->filter.scan_callback == NULL) {
+            menu->filter.scan_callback =
+                pollen_loop_add_efd(event_loop, tui_menu_filter_scan_callback, menu);
+        }
+        pollen_efd_trigger(menu->filter.scan_callback);
+    }
+}
+
+/* index of the first match that is not less than item */
+static size_t tui_menu_filter_lower_bound(const struct tui_menu *menu, size_t item) {
+    size_t lo = 0, hi = VEC_SIZE(&menu->filter.matches);
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (*VEC_AT(&menu->filter.matches, mid) < item) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Item at index changed or was just appended. Returns index in matches
+ * if it has to be redrawn, or -1 if it's not visible through the filter.
+ */
+static ssize_t tui_menu_filter_update_item(struct tui_menu *menu, size_t index) {
+    tui_menu_filter_forget_key(menu, index);
+    if (menu->filter.query == NULL) {
+        return index;
+    }
+
+    if (menu->filter.scanning) {
+        if (!menu->filter.narrowing && index >= menu->filter.scanned) {
+            return -1; /* scan will get to it */
+        }
+        tui_menu_filter_start(menu, false);
+        tui_menu_draw(menu);
+        return -1;
+    }
+
+    const size_t pos = tui_menu_filter_lower_bound(menu, index);
+    const bool present = (pos < VEC_SIZE(&menu->filter.matches)
+                          && *VEC_AT(&menu->filter.matches, pos) == index);
+    const bool matches = tui_menu_filter_item_matches(menu, index);
+    /* keep the same item selected when others appear or disappear before it */
+    if (matches && !present) {
+        if (pos == VEC_SIZE(&menu->filter.matches)) {
+            VEC_APPEND(&menu->filter.matches, &index);
+        } else {
+            VEC_INSERT(&menu->filter.matches, pos, &index);
+        }
+        if (pos <= menu->selected && VEC_SIZE(&menu->filter.matches) > 1) {
+            menu->selected += 1;
+        }
+        tui_menu_draw(menu);
+        return -1;
+    } else if (!matches && present) {
+        VEC_ERASE(&menu->filter.matches, pos);
+        if (pos < menu->selected || menu->selected >= VEC_SIZE(&menu->filter.matches)) {
+            menu->selected -= (menu->selected > 0);
+        }
+        tui_menu_draw(menu);
+        return -1;
+    }
+
+    return matches ? (ssize_t)pos : -1;
+}
+
+static void tui_menu_filter_reset(struct tui_menu *menu) {
+    VEC_FOREACH(&menu->filter.keys, i) {
+        free(VEC_AT(&menu->filter.keys, i)->str);
+    }
+    VEC_CLEAR(&menu->filter.keys);
+    VEC_CLEAR(&menu->filter.matches);
+    VEC_CLEAR(&menu->filter.candidates);
+
+    free(menu->filter.query);
+    menu->filter.query = NULL;
+    menu->filter.query_len = 0;
+    menu->filter.scanning = false;
+    menu->filter.narrowing = false;
+}
+
 void tui_menu_position(struct tui_menu *menu, int screen_x, int screen_y, int width, int height) {
     menu->screen_x = screen_x;
     menu->screen_y = screen_y;
@@ -367,6 +693,9 @@ void tui_menu_position(struct tui_menu *menu, int screen_x, int screen_y, int wi
     }
     menu->scrollbar_win = newwin(menu->height, 1, menu->screen_y, menu->screen_x + menu->width);
     leaveok(menu->scrollbar_win, true);
+
+    menu->dirty_rows = xreallocarray(menu->dirty_rows, menu->height, sizeof(*menu->dirty_rows));
+    tui_menu_draw(menu);
 }
 
 void tui_menu_hide(struct tui_menu *menu) {
@@ -378,17 +707,16 @@ void tui_menu_show(struct tui_menu *menu) {
     tui_menu_draw(menu);
 }
 
-void tui_menu_draw_scrollbar(struct tui_menu *menu) {
-    const int n_items = VEC_SIZE(&menu->items);
-    if (menu->hidden || n_items == 0) {
-        return;
-    }
-
+static void tui_menu_render_scrollbar(struct tui_menu *menu) {
+    const int n_items = tui_menu_count(menu);
     const int n_visible = MIN(n_items - menu->scroll, menu->height);
 
     int scrollbar_height;
     int scrollbar_pos;
-    if (n_items <= n_visible) {
+    if (n_items == 0) {
+        scrollbar_pos = 0;
+        scrollbar_height = 0;
+    } else if (n_items <= n_visible) {
         scrollbar_pos = 0;
         scrollbar_height = menu->height;
     } else {
@@ -403,61 +731,124 @@ void tui_menu_draw_scrollbar(struct tui_menu *menu) {
         const char c = (i < scrollbar_pos || i >= scrollbar_pos + scrollbar_height) ? ' ' : '#';
         mvwaddch(menu->scrollbar_win, i, 0, c);
     }
-    if (!menu->hidden) {
-        wnoutrefresh(menu->scrollbar_win);
-    }
 }
 
-bool tui_menu_draw_item(struct tui_menu *menu, size_t index) {
-    if (menu->hidden || index < menu->scroll || index > menu->scroll + menu->height - 1) {
-        return false;
+static void tui_menu_render_row(struct tui_menu *menu, int row) {
+    const size_t index = menu->scroll + row;
+    if (index >= tui_menu_count(menu)) {
+        wmove(menu->win, row, 0);
+        wclrtoeol(menu->win);
+        return;
     }
 
     if (index == menu->selected) {
         wattron(menu->win, A_REVERSE);
     }
 
-    const struct tui_menu_item *item = VEC_AT(&menu->items, index);
-    METHOD_CALL(item, draw, menu->win, index - menu->scroll, menu->width - 1 /* scrollbar */);
+    const struct tui_menu_item *item = tui_menu_item_at(menu, index);
+    METHOD_CALL(item, draw, menu->win, row, menu->width - 1 /* scrollbar */);
 
     if (index == menu->selected) {
         wattroff(menu->win, A_REVERSE);
     }
+}
+
+void tui_menu_flush(struct tui_menu *menu) {
+    if (menu->hidden) {
+        return;
+    }
 
-    if (!menu->hidden) {
+    bool rendered = false;
+    for (int row = 0; row < menu->height; row++) {
+        if (menu->dirty_rows[row]) {
+            tui_menu_render_row(menu, row);
+            menu->dirty_rows[row] = false;
+            rendered = true;
+        }
+    }
+    if (rendered) {
         wnoutrefresh(menu->win);
     }
 
+    if (menu->scrollbar_dirty) {
+        tui_menu_render_scrollbar(menu);
+        menu->scrollbar_dirty = false;
+        wnoutrefresh(menu->scrollbar_win);
+    }
+}
+
+void tui_menu_draw_scrollbar(struct tui_menu *menu) {
+    if (menu->hidden) {
+        return;
+    }
+
+    menu->scrollbar_dirty = true;
+    draw_damage(DRAW_DAMAGE_MENU);
+}
+
+bool tui_menu_draw_item(struct tui_menu *menu, size_t index) {
+    if (menu->hidden || index < menu->scroll || index > menu->scroll + menu->height - 1) {
+        return false;
+    }
+
+    menu->dirty_rows[index - menu->scroll] = true;
+    draw_damage(DRAW_DAMAGE_MENU);
+
     return true;
 }
 
 void tui_menu_draw(struct tui_menu *menu) {
-    const size_t lim = MIN((size_t)menu->height, VEC_SIZE(&menu->items) - menu->scroll);
-    for (size_t i = 0; i < lim; i++) {
-        tui_menu_draw_item(menu, menu->scroll + i);
+    if (menu->hidden) {
+        return;
     }
 
-    if (lim < (size_t)menu->height) {
-        wclrtobot(menu->win);
-        if (!menu->hidden) {
-            wnoutrefresh(menu->win);
-        }
+    for (int row = 0; row < menu->height; row++) {
+        menu->dirty_rows[row] = true;
     }
-
     tui_menu_draw_scrollbar(menu);
 }
 
 struct tui_menu_item *tui_menu_get_item(struct tui_menu *menu, size_t index) {
+    if (menu->source.fetch != NULL) {
+        return tui_menu_item_at(menu, index);
+    }
     return VEC_AT(&menu->items, index);
 }
 
+bool tui_menu_redraw_item(struct tui_menu *menu, size_t index) {
+    if (menu->filter.query == NULL) {
+        return tui_menu_draw_item(menu, index);
+    }
+
+    const size_t pos = tui_menu_filter_lower_bound(menu, index);
+    if (pos < VEC_SIZE(&menu->filter.matches) && *VEC_AT(&menu->filter.matches, pos) == index) {
+        return tui_menu_draw_item(menu, pos);
+    }
+    return false;
+}
+
 bool tui_menu_remove_item(struct tui_menu *menu, size_t index) {
     bool ret = false;
 
+    if (menu->source.fetch != NULL) {
+        WARN("tried to remove item from virtual tui_menu");
+        return false;
+    }
+
     struct tui_menu_item *i = VEC_AT(&menu->items, index);
     METHOD_CALL(i, free_contents);
 
     VEC_ERASE(&menu->items, index);
+    tui_menu_filter_forget_key(menu, index);
+    VEC_ERASE(&menu->filter.keys, index);
+
+    if (menu->filter.query != NULL) {
+        /* every match after this one is off by one now, easier to start over */
+        tui_menu_filter_start(menu, false);
+        tui_menu_draw(menu);
+        return true;
+    }
+
     if (index >= VEC_SIZE(&menu->items)) {
         menu->selected = VEC_SIZE(&menu->items) - 1;
     }
@@ -476,6 +867,19 @@ bool tui_menu_remove_item(struct tui_menu *menu, size_t index) {
 }
 
 void tui_menu_clear(struct tui_menu *menu) {
+    if (menu->source.fetch != NULL) {
+        for (size_t i = 0; i < TUI_MENU_PAGES; i++) {
+            tui_menu_page_unload(menu, &menu->source.pages[i]);
+        }
+        free(menu->source.pages);
+        menu->source.pages = NULL;
+        menu->source.fetch = NULL;
+        menu->source.data = NULL;
+        menu->source.count = 0;
+    }
+
+    tui_menu_filter_reset(menu);
+
     VEC_FOREACH(&menu->items, i) {
         struct tui_menu_item *item = VEC_AT(&menu->items, i);
         tui_menu_item_methods[item->type].free_contents(item);
@@ -485,14 +889,66 @@ void tui_menu_clear(struct tui_menu *menu) {
     menu->scroll = 0;
     menu->selected = 0;
 
-    wclear(menu->win);
+    /* rows past the end get cleared when they are drawn */
+    tui_menu_draw(menu);
+}
 
-    /* FIXME: no clue why this is needed, screen doesn't get cleared otherwise */
-    if (!menu->hidden) {
-        wnoutrefresh(menu->scrollbar_win);
+void tui_menu_set_source(struct tui_menu *menu, size_t count, tui_menu_fetch_t fetch, void *data) {
+    tui_menu_clear(menu);
+
+    menu->source.fetch = fetch;
+    menu->source.data = data;
+    menu->source.count = count;
+    menu->source.pages = xcalloc(TUI_MENU_PAGES, sizeof(*menu->source.pages));
+
+    tui_menu_draw(menu);
+}
+
+void tui_menu_filter(struct tui_menu *menu, const char *query) {
+    if (menu->source.fetch != NULL) {
+        WARN("tried to filter virtual tui_menu");
+        return;
     }
 
-    tui_menu_draw_scrollbar(menu);
+    if (query == NULL || query[0] == '\0') {
+        if (menu->filter.query == NULL) {
+            return;
+        }
+
+        /* stay on the same item, just with everything around it visible again */
+        size_t selected = 0;
+        if (menu->selected < VEC_SIZE(&menu->filter.matches)) {
+            selected = *VEC_AT(&menu->filter.matches, menu->selected);
+        }
+
+        free(menu->filter.query);
+        menu->filter.query = NULL;
+        menu->filter.query_len = 0;
+        menu->filter.scanning = false;
+        menu->filter.narrowing = false;
+        VEC_CLEAR(&menu->filter.matches);
+        VEC_CLEAR(&menu->filter.candidates);
+
+        menu->selected = selected;
+        menu->scroll = (selected >= (size_t)menu->height) ? selected - menu->height + 1 : 0;
+        tui_menu_draw(menu);
+        return;
+    }
+
+    char *folded = xstrdup(query);
+    const size_t folded_len = strlen(folded);
+    fold_case(folded, folded_len);
+
+    /* anything that contains "abc" also contains "ab", so only previous matches need a look */
+    const bool narrowing = (menu->filter.query != NULL && !menu->filter.scanning
+                            && strstr(folded, menu->filter.query) != NULL);
+
+    free(menu->filter.query);
+    menu->filter.query = folded;
+    menu->filter.query_len = folded_len;
+
+    tui_menu_filter_start(menu, narrowing);
+    tui_menu_draw(menu);
 }
 
 static bool tui_menu_ensure_visible(struct tui_menu *menu, size_t index) {
@@ -500,6 +956,11 @@ static bool tui_menu_ensure_visible(struct tui_menu *menu, size_t index) {
         const size_t diff = menu->scroll - index;
         wscrl(menu->win, -(int)diff);
         menu->scroll -= diff;
+        /* rows that are waiting to be redrawn moved along with the content */
+        if (diff < (size_t)menu->height) {
+            memmove(&menu->dirty_rows[diff], &menu->dirty_rows[0],
+                    (menu->height - diff) * sizeof(*menu->dirty_rows));
+        }
 
         for (size_t i = 0; i < MIN(diff, (size_t)menu->height); i++) {
             tui_menu_draw_item(menu, menu->scroll + i);
@@ -512,6 +973,10 @@ static bool tui_menu_ensure_visible(struct tui_menu *menu, size_t index) {
         const size_t diff = index + 1 - menu->height - menu->scroll;
         wscrl(menu->win, (int)diff);
         menu->scroll += diff;
+        if (diff < (size_t)menu->height) {
+            memmove(&menu->dirty_rows[0], &menu->dirty_rows[diff],
+                    (menu->height - diff) * sizeof(*menu->dirty_rows));
+        }
 
         for (size_t i = 0; i < MIN(diff, (size_t)menu->height); i++) {
             tui_menu_draw_item(menu, menu->scroll + menu->height - 1 - i);
@@ -526,13 +991,13 @@ static bool tui_menu_ensure_visible(struct tui_menu *menu, size_t index) {
 }
 
 bool tui_menu_select_nth(struct tui_menu *menu, size_t index) {
-    if (index >= VEC_SIZE(&menu->items)) {
+    if (index >= tui_menu_count(menu)) {
         WARN("tried to select elem %zu of tui_menu that has %zu elems",
-             index, VEC_SIZE(&menu->items));
+             index, tui_menu_count(menu));
         return false;
     } else if (index == menu->selected) {
         return false;
-    } else if (METHOD_CALL(VEC_AT(&menu->items, index), is_selectable)) {
+    } else if (METHOD_CALL(tui_menu_item_at(menu, index), is_selectable)) {
         const size_t prev_selected = menu->selected;
         menu->selected = index;
 
@@ -548,7 +1013,8 @@ bool tui_menu_select_nth(struct tui_menu *menu, size_t index) {
 }
 
 static bool tui_menu_select_prev_or_next(struct tui_menu *menu, int direction) {
-    if (VEC_SIZE(&menu->items) == 0) {
+    const size_t n_items = tui_menu_count(menu);
+    if (n_items == 0) {
         return false;
     }
 
@@ -557,15 +1023,15 @@ static bool tui_menu_select_prev_or_next(struct tui_menu *menu, int direction) {
     bool looped = false;
     do {
         if (direction > 0) {
-            next_index = (next_index + direction) % VEC_SIZE(&menu->items);
+            next_index = (next_index + direction) % n_items;
         } else {
-            next_index = MIN(next_index + direction, VEC_SIZE(&menu->items) - 1);
+            next_index = MIN(next_index + direction, n_items - 1);
         }
         if (next_index == old_index) {
             looped = true;
         }
 
-        const struct tui_menu_item *i = VEC_AT(&menu->items, next_index);
+        const struct tui_menu_item *i = tui_menu_item_at(menu, next_index);
         if (tui_menu_item_methods[i->type].is_selectable(i)) {
             menu->selected = next_index;
             break;
@@ -593,10 +1059,20 @@ bool tui_menu_select_prev(struct tui_menu *menu) {
 }
 
 bool tui_menu_append_item(struct tui_menu *menu, const struct tui_menu_item *item) {
+    if (menu->source.fetch != NULL) {
+        WARN("tried to append item to virtual tui_menu");
+        return false;
+    }
+
     struct tui_menu_item *new_item = VEC_EMPLACE_BACK(&menu->items);
     METHOD_CALL(item, copy, new_item);
+    VEC_EMPLACE_BACK_ZEROED(&menu->filter.keys);
 
-    bool ret = tui_menu_draw_item(menu, VEC_SIZE(&menu->items) - 1);
+    bool ret = false;
+    const ssize_t visible_index = tui_menu_filter_update_item(menu, VEC_SIZE(&menu->items) - 1);
+    if (visible_index >= 0) {
+        ret = tui_menu_draw_item(menu, visible_index);
+    }
     tui_menu_draw_scrollbar(menu);
 
     return ret;
@@ -607,20 +1083,30 @@ bool tui_menu_insert_or_replace_item(struct tui_menu *menu, size_t index,
     struct tui_menu_item *new_item = NULL;
     bool ret = false;
 
+    if (menu->source.fetch != NULL) {
+        WARN("tried to insert item into virtual tui_menu");
+        return false;
+    }
+
     if (index >= VEC_SIZE(&menu->items)) {
         /* fill with blanks */
         const size_t first_blank = VEC_SIZE(&menu->items) - 1;
         const size_t n_blanks = index - VEC_SIZE(&menu->items);
         struct tui_menu_item *blanks = VEC_EMPLACE_BACK_N(&menu->items, n_blanks);
+        VEC_EMPLACE_BACK_N_ZEROED(&menu->filter.keys, n_blanks);
 
         for (size_t i = 0; i < n_blanks; i++) {
             blanks[i].type = TUI_MENU_ITEM_TYPE_EMPTY;
-            ret = tui_menu_draw_item(menu, first_blank + i) || ret;
+            /* blanks never match, so they are not visible through a filter */
+            if (menu->filter.query == NULL) {
+                ret = tui_menu_draw_item(menu, first_blank + i) || ret;
+            }
         }
 
         tui_menu_draw_scrollbar(menu);
 
         new_item = VEC_EMPLACE_BACK(&menu->items);
+        VEC_EMPLACE_BACK_ZEROED(&menu->filter.keys);
     } else {
         struct tui_menu_item *old_item = VEC_AT(&menu->items, index);
         METHOD_CALL(old_item, free_contents);
@@ -629,16 +1115,26 @@ bool tui_menu_insert_or_replace_item(struct tui_menu *menu, size_t index,
     }
 
     METHOD_CALL(item, copy, new_item);
-    ret = tui_menu_draw_item(menu, index) || ret;
+
+    const ssize_t visible_index = tui_menu_filter_update_item(menu, index);
+    if (visible_index >= 0) {
+        ret = tui_menu_draw_item(menu, visible_index) || ret;
+    }
 
     return ret;
 }
 
 void tui_menu_action_activate(struct tui_menu *menu) {
-    METHOD_CALL(VEC_AT(&menu->items, menu->selected), activate);
+    if (menu->selected >= tui_menu_count(menu)) {
+        return;
+    }
+    METHOD_CALL(tui_menu_item_at(menu, menu->selected), activate);
 }
 
 void tui_menu_action_append(struct tui_menu *menu) {
-    METHOD_CALL(VEC_AT(&menu->items, menu->selected), append);
+    if (menu->selected >= tui_menu_count(menu)) {
+        return;
+    }
+    METHOD_CALL(tui_menu_item_at(menu, menu->selected), append);
 }
 
@@ -2,6 +2,7 @@
 #define SRC_TUI_MENU_H
 
 #include <curses.h>
+#include <stdint.h>
 
 #include "collections/vec.h"
 #include "types/song.h"
@@ -54,6 +55,31 @@ struct tui_menu_item {
     } as;
 };
 
+/*
+ * Where items of a virtual menu come from. Fills items with copies of up to count items
+ * starting at first and returns how many were filled. prev is the item right before
+ * first if it happens to be in memory, so the source can continue from it instead of
+ * seeking to first, and NULL otherwise.
+ */
+typedef size_t (*tui_menu_fetch_t)(size_t first, size_t count, const struct tui_menu_item *prev,
+                                   struct tui_menu_item *items, void *data);
+
+#define TUI_MENU_PAGE_SIZE 64
+#define TUI_MENU_PAGES 8
+
+struct tui_menu_page {
+    bool loaded;
+    size_t first;
+    uint64_t last_used;
+    struct tui_menu_item items[TUI_MENU_PAGE_SIZE];
+};
+
+/* Searchable text of an item, lowercased. Computed on first filter and kept. */
+struct tui_menu_filter_key {
+    char *str;
+    size_t len;
+};
+
 struct tui_menu {
     WINDOW *win;
     bool hidden;
@@ -62,24 +88,79 @@ struct tui_menu {
 
     WINDOW *scrollbar_win;
 
+    /* drawing only marks these, see tui_menu_flush */
+    bool *dirty_rows; /* height of them */
+    bool scrollbar_dirty;
+
     size_t scroll;
     size_t selected;
     VEC(struct tui_menu_item) items;
+
+    /* virtual mode, see tui_menu_set_source; items is empty then */
+    struct {
+        tui_menu_fetch_t fetch;
+        void *data;
+        size_t count;
+        struct tui_menu_page *pages; /* TUI_MENU_PAGES of them, least recently used is evicted */
+        uint64_t clock;
+    } source;
+
+    /* see tui_menu_filter; indexes seen by everything else are indexes into matches then */
+    struct {
+        char *query; /* lowercased, NULL if menu isn't filtered */
+        size_t query_len;
+        VEC(struct tui_menu_filter_key) keys; /* parallel to items */
+        VEC(size_t) matches; /* indexes of items that passed so far, ascending */
+        VEC(size_t) candidates; /* if narrowing, only these items are checked */
+        bool narrowing; /* query got longer, only previous matches can still match */
+        size_t scanned; /* items or candidates before this one were checked */
+        bool scanning;
+        struct pollen_callback *scan_callback;
+    } filter;
 };
 
 void tui_menu_position(struct tui_menu *menu, int screen_x, int screen_y, int width, int height);
 void tui_menu_hide(struct tui_menu *menu);
 void tui_menu_show(struct tui_menu *menu);
 
+/*
+ * These don't draw anything right away, they mark rows as dirty and schedule a frame.
+ * tui_menu_flush then draws everything that got dirty since the last frame.
+ */
 void tui_menu_draw(struct tui_menu *menu);
 bool tui_menu_draw_item(struct tui_menu *menu, size_t index);
 void tui_menu_draw_scrollbar(struct tui_menu *menu);
+void tui_menu_flush(struct tui_menu *menu);
 
+size_t tui_menu_count(const struct tui_menu *menu);
+/*
+ * For virtual menus, returned item is only valid until the next call on the same menu.
+ * Index is not affected by filter, unlike everywhere else.
+ */
 struct tui_menu_item *tui_menu_get_item(struct tui_menu *menu, size_t index);
 
+/* Like tui_menu_draw_item, but index is the same as in tui_menu_get_item */
+bool tui_menu_redraw_item(struct tui_menu *menu, size_t index);
+
 bool tui_menu_remove_item(struct tui_menu *menu, size_t index);
+/* Also turns virtual menu back into a normal one */
 void tui_menu_clear(struct tui_menu *menu);
 
+/*
+ * Makes menu virtual: it has count items, but only pages around what's on screen
+ * are kept in memory and they are fetched on demand as menu is scrolled.
+ * Items can't be added to or removed from virtual menus.
+ */
+void tui_menu_set_source(struct tui_menu *menu, size_t count, tui_menu_fetch_t fetch, void *data);
+
+/*
+ * Hides items whose text doesn't contain query (ASCII case-insensitive).
+ * Items are checked in chunks from the event loop, so this returns right away
+ * and matches show up as they are found. NULL or empty query removes the filter.
+ * Virtual menus can't be filtered, their source has to do it.
+ */
+void tui_menu_filter(struct tui_menu *menu, const char *query);
+
 bool tui_menu_select_nth(struct tui_menu *menu, size_t index);
 bool tui_menu_select_next(struct tui_menu *menu);
 bool tui_menu_select_prev(struct tui_menu *menu);
@@ -1,14 +1,16 @@
 #include "types/album.h"
+#include "collections/intern.h"
 #include "xmalloc.h"
 
 void album_deep_copy(struct album *dst, const struct album *src) {
     dst->id = xstrdup(src->id);
     dst->name = xstrdup(src->name);
-    dst->artist = xstrdup(src->artist);
-    dst->artist_id = xstrdup(src->artist_id);
+    dst->artist = intern_ref(src->artist);
+    dst->artist_id = intern_ref(src->artist_id);
 
     dst->song_count = src->song_count;
     dst->duration = src->duration;
+    dst->created = src->created;
 }
 
 void album_free_contents(struct album *a) {
@@ -18,7 +20,7 @@ void album_free_contents(struct album *a) {
 
     free(a->id);
     free(a->name);
-    free(a->artist);
-    free(a->artist_id);
+    intern_unref(a->artist);
+    intern_unref(a->artist_id);
 }
 
@@ -1,13 +1,17 @@
 #ifndef SRC_TYPES_ALBUM_H
 #define SRC_TYPES_ALBUM_H
 
+#include <stdint.h>
+
 struct album {
     char *id;
     char *name;
 
-    char *artist, *artist_id;
+    /* interned, see collections/intern.h */
+    const char *artist, *artist_id;
 
     int song_count, duration;
+    int64_t created; /* unix time, albums are sorted by it */
 };
 
 void album_deep_copy(struct album *dst, const struct album *src);
@@ -2,6 +2,7 @@
 #include "xmalloc.h"
 
 void cached_song_deep_copy(struct cached_song *dst, const struct cached_song *src) {
+    dst->server_id = src->server_id;
     dst->id = xstrdup(src->id);
     dst->filename = xstrdup(src->filename);
     dst->bitrate = src->bitrate;
@@ -5,6 +5,7 @@
 #include <stddef.h>
 
 struct cached_song {
+    int64_t server_id;
     char *id;
     char *filename;
     int bitrate;
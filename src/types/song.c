@@ -1,13 +1,14 @@
 #include "types/song.h"
+#include "collections/intern.h"
 #include "xmalloc.h"
 
 void song_deep_copy(struct song *dst, const struct song *src) {
     dst->id = xstrdup(src->id);
     dst->title = xstrdup(src->title);
-    dst->album = xstrdup(src->album);
-    dst->album_id = xstrdup(src->album_id);
-    dst->artist = xstrdup(src->artist);
-    dst->artist_id = xstrdup(src->artist_id);
+    dst->album = intern_ref(src->album);
+    dst->album_id = intern_ref(src->album_id);
+    dst->artist = intern_ref(src->artist);
+    dst->artist_id = intern_ref(src->artist_id);
     dst->filetype = xstrdup(src->filetype);
 
     dst->track = src->track;
@@ -24,10 +25,10 @@ void song_free_contents(struct song *song) {
 
     free(song->id);
     free(song->title);
-    free(song->album);
-    free(song->album_id);
-    free(song->artist);
-    free(song->artist_id);
+    intern_unref(song->album);
+    intern_unref(song->album_id);
+    intern_unref(song->artist);
+    intern_unref(song->artist_id);
     free(song->filetype);
 }
 
@@ -5,8 +5,9 @@ struct song {
     char *id;
     char *title;
 
-    char *album, *album_id;
-    char *artist, *artist_id;
+    /* interned, see collections/intern.h */
+    const char *album, *album_id;
+    const char *artist, *artist_id;
 
     char *filetype;
     int track, year, duration, bitrate;
@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include "worker_thread.h"
+#include "eventloop.h"
+#include "log.h"
+
+static void *worker_thread_func(void *data) {
+    struct worker *worker = data;
+
+    if (worker->thread_init != NULL) {
+        worker->thread_init();
+    }
+
+    pthread_mutex_lock(&worker->mutex);
+
+    while (true) {
+        while (!worker->quit && LIST_IS_EMPTY(&worker->jobs)) {
+            pthread_cond_wait(&worker->cond, &worker->mutex);
+        }
+        if (worker->quit && (!worker->finish_pending || LIST_IS_EMPTY(&worker->jobs))) {
+            break;
+        }
+
+        struct list *first = worker->jobs.next;
+        struct worker_job *job;
+        LIST_POP(job, first, link);
+
+        pthread_mutex_unlock(&worker->mutex);
+        worker->run(job);
+        pthread_mutex_lock(&worker->mutex);
+
+        LIST_PREPEND(&worker->done_jobs, &job->link);
+        pollen_efd_trigger(worker->done_callback);
+    }
+
+    pthread_mutex_unlock(&worker->mutex);
+
+    if (worker->thread_cleanup != NULL) {
+        worker->thread_cleanup();
+    }
+
+    return NULL;
+}
+
+static void process_done_jobs(struct worker *worker, bool cleanup) {
+    while (true) {
+        pthread_mutex_lock(&worker->mutex);
+        if (LIST_IS_EMPTY(&worker->done_jobs)) {
+            pthread_mutex_unlock(&worker->mutex);
+            break;
+        }
+        struct list *first = worker->done_jobs.next;
+        struct worker_job *job;
+        LIST_POP(job, first, link);
+        pthread_mutex_unlock(&worker->mutex);
+
+        worker->done(job, cleanup);
+    }
+}
+
+/* runs on main loop */
+static int done_callback_func(struct pollen_callback *callback, uint64_t val, void *data) {
+    process_done_jobs(data, false);
+    return 0;
+}
+
+bool worker_init(struct worker *worker) {
+    worker->done_callback = pollen_loop_add_efd(event_loop, done_callback_func, worker);
+    if (worker->done_callback == NULL) {
+        ERROR("failed to create %s callback", worker->name);
+        return false;
+    }
+
+    int ret = pthread_create(&worker->thread, NULL, worker_thread_func, worker);
+    if (ret != 0) {
+        ERROR("failed to create %s thread: %s", worker->name, strerror(ret));
+        return false;
+    }
+    worker->running = true;
+
+    return true;
+}
+
+void worker_cleanup(struct worker *worker) {
+    if (worker->running) {
+        pthread_mutex_lock(&worker->mutex);
+        worker->quit = true;
+        pthread_cond_signal(&worker->cond);
+        pthread_mutex_unlock(&worker->mutex);
+
+        pthread_join(worker->thread, NULL);
+        worker->running = false;
+        worker->quit = false;
+    }
+
+    process_done_jobs(worker, true);
+    /* whatever is left was dropped */
+    while (!LIST_IS_EMPTY(&worker->jobs)) {
+        struct list *first = worker->jobs.next;
+        struct worker_job *job;
+        LIST_POP(job, first, link);
+        worker->done(job, true);
+    }
+
+    pollen_loop_remove_callback(worker->done_callback);
+    worker->done_callback = NULL;
+}
+
+bool worker_submit(struct worker *worker, struct worker_job *job) {
+    if (!worker->running) {
+        ERROR("%s is not running", worker->name);
+        return false;
+    }
+
+    pthread_mutex_lock(&worker->mutex);
+    LIST_PREPEND(&worker->jobs, &job->link);
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef SRC_WORKER_THREAD_H
+#define SRC_WORKER_THREAD_H
+
+#include <pthread.h>
+
+#include "collections/list.h"
+
+/*
+ * A thread that runs jobs one at a time, for things that would block the main loop.
+ * Jobs can be submitted from any thread and are handed back to the main loop once done.
+ * Embed struct worker_job into your job and get it back with LIST_GET.
+ */
+struct worker_job {
+    LIST_ENTRY link;
+};
+
+struct worker {
+    const char *name; /* for log messages */
+    /* finish pending jobs in worker_cleanup instead of dropping them */
+    bool finish_pending;
+
+    /* optional, called on worker thread before the first job and after the last one */
+    void (*thread_init)(void);
+    void (*thread_cleanup)(void);
+    /* called on worker thread */
+    void (*run)(struct worker_job *job);
+    /*
+     * Called on main loop, owns the job. Also called from worker_cleanup with cleanup set,
+     * for finished jobs as well as for dropped ones that never ran. The rest of the
+     * program might be gone by then, so don't call back into it.
+     */
+    void (*done)(struct worker_job *job, bool cleanup);
+
+    /* private */
+    pthread_t thread;
+    bool running;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    LIST_HEAD jobs; /* protected by mutex */
+    LIST_HEAD done_jobs; /* protected by mutex */
+    bool quit; /* protected by mutex */
+
+    struct pollen_callback *done_callback;
+};
+
+/* for static initialisation, after the public members */
+#define WORKER_INITIALISER(pworker) \
+    .mutex = PTHREAD_MUTEX_INITIALIZER, \
+    .cond = PTHREAD_COND_INITIALIZER, \
+    .jobs = LIST_INITIALISER(&(pworker)->jobs), \
+    .done_jobs = LIST_INITIALISER(&(pworker)->done_jobs)
+
+bool worker_init(struct worker *worker);
+void worker_cleanup(struct worker *worker);
+
+/* Returns false if worker is not running, job is still owned by the caller then */
+bool worker_submit(struct worker *worker, struct worker_job *job);
+
+#endif /* #ifndef SRC_WORKER_THREAD_H */
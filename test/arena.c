@@ -0,0 +1,76 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "collections/arena.h"
+
+#define STREQ(a, b) (strcmp((a), (b)) == 0)
+
+int main(void) {
+    struct arena arena = {0};
+
+    /* zero-sized allocation from an empty arena is still a valid, distinct pointer */
+    void *z1 = arena_alloc(&arena, 0);
+    void *z2 = arena_alloc(&arena, 0);
+    assert(z1 != NULL && z2 != NULL && z1 != z2);
+
+    char *a = arena_strdup(&arena, "aboba");
+    char *b = arena_strdup(&arena, "skibidi toilet");
+    assert(arena_strdup(&arena, NULL) == NULL);
+    assert(STREQ(a, "aboba"));
+    assert(STREQ(b, "skibidi toilet"));
+
+    /* everything is aligned */
+    for (size_t i = 1; i < 100; i++) {
+        void *p = arena_alloc(&arena, i);
+        assert((uintptr_t)p % alignof(max_align_t) == 0);
+        memset(p, 0xAA, i);
+    }
+
+    /* fill a few chunks, earlier allocations must stay intact */
+    char *strs[10000];
+    for (size_t i = 0; i < 10000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "string number %zu", i);
+        strs[i] = arena_strdup(&arena, buf);
+    }
+    for (size_t i = 0; i < 10000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "string number %zu", i);
+        assert(STREQ(strs[i], buf));
+    }
+    assert(STREQ(a, "aboba"));
+
+    /* bigger than a chunk */
+    char *big = arena_alloc(&arena, ARENA_CHUNK_SIZE * 2);
+    memset(big, 'x', ARENA_CHUNK_SIZE * 2);
+    char *after_big = arena_strdup(&arena, "after big");
+    assert(STREQ(after_big, "after big"));
+
+    /* big allocation into an empty arena */
+    struct arena other = {0};
+    char *other_big = arena_alloc(&other, ARENA_CHUNK_SIZE);
+    memset(other_big, 'y', ARENA_CHUNK_SIZE);
+    char *other_str = arena_strdup(&other, "other");
+
+    arena_merge(&arena, &other);
+    assert(other.chunks == NULL);
+    assert(STREQ(other_str, "other"));
+    assert(other_big[ARENA_CHUNK_SIZE - 1] == 'y');
+    assert(STREQ(arena_strdup(&arena, "still works"), "still works"));
+
+    /* merging into an empty arena */
+    struct arena empty = {0};
+    arena_merge(&empty, &arena);
+    assert(arena.chunks == NULL);
+    assert(STREQ(strs[9999], "string number 9999"));
+
+    arena_free(&empty);
+    assert(empty.chunks == NULL);
+    arena_free(&empty); /* double free of an empty arena is fine */
+
+    return 0;
+}
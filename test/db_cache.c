@@ -0,0 +1,90 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "db/init.h"
+#include "db/internal.h"
+#include "db/query.h"
+#include "db/cache.h"
+#include "config.h"
+#include "log.h"
+
+#define STREQ(a, b) (strcmp((a), (b)) == 0)
+
+struct config config = {
+    .server_id = -1,
+};
+
+/* stream_open runs on threads owned by mpv, which never call db_init_thread */
+static void *open_cached_song(void *data) {
+    assert(db == NULL);
+
+    struct cached_song song;
+    assert(db_get_cached_song(&song, "so-1"));
+    assert(STREQ(song.filename, "so-1.opus"));
+    assert(STREQ(song.filetype, "opus"));
+    assert(song.bitrate == 128 && song.size == 12345);
+    cached_song_free_contents(&song);
+
+    assert(db_touch_cached_song("so-1"));
+    assert(!db_get_cached_song(&song, "so-2"));
+
+    return NULL;
+}
+
+int main(void) {
+    log_init(stderr, LOG_ERROR, false);
+
+    char dir[] = "/tmp/campanula-test-XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    config.data_dir = dir;
+
+    assert(db_init());
+    config.server_id = db_add_server("http://test.invalid");
+    assert(config.server_id >= 0);
+
+    char *sql;
+    const int len = asprintf(&sql,
+        "INSERT INTO artists ( id, name, server_id ) VALUES ( 'ar-1', 'artist', %1$li ); "
+        "INSERT INTO albums ( id, name, artist, song_count, duration, created, server_id ) "
+            "VALUES ( 'al-1', 'album', 'artist', 1, 60, 0, %1$li ); "
+        "INSERT INTO songs ( id, title, artist, album, server_id, artist_id, album_id ) "
+            "VALUES ( 'so-1', 'song', 'artist', 'album', %1$li, 'ar-1', 'al-1' ); ",
+        config.server_id);
+    assert(len >= 0);
+    const int ret = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    assert(ret == SQLITE_OK);
+    free(sql);
+
+    const struct cached_song song = {
+        .id = "so-1",
+        .filename = "so-1.opus",
+        .filetype = "opus",
+        .bitrate = 128,
+        .size = 12345,
+    };
+    assert(db_add_cached_song(&song));
+
+    /* twice, connection of the first thread is closed when it exits */
+    for (int i = 0; i < 2; i++) {
+        pthread_t thread;
+        assert(pthread_create(&thread, NULL, open_cached_song, NULL) == 0);
+        assert(pthread_join(thread, NULL) == 0);
+    }
+
+    db_cleanup();
+    log_cleanup();
+
+    char path[sizeof(dir) + 32];
+    const char *const files[] = { "db.sqlite3", "db.sqlite3-wal", "db.sqlite3-shm" };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+    assert(rmdir(dir) == 0);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "db/init.h"
+#include "db/internal.h"
+#include "db/query.h"
+#include "types/artist.h"
+#include "macros.h"
+#include "config.h"
+#include "log.h"
+
+struct config config = {
+    .server_id = -1,
+};
+
+/* upserts an artist the way sync does, returns how many rows it changed, fts ones included */
+static int upsert_artist(const char *id, const char *name) {
+    struct sqlite3_stmt *stmt = batch_inserts[BATCH_INSERT_ARTISTS].single;
+    const int before = sqlite3_total_changes(db);
+
+    sqlite3_bind_text(stmt, 1, id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, config.server_id);
+    assert(sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_reset(stmt);
+
+    return sqlite3_total_changes(db) - before;
+}
+
+static size_t search_artists(const char *query) {
+    struct artist *artists;
+    const size_t count = db_search_artists(&artists, query, 0, 10);
+    for (size_t i = 0; i < count; i++) {
+        artist_free_contents(&artists[i]);
+    }
+    free(artists);
+    return count;
+}
+
+int main(void) {
+    log_init(stderr, LOG_ERROR, false);
+
+    char dir[] = "/tmp/campanula-test-XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    config.data_dir = dir;
+
+    assert(db_init());
+    config.server_id = db_add_server("http://test.invalid");
+    assert(config.server_id >= 0);
+
+    /* fts5 writes to its shadow tables count too, so only unchanged rows give exact numbers */
+    assert(upsert_artist("ar-1", "Boards of Canada") > 1);
+    assert(search_artists("boards") == 1);
+
+    /* every sync upserts everything, unchanged rows must not be reindexed */
+    assert(upsert_artist("ar-1", "Boards of Canada") == 1);
+    assert(search_artists("boards") == 1);
+
+    /* old entry is deleted and the new one inserted */
+    assert(upsert_artist("ar-1", "Aphex Twin") > 1);
+    assert(search_artists("boards") == 0);
+    assert(search_artists("aphex") == 1);
+
+    db_cleanup();
+    log_cleanup();
+
+    char path[sizeof(dir) + 32];
+    const char *const files[] = { "db.sqlite3", "db.sqlite3-wal", "db.sqlite3-shm" };
+    for (size_t i = 0; i < SIZEOF_VEC(files); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+    assert(rmdir(dir) == 0);
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Runs the client against test/mock/server.c: starts it on a free port,
+ * syncs the whole library into a fresh db and streams a part of one song,
+ * all through the real api, network and db code.
+ * Takes path to the mock_server executable as the only argument.
+ */
+
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "mock/library.h"
+#include "db/init.h"
+#include "db/internal.h"
+#include "db/query.h"
+#include "db/populate.h"
+#include "network/init.h"
+#include "api/requests.h"
+#include "collections/vec.h"
+#include "eventloop.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "config.h"
+#include "log.h"
+
+#define SEED 7
+#define ARTISTS 30
+#define ALBUMS 120
+#define SONGS 900
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+struct config config = {
+    .server_id = -1,
+    .username = "test",
+    .password = "test",
+    .application_name = "campanula-test",
+    .sync_max_requests = 4,
+};
+
+static pid_t server_pid;
+
+static char *start_server(const char *path) {
+    int fds[2];
+    assert(pipe(fds) == 0);
+
+    server_pid = fork();
+    assert(server_pid >= 0);
+    if (server_pid == 0) {
+        /* don't leave it running if the test crashes */
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(path, path, "--port", "0", "--quiet", "--seed", STR(SEED),
+              "--artists", STR(ARTISTS), "--albums", STR(ALBUMS), "--songs", STR(SONGS), NULL);
+        perror("exec mock_server");
+        _exit(1);
+    }
+    close(fds[1]);
+
+    /* first line on stdout is the address it listens on */
+    FILE *f = fdopen(fds[0], "r");
+    char *line = NULL;
+    size_t size = 0;
+    const ssize_t len = getline(&line, &size, f);
+    assert(len > 0);
+    line[strcspn(line, "\n")] = '\0';
+    fclose(f);
+
+    return line;
+}
+
+static void stop_server(void) {
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+}
+
+static void on_populated(bool changed, void *userdata) {
+    *(bool *)userdata = changed;
+    pollen_loop_quit(event_loop, 0);
+}
+
+struct stream_result {
+    VEC(char) data; /* appended on network thread */
+    struct api_stream_info info;
+    const char *errmsg;
+    bool finished;
+};
+
+static bool on_stream_data(const char *errmsg, const struct api_stream_info *info,
+                           const void *data, ssize_t size, void *userdata) {
+    struct stream_result *r = userdata;
+
+    if (size > 0) {
+        r->info = *info;
+        VEC_APPEND_N(&r->data, (const char *)data, size);
+        return true;
+    }
+
+    /* final call, on main loop */
+    if (size < 0) {
+        r->errmsg = errmsg != NULL ? errmsg : "unknown error";
+    }
+    r->finished = true;
+    pollen_loop_quit(event_loop, 0);
+
+    return true;
+}
+
+static void remove_db(const char *dir) {
+    char path[256];
+    const char *const files[] = { "db.sqlite3", "db.sqlite3-wal", "db.sqlite3-shm" };
+    for (size_t i = 0; i < SIZEOF_VEC(files); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char **argv) {
+    assert(argc == 2);
+
+    log_init(stderr, LOG_WARN, false);
+
+    char *address = start_server(argv[1]);
+    config.server_address = address;
+
+    char dir[] = "/tmp/campanula-test-XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    config.data_dir = dir;
+
+    assert(db_init());
+    config.server_id = db_add_server(address);
+    assert(config.server_id >= 0);
+
+    event_loop = pollen_loop_create();
+    assert(network_init());
+
+    /* same seed and sizes as the server, so we know what to expect */
+    struct mock_library lib;
+    mock_library_init(&lib, SEED, ARTISTS, ALBUMS, SONGS);
+
+    bool changed = false;
+    assert(db_populate(on_populated, &changed));
+    /* nothing is held while waiting for responses, other connections can write */
+    assert(sqlite3_get_autocommit(db));
+    assert(pollen_loop_run(event_loop) == 0);
+    assert(changed);
+    assert(db_count_artists() == lib.n_artists);
+    assert(db_count_albums() == lib.n_albums);
+    assert(db_count_songs() == lib.n_songs);
+
+    /* bytes [1000, 5000) of a song, like a seek in the player would request */
+    const size_t song = 5, start = 1000, end = 5000;
+    char id[32];
+    snprintf(id, sizeof(id), "so-%zu", song);
+
+    struct stream_result r = {0};
+    assert(api_stream(id, 0, "raw", start, end, 0, on_stream_data, &r));
+    assert(pollen_loop_run(event_loop) == 0);
+    assert(r.finished);
+    if (r.errmsg != NULL) {
+        fprintf(stderr, "stream failed: %s\n", r.errmsg);
+        assert(0);
+    }
+    assert(r.info.offset == start);
+    assert(r.info.total_size == mock_library_song_size(&lib, song));
+    assert(VEC_SIZE(&r.data) == end - start);
+
+    char *expected = xmalloc(end - start);
+    mock_library_song_data(&lib, song, start, expected, end - start);
+    assert(memcmp(VEC_DATA(&r.data), expected, end - start) == 0);
+    free(expected);
+    VEC_FREE(&r.data);
+
+    network_cleanup();
+    pollen_loop_cleanup(event_loop);
+    db_cleanup();
+    mock_library_free(&lib);
+    stop_server();
+    remove_db(dir);
+    free(address);
+    log_cleanup();
+
+    return 0;
+}
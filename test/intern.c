@@ -0,0 +1,92 @@
+#include <pthread.h>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "collections/intern.h"
+
+#define STREQ(a, b) (strcmp((a), (b)) == 0)
+
+#define THREADS 4
+#define STRINGS 1000
+
+static void *thread_func(void *) {
+    for (int round = 0; round < 10; round++) {
+        const char *mine[STRINGS];
+        for (size_t i = 0; i < STRINGS; i++) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "shared %zu", i);
+            mine[i] = intern(buf);
+            assert(STREQ(mine[i], buf));
+            /* other threads can't free it while we hold a ref */
+            const char *again = intern(buf);
+            assert(again == mine[i]);
+            intern_unref(again);
+        }
+        for (size_t i = 0; i < STRINGS; i++) {
+            intern_unref(mine[i]);
+        }
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    assert(intern(NULL) == NULL);
+    assert(intern_ref(NULL) == NULL);
+    intern_unref(NULL);
+
+    const char *a = intern("aboba");
+    const char *b = intern("aboba");
+    const char *c = intern("skibidi toilet");
+    assert(a == b);
+    assert(a != c);
+    assert(STREQ(a, "aboba"));
+    assert(STREQ(c, "skibidi toilet"));
+    assert(intern_count() == 2);
+
+    assert(intern_ref(a) == a);
+    intern_unref(a);
+    intern_unref(b);
+    assert(intern_count() == 2);
+    assert(STREQ(a, "aboba"));
+    intern_unref(a);
+    intern_unref(c);
+    assert(intern_count() == 0);
+
+    /* grow the table a few times, then remove in a different order than inserted */
+    const char *strs[10000];
+    for (size_t i = 0; i < 10000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "string number %zu", i);
+        strs[i] = intern(buf);
+    }
+    assert(intern_count() == 10000);
+    for (size_t i = 0; i < 10000; i += 2) {
+        intern_unref(strs[i]);
+    }
+    assert(intern_count() == 5000);
+    /* everything left must still be found after backward shifting */
+    for (size_t i = 1; i < 10000; i += 2) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "string number %zu", i);
+        const char *s = intern(buf);
+        assert(s == strs[i]);
+        intern_unref(s);
+    }
+    for (size_t i = 1; i < 10000; i += 2) {
+        intern_unref(strs[i]);
+    }
+    assert(intern_count() == 0);
+
+    pthread_t threads[THREADS];
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, thread_func, NULL);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(intern_count() == 0);
+
+    return 0;
+}
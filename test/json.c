@@ -0,0 +1,167 @@
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "mock/library.h"
+#include "api/json.h"
+#include "api/types.h"
+#include "collections/string.h"
+
+#define STREQ(a, b) (strcmp((a), (b)) == 0)
+
+/* ids and names of everything that matters to callers, one per line */
+static void describe_child(struct string *out, const struct api_type_child *c) {
+    string_appendf(out, "song %s \"%s\" album %s\n", c->id, c->title,
+                   c->album_id != NULL ? c->album_id : "-");
+}
+
+static void describe_album(struct string *out, const struct api_type_album_id3 *a) {
+    string_appendf(out, "album %s \"%s\" %d songs\n", a->id, a->name, a->song_count);
+}
+
+static void describe(struct string *out, const struct subsonic_response *resp) {
+    string_clear(out);
+    if (resp == NULL) {
+        string_append(out, "NULL\n");
+        return;
+    }
+
+    string_appendf(out, "status %d type %d\n", resp->status, resp->inner_object_type);
+    const union subsonic_response_inner_object *o = &resp->inner_object;
+    switch (resp->inner_object_type) {
+    case API_TYPE_SONGS:
+        VEC_FOREACH(&o->songs.song, i) {
+            describe_child(out, VEC_AT(&o->songs.song, i));
+        }
+        break;
+    case API_TYPE_ALBUM_LIST_2:
+        VEC_FOREACH(&o->album_list_2.album, i) {
+            describe_album(out, VEC_AT(&o->album_list_2.album, i));
+        }
+        break;
+    case API_TYPE_ALBUM_WITH_SONGS_ID3:
+        describe_album(out, &o->album_with_songs_id3.album);
+        VEC_FOREACH(&o->album_with_songs_id3.song, i) {
+            describe_child(out, VEC_AT(&o->album_with_songs_id3.song, i));
+        }
+        break;
+    case API_TYPE_SEARCH_RESULT_3:
+        VEC_FOREACH(&o->search_result_3.artist, i) {
+            const struct api_type_artist_id3 *a = VEC_AT(&o->search_result_3.artist, i);
+            string_appendf(out, "artist %s \"%s\"\n", a->id, a->name);
+        }
+        VEC_FOREACH(&o->search_result_3.album, i) {
+            describe_album(out, VEC_AT(&o->search_result_3.album, i));
+        }
+        VEC_FOREACH(&o->search_result_3.song, i) {
+            describe_child(out, VEC_AT(&o->search_result_3.song, i));
+        }
+        break;
+    case API_TYPE_ERROR:
+        string_appendf(out, "error %d\n", o->error.code);
+        break;
+    default:
+        assert(0 && "not described");
+    }
+}
+
+static struct subsonic_response *parse_split(enum api_request_type request,
+                                             const char *body, size_t len, size_t split) {
+    struct api_response_parser *parser = api_response_parser_new(request);
+    assert(api_response_parser_feed(parser, body, split));
+    assert(api_response_parser_feed(parser, body + split, len - split));
+    return api_response_parser_finish(parser);
+}
+
+/*
+ * Streaming parser must give the same result as parsing the whole body at once,
+ * wherever the body is split. Returns description of the result.
+ */
+static void check_every_split(enum api_request_type request, const char *body,
+                              struct string *expected) {
+    const size_t len = strlen(body);
+
+    struct subsonic_response *resp = api_parse_response(request, body, len);
+    describe(expected, resp);
+    subsonic_response_free(resp);
+
+    struct string got = {0};
+    for (size_t split = 0; split <= len; split++) {
+        resp = parse_split(request, body, len, split);
+        describe(&got, resp);
+        subsonic_response_free(resp);
+
+        if (!STREQ(got.str, expected->str)) {
+            fprintf(stderr, "split at %zu:\n%s\nexpected:\n%s\n", split, got.str, expected->str);
+            assert(0);
+        }
+    }
+    string_free(&got);
+}
+
+int main(void) {
+    struct string expected = {0};
+
+    /* brackets, braces and escaped quotes inside strings don't confuse element boundaries */
+    check_every_split(API_REQUEST_GET_RANDOM_SONGS,
+        "{\"subsonic-response\": {\"status\": \"ok\", \"version\": \"1.16.1\", "
+        "\"randomSongs\": {\"song\": ["
+            "{\"id\": \"1\", \"isDir\": false, \"title\": \"say \\\"hi\\\" {not [an] object}\"}, "
+            "{\"id\": \"2\", \"isDir\": false, \"title\": \"back\\\\\", \"album\": \"}]\"}, "
+            "{\"id\": \"3\", \"isDir\": false, \"title\": \"\\\"\\\\\\\"}\", \"albumId\": \"{\"}"
+        "]}}}", &expected);
+    assert(STREQ(expected.str,
+                 "status 1 type 1\n"
+                 "song 1 \"say \"hi\" {not [an] object}\" album -\n"
+                 "song 2 \"back\\\" album -\n"
+                 "song 3 \"\"\\\"}\" album {\n"));
+
+    /* empty arrays, and keys that look like streamed arrays outside of the inner object */
+    check_every_split(API_REQUEST_GET_RANDOM_SONGS,
+        "{\"subsonic-response\": {\"status\": \"ok\", \"version\": \"1.16.1\", "
+        "\"song\": [], \"randomSongs\": {\"song\": []}}}", &expected);
+    assert(STREQ(expected.str, "status 1 type 1\n"));
+
+    check_every_split(API_REQUEST_SEARCH3,
+        "{\"subsonic-response\": {\"status\": \"ok\", \"version\": \"1.16.1\", "
+        "\"searchResult3\": {\"artist\": [], \"album\": [], \"song\": []}}}", &expected);
+    assert(STREQ(expected.str, "status 1 type 4\n"));
+
+    /* errors don't have streamed arrays at all */
+    check_every_split(API_REQUEST_GET_ALBUM,
+        "{\"subsonic-response\": {\"status\": \"failed\", \"version\": \"1.16.1\", "
+        "\"error\": {\"code\": 70, \"message\": \"[not] {found}\"}}}", &expected);
+
+    /* generated responses, names include non-ascii and characters that need escaping */
+    struct mock_library lib;
+    mock_library_init(&lib, 7, 4, 12, 60);
+    struct string body = {0};
+
+    mock_response_album(&lib, &body, 5);
+    check_every_split(API_REQUEST_GET_ALBUM, body.str, &expected);
+    assert(strstr(expected.str, "album al-5 ") != NULL);
+
+    string_clear(&body);
+    mock_response_album_list_2(&lib, &body, 5, 3);
+    check_every_split(API_REQUEST_GET_ALBUM_LIST_2, body.str, &expected);
+    assert(strstr(expected.str, "album al-3 ") != NULL);
+    assert(strstr(expected.str, "album al-7 ") != NULL);
+
+    string_clear(&body);
+    mock_response_search3(&lib, &body, 2, 0, 2, 0, 4, 0);
+    check_every_split(API_REQUEST_SEARCH3, body.str, &expected);
+
+    /* garbage inside a streamed element fails right away, not at the end */
+    const char *broken =
+        "{\"subsonic-response\": {\"status\": \"ok\", \"version\": \"1.16.1\", "
+        "\"randomSongs\": {\"song\": [{\"id\": \"1\", \"isDir\": false, nope}, ";
+    struct api_response_parser *parser = api_response_parser_new(API_REQUEST_GET_RANDOM_SONGS);
+    assert(!api_response_parser_feed(parser, broken, strlen(broken)));
+    assert(api_response_parser_finish(parser) == NULL);
+
+    string_free(&body);
+    string_free(&expected);
+    mock_library_free(&lib);
+
+    return 0;
+}
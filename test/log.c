@@ -0,0 +1,111 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "log.h"
+
+#define THREADS 4
+#define LINES_PER_THREAD 5000
+
+static void *thread_func(void *data) {
+    const int id = (intptr_t)data;
+
+    for (int i = 0; i < LINES_PER_THREAD; i++) {
+        log_println(LOG_TRACE, "thread %d line %d", id, i);
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    FILE *f = tmpfile();
+    assert(f != NULL);
+
+    /* filtered out before anything is queued */
+    log_init(f, LOG_INFO, false);
+    log_println(LOG_DEBUG, "not written");
+    log_println(LOG_INFO, "written");
+
+    /* warnings don't wait for the flush thread, and lines queued before them go first */
+    log_println(LOG_WARN, "warned");
+    char head[256];
+    const ssize_t head_len = pread(fileno(f), head, sizeof(head) - 1, 0);
+    assert(head_len > 0);
+    head[head_len] = '\0';
+    assert(strstr(head, " written\n") != NULL);
+    assert(strstr(head, " warned\n") > strstr(head, " written\n"));
+
+    /* switching streams must write out the old queue first */
+    log_init(f, LOG_TRACE, false);
+
+    char long_line[5000];
+    memset(long_line, 'a', sizeof(long_line) - 1);
+    long_line[sizeof(long_line) - 1] = '\0';
+    log_println(LOG_TRACE, "%s", long_line);
+
+    log_print(LOG_TRACE, "no newline, ");
+    log_print(LOG_TRACE, "still no newline\n");
+
+    pthread_t threads[THREADS];
+    for (intptr_t i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, thread_func, (void *)i);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    log_cleanup();
+    const uint64_t dropped = log_dropped_lines();
+    
+    rewind(f);
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+
+    len = getline(&line, &cap, f);
+    assert(len > 0);
+    assert(strncmp(line, "I ", 2) == 0);
+    assert(strcmp(strchr(line + 2, ' '), " written\n") == 0);
+
+    len = getline(&line, &cap, f);
+    assert(strncmp(line, "W ", 2) == 0);
+    assert(strcmp(strchr(line + 2, ' '), " warned\n") == 0);
+
+    len = getline(&line, &cap, f);
+    assert(len == (ssize_t)(strchr(line + 2, ' ') - line + 1 + sizeof(long_line)));
+    assert(strncmp(strchr(line + 2, ' ') + 1, long_line, sizeof(long_line) - 1) == 0);
+
+    len = getline(&line, &cap, f);
+    assert(strstr(line, "no newline, T ") != NULL);
+    assert(strstr(line, " still no newline\n") != NULL);
+
+    /* lines from one thread stay in order and none are lost unless counted as dropped */
+    int next[THREADS] = {0};
+    uint64_t got = 0, dropped_reported = 0;
+    while ((len = getline(&line, &cap, f)) > 0) {
+        uint64_t n;
+        if (sscanf(line, "W %*d logger: dropped %" SCNu64 " lines", &n) == 1) {
+            dropped_reported += n;
+            continue;
+        }
+
+        int id, i;
+        assert(sscanf(line, "T %*d thread %d line %d", &id, &i) == 2);
+        assert(id >= 0 && id < THREADS);
+        assert(i >= next[id]);
+        next[id] = i + 1;
+        got += 1;
+    }
+    assert(got + dropped == THREADS * LINES_PER_THREAD);
+    assert(dropped_reported == dropped);
+
+    free(line);
+    fclose(f);
+
+    return 0;
+}
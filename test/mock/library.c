@@ -0,0 +1,423 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mock/library.h"
+#include "xmalloc.h"
+#include "macros.h"
+
+static const char *words[] = {
+    "the", "a", "of", "in", "love", "night", "blue", "black", "dream", "fire",
+    "heart", "light", "dead", "sun", "moon", "rain", "city", "girl", "boy", "song",
+    "electric", "summer", "winter", "ghost", "machine", "river", "forever", "young",
+    "wild", "golden", "silence", "paradise", "midnight", "shadow", "echo", "stone",
+    "requiem", "symphony", "variations", "interlude", "reprise", "remastered",
+    "orchestra", "quartet", "no.", "op.", "minor", "major", "live", "version",
+    "Björk", "Sigur", "Rós", "Motörhead", "Беларусь", "Сплин", "東京", "事変",
+    "l'amour", "déjà", "vu", "\"quoted\"", "back\\slash", "AC/DC", "&", "+",
+};
+
+/* splitmix64 */
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+struct rng {
+    uint64_t state;
+};
+
+static struct rng rng_for(const struct mock_library *lib, enum mock_item kind, size_t index) {
+    return (struct rng){ .state = mix(lib->seed ^ mix(((uint64_t)(kind + 1) << 56) ^ index)) };
+}
+
+static uint64_t rng_next(struct rng *rng) {
+    rng->state = mix(rng->state);
+    return rng->state;
+}
+
+/* uniform in [lo, hi] */
+static uint64_t rng_range(struct rng *rng, uint64_t lo, uint64_t hi) {
+    return lo + rng_next(rng) % (hi - lo + 1);
+}
+
+static void append_json_escaped(struct string *out, const char *str) {
+    const char *run = str;
+    for (const char *p = str; *p != '\0'; p++) {
+        if (*p != '"' && *p != '\\') {
+            continue;
+        }
+        string_appendf(out, "%.*s\\%c", (int)(p - run), run, *p);
+        run = p + 1;
+    }
+    string_append(out, run);
+}
+
+/*
+ * Mostly 1-4 words, a tail of longer names and a few absurdly long ones
+ * (classical track titles, "deluxe edition" albums and such).
+ */
+static void append_name(const struct mock_library *lib, struct string *out,
+                        enum mock_item kind, size_t index) {
+    struct rng rng = rng_for(lib, kind, index);
+
+    const uint64_t roll = rng_range(&rng, 0, 99);
+    size_t n_words;
+    if (roll < 25) {
+        n_words = 1;
+    } else if (roll < 55) {
+        n_words = 2;
+    } else if (roll < 75) {
+        n_words = 3;
+    } else if (roll < 87) {
+        n_words = 4;
+    } else if (roll < 97) {
+        n_words = rng_range(&rng, 5, 8);
+    } else {
+        n_words = rng_range(&rng, 15, 30);
+    }
+
+    string_append(out, "\"");
+    for (size_t i = 0; i < n_words; i++) {
+        if (i > 0) {
+            string_append(out, " ");
+        }
+        append_json_escaped(out, words[rng_range(&rng, 0, SIZEOF_VEC(words) - 1)]);
+    }
+    /* keeps names unique, which real libraries mostly are */
+    string_appendf(out, " %zu\"", index);
+}
+
+/* splits total into parts contiguous ranges of random length, at least 1 each */
+static size_t *split(const struct mock_library *lib, enum mock_item kind,
+                     size_t total, size_t parts) {
+    assert(total >= parts);
+
+    size_t *first = xmalloc((parts + 1) * sizeof(*first));
+    double *weights = xmalloc(parts * sizeof(*weights));
+
+    double sum = 0;
+    for (size_t i = 0; i < parts; i++) {
+        struct rng rng = rng_for(lib, kind, i);
+        weights[i] = 0.2 + (double)rng_range(&rng, 0, 1600) / 1000.0;
+        sum += weights[i];
+    }
+
+    /* everyone gets 1, the rest is spread by weight */
+    const size_t extra = total - parts;
+    double acc = 0;
+    for (size_t i = 0; i < parts; i++) {
+        first[i] = i + (size_t)((double)extra * acc / sum);
+        acc += weights[i];
+    }
+    first[parts] = total;
+
+    free(weights);
+    return first;
+}
+
+void mock_library_init(struct mock_library *lib, uint64_t seed,
+                       size_t n_artists, size_t n_albums, size_t n_songs) {
+    n_artists = MAX(n_artists, (size_t)1);
+    n_albums = MAX(n_albums, n_artists);
+    n_songs = MAX(n_songs, n_albums);
+
+    lib->seed = seed;
+    lib->n_artists = n_artists;
+    lib->n_albums = n_albums;
+    lib->n_songs = n_songs;
+
+    lib->artist_first_album = split(lib, MOCK_ARTIST, n_albums, n_artists);
+    lib->album_first_song = split(lib, MOCK_ALBUM, n_songs, n_albums);
+}
+
+void mock_library_init_truncated(struct mock_library *lib, const struct mock_library *base,
+                                 size_t n_albums) {
+    n_albums = MAX(MIN(n_albums, base->n_albums), (size_t)1);
+
+    lib->seed = base->seed;
+    lib->n_albums = n_albums;
+    lib->n_artists = mock_library_album_artist(base, n_albums - 1) + 1;
+    lib->n_songs = base->album_first_song[n_albums];
+
+    lib->artist_first_album = xmalloc((lib->n_artists + 1) * sizeof(size_t));
+    memcpy(lib->artist_first_album, base->artist_first_album, lib->n_artists * sizeof(size_t));
+    lib->artist_first_album[lib->n_artists] = n_albums;
+
+    lib->album_first_song = xmalloc((n_albums + 1) * sizeof(size_t));
+    memcpy(lib->album_first_song, base->album_first_song, (n_albums + 1) * sizeof(size_t));
+}
+
+void mock_library_free(struct mock_library *lib) {
+    free(lib->artist_first_album);
+    free(lib->album_first_song);
+}
+
+/* index of the range containing i */
+static size_t find_range(const size_t *first, size_t n, size_t i) {
+    size_t lo = 0, hi = n;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (first[mid] <= i) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t mock_library_album_artist(const struct mock_library *lib, size_t album) {
+    return find_range(lib->artist_first_album, lib->n_artists, album);
+}
+
+size_t mock_library_song_album(const struct mock_library *lib, size_t song) {
+    return find_range(lib->album_first_song, lib->n_albums, song);
+}
+
+bool mock_library_parse_id(const struct mock_library *lib, const char *id,
+                           enum mock_item kind, size_t *index) {
+    static const char *prefixes[] = {
+        [MOCK_ARTIST] = "ar-",
+        [MOCK_ALBUM] = "al-",
+        [MOCK_SONG] = "so-",
+    };
+    const size_t limits[] = {
+        [MOCK_ARTIST] = lib->n_artists,
+        [MOCK_ALBUM] = lib->n_albums,
+        [MOCK_SONG] = lib->n_songs,
+    };
+
+    const char *prefix = prefixes[kind];
+    const size_t limit = limits[kind];
+    if (id == NULL || !STRSTARTSWITH(id, prefix)) {
+        return false;
+    }
+
+    char *end;
+    const unsigned long long n = strtoull(id + strlen(prefix), &end, 10);
+    if (*end != '\0' || end == id + strlen(prefix) || n >= limit) {
+        return false;
+    }
+
+    *index = n;
+    return true;
+}
+
+static int32_t song_duration(const struct mock_library *lib, size_t song) {
+    struct rng rng = rng_for(lib, MOCK_SONG, song);
+    rng_next(&rng); /* don't correlate with name */
+    return rng_range(&rng, 60, 600);
+}
+
+static int32_t album_year(const struct mock_library *lib, size_t album) {
+    struct rng rng = rng_for(lib, MOCK_ALBUM, album);
+    rng_next(&rng);
+    return rng_range(&rng, 1960, 2025);
+}
+
+void mock_library_append_artist(const struct mock_library *lib, struct string *out, size_t artist) {
+    string_appendf(out, "{\"id\":\"ar-%zu\",\"name\":", artist);
+    append_name(lib, out, MOCK_ARTIST, artist);
+    string_appendf(out, ",\"albumCount\":%zu}",
+                   lib->artist_first_album[artist + 1] - lib->artist_first_album[artist]);
+}
+
+void mock_library_append_album(const struct mock_library *lib, struct string *out, size_t album) {
+    const size_t artist = mock_library_album_artist(lib, album);
+    const size_t first = lib->album_first_song[album], last = lib->album_first_song[album + 1];
+
+    int64_t duration = 0;
+    for (size_t i = first; i < last; i++) {
+        duration += song_duration(lib, i);
+    }
+
+    const int32_t year = album_year(lib, album);
+    string_appendf(out, "{\"id\":\"al-%zu\",\"name\":", album);
+    append_name(lib, out, MOCK_ALBUM, album);
+    string_appendf(out, ",\"songCount\":%zu,\"duration\":%" PRIi64 ","
+                   "\"created\":\"%d-%02zu-%02zuT12:00:00.000Z\",\"year\":%d,"
+                   "\"artistId\":\"ar-%zu\",\"artist\":",
+                   last - first, duration, year, album % 12 + 1, album % 28 + 1, year, artist);
+    append_name(lib, out, MOCK_ARTIST, artist);
+    string_append(out, "}");
+}
+
+void mock_library_append_song(const struct mock_library *lib, struct string *out, size_t song) {
+    const size_t album = mock_library_song_album(lib, song);
+    const size_t artist = mock_library_album_artist(lib, album);
+
+    string_appendf(out, "{\"id\":\"so-%zu\",\"parent\":\"al-%zu\",\"isDir\":false,\"title\":",
+                   song, album);
+    append_name(lib, out, MOCK_SONG, song);
+    string_append(out, ",\"album\":");
+    append_name(lib, out, MOCK_ALBUM, album);
+    string_append(out, ",\"artist\":");
+    append_name(lib, out, MOCK_ARTIST, artist);
+    string_appendf(out, ",\"track\":%zu,\"year\":%d,\"size\":%zu,"
+                   "\"contentType\":\"audio/mpeg\",\"suffix\":\"mp3\","
+                   "\"duration\":%d,\"bitRate\":320,"
+                   "\"albumId\":\"al-%zu\",\"artistId\":\"ar-%zu\",\"type\":\"music\"}",
+                   song - lib->album_first_song[album] + 1, album_year(lib, album),
+                   mock_library_song_size(lib, song), song_duration(lib, song),
+                   album, artist);
+}
+
+static void response_begin(struct string *out, const char *status) {
+    string_appendf(out, "{\"subsonic-response\":{\"status\":\"%s\",\"version\":\"1.16.1\","
+                   "\"type\":\"campanula-mock\",\"serverVersion\":\"0.0.0\","
+                   "\"openSubsonic\":true", status);
+}
+
+static void response_end(struct string *out) {
+    string_append(out, "}}");
+}
+
+void mock_response_ok(struct string *out) {
+    response_begin(out, "ok");
+    response_end(out);
+}
+
+void mock_response_error(struct string *out, int code, const char *message) {
+    response_begin(out, "failed");
+    string_appendf(out, ",\"error\":{\"code\":%d,\"message\":\"", code);
+    append_json_escaped(out, message);
+    string_append(out, "\"}");
+    response_end(out);
+}
+
+typedef void (*append_func_t)(const struct mock_library *lib, struct string *out, size_t i);
+
+static void append_array(const struct mock_library *lib, struct string *out, const char *name,
+                         append_func_t append, size_t total, size_t count, size_t offset) {
+    string_appendf(out, "\"%s\":[", name);
+    for (size_t i = offset; i < total && i - offset < count; i++) {
+        if (i > offset) {
+            string_append(out, ",");
+        }
+        append(lib, out, i);
+    }
+    string_append(out, "]");
+}
+
+void mock_response_search3(const struct mock_library *lib, struct string *out,
+                           size_t artist_count, size_t artist_offset,
+                           size_t album_count, size_t album_offset,
+                           size_t song_count, size_t song_offset) {
+    response_begin(out, "ok");
+    string_append(out, ",\"searchResult3\":{");
+    append_array(lib, out, "artist", mock_library_append_artist,
+                 lib->n_artists, artist_count, artist_offset);
+    string_append(out, ",");
+    append_array(lib, out, "album", mock_library_append_album,
+                 lib->n_albums, album_count, album_offset);
+    string_append(out, ",");
+    append_array(lib, out, "song", mock_library_append_song,
+                 lib->n_songs, song_count, song_offset);
+    string_append(out, "}");
+    response_end(out);
+}
+
+void mock_response_album_list_2(const struct mock_library *lib, struct string *out,
+                                size_t size, size_t offset) {
+    response_begin(out, "ok");
+    string_append(out, ",\"albumList2\":{");
+    append_array(lib, out, "album", mock_library_append_album, lib->n_albums, size, offset);
+    string_append(out, "}");
+    response_end(out);
+}
+
+void mock_response_album(const struct mock_library *lib, struct string *out, size_t album) {
+    response_begin(out, "ok");
+    string_append(out, ",\"album\":");
+
+    /* AlbumWithSongsID3 is AlbumID3 with one more member */
+    mock_library_append_album(lib, out, album);
+    out->str[--out->len] = '\0'; /* closing brace */
+    string_append(out, ",");
+
+    const size_t first = lib->album_first_song[album], last = lib->album_first_song[album + 1];
+    append_array(lib, out, "song", mock_library_append_song, last, last - first, first);
+    string_append(out, "}");
+    response_end(out);
+}
+
+static char artist_index_char(const struct mock_library *lib, size_t artist) {
+    struct string name = {0};
+    append_name(lib, &name, MOCK_ARTIST, artist);
+    /* skip opening quote */
+    char c = name.str[1];
+    string_free(&name);
+
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 'A';
+    } else if (c >= 'A' && c <= 'Z') {
+        return c;
+    } else {
+        return '#';
+    }
+}
+
+void mock_response_artists(const struct mock_library *lib, struct string *out) {
+    response_begin(out, "ok");
+    string_append(out, ",\"artists\":{\"ignoredArticles\":\"The El La Los Las Le Les\",\"index\":[");
+
+    /* one pass per index letter, quadratic in letters only */
+    static const char letters[] = "#ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    bool first_index = true;
+    for (const char *l = letters; *l != '\0'; l++) {
+        bool first_artist = true;
+        for (size_t i = 0; i < lib->n_artists; i++) {
+            if (artist_index_char(lib, i) != *l) {
+                continue;
+            }
+            if (first_artist) {
+                string_appendf(out, "%s{\"name\":\"%c\",\"artist\":[", first_index ? "" : ",", *l);
+                first_artist = false;
+                first_index = false;
+            } else {
+                string_append(out, ",");
+            }
+            mock_library_append_artist(lib, out, i);
+        }
+        if (!first_artist) {
+            string_append(out, "]}");
+        }
+    }
+
+    string_append(out, "]}");
+    response_end(out);
+}
+
+/* only used to check if library changed, so no artists here */
+void mock_response_indexes(const struct mock_library *, struct string *out,
+                           int64_t last_modified) {
+    response_begin(out, "ok");
+    string_appendf(out, ",\"indexes\":{\"lastModified\":%" PRIi64 ","
+                   "\"ignoredArticles\":\"The El La Los Las Le Les\"}", last_modified);
+    response_end(out);
+}
+
+size_t mock_library_song_size(const struct mock_library *lib, size_t song) {
+    /* 320 kbps */
+    return (size_t)song_duration(lib, song) * 40'000;
+}
+
+void mock_library_song_data(const struct mock_library *lib, size_t song,
+                            size_t offset, void *buf, size_t len) {
+    /* every 8 byte word depends only on its position, so any range can be produced */
+    unsigned char *out = buf;
+    const uint64_t song_seed = lib->seed ^ mix(song);
+
+    size_t i = 0;
+    while (i < len) {
+        const size_t pos = offset + i;
+        const uint64_t word = mix(song_seed ^ (pos / 8));
+        for (size_t b = pos % 8; b < 8 && i < len; b++, i++) {
+            out[i] = (unsigned char)(word >> (b * 8));
+        }
+    }
+}
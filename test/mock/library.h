@@ -0,0 +1,80 @@
+#ifndef TEST_MOCK_LIBRARY_H
+#define TEST_MOCK_LIBRARY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "collections/string.h"
+
+/*
+ * Synthetic music library. Everything is derived from the seed and the index of
+ * an item, so nothing but album and artist boundaries is kept in memory and the
+ * same seed always produces the same library. Names follow roughly the length
+ * distribution of real catalogues: mostly a couple of words, sometimes very long,
+ * sometimes non-ASCII, sometimes with characters that need escaping in json.
+ *
+ * Ids are "ar-N", "al-N" and "so-N". Albums of one artist and songs of one album
+ * are contiguous ranges of indices.
+ */
+
+enum mock_item {
+    MOCK_ARTIST,
+    MOCK_ALBUM,
+    MOCK_SONG,
+};
+
+struct mock_library {
+    uint64_t seed;
+    size_t n_artists, n_albums, n_songs;
+
+    size_t *artist_first_album; /* n_artists + 1 entries */
+    size_t *album_first_song; /* n_albums + 1 entries */
+};
+
+/* Each artist gets at least one album and each album at least one song, counts are raised if needed */
+void mock_library_init(struct mock_library *lib, uint64_t seed,
+                       size_t n_artists, size_t n_albums, size_t n_songs);
+/*
+ * Same library as base but only with its first n_albums albums, their songs
+ * and artists. Everything that is left keeps its id, like the rest was removed.
+ */
+void mock_library_init_truncated(struct mock_library *lib, const struct mock_library *base,
+                                 size_t n_albums);
+void mock_library_free(struct mock_library *lib);
+
+size_t mock_library_album_artist(const struct mock_library *lib, size_t album);
+size_t mock_library_song_album(const struct mock_library *lib, size_t song);
+
+/* Parses "ar-N", "al-N" or "so-N", returns false if id is not of that kind or out of range */
+bool mock_library_parse_id(const struct mock_library *lib, const char *id,
+                           enum mock_item kind, size_t *index);
+
+/* Append a single json object in subsonic format (ArtistID3, AlbumID3, Child) */
+void mock_library_append_artist(const struct mock_library *lib, struct string *out, size_t artist);
+void mock_library_append_album(const struct mock_library *lib, struct string *out, size_t album);
+void mock_library_append_song(const struct mock_library *lib, struct string *out, size_t song);
+
+/*
+ * Complete "subsonic-response" bodies. Ranges are clamped to what exists.
+ * getArtists groups artists by the first byte of their name like real servers do.
+ */
+void mock_response_ok(struct string *out);
+void mock_response_error(struct string *out, int code, const char *message);
+void mock_response_search3(const struct mock_library *lib, struct string *out,
+                           size_t artist_count, size_t artist_offset,
+                           size_t album_count, size_t album_offset,
+                           size_t song_count, size_t song_offset);
+void mock_response_album_list_2(const struct mock_library *lib, struct string *out,
+                                size_t size, size_t offset);
+void mock_response_album(const struct mock_library *lib, struct string *out, size_t album);
+void mock_response_artists(const struct mock_library *lib, struct string *out);
+void mock_response_indexes(const struct mock_library *lib, struct string *out,
+                           int64_t last_modified);
+
+/* Length of synthetic audio for a song and its contents, for stream requests */
+size_t mock_library_song_size(const struct mock_library *lib, size_t song);
+void mock_library_song_data(const struct mock_library *lib, size_t song,
+                            size_t offset, void *buf, size_t len);
+
+#endif /* #ifndef TEST_MOCK_LIBRARY_H */
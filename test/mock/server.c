@@ -0,0 +1,912 @@
+/*
+ * Local Subsonic server for testing and benchmarking without a real one.
+ * Serves a synthetic library (see mock/library.h), can slow responses down,
+ * inject errors, and record sessions against a real server to replay them later.
+ * Point config.server_address at the printed address, credentials are ignored.
+ */
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <curl/curl.h>
+
+#include "mock/library.h"
+#include "collections/string.h"
+#include "xmalloc.h"
+#include "macros.h"
+
+#define MAX_REQUEST_HEAD 16384
+#define MAX_PARAMS 32
+#define STREAM_CHUNK 65536
+
+enum error_kind {
+    ERROR_KIND_HTTP = 1 << 0, /* 503 with empty body */
+    ERROR_KIND_SUBSONIC = 1 << 1, /* 200 with status "failed" */
+    ERROR_KIND_TRUNCATE = 1 << 2, /* connection closed halfway through the body */
+};
+
+static struct {
+    const char *address;
+    uint16_t port;
+
+    uint64_t seed;
+    size_t artists, albums, songs;
+    int64_t last_modified;
+
+    unsigned latency_ms, jitter_ms;
+    size_t bandwidth; /* bytes per second per connection, 0 is unlimited */
+    double error_rate;
+    uint32_t error_kinds;
+
+    const char *record_dir, *upstream;
+    const char *replay_dir;
+
+    bool quiet;
+} opts = {
+    .address = "127.0.0.1",
+    .port = 4533,
+    .seed = 1,
+    .artists = 1'000,
+    .albums = 5'000,
+    .songs = 50'000,
+    .error_kinds = ERROR_KIND_HTTP | ERROR_KIND_SUBSONIC | ERROR_KIND_TRUNCATE,
+};
+
+static struct mock_library lib;
+
+struct param {
+    char *key, *value;
+};
+
+struct request {
+    char *target;
+    char *endpoint; /* "search3", ".view" suffix stripped */
+    char *query; /* raw, without '?' */
+
+    struct param params[MAX_PARAMS];
+    size_t n_params;
+
+    bool has_range;
+    size_t range_start, range_end; /* inclusive, range_end is SIZE_MAX if open */
+    bool range_suffix; /* "bytes=-N", last N bytes, N is in range_end */
+
+    bool keep_alive;
+};
+
+struct response {
+    int status;
+    const char *content_type;
+    struct string body;
+
+    /* stream responses are generated while sending instead of living in body */
+    bool stream;
+    size_t song;
+    size_t offset, length, total;
+
+    char content_range[96];
+};
+
+[[gnu::format(printf, 1, 2)]]
+static void log_message(const char *fmt, ...) {
+    if (opts.quiet) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns) {
+    struct timespec ts = { .tv_sec = ns / 1'000'000'000, .tv_nsec = ns % 1'000'000'000 };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+}
+
+/* per connection, seeded from the connection fd and time */
+static thread_local uint64_t rng_state;
+
+static double random_unit(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (double)(rng_state >> 11) / (double)(1ull << 53);
+}
+
+static void url_decode(char *str) {
+    char *out = str;
+    for (char *in = str; *in != '\0'; in++) {
+        if (*in == '+') {
+            *out++ = ' ';
+        } else if (*in == '%' && in[1] != '\0' && in[2] != '\0') {
+            const char hex[3] = { in[1], in[2], '\0' };
+            *out++ = (char)strtol(hex, NULL, 16);
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+static const char *param_str(const struct request *req, const char *key) {
+    for (size_t i = 0; i < req->n_params; i++) {
+        if (STREQ(req->params[i].key, key)) {
+            return req->params[i].value;
+        }
+    }
+    return NULL;
+}
+
+static size_t param_size(const struct request *req, const char *key, size_t def) {
+    const char *str = param_str(req, key);
+    if (str == NULL) {
+        return def;
+    }
+
+    char *end;
+    const long long n = strtoll(str, &end, 10);
+    return (*end != '\0' || n < 0) ? def : (size_t)n;
+}
+
+/* "N-", "N-M" or "-N". Anything else is not understood and the header is ignored */
+static bool parse_range(const char *spec, struct request *req) {
+    char *end;
+
+    if (spec[0] == '-') {
+        req->range_suffix = true;
+        req->range_end = strtoull(spec + 1, &end, 10);
+        return end != spec + 1 && *end == '\0';
+    }
+
+    req->range_start = strtoull(spec, &end, 10);
+    if (end == spec || *end != '-') {
+        return false;
+    }
+    spec = end + 1;
+    if (*spec == '\0') {
+        req->range_end = SIZE_MAX;
+        return true;
+    }
+    req->range_end = strtoull(spec, &end, 10);
+    return end != spec && *end == '\0';
+}
+
+/* head is modified in place, request points into it */
+static bool parse_request(char *head, struct request *req) {
+    *req = (struct request){ .keep_alive = true };
+
+    char *saveptr;
+    char *line = strtok_r(head, "\r\n", &saveptr);
+    if (line == NULL) {
+        return false;
+    }
+
+    char *line_saveptr;
+    char *method = strtok_r(line, " ", &line_saveptr);
+    req->target = strtok_r(NULL, " ", &line_saveptr);
+    const char *version = strtok_r(NULL, " ", &line_saveptr);
+    if (method == NULL || req->target == NULL || version == NULL || !STREQ(method, "GET")) {
+        return false;
+    }
+    if (STREQ(version, "HTTP/1.0")) {
+        req->keep_alive = false;
+    }
+
+    while ((line = strtok_r(NULL, "\r\n", &saveptr)) != NULL) {
+        char *value = strchr(line, ':');
+        if (value == NULL) {
+            continue;
+        }
+        *value++ = '\0';
+        value += strspn(value, " \t");
+
+        if (strcasecmp(line, "Range") == 0 && STRSTARTSWITH(value, "bytes=")) {
+            req->has_range = parse_range(value + strlen("bytes="), req);
+        } else if (strcasecmp(line, "Connection") == 0 && strcasecmp(value, "close") == 0) {
+            req->keep_alive = false;
+        }
+    }
+
+    /* keep the target intact for recording */
+    char *path = xstrdup(req->target);
+    char *query = strchr(path, '?');
+    if (query != NULL) {
+        *query++ = '\0';
+    }
+    req->query = xstrdup(query != NULL ? query : "");
+
+    const char *endpoint = strrchr(path, '/');
+    req->endpoint = xstrdup(endpoint != NULL ? endpoint + 1 : path);
+    char *view = strstr(req->endpoint, ".view");
+    if (view != NULL && view[strlen(".view")] == '\0') {
+        *view = '\0';
+    }
+    free(path);
+
+    char *params = xstrdup(req->query);
+    char *param_saveptr;
+    for (char *kv = strtok_r(params, "&", &param_saveptr);
+         kv != NULL && req->n_params < MAX_PARAMS;
+         kv = strtok_r(NULL, "&", &param_saveptr)) {
+        char *value = strchr(kv, '=');
+        if (value != NULL) {
+            *value++ = '\0';
+        }
+        struct param *p = &req->params[req->n_params++];
+        p->key = xstrdup(kv);
+        p->value = xstrdup(value != NULL ? value : "");
+        url_decode(p->key);
+        url_decode(p->value);
+    }
+    free(params);
+
+    return true;
+}
+
+static void request_free(struct request *req) {
+    for (size_t i = 0; i < req->n_params; i++) {
+        free(req->params[i].key);
+        free(req->params[i].value);
+    }
+    free(req->endpoint);
+    free(req->query);
+}
+
+/* struct string is for text, recorded bodies might be binary */
+static void append_bytes(struct string *str, const char *data, size_t len) {
+    if (str->len + len + 1 > str->capacity) {
+        str->capacity = MAX(str->capacity * 2, str->len + len + 1);
+        str->str = xrealloc(str->str, str->capacity);
+    }
+    memcpy(&str->str[str->len], data, len);
+    str->len += len;
+    str->str[str->len] = '\0';
+}
+
+static void respond_json(struct response *resp) {
+    resp->status = 200;
+    resp->content_type = "application/json";
+}
+
+static void respond_subsonic_error(struct response *resp, int code, const char *message) {
+    respond_json(resp);
+    string_clear(&resp->body);
+    mock_response_error(&resp->body, code, message);
+}
+
+static void handle_stream(const struct request *req, struct response *resp) {
+    size_t song;
+    if (!mock_library_parse_id(&lib, param_str(req, "id"), MOCK_SONG, &song)) {
+        respond_subsonic_error(resp, 70, "Song not found");
+        return;
+    }
+
+    const size_t total = mock_library_song_size(&lib, song);
+    resp->stream = true;
+    resp->song = song;
+    resp->total = total;
+    resp->content_type = "audio/mpeg";
+
+    if (!req->has_range) {
+        resp->status = 200;
+        resp->offset = 0;
+        resp->length = total;
+        return;
+    }
+
+    size_t start, end;
+    if (req->range_suffix) {
+        start = total - MIN(req->range_end, total);
+        end = total - 1;
+    } else {
+        start = req->range_start;
+        end = MIN(req->range_end, total - 1);
+    }
+
+    /* past the end, reversed ("100-50") or empty suffix ("-0") */
+    if (start >= total || end < start) {
+        resp->stream = false;
+        resp->status = 416;
+        resp->content_type = "text/plain";
+        snprintf(resp->content_range, sizeof(resp->content_range), "bytes */%zu", total);
+        return;
+    }
+
+    resp->status = 206;
+    resp->offset = start;
+    resp->length = end - start + 1;
+    snprintf(resp->content_range, sizeof(resp->content_range),
+             "bytes %zu-%zu/%zu", start, end, total);
+}
+
+static void handle_synthetic(const struct request *req, struct response *resp) {
+    const char *e = req->endpoint;
+
+    if (STREQ(e, "stream") || STREQ(e, "download")) {
+        handle_stream(req, resp);
+        return;
+    }
+
+    respond_json(resp);
+
+    if (STREQ(e, "ping")) {
+        mock_response_ok(&resp->body);
+    } else if (STREQ(e, "scrobble")) {
+        size_t song;
+        if (!mock_library_parse_id(&lib, param_str(req, "id"), MOCK_SONG, &song)) {
+            respond_subsonic_error(resp, 70, "Song not found");
+            return;
+        }
+        mock_response_ok(&resp->body);
+    } else if (STREQ(e, "search3")) {
+        mock_response_search3(&lib, &resp->body,
+                              param_size(req, "artistCount", 20),
+                              param_size(req, "artistOffset", 0),
+                              param_size(req, "albumCount", 20),
+                              param_size(req, "albumOffset", 0),
+                              param_size(req, "songCount", 20),
+                              param_size(req, "songOffset", 0));
+    } else if (STREQ(e, "getAlbumList2")) {
+        mock_response_album_list_2(&lib, &resp->body,
+                                   MIN(param_size(req, "size", 10), (size_t)500),
+                                   param_size(req, "offset", 0));
+    } else if (STREQ(e, "getAlbum")) {
+        size_t album;
+        if (!mock_library_parse_id(&lib, param_str(req, "id"), MOCK_ALBUM, &album)) {
+            respond_subsonic_error(resp, 70, "Album not found");
+            return;
+        }
+        mock_response_album(&lib, &resp->body, album);
+    } else if (STREQ(e, "getArtists")) {
+        mock_response_artists(&lib, &resp->body);
+    } else if (STREQ(e, "getIndexes")) {
+        mock_response_indexes(&lib, &resp->body, opts.last_modified);
+    } else {
+        resp->status = 404;
+        resp->content_type = "text/plain";
+        string_append(&resp->body, "not implemented by mock server\n");
+    }
+}
+
+/*
+ * Recording. Requests are keyed by endpoint, query without auth parameters
+ * (they are salted differently every time) and Range header.
+ * Each file is a "status\tcontent-type\tcontent-range\n" line followed by the body.
+ */
+
+static bool is_auth_param(const char *key) {
+    static const char *auth_params[] = { "u", "p", "t", "s", "v", "c", "apiKey" };
+    for (size_t i = 0; i < SIZEOF_VEC(auth_params); i++) {
+        if (STREQ(key, auth_params[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void session_path(const struct request *req, const char *dir, struct string *path) {
+    struct string key = {0};
+    string_appendf(&key, "%s?", req->endpoint);
+    for (size_t i = 0; i < req->n_params; i++) {
+        if (!is_auth_param(req->params[i].key)) {
+            string_appendf(&key, "%s=%s&", req->params[i].key, req->params[i].value);
+        }
+    }
+    if (req->has_range && req->range_suffix) {
+        string_appendf(&key, "|-%zu", req->range_end);
+    } else if (req->has_range) {
+        string_appendf(&key, "|%zu-%zu", req->range_start, req->range_end);
+    }
+
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < key.len; i++) {
+        hash ^= (unsigned char)key.str[i];
+        hash *= 0x100000001b3;
+    }
+
+    string_appendf(path, "%s/%s-%016" PRIx64, dir, req->endpoint, hash);
+    string_free(&key);
+}
+
+static bool load_session(const struct request *req, struct response *resp) {
+    struct string path = {0};
+    session_path(req, opts.replay_dir, &path);
+
+    FILE *f = fopen(path.str, "r");
+    if (f == NULL) {
+        log_message("replay: no recording for %s (%s)\n", req->target, path.str);
+        string_free(&path);
+        return false;
+    }
+    string_free(&path);
+
+    static thread_local char content_type[128];
+    if (fscanf(f, "%d\t%127[^\t]\t%95[^\n]\n", &resp->status, content_type, resp->content_range) < 2) {
+        fclose(f);
+        return false;
+    }
+    if (STREQ(resp->content_range, "-")) {
+        resp->content_range[0] = '\0';
+    }
+    resp->content_type = content_type;
+
+    char buf[STREAM_CHUNK];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        append_bytes(&resp->body, buf, n);
+    }
+
+    fclose(f);
+    return true;
+}
+
+static size_t on_upstream_data(char *data, size_t size, size_t nmemb, void *userdata) {
+    append_bytes(userdata, data, size * nmemb);
+    return size * nmemb;
+}
+
+static size_t on_upstream_header(char *data, size_t size, size_t nmemb, void *userdata) {
+    struct response *resp = userdata;
+    const size_t len = size * nmemb;
+    const char *name = "Content-Range:";
+    if (len > strlen(name) && strncasecmp(data, name, strlen(name)) == 0) {
+        const char *value = data + strlen(name);
+        value += strspn(value, " ");
+        const int value_len = (int)strcspn(value, "\r\n");
+        snprintf(resp->content_range, sizeof(resp->content_range), "%.*s", value_len, value);
+    }
+    return len;
+}
+
+static bool record_session(const struct request *req, struct response *resp) {
+    struct string url = {0};
+    string_appendf(&url, "%s/rest/%s?%s", opts.upstream, req->endpoint, req->query);
+
+    CURL *easy = curl_easy_init();
+    curl_easy_setopt(easy, CURLOPT_URL, url.str);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, on_upstream_data);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &resp->body);
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, on_upstream_header);
+    curl_easy_setopt(easy, CURLOPT_HEADERDATA, resp);
+    curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+
+    char range[64];
+    if (req->has_range) {
+        if (req->range_suffix) {
+            snprintf(range, sizeof(range), "-%zu", req->range_end);
+        } else if (req->range_end == SIZE_MAX) {
+            snprintf(range, sizeof(range), "%zu-", req->range_start);
+        } else {
+            snprintf(range, sizeof(range), "%zu-%zu", req->range_start, req->range_end);
+        }
+        curl_easy_setopt(easy, CURLOPT_RANGE, range);
+    }
+
+    const CURLcode rc = curl_easy_perform(easy);
+    string_free(&url);
+    if (rc != CURLE_OK) {
+        log_message("record: %s: %s\n", req->target, curl_easy_strerror(rc));
+        curl_easy_cleanup(easy);
+        return false;
+    }
+
+    long status;
+    const char *content_type = NULL;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_getinfo(easy, CURLINFO_CONTENT_TYPE, &content_type);
+
+    static thread_local char content_type_copy[128];
+    snprintf(content_type_copy, sizeof(content_type_copy), "%s",
+             content_type != NULL ? content_type : "application/octet-stream");
+    resp->status = (int)status;
+    resp->content_type = content_type_copy;
+    curl_easy_cleanup(easy);
+
+    struct string path = {0};
+    session_path(req, opts.record_dir, &path);
+    FILE *f = fopen(path.str, "w");
+    if (f == NULL) {
+        log_message("record: failed to open %s: %s\n", path.str, strerror(errno));
+    } else {
+        fprintf(f, "%d\t%s\t%s\n", resp->status, resp->content_type,
+                resp->content_range[0] != '\0' ? resp->content_range : "-");
+        fwrite(resp->body.str, 1, resp->body.len, f);
+        fclose(f);
+    }
+    string_free(&path);
+
+    return true;
+}
+
+/*
+ * Sending. Everything goes through send_throttled so bandwidth limit applies
+ * to headers and bodies alike.
+ */
+
+struct throttle {
+    uint64_t start_ns;
+    size_t sent;
+};
+
+static bool send_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        const ssize_t ret = send(fd, p, len, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+static bool send_throttled(int fd, struct throttle *t, const void *data, size_t len) {
+    if (opts.bandwidth == 0) {
+        return send_all(fd, data, len);
+    }
+
+    /* 20 slices per second keeps it smooth enough */
+    const size_t slice = MAX(opts.bandwidth / 20, (size_t)1);
+    const char *p = data;
+    while (len > 0) {
+        const size_t n = MIN(len, slice);
+        if (!send_all(fd, p, n)) {
+            return false;
+        }
+        p += n;
+        len -= n;
+        t->sent += n;
+
+        const uint64_t due = t->start_ns + t->sent * 1'000'000'000ull / opts.bandwidth;
+        const uint64_t now = now_ns();
+        if (due > now) {
+            sleep_ns(due - now);
+        }
+    }
+    return true;
+}
+
+static const char *status_text(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 416: return "Range Not Satisfiable";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+/* returns false if connection should be closed */
+static bool send_response(int fd, const struct request *req, const struct response *resp,
+                          bool truncate) {
+    struct throttle t = { .start_ns = now_ns() };
+    const size_t length = resp->stream ? resp->length : resp->body.len;
+
+    struct string head = {0};
+    string_appendf(&head, "HTTP/1.1 %d %s\r\n", resp->status, status_text(resp->status));
+    string_appendf(&head, "Content-Type: %s\r\n", resp->content_type);
+    string_appendf(&head, "Content-Length: %zu\r\n", length);
+    if (resp->stream || resp->content_range[0] != '\0') {
+        string_append(&head, "Accept-Ranges: bytes\r\n");
+    }
+    if (resp->content_range[0] != '\0') {
+        string_appendf(&head, "Content-Range: %s\r\n", resp->content_range);
+    }
+    string_appendf(&head, "Connection: %s\r\n\r\n", req->keep_alive ? "keep-alive" : "close");
+
+    bool ok = send_throttled(fd, &t, head.str, head.len);
+    string_free(&head);
+
+    const size_t to_send = truncate ? length / 2 : length;
+    if (!resp->stream) {
+        ok = ok && send_throttled(fd, &t, resp->body.str, to_send);
+    } else {
+        char *buf = xmalloc(STREAM_CHUNK);
+        for (size_t off = 0; ok && off < to_send; off += STREAM_CHUNK) {
+            const size_t n = MIN((size_t)STREAM_CHUNK, to_send - off);
+            mock_library_song_data(&lib, resp->song, resp->offset + off, buf, n);
+            ok = send_throttled(fd, &t, buf, n);
+        }
+        free(buf);
+    }
+
+    return ok && !truncate && req->keep_alive;
+}
+
+/* returns false if connection should be closed */
+static bool handle_request(int fd, struct request *req) {
+    const uint64_t start = now_ns();
+    struct response resp = {0};
+
+    if (opts.latency_ms > 0 || opts.jitter_ms > 0) {
+        const double jitter = opts.jitter_ms * random_unit();
+        sleep_ns((uint64_t)((opts.latency_ms + jitter) * 1'000'000));
+    }
+
+    uint32_t error = 0;
+    if (opts.error_rate > 0 && random_unit() < opts.error_rate) {
+        /* pick one of the enabled kinds */
+        uint32_t kinds[3];
+        size_t n_kinds = 0;
+        for (uint32_t k = ERROR_KIND_HTTP; k <= ERROR_KIND_TRUNCATE; k <<= 1) {
+            if (opts.error_kinds & k) {
+                kinds[n_kinds++] = k;
+            }
+        }
+        if (n_kinds > 0) {
+            error = kinds[(size_t)(random_unit() * n_kinds) % n_kinds];
+        }
+    }
+
+    if (error == ERROR_KIND_HTTP) {
+        resp.status = 503;
+        resp.content_type = "text/plain";
+    } else if (error == ERROR_KIND_SUBSONIC) {
+        respond_subsonic_error(&resp, 0, "Injected error");
+    } else if (opts.replay_dir != NULL) {
+        if (!load_session(req, &resp)) {
+            resp.status = 404;
+            resp.content_type = "text/plain";
+            string_clear(&resp.body);
+            string_append(&resp.body, "not recorded\n");
+        }
+    } else if (opts.upstream != NULL) {
+        if (!record_session(req, &resp)) {
+            resp.status = 503;
+            resp.content_type = "text/plain";
+            string_clear(&resp.body);
+        }
+    } else {
+        handle_synthetic(req, &resp);
+    }
+
+    const bool keep = send_response(fd, req, &resp, error == ERROR_KIND_TRUNCATE);
+
+    log_message("%d %s %s%s (%.1f ms)\n", resp.status, req->target,
+          req->has_range ? "[range] " : "", error ? "[injected error]" : "",
+          (double)(now_ns() - start) / 1'000'000.0);
+
+    string_free(&resp.body);
+    return keep;
+}
+
+static void *connection_thread(void *data) {
+    const int fd = (int)(intptr_t)data;
+    rng_state = opts.seed ^ now_ns() ^ ((uint64_t)fd << 32) ^ 1;
+
+    char *buf = xmalloc(MAX_REQUEST_HEAD + 1);
+    size_t len = 0;
+
+    while (true) {
+        char *end;
+        buf[len] = '\0';
+        while ((end = strstr(buf, "\r\n\r\n")) == NULL) {
+            if (len == MAX_REQUEST_HEAD) {
+                goto out;
+            }
+            const ssize_t ret = recv(fd, &buf[len], MAX_REQUEST_HEAD - len, 0);
+            if (ret <= 0) {
+                goto out;
+            }
+            len += ret;
+            buf[len] = '\0';
+        }
+
+        const size_t head_len = end - buf + 4;
+        end[2] = '\0';
+
+        struct request req;
+        bool keep = false;
+        if (parse_request(buf, &req)) {
+            keep = handle_request(fd, &req);
+        } else {
+            const char bad[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n"
+                               "Connection: close\r\n\r\n";
+            send_all(fd, bad, strlen(bad));
+        }
+        request_free(&req);
+
+        if (!keep) {
+            break;
+        }
+
+        /* pipelined requests */
+        memmove(buf, &buf[head_len], len - head_len);
+        len -= head_len;
+    }
+
+out:
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+static uint32_t parse_error_kinds(const char *str) {
+    uint32_t kinds = 0;
+    char *copy = xstrdup(str);
+    char *saveptr;
+    for (char *k = strtok_r(copy, ",", &saveptr); k != NULL; k = strtok_r(NULL, ",", &saveptr)) {
+        if (STREQ(k, "http")) {
+            kinds |= ERROR_KIND_HTTP;
+        } else if (STREQ(k, "subsonic")) {
+            kinds |= ERROR_KIND_SUBSONIC;
+        } else if (STREQ(k, "truncate")) {
+            kinds |= ERROR_KIND_TRUNCATE;
+        } else {
+            fprintf(stderr, "unknown error kind %s\n", k);
+            exit(1);
+        }
+    }
+    free(copy);
+    return kinds;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -a, --address ADDR        listen address (127.0.0.1)\n"
+            "  -p, --port PORT           listen port, 0 picks a free one (4533)\n"
+            "      --seed N              library seed (1)\n"
+            "      --artists N           number of artists (1000)\n"
+            "      --albums N            number of albums (5000)\n"
+            "      --songs N             number of songs (50000)\n"
+            "      --last-modified MS    getIndexes lastModified (server start time)\n"
+            "  -l, --latency MS          delay before every response (0)\n"
+            "      --jitter MS           random extra delay up to this much (0)\n"
+            "  -b, --bandwidth BYTES     per connection limit in bytes per second (unlimited)\n"
+            "  -e, --error-rate P        probability of an injected error, 0..1 (0)\n"
+            "      --errors KINDS        comma separated: http,subsonic,truncate (all)\n"
+            "      --record DIR          forward to --upstream and save responses to DIR\n"
+            "      --upstream URL        real server, e.g. https://demo.navidrome.org\n"
+            "      --replay DIR          serve responses saved with --record\n"
+            "  -q, --quiet               don't log requests\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    enum {
+        OPT_SEED = 256, OPT_ARTISTS, OPT_ALBUMS, OPT_SONGS, OPT_LAST_MODIFIED,
+        OPT_JITTER, OPT_ERRORS, OPT_RECORD, OPT_UPSTREAM, OPT_REPLAY,
+    };
+    static const struct option long_options[] = {
+        { "address", required_argument, NULL, 'a' },
+        { "port", required_argument, NULL, 'p' },
+        { "seed", required_argument, NULL, OPT_SEED },
+        { "artists", required_argument, NULL, OPT_ARTISTS },
+        { "albums", required_argument, NULL, OPT_ALBUMS },
+        { "songs", required_argument, NULL, OPT_SONGS },
+        { "last-modified", required_argument, NULL, OPT_LAST_MODIFIED },
+        { "latency", required_argument, NULL, 'l' },
+        { "jitter", required_argument, NULL, OPT_JITTER },
+        { "bandwidth", required_argument, NULL, 'b' },
+        { "error-rate", required_argument, NULL, 'e' },
+        { "errors", required_argument, NULL, OPT_ERRORS },
+        { "record", required_argument, NULL, OPT_RECORD },
+        { "upstream", required_argument, NULL, OPT_UPSTREAM },
+        { "replay", required_argument, NULL, OPT_REPLAY },
+        { "quiet", no_argument, NULL, 'q' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    opts.last_modified = ts.tv_sec * 1000ll;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "a:p:l:b:e:qh", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'a': opts.address = optarg; break;
+        case 'p': opts.port = (uint16_t)strtoul(optarg, NULL, 10); break;
+        case OPT_SEED: opts.seed = strtoull(optarg, NULL, 10); break;
+        case OPT_ARTISTS: opts.artists = strtoull(optarg, NULL, 10); break;
+        case OPT_ALBUMS: opts.albums = strtoull(optarg, NULL, 10); break;
+        case OPT_SONGS: opts.songs = strtoull(optarg, NULL, 10); break;
+        case OPT_LAST_MODIFIED: opts.last_modified = strtoll(optarg, NULL, 10); break;
+        case 'l': opts.latency_ms = strtoul(optarg, NULL, 10); break;
+        case OPT_JITTER: opts.jitter_ms = strtoul(optarg, NULL, 10); break;
+        case 'b': opts.bandwidth = strtoull(optarg, NULL, 10); break;
+        case 'e': opts.error_rate = strtod(optarg, NULL); break;
+        case OPT_ERRORS: opts.error_kinds = parse_error_kinds(optarg); break;
+        case OPT_RECORD: opts.record_dir = optarg; break;
+        case OPT_UPSTREAM: opts.upstream = optarg; break;
+        case OPT_REPLAY: opts.replay_dir = optarg; break;
+        case 'q': opts.quiet = true; break;
+        case 'h': usage(argv[0]); return 0;
+        default: usage(argv[0]); return 1;
+        }
+    }
+
+    if ((opts.record_dir != NULL) != (opts.upstream != NULL)) {
+        fprintf(stderr, "--record and --upstream go together\n");
+        return 1;
+    }
+    if (opts.record_dir != NULL && opts.replay_dir != NULL) {
+        fprintf(stderr, "can't --record and --replay at the same time\n");
+        return 1;
+    }
+    if (opts.record_dir != NULL) {
+        mkdir(opts.record_dir, 0755);
+        curl_global_init(CURL_GLOBAL_ALL);
+    }
+
+    mock_library_init(&lib, opts.seed, opts.artists, opts.albums, opts.songs);
+
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(opts.port) };
+    if (inet_pton(AF_INET, opts.address, &addr.sin_addr) != 1) {
+        fprintf(stderr, "invalid address %s\n", opts.address);
+        return 1;
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 64) < 0) {
+        perror("bind");
+        return 1;
+    }
+
+    socklen_t addr_len = sizeof(addr);
+    getsockname(sock, (struct sockaddr *)&addr, &addr_len);
+    /* on stdout so scripts can pick the port up */
+    printf("http://%s:%d\n", opts.address, ntohs(addr.sin_port));
+    fflush(stdout);
+    log_message("%zu artists, %zu albums, %zu songs%s%s\n",
+          lib.n_artists, lib.n_albums, lib.n_songs,
+          opts.record_dir != NULL ? ", recording" : "",
+          opts.replay_dir != NULL ? ", replaying" : "");
+
+    while (true) {
+        const int fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, connection_thread, (void *)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(sock);
+    mock_library_free(&lib);
+    return 1;
+}
@@ -0,0 +1,158 @@
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "mock/library.h"
+#include "api/json.h"
+#include "api/types.h"
+#include "collections/string.h"
+
+#define STREQ(a, b) (strcmp((a), (b)) == 0)
+
+static void check_id(const char *id, const char *prefix, size_t index) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s-%zu", prefix, index);
+    assert(STREQ(id, buf));
+}
+
+/* names end with the index of the item, whatever comes before it */
+static void check_name(const char *name, size_t index) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), " %zu", index);
+    const size_t len = strlen(name), suffix_len = strlen(buf);
+    assert(len >= suffix_len);
+    assert(STREQ(name + len - suffix_len, buf));
+}
+
+/* parse in small chunks, must give the same thing as parsing all at once */
+static struct subsonic_response *parse_chunked(enum api_request_type request,
+                                               const struct string *body) {
+    struct api_response_parser *parser = api_response_parser_new(request);
+    for (size_t off = 0; off < body->len; off += 7) {
+        const size_t n = body->len - off < 7 ? body->len - off : 7;
+        assert(api_response_parser_feed(parser, body->str + off, n));
+    }
+    return api_response_parser_finish(parser);
+}
+
+int main(void) {
+    struct mock_library lib;
+    mock_library_init(&lib, 42, 50, 200, 3000);
+    assert(lib.n_artists == 50 && lib.n_albums == 200 && lib.n_songs == 3000);
+
+    /* same seed, same library */
+    struct mock_library lib2;
+    mock_library_init(&lib2, 42, 50, 200, 3000);
+    assert(memcmp(lib.album_first_song, lib2.album_first_song,
+                  (lib.n_albums + 1) * sizeof(size_t)) == 0);
+    mock_library_free(&lib2);
+
+    /* truncated library is a prefix of the original one */
+    struct mock_library small;
+    mock_library_init_truncated(&small, &lib, 100);
+    assert(small.n_albums == 100);
+    assert(small.n_songs == lib.album_first_song[100]);
+    assert(small.n_artists == mock_library_album_artist(&lib, 99) + 1);
+    for (size_t i = 0; i < small.n_songs; i += 37) {
+        assert(mock_library_song_album(&small, i) == mock_library_song_album(&lib, i));
+    }
+    for (size_t i = 0; i < small.n_albums; i++) {
+        assert(mock_library_album_artist(&small, i) == mock_library_album_artist(&lib, i));
+    }
+    mock_library_free(&small);
+
+    size_t index;
+    assert(mock_library_parse_id(&lib, "so-2999", MOCK_SONG, &index) && index == 2999);
+    assert(!mock_library_parse_id(&lib, "so-3000", MOCK_SONG, &index));
+    assert(!mock_library_parse_id(&lib, "al-1", MOCK_SONG, &index));
+    assert(!mock_library_parse_id(&lib, "ar-1x", MOCK_ARTIST, &index));
+
+    struct string body = {0};
+    struct subsonic_response *resp;
+
+    mock_response_search3(&lib, &body, 20, 40, 100, 150, 500, 0);
+    resp = api_parse_response(API_REQUEST_SEARCH3, body.str, body.len);
+    assert(resp != NULL);
+    assert(resp->status == RESPONSE_STATUS_OK);
+    assert(resp->inner_object_type == API_TYPE_SEARCH_RESULT_3);
+    const struct api_type_search_result_3 *sr = &resp->inner_object.search_result_3;
+    /* clamped to what exists */
+    assert(VEC_SIZE(&sr->artist) == 10);
+    assert(VEC_SIZE(&sr->album) == 50);
+    assert(VEC_SIZE(&sr->song) == 500);
+    for (size_t i = 0; i < VEC_SIZE(&sr->album); i++) {
+        const struct api_type_album_id3 *a = VEC_AT(&sr->album, i);
+        check_id(a->id, "al", 150 + i);
+        check_name(a->name, 150 + i);
+        check_id(a->artist_id, "ar", mock_library_album_artist(&lib, 150 + i));
+    }
+    for (size_t i = 0; i < VEC_SIZE(&sr->song); i++) {
+        const struct api_type_child *s = VEC_AT(&sr->song, i);
+        check_id(s->id, "so", i);
+        check_name(s->title, i);
+        check_id(s->album_id, "al", mock_library_song_album(&lib, i));
+        assert(s->size == (int64_t)mock_library_song_size(&lib, i));
+    }
+
+    struct subsonic_response *resp2 = parse_chunked(API_REQUEST_SEARCH3, &body);
+    assert(resp2 != NULL);
+    const struct api_type_search_result_3 *sr2 = &resp2->inner_object.search_result_3;
+    assert(VEC_SIZE(&sr2->song) == VEC_SIZE(&sr->song));
+    for (size_t i = 0; i < VEC_SIZE(&sr->song); i++) {
+        assert(STREQ(VEC_AT(&sr->song, i)->title, VEC_AT(&sr2->song, i)->title));
+    }
+    subsonic_response_free(resp2);
+    subsonic_response_free(resp);
+
+    /* every song of an album and nothing else */
+    const size_t album = 123;
+    string_clear(&body);
+    mock_response_album(&lib, &body, album);
+    resp = api_parse_response(API_REQUEST_GET_ALBUM, body.str, body.len);
+    assert(resp != NULL);
+    assert(resp->inner_object_type == API_TYPE_ALBUM_WITH_SONGS_ID3);
+    const struct api_type_album_with_songs_id3 *aws = &resp->inner_object.album_with_songs_id3;
+    check_id(aws->album.id, "al", album);
+    const size_t first = lib.album_first_song[album], last = lib.album_first_song[album + 1];
+    assert(VEC_SIZE(&aws->song) == last - first);
+    for (size_t i = 0; i < VEC_SIZE(&aws->song); i++) {
+        check_id(VEC_AT(&aws->song, i)->id, "so", first + i);
+    }
+    subsonic_response_free(resp);
+
+    /* all artists, each exactly once across indices */
+    string_clear(&body);
+    mock_response_artists(&lib, &body);
+    resp = api_parse_response(API_REQUEST_GET_ARTISTS, body.str, body.len);
+    assert(resp != NULL);
+    assert(resp->inner_object_type == API_TYPE_ARTISTS_ID3);
+    size_t n_artists = 0;
+    const struct api_type_artists_id3 *artists = &resp->inner_object.artists_id3;
+    for (size_t i = 0; i < VEC_SIZE(&artists->index); i++) {
+        n_artists += VEC_SIZE(&VEC_AT(&artists->index, i)->artist);
+    }
+    assert(n_artists == lib.n_artists);
+    subsonic_response_free(resp);
+
+    string_clear(&body);
+    mock_response_error(&body, 70, "not \"found\"");
+    resp = api_parse_response(API_REQUEST_GET_ALBUM, body.str, body.len);
+    assert(resp != NULL);
+    assert(resp->status == RESPONSE_STATUS_FAILED);
+    assert(resp->inner_object.error.code == 70);
+    assert(STREQ(resp->inner_object.error.message, "not \"found\""));
+    subsonic_response_free(resp);
+
+    /* audio is seekable: reading at an offset gives the same bytes as reading from start */
+    const size_t song_size = mock_library_song_size(&lib, 7);
+    char whole[4096], part[1000];
+    assert(song_size > sizeof(whole));
+    mock_library_song_data(&lib, 7, 0, whole, sizeof(whole));
+    mock_library_song_data(&lib, 7, 1234, part, sizeof(part));
+    assert(memcmp(whole + 1234, part, sizeof(part)) == 0);
+
+    string_free(&body);
+    mock_library_free(&lib);
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "collections/mpsc.h"
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 100000
+
+struct item {
+    int producer;
+    int seq;
+    struct mpsc_node node;
+};
+
+static struct mpsc_queue queue;
+static struct item items[PRODUCERS][ITEMS_PER_PRODUCER];
+
+static void *producer(void *data) {
+    const int id = (intptr_t)data;
+
+    for (int i = 0; i < ITEMS_PER_PRODUCER; i++) {
+        items[id][i] = (struct item){ .producer = id, .seq = i };
+        mpsc_queue_push(&queue, &items[id][i].node);
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    mpsc_queue_init(&queue);
+
+    /* single threaded */
+    struct item a = { .seq = 1 }, b = { .seq = 2 };
+    assert(mpsc_queue_pop(&queue) == NULL);
+    mpsc_queue_push(&queue, &a.node);
+    mpsc_queue_push(&queue, &b.node);
+
+    struct item *it;
+    it = CONTAINER_OF(mpsc_queue_pop(&queue), it, node);
+    assert(it->seq == 1);
+    it = CONTAINER_OF(mpsc_queue_pop(&queue), it, node);
+    assert(it->seq == 2);
+    assert(mpsc_queue_pop(&queue) == NULL);
+
+    mpsc_queue_push(&queue, &a.node);
+    it = CONTAINER_OF(mpsc_queue_pop(&queue), it, node);
+    assert(it->seq == 1);
+    assert(mpsc_queue_pop(&queue) == NULL);
+
+    /* multiple producers, items from each producer must arrive in order */
+    pthread_t threads[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&threads[i], NULL, producer, (void *)(intptr_t)i);
+    }
+
+    int next_seq[PRODUCERS] = {0};
+    int received = 0;
+    while (received < PRODUCERS * ITEMS_PER_PRODUCER) {
+        struct mpsc_node *node = mpsc_queue_pop(&queue);
+        if (node == NULL) {
+            continue;
+        }
+
+        it = CONTAINER_OF(node, it, node);
+        assert(it->seq == next_seq[it->producer]);
+        next_seq[it->producer] += 1;
+        received += 1;
+    }
+    assert(mpsc_queue_pop(&queue) == NULL);
+
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        assert(next_seq[i] == ITEMS_PER_PRODUCER);
+    }
+
+    fprintf(stderr, "received %d items\n", received);
+}
+
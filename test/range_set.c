@@ -0,0 +1,71 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "collections/range_set.h"
+
+static void print_set(const struct range_set *set) {
+    VEC_FOREACH(&set->ranges, i) {
+        const struct range *r = VEC_AT(&set->ranges, i);
+        fprintf(stderr, "[%zu, %zu) ", r->start, r->end);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(void) {
+    struct range_set set = {0};
+
+    assert(range_set_find(&set, 0) == NULL);
+    assert(range_set_next_start(&set, 0) == SIZE_MAX);
+
+    range_set_add(&set, 10, 20);
+    range_set_add(&set, 30, 40);
+    range_set_add(&set, 0, 5);
+    range_set_add(&set, 7, 7); /* empty, ignored */
+    print_set(&set);
+    assert(VEC_SIZE(&set.ranges) == 3);
+    assert(VEC_AT(&set.ranges, 0)->start == 0 && VEC_AT(&set.ranges, 0)->end == 5);
+    assert(VEC_AT(&set.ranges, 1)->start == 10 && VEC_AT(&set.ranges, 1)->end == 20);
+    assert(VEC_AT(&set.ranges, 2)->start == 30 && VEC_AT(&set.ranges, 2)->end == 40);
+
+    assert(range_set_find(&set, 4)->end == 5);
+    assert(range_set_find(&set, 5) == NULL);
+    assert(range_set_find(&set, 10)->start == 10);
+    assert(range_set_find(&set, 19)->start == 10);
+    assert(range_set_find(&set, 20) == NULL);
+    assert(range_set_find(&set, 100) == NULL);
+
+    assert(range_set_next_start(&set, 0) == 10);
+    assert(range_set_next_start(&set, 6) == 10);
+    assert(range_set_next_start(&set, 15) == 30);
+    assert(range_set_next_start(&set, 35) == SIZE_MAX);
+
+    assert(range_set_covers(&set, 11, 20));
+    assert(!range_set_covers(&set, 11, 21));
+    assert(!range_set_covers(&set, 5, 6));
+
+    /* adjacent ranges are merged */
+    range_set_add(&set, 5, 10);
+    print_set(&set);
+    assert(VEC_SIZE(&set.ranges) == 2);
+    assert(VEC_AT(&set.ranges, 0)->start == 0 && VEC_AT(&set.ranges, 0)->end == 20);
+
+    /* range spanning several existing ones swallows them */
+    range_set_add(&set, 50, 60);
+    range_set_add(&set, 15, 55);
+    print_set(&set);
+    assert(VEC_SIZE(&set.ranges) == 1);
+    assert(VEC_AT(&set.ranges, 0)->start == 0 && VEC_AT(&set.ranges, 0)->end == 60);
+    assert(range_set_covers(&set, 0, 60));
+
+    /* range inside an existing one changes nothing */
+    range_set_add(&set, 20, 30);
+    assert(VEC_SIZE(&set.ranges) == 1);
+    assert(VEC_AT(&set.ranges, 0)->start == 0 && VEC_AT(&set.ranges, 0)->end == 60);
+
+    range_set_clear(&set);
+    assert(VEC_SIZE(&set.ranges) == 0);
+
+    range_set_free(&set);
+}
+
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include <assert.h>
 #include <stdio.h>
 
@@ -43,13 +44,53 @@ void generic_callback(uint64_t event, const struct signal_data *data, void *user
     *(int *)userdata += 1;
 }
 
+#define THREADS 4
+#define EVENTS_PER_THREAD 10000
+
+struct coalesce_counts {
+    int first, second;
+    uint64_t last_first;
+};
+
+void coalesce_callback(uint64_t event, const struct signal_data *data, void *userdata) {
+    struct coalesce_counts *counts = userdata;
+    assert(data->type == SIGNAL_DATA_TYPE_U64);
+
+    switch (event) {
+    case FIRST_COSMIC_VELOCITY:
+        counts->first += 1;
+        counts->last_first = data->as.u64;
+        break;
+    case SECOND_COSMIC_VELOCITY:
+        counts->second += 1;
+        if (counts->second == THREADS * EVENTS_PER_THREAD) {
+            pollen_loop_quit(event_loop, 420);
+        }
+        break;
+    case THIRD_COSMIC_VELOCITY:
+        pollen_loop_quit(event_loop, 69);
+        break;
+    }
+}
+
+void *emitter_thread(void *data) {
+    struct signal_emitter *e = data;
+
+    for (int i = 0; i < EVENTS_PER_THREAD; i++) {
+        signal_emit_u64(e, FIRST_COSMIC_VELOCITY, i);
+        signal_emit_u64(e, SECOND_COSMIC_VELOCITY, i);
+    }
+
+    return NULL;
+}
+
 int main(void) {
     struct signal_emitter e;
     struct signal_listener l1, l2, l3, g;
 
     event_loop = pollen_loop_create();
 
-    signal_emitter_init(&e);
+    assert(signal_emitter_init(&e, 0));
 
     int c1 = 0;
     signal_subscribe(&e, &l1, FIRST_COSMIC_VELOCITY, first_callback, &c1);
@@ -75,6 +116,36 @@ int main(void) {
 
     signal_emitter_cleanup(&e);
 
+    /* coalesced events only deliver the latest value */
+    struct signal_emitter ce;
+    struct signal_listener cl;
+    struct coalesce_counts counts = {0};
+    assert(signal_emitter_init(&ce, FIRST_COSMIC_VELOCITY));
+    signal_subscribe(&ce, &cl, (uint64_t)-1, coalesce_callback, &counts);
+
+    for (int i = 0; i < 1000; i++) {
+        signal_emit_u64(&ce, FIRST_COSMIC_VELOCITY, i);
+    }
+    signal_emit_u64(&ce, THIRD_COSMIC_VELOCITY, 0);
+    assert(pollen_loop_run(event_loop) == 69);
+    assert(counts.first == 1);
+    assert(counts.last_first == 999);
+
+    /* emitting from other threads, nothing that isn't coalesced gets lost */
+    counts = (struct coalesce_counts){0};
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, emitter_thread, &ce);
+    }
+    assert(pollen_loop_run(event_loop) == 420);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(counts.second == THREADS * EVENTS_PER_THREAD);
+    assert(counts.first >= 1 && counts.first <= THREADS * EVENTS_PER_THREAD);
+
+    signal_emitter_cleanup(&ce);
+
     return 0;
 }
 
@@ -0,0 +1,117 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "worker_thread.h"
+#include "eventloop.h"
+#include "xmalloc.h"
+
+#define THREADS 4
+#define JOBS_PER_THREAD 100
+
+struct job {
+    struct worker_job base;
+    int number;
+    pthread_t ran_on;
+};
+
+static pthread_t worker_tid;
+static int thread_inits = 0, thread_cleanups = 0;
+static int done_count = 0, done_on_cleanup = 0, ran_on_cleanup = 0;
+
+static void thread_init(void) {
+    worker_tid = pthread_self();
+    thread_inits += 1;
+}
+
+static void thread_cleanup(void) {
+    thread_cleanups += 1;
+}
+
+static void run(struct worker_job *wjob) {
+    struct job *job;
+    LIST_GET(job, wjob, base);
+
+    job->ran_on = pthread_self();
+}
+
+static void done(struct worker_job *wjob, bool cleanup) {
+    struct job *job;
+    LIST_GET(job, wjob, base);
+
+    if (cleanup) {
+        done_on_cleanup += 1;
+        ran_on_cleanup += pthread_equal(job->ran_on, worker_tid);
+    } else {
+        assert(pthread_equal(job->ran_on, worker_tid));
+        if (++done_count == THREADS * JOBS_PER_THREAD) {
+            pollen_loop_quit(event_loop, 0);
+        }
+    }
+
+    free(job);
+}
+
+static struct worker worker = {
+    .name = "test worker",
+    .thread_init = thread_init,
+    .thread_cleanup = thread_cleanup,
+    .run = run,
+    .done = done,
+    WORKER_INITIALISER(&worker),
+};
+
+static struct job *job_create(int number) {
+    struct job *job = xcalloc(1, sizeof(*job));
+    job->number = number;
+    return job;
+}
+
+static void *submit_thread_func(void *data) {
+    for (int i = 0; i < JOBS_PER_THREAD; i++) {
+        assert(worker_submit(&worker, &job_create(i)->base));
+    }
+    return NULL;
+}
+
+int main(void) {
+    event_loop = pollen_loop_create();
+
+    /* not running yet, job stays ours */
+    struct job *job = job_create(0);
+    assert(!worker_submit(&worker, &job->base));
+    free(job);
+
+    assert(worker_init(&worker));
+
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, submit_thread_func, NULL) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    assert(pollen_loop_run(event_loop) == 0);
+    assert(done_count == THREADS * JOBS_PER_THREAD);
+
+    /* everything was handed back already */
+    worker_cleanup(&worker);
+    assert(done_on_cleanup == 0);
+    assert(thread_inits == 1 && thread_cleanups == 1);
+
+    /* can be started again, this time pending jobs have to be finished */
+    worker.finish_pending = true;
+    assert(worker_init(&worker));
+    for (int i = 0; i < JOBS_PER_THREAD; i++) {
+        assert(worker_submit(&worker, &job_create(i)->base));
+    }
+    worker_cleanup(&worker);
+    assert(done_on_cleanup == JOBS_PER_THREAD);
+    assert(ran_on_cleanup == JOBS_PER_THREAD);
+    assert(thread_inits == 2 && thread_cleanups == 2);
+
+    pollen_loop_cleanup(event_loop);
+
+    return 0;
+}